@@ -0,0 +1,360 @@
+//
+//  Actions.c
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+#include "Actions.h"
+
+#include "ScriptExecution.h"
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Actions
+/////////////////////////////////////////////////////////////////////
+
+
+/// An action file is a script whose name ends in kActionsSuffix. Instead of
+/// being executed, it is read by the plugin, and each line is carried out
+/// in-process:
+///
+///     mkdir PATH [MODE]      create a directory, unless it exists
+///     touch PATH             create a file, or update its modification time
+///     symlink PATH TARGET    create a symbolic link, unless it exists
+///     chown PATH             give PATH to the user logging in
+///     chmod PATH MODE        change the mode
+///
+/// Fields are separated by spaces, and may be quoted with double quotes.
+/// A PATH starting with "~/" is relative to the user's home directory.
+/// The last component of PATH is never followed if it's a symbolic link,
+/// and for root mechanisms no component of a "~/" path is.
+/// Blank lines and lines starting with # are ignored.
+///
+/// Actions run on a thread of their own, which takes on the uid and gid of
+/// the user for user mechanisms.
+static const char *kActionsSuffix = ".actions";
+
+enum {
+    kMaxActionsFileSize = 64 * 1024,
+    kMaxActionFields = 3,
+    kDefaultDirectoryMode = 0755
+};
+
+/// ActionRun is handed to the thread carrying out an action file.
+typedef struct {
+    InvocationRecord *fInvocation;
+    ScriptRecord *fScript;
+    int fError;
+} ActionRun;
+
+/// Return true if the script called name is an action file.
+bool IsActionFile(const char *name)
+{
+    size_t nameLength = strlen(name);
+    size_t suffixLength = strlen(kActionsSuffix);
+    
+    return nameLength > suffixLength && strcmp(name + nameLength - suffixLength, kActionsSuffix) == 0;
+}
+
+/// Split line into at most kMaxActionFields + 1 fields, in place.
+///
+/// @return The number of fields, or -1 if there are too many or a quote
+///         isn't closed.
+static int SplitActionLine(char *line, char **fields)
+{
+    int count = 0;
+    
+    for (;;) {
+        while (*line == ' ' || *line == '\t') {
+            line++;
+        }
+        if (*line == '\0') {
+            return count;
+        }
+        if (count > kMaxActionFields) {
+            return -1;
+        }
+        if (*line == '"') {
+            fields[count++] = ++line;
+            if ((line = strchr(line, '"')) == NULL) {
+                return -1;
+            }
+        } else {
+            fields[count++] = line;
+            line += strcspn(line, " \t");
+        }
+        if (*line != '\0') {
+            *line++ = '\0';
+        }
+    }
+}
+
+/// Parse an octal file mode.
+static bool ParseMode(const char *value, mode_t *mode)
+{
+    char *end;
+    long number;
+    
+    number = strtol(value, &end, 8);
+    if (*value == '\0' || *end != '\0' || number < 0 || number > 07777) {
+        return false;
+    }
+    *mode = (mode_t)number;
+    return true;
+}
+
+/// Change the mode of name in the directory dirFd without following a
+/// symbolic link.
+static int ChangeModeNoFollow(int dirFd, const char *name, mode_t mode)
+{
+    int fd;
+    int err;
+    
+    if ((fd = openat(dirFd, name, O_RDONLY | O_NOFOLLOW | O_NONBLOCK | O_CLOEXEC)) == -1) {
+        return -1;
+    }
+    err = fchmod(fd, mode);
+    close(fd);
+    return err;
+}
+
+/// Open the directory holding the last component of the PATH of an action,
+/// copying PATH into path and pointing name at that component.
+///
+/// The "~/" paths of root mechanisms are walked from the home directory one
+/// component at a time, without following symbolic links or "..", so that
+/// a user can't send root elsewhere by putting a link in their home
+/// directory. Other paths are resolved as usual.
+///
+/// @return The directory, or -1 with errno set.
+static int OpenActionParent(const InvocationRecord *invocation, const char *field, char *path, const char **name)
+{
+    bool walk = strncmp(field, "~/", 2) == 0 && invocation->fContext == kRunAsRoot;
+    char *component;
+    char *slash;
+    size_t length;
+    int next;
+    int fd;
+    
+    if (walk) {
+        length = strlcpy(path, field + 2, MAXPATHLEN);
+    } else if (strncmp(field, "~/", 2) == 0) {
+        length = (size_t)snprintf(path, MAXPATHLEN, "%s/%s", invocation->fHome, field + 2);
+    } else if (field[0] == '/') {
+        length = strlcpy(path, field, MAXPATHLEN);
+    } else {
+        errno = EINVAL;
+        return -1;
+    }
+    if (length >= MAXPATHLEN) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    while (length > 1 && path[length - 1] == '/') {
+        path[--length] = '\0';
+    }
+    
+    if (! walk) {
+        slash = strrchr(path, '/');
+        *name = slash[1] != '\0' ? slash + 1 : ".";
+        if (slash == path) {
+            return open("/", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        }
+        *slash = '\0';
+        return open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    }
+    
+    if ((fd = open(invocation->fHome, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1) {
+        return -1;
+    }
+    for (component = path; (slash = strchr(component, '/')) != NULL; component = slash + 1) {
+        *slash = '\0';
+        if (strcmp(component, "..") == 0) {
+            close(fd);
+            errno = EINVAL;
+            return -1;
+        }
+        if (*component == '\0' || strcmp(component, ".") == 0) {
+            continue;
+        }
+        next = openat(fd, component, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        close(fd);
+        if (next == -1) {
+            return -1;
+        }
+        fd = next;
+    }
+    if (strcmp(component, "..") == 0) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+    *name = *component != '\0' ? component : ".";
+    return fd;
+}
+
+/// Carry out a single action on name in the directory dirFd for invocation.
+///
+/// @return 0, or an errno value if the action failed or isn't valid.
+static int RunActionAt(const InvocationRecord *invocation, char **fields, int count, int dirFd, const char *name)
+{
+    char target[MAXPATHLEN];
+    struct stat info;
+    mode_t mode;
+    ssize_t length;
+    int fd;
+    
+    if (strcmp(fields[0], "mkdir") == 0 && count <= 3) {
+        mode = kDefaultDirectoryMode;
+        if (count == 3 && ! ParseMode(fields[2], &mode)) {
+            return EINVAL;
+        }
+        if (mkdirat(dirFd, name, mode) != 0) {
+            if (errno != EEXIST || fstatat(dirFd, name, &info, AT_SYMLINK_NOFOLLOW) != 0) {
+                return errno;
+            }
+            return S_ISDIR(info.st_mode) ? 0 : EEXIST;
+        }
+        // mkdir() applies the umask.
+        return count == 3 && ChangeModeNoFollow(dirFd, name, mode) != 0 ? errno : 0;
+    } else if (strcmp(fields[0], "touch") == 0 && count == 2) {
+        if ((fd = openat(dirFd, name, O_WRONLY | O_CREAT | O_NOFOLLOW | O_NONBLOCK | O_CLOEXEC, 0644)) == -1) {
+            return errno;
+        }
+        if (futimes(fd, NULL) != 0) {
+            close(fd);
+            return errno;
+        }
+        close(fd);
+        return 0;
+    } else if (strcmp(fields[0], "symlink") == 0 && count == 3) {
+        if (symlinkat(fields[2], dirFd, name) == 0) {
+            return 0;
+        }
+        if (errno != EEXIST || (length = readlinkat(dirFd, name, target, sizeof(target) - 1)) == -1) {
+            return errno;
+        }
+        target[length] = '\0';
+        return strcmp(target, fields[2]) == 0 ? 0 : EEXIST;
+    } else if (strcmp(fields[0], "chown") == 0 && count == 2) {
+        return fchownat(dirFd, name, invocation->fUid, invocation->fGid, AT_SYMLINK_NOFOLLOW) == 0 ? 0 : errno;
+    } else if (strcmp(fields[0], "chmod") == 0 && count == 3) {
+        if (! ParseMode(fields[2], &mode)) {
+            return EINVAL;
+        }
+        return ChangeModeNoFollow(dirFd, name, mode) == 0 ? 0 : errno;
+    }
+    return EINVAL;
+}
+
+/// Carry out a single action for invocation.
+///
+/// @return 0, or an errno value if the action failed or isn't valid.
+static int RunAction(const InvocationRecord *invocation, char **fields, int count)
+{
+    char path[MAXPATHLEN];
+    const char *name;
+    int dirFd;
+    int err;
+    
+    if (count < 2) {
+        return EINVAL;
+    }
+    if ((dirFd = OpenActionParent(invocation, fields[1], path, &name)) == -1) {
+        return errno;
+    }
+    err = RunActionAt(invocation, fields, count, dirFd, name);
+    close(dirFd);
+    return err;
+}
+
+/// Read and carry out the action file of run, as the user for user
+/// mechanisms. Runs on a thread of its own, so that the identity it takes
+/// on doesn't affect the rest of the plugin host.
+static void *ActionThread(void *arg)
+{
+    ActionRun *run = arg;
+    InvocationRecord *invocation = run->fInvocation;
+    ScriptRecord *script = run->fScript;
+    char *fields[kMaxActionFields + 1];
+    char *contents;
+    char *line;
+    char *next;
+    ssize_t length;
+    ssize_t n;
+    int count;
+    int fd;
+    
+    if (invocation->fContext == kRunAsUser && pthread_setugid_np(invocation->fUid, invocation->fGid) != 0) {
+        run->fError = errno;
+        return NULL;
+    }
+    
+    contents = NULL;
+    if ((fd = open(script->fPath, O_RDONLY | O_NOFOLLOW | O_CLOEXEC)) == -1
+        || (contents = malloc(kMaxActionsFileSize + 1)) == NULL) {
+        run->fError = errno;
+    } else {
+        length = 0;
+        while (length < kMaxActionsFileSize
+               && ((n = read(fd, contents + length, kMaxActionsFileSize - length)) > 0
+                   || (n == -1 && errno == EINTR))) {
+            length += n > 0 ? n : 0;
+        }
+        if (length == kMaxActionsFileSize) {
+            run->fError = EFBIG;
+        } else if (n == -1) {
+            run->fError = errno;
+        }
+        contents[length] = '\0';
+        
+        for (line = contents; run->fError == 0 && line != NULL; line = next) {
+            script->fFailedLine++;
+            if ((next = strchr(line, '\n')) != NULL) {
+                *next++ = '\0';
+            }
+            if (*line == '#') {
+                continue;
+            }
+            if ((count = SplitActionLine(line, fields)) == -1) {
+                run->fError = EINVAL;
+            } else if (count > 0 && (run->fError = RunAction(invocation, fields, count)) == 0) {
+                script->fActionCount++;
+            }
+        }
+        if (run->fError == 0) {
+            script->fFailedLine = 0;
+        }
+    }
+    free(contents);
+    if (fd != -1) {
+        close(fd);
+    }
+    
+    if (invocation->fContext == kRunAsUser) {
+        pthread_setugid_np(KAUTH_UID_NONE, KAUTH_GID_NONE);
+    }
+    return NULL;
+}
+
+/// Carry out the action file script for invocation, and wait until it's
+/// done.
+///
+/// @return 0, or the errno value of the first failure.
+int RunActionFile(InvocationRecord *invocation, ScriptRecord *script)
+{
+    ActionRun run;
+    pthread_t thread;
+    int err;
+    
+    run.fInvocation = invocation;
+    run.fScript = script;
+    run.fError = 0;
+    if ((err = pthread_create(&thread, NULL, ActionThread, &run)) != 0) {
+        return err;
+    }
+    pthread_join(thread, NULL);
+    return run.fError;
+}
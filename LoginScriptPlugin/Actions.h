@@ -0,0 +1,16 @@
+//
+//  Actions.h
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+#ifndef __LoginScriptPlugin__Actions__
+#define __LoginScriptPlugin__Actions__
+
+#include "Common.h"
+
+bool IsActionFile(const char *name);
+int RunActionFile(InvocationRecord *invocation, ScriptRecord *script);
+
+#endif /* defined(__LoginScriptPlugin__Actions__) */
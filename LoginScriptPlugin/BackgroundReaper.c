@@ -0,0 +1,234 @@
+//
+//  BackgroundReaper.c
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+#include "BackgroundReaper.h"
+
+#include "EventLoop.h"
+#include "LeftoverProcesses.h"
+#include "LoginScriptPlugin.h"
+#include "ScriptOutput.h"
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Background Reaper
+/////////////////////////////////////////////////////////////////////
+
+
+/// Reap a detached script that has exited and log its outcome.
+static void ReapDetachedScript(PluginRecord *plugin, DetachedScript *detached)
+{
+    SpawnStatus status;
+    struct timeval now;
+    
+    CleanUpProcessGroup(detached->fPid, detached->fPath, detached->fKillLeftovers, plugin->fLogClient);
+    if (detached->fBackend->fWait(plugin, detached->fPid, &status) != 0) {
+        asl_log(plugin->fLogClient, NULL, ASL_LEVEL_WARNING,
+                "Received errno %d while waiting for detached %s", errno, detached->fPath);
+        return;
+    }
+    ReadOutputBuffer(&detached->fOutput);
+    CloseOutputBuffer(&detached->fOutput);
+    gettimeofday(&now, NULL);
+    asl_log(plugin->fLogClient, NULL, ASL_LEVEL_NOTICE,
+            "Detached %s ran for %.3f s", detached->fPath,
+            (now.tv_sec - detached->fStartTime.tv_sec) + (now.tv_usec - detached->fStartTime.tv_usec) / 1e6);
+    LogOutputBuffer(&detached->fOutput, strrchr(detached->fPath, '/') + 1, plugin->fLogClient);
+    if (WIFSIGNALED(status.fStatus)) {
+        asl_log(plugin->fLogClient, NULL, ASL_LEVEL_WARNING,
+                "Detached %s died with signal %d", detached->fPath, WTERMSIG(status.fStatus));
+    } else {
+        asl_log(plugin->fLogClient, NULL, ASL_LEVEL_WARNING,
+                "Detached %s exited with status %d", detached->fPath, WEXITSTATUS(status.fStatus));
+    }
+}
+
+/// Remove detached from the reaper's list and release it.
+static void ForgetDetachedScript(BackgroundReaper *reaper, DetachedScript *detached)
+{
+    size_t i;
+    
+    pthread_mutex_lock(&reaper->fLock);
+    for (i = 0; i < reaper->fCount; i++) {
+        if (reaper->fScripts[i] == detached) {
+            reaper->fScripts[i] = reaper->fScripts[--reaper->fCount];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&reaper->fLock);
+    
+    FreeOutputBuffer(&detached->fOutput);
+    free(detached->fPath);
+    free(detached);
+}
+
+/// Main function of the reaper thread.
+static void *ReaperMain(void *arg)
+{
+    PluginRecord *plugin = arg;
+    BackgroundReaper *reaper = &plugin->fReaper;
+    Event event;
+    bool stopping;
+    
+    for (;;) {
+        if (! EventLoopNext(&reaper->fLoop, &event)) {
+            asl_log(plugin->fLogClient, NULL, ASL_LEVEL_ERR,
+                    "Background reaper failed with errno %d", errno);
+            return NULL;
+        }
+        if (event.fKind == kEventProcessExited) {
+            ReapDetachedScript(plugin, event.fContext);
+            ForgetDetachedScript(reaper, event.fContext);
+        } else if (event.fKind == kEventReadable) {
+            ReadOutputBuffer(&((DetachedScript *)event.fContext)->fOutput);
+        } else if (event.fKind == kEventWakeup) {
+            pthread_mutex_lock(&reaper->fLock);
+            stopping = reaper->fStopping;
+            pthread_mutex_unlock(&reaper->fLock);
+            if (stopping) {
+                return NULL;
+            }
+        }
+    }
+}
+
+/// Set up the reaper of plugin. The thread isn't started until it's needed.
+void InitBackgroundReaper(BackgroundReaper *reaper)
+{
+    pthread_mutex_init(&reaper->fLock, NULL);
+    reaper->fStarted = false;
+    reaper->fStopping = false;
+    reaper->fLoop.fQueue = -1;
+    reaper->fScripts = NULL;
+    reaper->fCount = 0;
+    reaper->fCapacity = 0;
+}
+
+/// Start the reaper thread. Must be called with the reaper lock held.
+static bool StartBackgroundReaper(PluginRecord *plugin)
+{
+    BackgroundReaper *reaper = &plugin->fReaper;
+    
+    if (! EventLoopCreate(&reaper->fLoop)) {
+        asl_log(plugin->fLogClient, NULL, ASL_LEVEL_ERR,
+                "Creating background reaper queue failed with errno %d", errno);
+        return false;
+    }
+    if (! EventLoopAddWakeup(&reaper->fLoop, NULL)
+        || pthread_create(&reaper->fThread, NULL, ReaperMain, plugin) != 0) {
+        asl_log(plugin->fLogClient, NULL, ASL_LEVEL_ERR, "Starting background reaper failed");
+        EventLoopDestroy(&reaper->fLoop);
+        return false;
+    }
+    reaper->fStarted = true;
+    return true;
+}
+
+/// Hand a running script over to the background reaper, along with the
+/// output collected so far and the pipe for the rest, which output is
+/// left empty of.
+///
+/// @return false if the reaper can't take it, in which case the caller
+///         still has to wait for the script.
+bool AdoptDetachedScript(PluginRecord *plugin, const char *path, pid_t pid, const SpawnBackend *backend,
+                                const struct timeval *startTime, bool killLeftovers, OutputBuffer *output)
+{
+    BackgroundReaper *reaper = &plugin->fReaper;
+    DetachedScript **scripts;
+    DetachedScript *detached;
+    size_t capacity;
+    
+    if ((detached = calloc(1, sizeof(*detached))) == NULL) {
+        return false;
+    }
+    if ((detached->fPath = strdup(path)) == NULL) {
+        free(detached);
+        return false;
+    }
+    detached->fPid = pid;
+    detached->fBackend = backend;
+    detached->fStartTime = *startTime;
+    detached->fKillLeftovers = killLeftovers;
+    InitOutputBuffer(&detached->fOutput);
+    
+    pthread_mutex_lock(&reaper->fLock);
+    if (reaper->fStopping || (! reaper->fStarted && ! StartBackgroundReaper(plugin))) {
+        goto fail;
+    }
+    if (reaper->fCount == reaper->fCapacity) {
+        capacity = reaper->fCapacity ? reaper->fCapacity * 2 : 8;
+        scripts = realloc(reaper->fScripts, capacity * sizeof(*scripts));
+        if (scripts == NULL) {
+            goto fail;
+        }
+        reaper->fScripts = scripts;
+        reaper->fCapacity = capacity;
+    }
+    if (output->fFd != -1 && ! EventLoopWatchReadable(&reaper->fLoop, output->fFd, detached)) {
+        goto fail;
+    }
+    detached->fOutput = *output;
+    InitOutputBuffer(output);
+    if (! EventLoopWatchProcess(&reaper->fLoop, pid, detached)) {
+        if (errno != ESRCH) {
+            // Give the output back.
+            EventLoopUnwatchReadable(&reaper->fLoop, detached->fOutput.fFd);
+            *output = detached->fOutput;
+            InitOutputBuffer(&detached->fOutput);
+            goto fail;
+        }
+        // Already gone, so it won't take long to reap.
+        pthread_mutex_unlock(&reaper->fLock);
+        ReapDetachedScript(plugin, detached);
+        FreeOutputBuffer(&detached->fOutput);
+        free(detached->fPath);
+        free(detached);
+        return true;
+    }
+    reaper->fScripts[reaper->fCount++] = detached;
+    pthread_mutex_unlock(&reaper->fLock);
+    return true;
+    
+fail:
+    pthread_mutex_unlock(&reaper->fLock);
+    free(detached->fPath);
+    free(detached);
+    return false;
+}
+
+/// Stop the reaper thread. Detached scripts that are still running are
+/// left alone.
+void StopBackgroundReaper(PluginRecord *plugin)
+{
+    BackgroundReaper *reaper = &plugin->fReaper;
+    size_t i;
+    
+    pthread_mutex_lock(&reaper->fLock);
+    reaper->fStopping = true;
+    pthread_mutex_unlock(&reaper->fLock);
+    
+    if (reaper->fStarted) {
+        EventLoopWake(&reaper->fLoop);
+        pthread_join(reaper->fThread, NULL);
+        EventLoopDestroy(&reaper->fLoop);
+        reaper->fStarted = false;
+    }
+    
+    if (reaper->fCount > 0) {
+        asl_log(plugin->fLogClient, NULL, ASL_LEVEL_NOTICE,
+                "Abandoning %zu detached scripts that are still running", reaper->fCount);
+    }
+    for (i = 0; i < reaper->fCount; i++) {
+        FreeOutputBuffer(&reaper->fScripts[i]->fOutput);
+        free(reaper->fScripts[i]->fPath);
+        free(reaper->fScripts[i]);
+    }
+    free(reaper->fScripts);
+    reaper->fScripts = NULL;
+    reaper->fCount = reaper->fCapacity = 0;
+    pthread_mutex_destroy(&reaper->fLock);
+}
@@ -0,0 +1,45 @@
+//
+//  BackgroundReaper.h
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+#ifndef __LoginScriptPlugin__BackgroundReaper__
+#define __LoginScriptPlugin__BackgroundReaper__
+
+#include "Common.h"
+#include "EventLoop.h"
+#include "ScriptOutput.h"
+#include "Spawn.h"
+
+/// DetachedScript is a script that keeps running in the background after
+/// the mechanism that started it has returned.
+typedef struct {
+    char *fPath;
+    pid_t fPid;
+    const SpawnBackend *fBackend;
+    struct timeval fStartTime;
+    bool fKillLeftovers;
+    OutputBuffer fOutput;
+} DetachedScript;
+
+/// BackgroundReaper waits for detached scripts on a thread of its own,
+/// so that they don't linger as zombies and their outcome gets logged.
+/// The thread is started when the first script is detached.
+typedef struct {
+    pthread_mutex_t fLock;
+    bool fStarted;
+    bool fStopping;
+    pthread_t fThread;
+    EventLoop fLoop;
+    DetachedScript **fScripts;
+    size_t fCount;
+    size_t fCapacity;
+} BackgroundReaper;
+
+void InitBackgroundReaper(BackgroundReaper *reaper);
+bool AdoptDetachedScript(PluginRecord *plugin, const char *path, pid_t pid, const SpawnBackend *backend, const struct timeval *startTime, bool killLeftovers, OutputBuffer *output);
+void StopBackgroundReaper(PluginRecord *plugin);
+
+#endif /* defined(__LoginScriptPlugin__BackgroundReaper__) */
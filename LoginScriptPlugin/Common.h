@@ -0,0 +1,91 @@
+//
+//  Common.h
+//  LoginScriptPlugin
+//
+//  Split out of LoginScriptPlugin.c, created by Per Olofsson on 2014-11-21.
+//  Copyright (c) 2014 Göteborgs universitet. All rights reserved.
+//
+
+#ifndef __LoginScriptPlugin__Common__
+#define __LoginScriptPlugin__Common__
+
+#include <Security/AuthorizationPlugin.h>
+#include <Security/AuthSession.h>
+#include <Security/AuthorizationTags.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <asl.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <assert.h>
+#include <glob.h>
+#include <ctype.h>
+#include <spawn.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/wait.h>
+#include <sys/errno.h>
+#include <sys/stat.h>
+#include <sys/param.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/sysctl.h>
+#include <sys/file.h>
+#include <sys/kauth.h>
+#include <libgen.h>
+#include <sysexits.h>
+#include <pthread.h>
+#include <libproc.h>
+#include <paths.h>
+#include <pwd.h>
+#include <grp.h>
+#include <fnmatch.h>
+#include <membership.h>
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Globals
+/////////////////////////////////////////////////////////////////////
+
+
+extern const char *kLoginScriptDir;
+extern const char *kManifestName;
+extern const char *kLockNameCharacters;
+
+enum {
+    kNotifyFileno = 3,     // descriptor scripts signal readiness on
+    kMaxScriptWeight = 16  // machine-wide slots a single script may take
+};
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Core Data Structures
+/////////////////////////////////////////////////////////////////////
+
+
+// The records are defined in the headers of the modules that own them.
+typedef struct PluginRecord PluginRecord;
+typedef struct MechanismRecord MechanismRecord;
+typedef struct ManifestRecord ManifestRecord;
+typedef struct InvocationRecord InvocationRecord;
+typedef struct ScriptRecord ScriptRecord;
+
+typedef enum {
+    kRunAsRoot,
+    kRunAsUser
+} userContext;
+
+typedef enum {
+    kRunBeforeHomedirMount,
+    kRunAfterHomedirMount
+} scriptPhase;
+
+#endif /* defined(__LoginScriptPlugin__Common__) */
@@ -0,0 +1,256 @@
+//
+//  DurationHistory.c
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+#include "DurationHistory.h"
+
+#include "LoginScriptPlugin.h"
+#include "ScriptExecution.h"
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Duration History
+/////////////////////////////////////////////////////////////////////
+
+
+/// The duration history has a line per script with its average duration
+/// in seconds, a space and its path. It's only trusted if it's owned by
+/// root and not accessible to anyone else.
+const char *kDurationHistoryPath = "/var/db/LoginScriptPlugin.durations";
+
+static const double kDurationWeight = 0.3;          // of the latest run in the average
+static const double kUnknownDurationSeconds = 1.0;  // for scripts without a history
+
+enum {
+    kMaxHistorySize = 256 * 1024
+};
+
+/// Set up an empty history, which is read from the file when it's first
+/// needed.
+void InitDurationHistory(DurationHistory *history)
+{
+    pthread_mutex_init(&history->fLock, NULL);
+    history->fLoaded = false;
+    history->fEntries = NULL;
+    history->fCount = 0;
+    history->fCapacity = 0;
+}
+
+/// Release the memory held by history.
+void DestroyDurationHistory(DurationHistory *history)
+{
+    size_t i;
+    
+    for (i = 0; i < history->fCount; i++) {
+        free(history->fEntries[i].fPath);
+    }
+    free(history->fEntries);
+    pthread_mutex_destroy(&history->fLock);
+}
+
+/// Return the entry for path in history, adding one if add is true.
+/// Must be called with the history lock held.
+///
+/// @return The entry, or NULL if there is none or memory allocation
+///         failed.
+static ScriptDuration *FindScriptDuration(DurationHistory *history, const char *path, bool add)
+{
+    ScriptDuration *entries;
+    ScriptDuration *entry;
+    size_t capacity;
+    size_t i;
+    
+    for (i = 0; i < history->fCount; i++) {
+        if (strcmp(history->fEntries[i].fPath, path) == 0) {
+            return &history->fEntries[i];
+        }
+    }
+    if (! add) {
+        return NULL;
+    }
+    if (history->fCount == history->fCapacity) {
+        capacity = history->fCapacity ? history->fCapacity * 2 : 32;
+        if ((entries = realloc(history->fEntries, capacity * sizeof(*entries))) == NULL) {
+            return NULL;
+        }
+        history->fEntries = entries;
+        history->fCapacity = capacity;
+    }
+    entry = &history->fEntries[history->fCount];
+    if ((entry->fPath = strdup(path)) == NULL) {
+        return NULL;
+    }
+    entry->fSeconds = -1;
+    history->fCount++;
+    return entry;
+}
+
+/// Read kDurationHistoryPath into history, unless that's been done
+/// already. Must be called with the history lock held.
+static void LoadDurationHistory(DurationHistory *history, aslclient logClient)
+{
+    ScriptDuration *entry;
+    struct stat info;
+    char *contents;
+    char *line;
+    char *next;
+    char *path;
+    double seconds;
+    ssize_t length;
+    ssize_t n;
+    int fd;
+    
+    if (history->fLoaded) {
+        return;
+    }
+    history->fLoaded = true;
+    
+    if ((fd = open(kDurationHistoryPath, O_RDONLY | O_NOFOLLOW | O_CLOEXEC)) == -1) {
+        if (errno != ENOENT) {
+            asl_log(logClient, NULL, ASL_LEVEL_WARNING,
+                    "Can't open %s, errno %d", kDurationHistoryPath, errno);
+        }
+        return;
+    }
+    if (fstat(fd, &info) != 0 || ! S_ISREG(info.st_mode) || info.st_uid != 0
+        || (info.st_mode & (S_IRWXG | S_IRWXO)) != 0 || info.st_size > kMaxHistorySize) {
+        asl_log(logClient, NULL, ASL_LEVEL_WARNING,
+                "Ignoring %s, it must be a file only accessible to root", kDurationHistoryPath);
+        close(fd);
+        return;
+    }
+    if ((contents = malloc((size_t)info.st_size + 1)) == NULL) {
+        close(fd);
+        return;
+    }
+    length = 0;
+    while (length < info.st_size
+           && ((n = read(fd, contents + length, (size_t)(info.st_size - length))) > 0
+               || (n == -1 && errno == EINTR))) {
+        length += n > 0 ? n : 0;
+    }
+    close(fd);
+    contents[length] = '\0';
+    
+    for (line = contents; line != NULL; line = next) {
+        if ((next = strchr(line, '\n')) != NULL) {
+            *next++ = '\0';
+        }
+        seconds = strtod(line, &path);
+        if (path == line || *path++ != ' ' || *path != '/' || seconds < 0) {
+            continue;
+        }
+        if ((entry = FindScriptDuration(history, path, true)) != NULL) {
+            entry->fSeconds = seconds;
+        }
+    }
+    free(contents);
+}
+
+/// Write history to kDurationHistoryPath, leaving out scripts that no
+/// longer exist. Must be called with the history lock held.
+///
+/// The file is replaced atomically, so readers never see a partial one.
+static void SaveDurationHistory(DurationHistory *history, aslclient logClient)
+{
+    char temporary[MAXPATHLEN];
+    struct stat info;
+    FILE *file;
+    size_t i;
+    int fd;
+    
+    snprintf(temporary, sizeof(temporary), "%s.new", kDurationHistoryPath);
+    (void)unlink(temporary);
+    if ((fd = open(temporary, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, S_IRUSR | S_IWUSR)) == -1) {
+        asl_log(logClient, NULL, ASL_LEVEL_WARNING,
+                "Can't create %s, errno %d", temporary, errno);
+        return;
+    }
+    if ((file = fdopen(fd, "w")) == NULL) {
+        close(fd);
+        unlink(temporary);
+        return;
+    }
+    for (i = 0; i < history->fCount; i++) {
+        if (history->fEntries[i].fSeconds >= 0 && lstat(history->fEntries[i].fPath, &info) == 0) {
+            fprintf(file, "%.3f %s\n", history->fEntries[i].fSeconds, history->fEntries[i].fPath);
+        }
+    }
+    if (fclose(file) != 0 || rename(temporary, kDurationHistoryPath) != 0) {
+        asl_log(logClient, NULL, ASL_LEVEL_WARNING,
+                "Can't write %s, errno %d", kDurationHistoryPath, errno);
+        unlink(temporary);
+    }
+}
+
+/// Fill in the expected duration of every script of invocation from the
+/// history. Scripts that aren't run as a process are expected to take
+/// no time.
+void LookUpDurations(InvocationRecord *invocation)
+{
+    DurationHistory *history = &invocation->fPlugin->fHistory;
+    const ScriptDuration *entry;
+    ScriptRecord *script;
+    size_t i;
+    
+    pthread_mutex_lock(&history->fLock);
+    LoadDurationHistory(history, invocation->fPlugin->fLogClient);
+    for (i = 0; i < invocation->fScriptCount; i++) {
+        script = &invocation->fScripts[i];
+        if (! script->fTrusted || script->fSettings->fDetach) {
+            script->fExpected = 0;
+        } else if ((entry = FindScriptDuration(history, script->fPath, false)) != NULL && entry->fSeconds >= 0) {
+            script->fExpected = entry->fSeconds;
+        } else {
+            script->fExpected = kUnknownDurationSeconds;
+        }
+    }
+    pthread_mutex_unlock(&history->fLock);
+}
+
+/// Add the durations of the scripts invocation ran to the history, and
+/// save it.
+///
+/// Scripts that were stopped, cancelled or skipped, and scripts that
+/// ran in the background, don't tell how long they take, and are left
+/// out. For a script that signalled readiness, the time until then is
+/// what counts.
+void RecordDurations(InvocationRecord *invocation)
+{
+    DurationHistory *history = &invocation->fPlugin->fHistory;
+    ScriptDuration *entry;
+    ScriptRecord *script;
+    double seconds;
+    bool changed;
+    size_t i;
+    
+    pthread_mutex_lock(&history->fLock);
+    changed = false;
+    for (i = 0; i < invocation->fScriptCount; i++) {
+        script = &invocation->fScripts[i];
+        if ((script->fState != kScriptFinished && script->fState != kScriptReady)
+            || ! script->fTrusted || script->fSkipped || script->fTimedOut || script->fCancelled
+            || (script->fPid == -1 && ! script->fActions)) {
+            continue;
+        }
+        if ((entry = FindScriptDuration(history, script->fPath, true)) == NULL) {
+            continue;
+        }
+        seconds = (script->fEndTime.tv_sec - script->fStartTime.tv_sec)
+                + (script->fEndTime.tv_usec - script->fStartTime.tv_usec) / 1e6;
+        if (entry->fSeconds < 0) {
+            entry->fSeconds = seconds;
+        } else {
+            entry->fSeconds = kDurationWeight * seconds + (1 - kDurationWeight) * entry->fSeconds;
+        }
+        changed = true;
+    }
+    if (changed) {
+        SaveDurationHistory(history, invocation->fPlugin->fLogClient);
+    }
+    pthread_mutex_unlock(&history->fLock);
+}
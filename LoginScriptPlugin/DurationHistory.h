@@ -0,0 +1,36 @@
+//
+//  DurationHistory.h
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+#ifndef __LoginScriptPlugin__DurationHistory__
+#define __LoginScriptPlugin__DurationHistory__
+
+#include "Common.h"
+
+extern const char *kDurationHistoryPath;
+
+/// ScriptDuration is the average time a script has taken to run.
+typedef struct {
+    char *fPath;
+    double fSeconds;       // exponentially weighted moving average
+} ScriptDuration;
+
+/// DurationHistory holds the durations of the scripts that have run,
+/// which are kept in kDurationHistoryPath between plugin hosts.
+typedef struct {
+    pthread_mutex_t fLock;
+    bool fLoaded;          // read from the file yet
+    ScriptDuration *fEntries;
+    size_t fCount;
+    size_t fCapacity;
+} DurationHistory;
+
+void InitDurationHistory(DurationHistory *history);
+void DestroyDurationHistory(DurationHistory *history);
+void LookUpDurations(InvocationRecord *invocation);
+void RecordDurations(InvocationRecord *invocation);
+
+#endif /* defined(__LoginScriptPlugin__DurationHistory__) */
@@ -0,0 +1,304 @@
+//
+//  EarlyLaunch.c
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+#include "EarlyLaunch.h"
+
+#include "BackgroundReaper.h"
+#include "EventLoop.h"
+#include "LoginScriptPlugin.h"
+#include "LoginSessions.h"
+#include "RunPredicates.h"
+#include "ScriptExecution.h"
+#include "ScriptOutput.h"
+#include "Spawn.h"
+#include "WorkerPool.h"
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Early Launch
+/////////////////////////////////////////////////////////////////////
+
+
+// Postmount-root scripts marked home_independent don't have to wait for
+// the home directory to be mounted. The premount-user mechanism, the last
+// one before the mount, starts those that don't wait for other scripts
+// once its own scripts have allowed the login, and leaves them running in
+// the plugin's table of early scripts, each holding a worker pool slot.
+// The postmount-root mechanism of the same login claims them, and joins
+// each one when its turn comes instead of starting it, so that its
+// timeout, output and result are dealt with as if it had just been
+// started. Early scripts that no mechanism claims are stopped when their
+// login is over.
+
+/// Set up an empty early script table.
+void InitEarlyScriptTable(EarlyScriptTable *table)
+{
+    pthread_mutex_init(&table->fLock, NULL);
+    table->fScripts = NULL;
+}
+
+/// Release early, which must have been unlinked from its table.
+void FreeEarlyScript(EarlyScript *early)
+{
+    if (early->fOutputFd != -1) {
+        close(early->fOutputFd);
+    }
+    free(early->fPath);
+    free(early);
+}
+
+/// Stop an early script that its login no longer needs, let the
+/// background reaper wait for it, and give back its worker pool slot.
+void AbandonEarlyScript(PluginRecord *plugin, EarlyScript *early)
+{
+    OutputBuffer output;
+    
+    ReleaseWorker(&plugin->fPool);
+    asl_log(plugin->fLogClient, NULL, ASL_LEVEL_NOTICE,
+            "Stopping %s with pid %d, which was started early for a login that didn't get to it",
+            early->fPath, early->fPid);
+    if (killpg(early->fPid, SIGTERM) == -1 && kill(early->fPid, SIGTERM) == -1 && errno != ESRCH) {
+        asl_log(plugin->fLogClient, NULL, ASL_LEVEL_WARNING,
+                "Sending signal %d to %s failed with errno %d", SIGTERM, early->fPath, errno);
+    }
+    InitOutputBuffer(&output);
+    output.fFd = early->fOutputFd;
+    early->fOutputFd = -1;
+    if (! AdoptDetachedScript(plugin, early->fPath, early->fPid, early->fBackend,
+                              &early->fStartTime, true, &output)) {
+        asl_log(plugin->fLogClient, NULL, ASL_LEVEL_WARNING,
+                "Can't hand %s over to the background reaper, leaving it unreaped", early->fPath);
+    }
+    FreeOutputBuffer(&output);
+    FreeEarlyScript(early);
+}
+
+/// Stop the early scripts of the login of mechanism, or all of them if
+/// mechanism is NULL, along with any that have outlived kSessionExpirySeconds.
+void AbandonEarlyScripts(PluginRecord *plugin, const MechanismRecord *mechanism)
+{
+    EarlyScriptTable *table = &plugin->fEarlyScripts;
+    EarlyScript **link;
+    EarlyScript *early;
+    EarlyScript *abandoned;
+    struct timeval now;
+    
+    gettimeofday(&now, NULL);
+    abandoned = NULL;
+    
+    pthread_mutex_lock(&table->fLock);
+    for (link = &table->fScripts; (early = *link) != NULL; ) {
+        if (mechanism == NULL
+            || (early->fEngine == mechanism->fEngine && early->fUid == mechanism->fSessionUid)
+            || now.tv_sec - early->fStartTime.tv_sec > kSessionExpirySeconds) {
+            *link = early->fNext;
+            early->fNext = abandoned;
+            abandoned = early;
+        } else {
+            link = &early->fNext;
+        }
+    }
+    pthread_mutex_unlock(&table->fLock);
+    
+    while ((early = abandoned) != NULL) {
+        abandoned = early->fNext;
+        AbandonEarlyScript(plugin, early);
+    }
+}
+
+/// Start the postmount-root scripts of the login of mechanism that neither
+/// need the home directory nor wait for other scripts, right after the
+/// last premount mechanism, invocation, has allowed the login.
+///
+/// The scripts are found and ordered just as the postmount-root mechanism
+/// will, so only those it would start right away are started early. Each
+/// takes a worker pool slot, and the rest are left for the postmount
+/// mechanism once the pool is full. So are scripts that are detached,
+/// signal readiness, are resident, take machine-wide locks or slots, or
+/// would be shed under the current pressure, and action files.
+void LaunchEarlyScripts(MechanismRecord *mechanism, const InvocationRecord *invocation)
+{
+    PluginRecord *plugin = invocation->fPlugin;
+    const SpawnBackend *backend = invocation->fManifest->fSpawnBackend;
+    const ScriptSettings *settings;
+    InvocationRecord postmount;
+    ScriptRecord *script;
+    SpawnRequest request;
+    EarlyScript *early;
+    char *argv[5];
+    int fds[2];
+    size_t launched;
+    size_t i;
+    
+    // A repeated premount mechanism replaces what an earlier one started.
+    AbandonEarlyScripts(plugin, mechanism);
+    
+    if (invocation->fDeadline.tv_sec != 0 && TimeUntil(&invocation->fDeadline) <= 0) {
+        return;
+    }
+    
+    memset(&postmount, 0, sizeof(postmount));
+    postmount.fPlugin = plugin;
+    postmount.fManifest = invocation->fManifest;
+    postmount.fContext = kRunAsRoot;
+    postmount.fPhase = kRunAfterHomedirMount;
+    postmount.fUid = invocation->fUid;
+    postmount.fGid = invocation->fGid;
+    postmount.fHome = invocation->fHome;
+    memcpy(postmount.fUidStr, invocation->fUidStr, sizeof(postmount.fUidStr));
+    memcpy(postmount.fGidStr, invocation->fGidStr, sizeof(postmount.fGidStr));
+    postmount.fPressure = invocation->fPressure;
+    postmount.fUnderPressure = invocation->fUnderPressure;
+    postmount.fDeadline = invocation->fDeadline;
+    if ((postmount.fEnvp = CreateEnvironment(postmount.fUid, postmount.fHome, kRunAsRoot, plugin->fLogClient)) == NULL
+        || ! CreateScripts(&postmount)) {
+        asl_log(plugin->fLogClient, NULL, ASL_LEVEL_WARNING,
+                "Can't start scripts early, memory allocation failed");
+        FreeScripts(&postmount);
+        FreeEnvironment(postmount.fEnvp);
+        return;
+    }
+    
+    launched = 0;
+    for (i = 0; i < postmount.fScriptCount; i++) {
+        script = &postmount.fScripts[i];
+        settings = script->fSettings;
+        if (! settings->fHomeIndependent || script->fDepCount != 0 || ! script->fTrusted || script->fActions
+            || settings->fDetach || settings->fNotifyReady || settings->fResident
+            || settings->fLock != NULL || settings->fWeight != 0
+            || (settings->fShedding != kShedNever && postmount.fUnderPressure)) {
+            continue;
+        }
+        if (! RunPredicatesMatch(&postmount, script)) {
+            continue;
+        }
+        if (! AcquireWorker(&plugin->fPool, false, NULL)) {
+            asl_log(plugin->fLogClient, NULL, ASL_LEVEL_DEBUG,
+                    "Not starting %s early, the worker pool is full", script->fPath);
+            break;
+        }
+        
+        if ((early = calloc(1, sizeof(*early))) == NULL || (early->fPath = strdup(script->fPath)) == NULL) {
+            free(early);
+            ReleaseWorker(&plugin->fPool);
+            asl_log(plugin->fLogClient, NULL, ASL_LEVEL_WARNING,
+                    "Can't start %s early, memory allocation failed", script->fPath);
+            continue;
+        }
+        if (pipe(fds) != 0) {
+            asl_log(plugin->fLogClient, NULL, ASL_LEVEL_WARNING,
+                    "Creating output pipe for %s failed with errno %d", script->fPath, errno);
+            free(early->fPath);
+            free(early);
+            ReleaseWorker(&plugin->fPool);
+            continue;
+        }
+        fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+        fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+        fcntl(fds[0], F_SETFL, O_NONBLOCK);
+        
+        argv[0] = early->fPath;
+        argv[1] = postmount.fUidStr;
+        argv[2] = postmount.fGidStr;
+        argv[3] = (char *)postmount.fHome;
+        argv[4] = NULL;
+        
+        request.fPath = early->fPath;
+        request.fArgv = argv;
+        request.fEnvp = postmount.fEnvp;
+        request.fUid = postmount.fUid;
+        request.fGid = postmount.fGid;
+        request.fContext = kRunAsRoot;
+        request.fOutputFd = fds[1];
+        request.fNotifyFd = -1;
+        request.fLimits = settings->fLimits;
+        request.fPriority = settings->fPriority;
+        
+        gettimeofday(&early->fStartTime, NULL);
+        early->fPid = backend->fSpawn(plugin, &request);
+        close(fds[1]);
+        if (early->fPid == -1) {
+            asl_log(plugin->fLogClient, NULL, ASL_LEVEL_WARNING,
+                    "Spawning %s early with %s failed with errno %d", script->fPath, backend->fName, errno);
+            close(fds[0]);
+            free(early->fPath);
+            free(early);
+            ReleaseWorker(&plugin->fPool);
+            continue;
+        }
+        early->fEngine = mechanism->fEngine;
+        early->fUid = mechanism->fSessionUid;
+        early->fBackend = backend;
+        early->fOutputFd = fds[0];
+        
+        pthread_mutex_lock(&plugin->fEarlyScripts.fLock);
+        early->fNext = plugin->fEarlyScripts.fScripts;
+        plugin->fEarlyScripts.fScripts = early;
+        pthread_mutex_unlock(&plugin->fEarlyScripts.fLock);
+        
+        asl_log(plugin->fLogClient, NULL, ASL_LEVEL_DEBUG,
+                "Started %s early with pid %d", early->fPath, early->fPid);
+        launched++;
+    }
+    
+    if (launched > 0) {
+        asl_log(plugin->fLogClient, NULL, ASL_LEVEL_NOTICE,
+                "Started %zu %s scripts early, ahead of the home directory mount", launched,
+                PhasePrefix(postmount.fPhase, postmount.fContext));
+    }
+    FreeScripts(&postmount);
+    FreeEnvironment(postmount.fEnvp);
+}
+
+/// Stop all early scripts when the plugin is unloaded.
+void StopEarlyScripts(PluginRecord *plugin)
+{
+    AbandonEarlyScripts(plugin, NULL);
+    pthread_mutex_destroy(&plugin->fEarlyScripts.fLock);
+}
+
+/// Hand the early scripts of the login of mechanism over to the scripts
+/// of invocation with the same path, which join them instead of starting
+/// them. Early scripts that invocation doesn't have, or doesn't trust any
+/// more, are stopped.
+void ClaimEarlyScripts(const MechanismRecord *mechanism, InvocationRecord *invocation)
+{
+    EarlyScriptTable *table = &invocation->fPlugin->fEarlyScripts;
+    EarlyScript **link;
+    EarlyScript *early;
+    EarlyScript *abandoned;
+    size_t i;
+    
+    abandoned = NULL;
+    
+    pthread_mutex_lock(&table->fLock);
+    for (link = &table->fScripts; (early = *link) != NULL; ) {
+        if (early->fEngine != mechanism->fEngine || early->fUid != mechanism->fSessionUid) {
+            link = &early->fNext;
+            continue;
+        }
+        *link = early->fNext;
+        for (i = 0; i < invocation->fScriptCount; i++) {
+            if (invocation->fScripts[i].fTrusted && invocation->fScripts[i].fEarly == NULL
+                && strcmp(invocation->fScripts[i].fPath, early->fPath) == 0) {
+                invocation->fScripts[i].fEarly = early;
+                break;
+            }
+        }
+        if (i == invocation->fScriptCount) {
+            early->fNext = abandoned;
+            abandoned = early;
+        }
+    }
+    pthread_mutex_unlock(&table->fLock);
+    
+    while ((early = abandoned) != NULL) {
+        abandoned = early->fNext;
+        AbandonEarlyScript(invocation->fPlugin, early);
+    }
+}
@@ -0,0 +1,42 @@
+//
+//  EarlyLaunch.h
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+#ifndef __LoginScriptPlugin__EarlyLaunch__
+#define __LoginScriptPlugin__EarlyLaunch__
+
+#include "Common.h"
+#include "Spawn.h"
+
+/// EarlyScript is a postmount script that the premount mechanism started
+/// ahead of time, because it doesn't need the home directory. The
+/// postmount mechanism of the same login joins it instead of starting it.
+typedef struct EarlyScript {
+    struct EarlyScript *fNext;
+    AuthorizationEngineRef fEngine;    // of the login it was started for
+    uid_t fUid;
+    char *fPath;
+    pid_t fPid;
+    const SpawnBackend *fBackend;
+    struct timeval fStartTime;
+    int fOutputFd;         // read end of the output pipe, -1 once handed on
+} EarlyScript;
+
+/// EarlyScriptTable holds the early scripts that haven't been joined yet.
+typedef struct {
+    pthread_mutex_t fLock;
+    EarlyScript *fScripts;
+} EarlyScriptTable;
+
+void InitEarlyScriptTable(EarlyScriptTable *table);
+void FreeEarlyScript(EarlyScript *early);
+void AbandonEarlyScript(PluginRecord *plugin, EarlyScript *early);
+void AbandonEarlyScripts(PluginRecord *plugin, const MechanismRecord *mechanism);
+void LaunchEarlyScripts(MechanismRecord *mechanism, const InvocationRecord *invocation);
+void StopEarlyScripts(PluginRecord *plugin);
+void ClaimEarlyScripts(const MechanismRecord *mechanism, InvocationRecord *invocation);
+
+#endif /* defined(__LoginScriptPlugin__EarlyLaunch__) */
@@ -0,0 +1,30 @@
+//
+//  EventLoop.c
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+#include "EventLoop.h"
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Event Loop
+/////////////////////////////////////////////////////////////////////
+
+
+// The event loop lets the script executor wait for process exits,
+// output and timers in one place. It's implemented on kqueue in
+// EventLoopKqueue.c, and on epoll in EventLoopEpoll.c.
+
+/// Return the number of milliseconds until deadline, negative if it has
+/// passed.
+long TimeUntil(const struct timeval *deadline)
+{
+    struct timeval now;
+    
+    gettimeofday(&now, NULL);
+    return (deadline->tv_sec - now.tv_sec) * 1000L
+         + (deadline->tv_usec - now.tv_usec) / 1000;
+}
@@ -0,0 +1,61 @@
+//
+//  EventLoop.h
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+#ifndef __LoginScriptPlugin__EventLoop__
+#define __LoginScriptPlugin__EventLoop__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <pthread.h>
+
+// The event loop only depends on the system headers, so that it can be
+// built and tested on its own. EventLoopKqueue.c implements it for macOS,
+// and EventLoopEpoll.c for Linux, where the tests also run.
+
+typedef enum {
+    kEventProcessExited,
+    kEventReadable,
+    kEventTimer,
+    kEventWakeup
+} eventKind;
+
+/// Event is a single occurrence reported by EventLoopNext().
+typedef struct {
+    eventKind fKind;
+    void *fContext;        // as passed when the source was added
+    int fFd;               // kEventReadable only, the readable descriptor
+    bool fEOF;             // kEventReadable only, the writing end has been closed
+} Event;
+
+typedef struct EventSource EventSource;
+
+/// EventLoop multiplexes process exits, readable descriptors and timers.
+typedef struct {
+    int fQueue;            // kqueue or epoll instance
+#ifdef __linux__
+    int fWakeFd;           // eventfd of EventLoopWake(), -1 if none
+    pthread_mutex_t fLock; // sources may be added from other threads
+    EventSource *fSources; // what each epoll event refers to
+    uint64_t fLastId;      // of the last source added
+#endif
+} EventLoop;
+
+bool EventLoopCreate(EventLoop *loop);
+void EventLoopDestroy(EventLoop *loop);
+bool EventLoopWatchProcess(EventLoop *loop, pid_t pid, void *context);
+bool EventLoopWatchReadable(EventLoop *loop, int fd, void *context);
+void EventLoopUnwatchReadable(EventLoop *loop, int fd);
+bool EventLoopSetTimer(EventLoop *loop, void *context, long milliseconds);
+void EventLoopCancelTimer(EventLoop *loop, void *context);
+bool EventLoopAddWakeup(EventLoop *loop, void *context);
+void EventLoopWake(EventLoop *loop);
+bool EventLoopNext(EventLoop *loop, Event *event);
+long TimeUntil(const struct timeval *deadline);
+
+#endif /* defined(__LoginScriptPlugin__EventLoop__) */
@@ -0,0 +1,340 @@
+//
+//  EventLoopEpoll.c
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <sys/syscall.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "EventLoop.h"
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Event Loop on epoll
+/////////////////////////////////////////////////////////////////////
+
+
+// The event loop on epoll, for Linux. Every source is a descriptor: a
+// pidfd for a process, a timerfd for a timer, and an eventfd for the
+// wakeup. Process exits can be watched for any pid, like with kqueue, as
+// a pidfd doesn't need the process to be a child.
+//
+// Each epoll event carries the id of an EventSource in loop->fSources,
+// which is guarded by loop->fLock, as other threads may add and remove
+// sources while the loop waits.
+
+struct EventSource {
+    EventSource *fNext;
+    uint64_t fId;          // unique within the loop, in the epoll event
+    eventKind fKind;
+    int fFd;               // the descriptor epoll watches
+    void *fContext;
+};
+
+/// Return the source of kind for fd, or for context if fd is -1.
+///
+/// Must be called with loop->fLock held.
+static EventSource *FindEventSource(EventLoop *loop, eventKind kind, int fd, void *context)
+{
+    EventSource *source;
+    
+    for (source = loop->fSources; source != NULL; source = source->fNext) {
+        if (source->fKind == kind && (fd != -1 ? source->fFd == fd : source->fContext == context)) {
+            return source;
+        }
+    }
+    return NULL;
+}
+
+/// Return the source with id, or NULL if it has been removed.
+///
+/// Must be called with loop->fLock held.
+static EventSource *FindEventSourceById(EventLoop *loop, uint64_t id)
+{
+    EventSource *source;
+    
+    for (source = loop->fSources; source != NULL; source = source->fNext) {
+        if (source->fId == id) {
+            return source;
+        }
+    }
+    return NULL;
+}
+
+/// Add a source for fd to loop, watching it for input.
+///
+/// Must be called with loop->fLock held.
+///
+/// @return NULL with errno set on failure.
+static EventSource *AddEventSource(EventLoop *loop, eventKind kind, int fd, void *context)
+{
+    EventSource *source;
+    struct epoll_event ev;
+    
+    if ((source = malloc(sizeof(*source))) == NULL) {
+        return NULL;
+    }
+    source->fId = ++loop->fLastId;
+    source->fKind = kind;
+    source->fFd = fd;
+    source->fContext = context;
+    ev.events = EPOLLIN;
+    ev.data.u64 = source->fId;
+    if (epoll_ctl(loop->fQueue, EPOLL_CTL_ADD, fd, &ev) == -1) {
+        free(source);
+        return NULL;
+    }
+    source->fNext = loop->fSources;
+    loop->fSources = source;
+    return source;
+}
+
+/// Remove source from loop and free it. Closes the descriptor unless it
+/// belongs to the caller, as for kEventReadable.
+///
+/// Must be called with loop->fLock held.
+static void RemoveEventSource(EventLoop *loop, EventSource *source)
+{
+    EventSource **link;
+    
+    for (link = &loop->fSources; *link != NULL; link = &(*link)->fNext) {
+        if (*link == source) {
+            *link = source->fNext;
+            break;
+        }
+    }
+    (void)epoll_ctl(loop->fQueue, EPOLL_CTL_DEL, source->fFd, NULL);
+    if (source->fKind != kEventReadable) {
+        close(source->fFd);
+    }
+    free(source);
+}
+
+/// Create the epoll instance backing loop.
+///
+/// @return false with errno set on failure.
+bool EventLoopCreate(EventLoop *loop)
+{
+    loop->fQueue = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->fQueue == -1) {
+        return false;
+    }
+    loop->fWakeFd = -1;
+    loop->fSources = NULL;
+    loop->fLastId = 0;
+    pthread_mutex_init(&loop->fLock, NULL);
+    return true;
+}
+
+/// Release the epoll instance backing loop, and every source in it.
+void EventLoopDestroy(EventLoop *loop)
+{
+    while (loop->fSources != NULL) {
+        RemoveEventSource(loop, loop->fSources);
+    }
+    pthread_mutex_destroy(&loop->fLock);
+    close(loop->fQueue);
+    loop->fQueue = -1;
+    loop->fWakeFd = -1;
+}
+
+/// Report the exit of pid once, as kEventProcessExited.
+///
+/// The process isn't reaped. Needs pidfd_open(), from Linux 5.3.
+///
+/// @return false with errno set, ESRCH if the process has already been
+///         reaped.
+bool EventLoopWatchProcess(EventLoop *loop, pid_t pid, void *context)
+{
+    int fd;
+    bool added;
+    
+    if ((fd = (int)syscall(SYS_pidfd_open, pid, 0)) == -1) {
+        return false;
+    }
+    pthread_mutex_lock(&loop->fLock);
+    added = AddEventSource(loop, kEventProcessExited, fd, context) != NULL;
+    pthread_mutex_unlock(&loop->fLock);
+    if (! added) {
+        close(fd);
+    }
+    return added;
+}
+
+/// Report kEventReadable whenever fd has data to read or has reached end
+/// of file. Closing fd removes it from loop, unless another process still
+/// has it open.
+///
+/// @return false with errno set on failure.
+bool EventLoopWatchReadable(EventLoop *loop, int fd, void *context)
+{
+    EventSource *source;
+    struct epoll_event ev;
+    bool added;
+    
+    pthread_mutex_lock(&loop->fLock);
+    // A source left behind by a descriptor that was closed without being
+    // unwatched may have the same number.
+    if ((source = FindEventSource(loop, kEventReadable, fd, NULL)) != NULL) {
+        source->fContext = context;
+        ev.events = EPOLLIN;
+        ev.data.u64 = source->fId;
+        added = epoll_ctl(loop->fQueue, EPOLL_CTL_ADD, fd, &ev) == 0
+             || (errno == EEXIST && epoll_ctl(loop->fQueue, EPOLL_CTL_MOD, fd, &ev) == 0);
+    } else {
+        added = AddEventSource(loop, kEventReadable, fd, context) != NULL;
+    }
+    pthread_mutex_unlock(&loop->fLock);
+    return added;
+}
+
+/// Stop reporting kEventReadable for fd.
+void EventLoopUnwatchReadable(EventLoop *loop, int fd)
+{
+    EventSource *source;
+    
+    pthread_mutex_lock(&loop->fLock);
+    if ((source = FindEventSource(loop, kEventReadable, fd, NULL)) != NULL) {
+        RemoveEventSource(loop, source);
+    }
+    pthread_mutex_unlock(&loop->fLock);
+}
+
+/// Report kEventTimer once, after milliseconds. Every context has at most
+/// one timer, so this replaces any timer already set for context.
+///
+/// @return false with errno set on failure.
+bool EventLoopSetTimer(EventLoop *loop, void *context, long milliseconds)
+{
+    EventSource *source;
+    struct itimerspec spec = { { 0, 0 }, { 0, 0 } };
+    int fd;
+    bool set;
+    
+    // An all zero timerfd is disarmed, where kqueue fires at once.
+    if (milliseconds <= 0) {
+        spec.it_value.tv_nsec = 1;
+    } else {
+        spec.it_value.tv_sec = milliseconds / 1000;
+        spec.it_value.tv_nsec = (milliseconds % 1000) * 1000000L;
+    }
+    
+    pthread_mutex_lock(&loop->fLock);
+    if ((source = FindEventSource(loop, kEventTimer, -1, context)) != NULL) {
+        set = timerfd_settime(source->fFd, 0, &spec, NULL) == 0;
+    } else if ((fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) == -1) {
+        set = false;
+    } else if (timerfd_settime(fd, 0, &spec, NULL) == -1
+               || AddEventSource(loop, kEventTimer, fd, context) == NULL) {
+        close(fd);
+        set = false;
+    } else {
+        set = true;
+    }
+    pthread_mutex_unlock(&loop->fLock);
+    return set;
+}
+
+/// Remove the timer for context, if it hasn't fired yet.
+void EventLoopCancelTimer(EventLoop *loop, void *context)
+{
+    EventSource *source;
+    
+    pthread_mutex_lock(&loop->fLock);
+    if ((source = FindEventSource(loop, kEventTimer, -1, context)) != NULL) {
+        RemoveEventSource(loop, source);
+    }
+    pthread_mutex_unlock(&loop->fLock);
+}
+
+/// Prepare loop to be woken up from other threads, reporting kEventWakeup
+/// with context.
+///
+/// @return false with errno set on failure.
+bool EventLoopAddWakeup(EventLoop *loop, void *context)
+{
+    int fd;
+    bool added;
+    
+    if ((fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1) {
+        return false;
+    }
+    pthread_mutex_lock(&loop->fLock);
+    added = AddEventSource(loop, kEventWakeup, fd, context) != NULL;
+    if (added) {
+        loop->fWakeFd = fd;
+    }
+    pthread_mutex_unlock(&loop->fLock);
+    if (! added) {
+        close(fd);
+    }
+    return added;
+}
+
+/// Make a thread waiting in EventLoopNext() return kEventWakeup. May be
+/// called from any thread.
+void EventLoopWake(EventLoop *loop)
+{
+    uint64_t one = 1;
+    
+    (void)write(loop->fWakeFd, &one, sizeof(one));
+}
+
+/// Wait for the next event.
+///
+/// @return false with errno set if waiting failed.
+bool EventLoopNext(EventLoop *loop, Event *event)
+{
+    struct epoll_event ev;
+    EventSource *source;
+    uint64_t count;
+    int n;
+    
+    for (;;) {
+        n = epoll_wait(loop->fQueue, &ev, 1, -1);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n == -1) {
+            return false;
+        }
+        if (n == 0) {
+            continue;
+        }
+        pthread_mutex_lock(&loop->fLock);
+        // Another thread may have removed the source since.
+        if ((source = FindEventSourceById(loop, ev.data.u64)) == NULL) {
+            pthread_mutex_unlock(&loop->fLock);
+            continue;
+        }
+        event->fKind = source->fKind;
+        event->fContext = source->fContext;
+        event->fFd = -1;
+        event->fEOF = false;
+        switch (source->fKind) {
+            case kEventProcessExited:
+            case kEventTimer:
+                // Both fire once.
+                RemoveEventSource(loop, source);
+                break;
+            case kEventReadable:
+                event->fFd = source->fFd;
+                event->fEOF = (ev.events & (EPOLLHUP | EPOLLRDHUP)) != 0;
+                break;
+            case kEventWakeup:
+                (void)read(source->fFd, &count, sizeof(count));
+                break;
+        }
+        pthread_mutex_unlock(&loop->fLock);
+        return true;
+    }
+}
@@ -0,0 +1,147 @@
+//
+//  EventLoopKqueue.c
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+#include <sys/event.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "EventLoop.h"
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Event Loop on kqueue
+/////////////////////////////////////////////////////////////////////
+
+
+// The event loop on kqueue. Process exits can be watched for any pid, not
+// just children of the plugin host, which is what makes it work with
+// scripts started by the launcher.
+
+/// Create the kernel queue backing loop.
+///
+/// @return false with errno set on failure.
+bool EventLoopCreate(EventLoop *loop)
+{
+    loop->fQueue = kqueue();
+    return loop->fQueue != -1;
+}
+
+/// Release the kernel queue backing loop.
+void EventLoopDestroy(EventLoop *loop)
+{
+    close(loop->fQueue);
+    loop->fQueue = -1;
+}
+
+/// Apply a single change to the kernel queue.
+static bool EventLoopChange(EventLoop *loop, uintptr_t ident, int16_t filter, uint16_t flags, uint32_t fflags, intptr_t data, void *context)
+{
+    struct kevent change;
+    
+    EV_SET(&change, ident, filter, flags, fflags, data, context);
+    return kevent(loop->fQueue, &change, 1, NULL, 0, NULL) == 0;
+}
+
+/// Report the exit of pid once, as kEventProcessExited.
+///
+/// The process isn't reaped.
+///
+/// @return false with errno set, ESRCH if the process has already exited.
+bool EventLoopWatchProcess(EventLoop *loop, pid_t pid, void *context)
+{
+    return EventLoopChange(loop, (uintptr_t)pid, EVFILT_PROC, EV_ADD | EV_ONESHOT, NOTE_EXIT, 0, context);
+}
+
+/// Report kEventReadable whenever fd has data to read or has reached end
+/// of file. Closing fd removes it from loop.
+///
+/// @return false with errno set on failure.
+bool EventLoopWatchReadable(EventLoop *loop, int fd, void *context)
+{
+    return EventLoopChange(loop, (uintptr_t)fd, EVFILT_READ, EV_ADD, 0, 0, context);
+}
+
+/// Stop reporting kEventReadable for fd.
+void EventLoopUnwatchReadable(EventLoop *loop, int fd)
+{
+    (void)EventLoopChange(loop, (uintptr_t)fd, EVFILT_READ, EV_DELETE, 0, 0, NULL);
+}
+
+/// Report kEventTimer once, after milliseconds. Every context has at most
+/// one timer, so this replaces any timer already set for context.
+///
+/// @return false with errno set on failure.
+bool EventLoopSetTimer(EventLoop *loop, void *context, long milliseconds)
+{
+    return EventLoopChange(loop, (uintptr_t)context, EVFILT_TIMER, EV_ADD | EV_ONESHOT, 0, milliseconds, context);
+}
+
+/// Remove the timer for context, if it hasn't fired yet.
+void EventLoopCancelTimer(EventLoop *loop, void *context)
+{
+    (void)EventLoopChange(loop, (uintptr_t)context, EVFILT_TIMER, EV_DELETE, 0, 0, context);
+}
+
+/// Prepare loop to be woken up from other threads, reporting kEventWakeup
+/// with context.
+///
+/// @return false with errno set on failure.
+bool EventLoopAddWakeup(EventLoop *loop, void *context)
+{
+    return EventLoopChange(loop, 0, EVFILT_USER, EV_ADD | EV_CLEAR, 0, 0, context);
+}
+
+/// Make a thread waiting in EventLoopNext() return kEventWakeup. May be
+/// called from any thread.
+void EventLoopWake(EventLoop *loop)
+{
+    (void)EventLoopChange(loop, 0, EVFILT_USER, 0, NOTE_TRIGGER, 0, NULL);
+}
+
+/// Wait for the next event.
+///
+/// @return false with errno set if waiting failed.
+bool EventLoopNext(EventLoop *loop, Event *event)
+{
+    struct kevent kev;
+    int n;
+    
+    for (;;) {
+        n = kevent(loop->fQueue, NULL, 0, &kev, 1, NULL);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n == -1) {
+            return false;
+        }
+        if (n == 0) {
+            continue;
+        }
+        event->fContext = kev.udata;
+        event->fFd = -1;
+        event->fEOF = false;
+        switch (kev.filter) {
+            case EVFILT_PROC:
+                event->fKind = kEventProcessExited;
+                return true;
+            case EVFILT_READ:
+                event->fKind = kEventReadable;
+                event->fFd = (int)kev.ident;
+                event->fEOF = (kev.flags & EV_EOF) != 0;
+                return true;
+            case EVFILT_TIMER:
+                event->fKind = kEventTimer;
+                return true;
+            case EVFILT_USER:
+                event->fKind = kEventWakeup;
+                return true;
+            default:
+                break;
+        }
+    }
+}
@@ -0,0 +1,855 @@
+//
+//  Launcher.c
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+#include "Launcher.h"
+
+#include "LoginScriptPlugin.h"
+#include "Spawn.h"
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Launcher
+/////////////////////////////////////////////////////////////////////
+
+
+// The launcher is a copy of the plugin host forked in
+// AuthorizationPluginCreate, before the host has grown. It receives spawn
+// requests over a socketpair, forks and executes scripts, and reports
+// back when they have been started. A script that has exited is only
+// reaped when the plugin asks for it, so that its process group id can't
+// be reused while the plugin cleans up what it left behind, and how it
+// exited is reported back then. The launcher never
+// allocates memory or touches libraries that may have been left in an
+// inconsistent state by fork(), it only uses system calls and static
+// buffers.
+
+enum {
+    kLauncherSpawn = 1,    // plugin -> launcher, fKey is the request serial, may carry descriptors
+    kLauncherStarted,      // launcher -> plugin, fKey is the request serial
+    kLauncherExited,       // launcher -> plugin, fKey is the pid
+    kLauncherReap          // plugin -> launcher, fKey is the pid
+};
+
+enum {
+    kLauncherMaxMessage = 64 * 1024,
+    kLauncherMaxStrings = 1024,
+    kLauncherMaxDescriptors = 2,
+    kLauncherMaxReaps = 1024           // scripts the plugin can wait for at once
+};
+
+enum {
+    kLauncherHasOutputFd = 1 << 0,     // kLauncherSpawn carries the output descriptor
+    kLauncherHasNotifyFd = 1 << 1      // kLauncherSpawn carries the readiness descriptor, after the output one
+};
+
+/// LauncherHeader precedes every message on the launcher socket.
+typedef struct {
+    uint32_t fType;
+    uint32_t fLength;      // number of payload bytes following the header
+    int32_t fKey;
+} LauncherHeader;
+
+/// Payload of kLauncherSpawn, followed by the path, the arguments and
+/// the environment as NUL terminated strings.
+typedef struct {
+    uid_t fUid;
+    gid_t fGid;
+    int32_t fContext;
+    uint32_t fFlags;
+    ResourceLimits fLimits;
+    int32_t fPriority;
+    uint32_t fArgc;
+    uint32_t fEnvc;
+} LauncherSpawnMessage;
+
+/// Payload of kLauncherStarted.
+typedef struct {
+    int32_t fPid;          // -1 if the script couldn't be started
+    int32_t fError;
+} LauncherStartedMessage;
+
+/// Payload of kLauncherExited.
+typedef struct {
+    int32_t fError;        // from wait4(), 0 if the script was reaped
+    int32_t fStatus;
+    struct timeval fUserTime;
+    struct timeval fSystemTime;
+} LauncherExitedMessage;
+
+static int gLauncherWakeFd = -1;       // write end of the launcher's SIGCHLD pipe
+static pid_t gLauncherReaps[kLauncherMaxReaps];    // scripts the plugin waits for
+static int gLauncherReapCount = 0;
+
+/// Write len bytes to fd, retrying on short writes.
+bool WriteFully(int fd, const void *buf, size_t len)
+{
+    const char *p = buf;
+    ssize_t n;
+    
+    while (len > 0) {
+        n = write(fd, p, len);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+/// Read exactly len bytes from fd.
+///
+/// @return false on error or if the other end closed the connection.
+static bool ReadFully(int fd, void *buf, size_t len)
+{
+    char *p = buf;
+    ssize_t n;
+    
+    while (len > 0) {
+        n = read(fd, p, len);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        if (n == 0) {
+            errno = EPIPE;
+            return false;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+/// Send a message with the given header fields and payload.
+///
+/// Any descriptors in fds are passed along with the header as SCM_RIGHTS.
+static bool LauncherSend(int sock, uint32_t type, int32_t key, const void *payload, uint32_t length, const int *fds, int fdCount)
+{
+    LauncherHeader header;
+    union {
+        struct cmsghdr fHeader;
+        char fBuffer[CMSG_SPACE(kLauncherMaxDescriptors * sizeof(int))];
+    } control;
+    struct cmsghdr *cmsg;
+    struct msghdr msg;
+    struct iovec iov;
+    ssize_t n;
+    
+    header.fType = type;
+    header.fLength = length;
+    header.fKey = key;
+    if (fdCount == 0) {
+        return WriteFully(sock, &header, sizeof(header))
+        && WriteFully(sock, payload, length);
+    }
+    
+    iov.iov_base = &header;
+    iov.iov_len = sizeof(header);
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.fBuffer;
+    msg.msg_controllen = CMSG_SPACE(fdCount * sizeof(int));
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(fdCount * sizeof(int));
+    memcpy(CMSG_DATA(cmsg), fds, fdCount * sizeof(int));
+    do {
+        n = sendmsg(sock, &msg, 0);
+    } while (n == -1 && errno == EINTR);
+    if (n == -1) {
+        return false;
+    }
+    return WriteFully(sock, (char *)&header + n, sizeof(header) - (size_t)n)
+    && WriteFully(sock, payload, length);
+}
+
+/// Read a message header, and the descriptors passed along with it into
+/// fds, which must have room for kLauncherMaxDescriptors.
+///
+/// @return false on error or if the other end closed the connection.
+static bool LauncherReceiveHeader(int sock, LauncherHeader *header, int *fds, int *fdCount)
+{
+    union {
+        struct cmsghdr fHeader;
+        char fBuffer[CMSG_SPACE(kLauncherMaxDescriptors * sizeof(int))];
+    } control;
+    struct cmsghdr *cmsg;
+    struct msghdr msg;
+    struct iovec iov;
+    ssize_t n;
+    int count;
+    int i;
+    
+    *fdCount = 0;
+    iov.iov_base = header;
+    iov.iov_len = sizeof(*header);
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.fBuffer;
+    msg.msg_controllen = sizeof(control.fBuffer);
+    do {
+        n = recvmsg(sock, &msg, 0);
+    } while (n == -1 && errno == EINTR);
+    if (n <= 0) {
+        return false;
+    }
+    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            count = (int)((cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+            for (i = 0; i < count && *fdCount < kLauncherMaxDescriptors; i++) {
+                memcpy(&fds[*fdCount], CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+                fcntl(fds[*fdCount], F_SETFD, FD_CLOEXEC);
+                (*fdCount)++;
+            }
+        }
+    }
+    if (! ReadFully(sock, (char *)header + n, sizeof(*header) - (size_t)n)) {
+        for (i = 0; i < *fdCount; i++) {
+            close(fds[i]);
+        }
+        return false;
+    }
+    return true;
+}
+
+static void LauncherSignalHandler(int sig)
+{
+    int savedErrno = errno;
+    
+    (void)sig;
+    (void)write(gLauncherWakeFd, "", 1);
+    errno = savedErrno;
+}
+
+/// Reap the scripts the plugin waits for that have exited, and report
+/// them to the plugin.
+static void LauncherReapChildren(int sock)
+{
+    LauncherExitedMessage message;
+    struct rusage usage;
+    int status;
+    pid_t pid;
+    int i;
+    
+    i = 0;
+    while (i < gLauncherReapCount) {
+        pid = wait4(gLauncherReaps[i], &status, WNOHANG, &usage);
+        if (pid == -1 && errno == EINTR) {
+            continue;
+        }
+        if (pid == 0) {
+            i++;
+            continue;
+        }
+        memset(&message, 0, sizeof(message));
+        if (pid == -1) {
+            message.fError = errno;
+        } else {
+            message.fStatus = status;
+            message.fUserTime = usage.ru_utime;
+            message.fSystemTime = usage.ru_stime;
+        }
+        pid = gLauncherReaps[i];
+        gLauncherReaps[i] = gLauncherReaps[--gLauncherReapCount];
+        if (! LauncherSend(sock, kLauncherExited, pid, &message, sizeof(message), NULL, 0)) {
+            _exit(EX_IOERR);
+        }
+    }
+}
+
+/// Reap the script pid for the plugin once it has exited.
+static void LauncherHandleReap(int sock, pid_t pid)
+{
+    LauncherExitedMessage message;
+    
+    if (gLauncherReapCount == kLauncherMaxReaps) {
+        memset(&message, 0, sizeof(message));
+        message.fError = EAGAIN;
+        if (! LauncherSend(sock, kLauncherExited, pid, &message, sizeof(message), NULL, 0)) {
+            _exit(EX_IOERR);
+        }
+        return;
+    }
+    gLauncherReaps[gLauncherReapCount++] = pid;
+    LauncherReapChildren(sock);
+}
+
+/// Start the script described by a kLauncherSpawn payload and report its
+/// pid to the plugin. The descriptors in fds are closed when the script
+/// has been started.
+static void LauncherHandleSpawn(int sock, int wakeReadFd, int32_t serial, char *payload, uint32_t length, const int *fds, int fdCount)
+{
+    static char *argv[kLauncherMaxStrings + 1];
+    static char *envp[kLauncherMaxStrings + 1];
+    LauncherSpawnMessage *message;
+    LauncherStartedMessage reply;
+    SpawnRequest request;
+    sigset_t signalMask;
+    char *p;
+    char *end;
+    uint32_t i;
+    int expected;
+    int fd;
+    
+    reply.fPid = -1;
+    reply.fError = EINVAL;
+    
+    message = (LauncherSpawnMessage *)payload;
+    p = payload + sizeof(*message);
+    end = payload + length;
+    if (length < sizeof(*message)
+        || message->fArgc > kLauncherMaxStrings
+        || message->fEnvc > kLauncherMaxStrings
+        || length == 0 || payload[length - 1] != '\0') {
+        goto reply;
+    }
+    
+    // Match the passed descriptors with their roles.
+    expected = ((message->fFlags & kLauncherHasOutputFd) != 0) + ((message->fFlags & kLauncherHasNotifyFd) != 0);
+    if (fdCount != expected) {
+        goto reply;
+    }
+    fd = 0;
+    request.fOutputFd = (message->fFlags & kLauncherHasOutputFd) ? fds[fd++] : -1;
+    request.fNotifyFd = (message->fFlags & kLauncherHasNotifyFd) ? fds[fd++] : -1;
+    
+    // Split the string table into path, argv and envp.
+    request.fPath = p;
+    p += strlen(p) + 1;
+    for (i = 0; i < message->fArgc; i++) {
+        if (p >= end) {
+            goto reply;
+        }
+        argv[i] = p;
+        p += strlen(p) + 1;
+    }
+    argv[i] = NULL;
+    for (i = 0; i < message->fEnvc; i++) {
+        if (p >= end) {
+            goto reply;
+        }
+        envp[i] = p;
+        p += strlen(p) + 1;
+    }
+    envp[i] = NULL;
+    
+    request.fArgv = argv;
+    request.fEnvp = envp;
+    request.fUid = message->fUid;
+    request.fGid = message->fGid;
+    request.fContext = (userContext)message->fContext;
+    request.fLimits = message->fLimits;
+    request.fPriority = (scriptPriority)message->fPriority;
+    
+    reply.fPid = fork();
+    if (reply.fPid == 0) {
+        // Child, restore the signal state inherited from the plugin host.
+        close(sock);
+        close(wakeReadFd);
+        close(gLauncherWakeFd);
+        signal(SIGCHLD, SIG_DFL);
+        sigemptyset(&signalMask);
+        sigprocmask(SIG_SETMASK, &signalMask, NULL);
+        ExecChild(&request, NULL);
+    }
+    reply.fError = reply.fPid == -1 ? errno : 0;
+    if (reply.fPid > 0) {
+        (void)setpgid(reply.fPid, reply.fPid);
+    }
+    
+reply:
+    for (fd = 0; fd < fdCount; fd++) {
+        close(fds[fd]);
+    }
+    if (! LauncherSend(sock, kLauncherStarted, serial, &reply, sizeof(reply), NULL, 0)) {
+        _exit(EX_IOERR);
+    }
+}
+
+/// Main loop of the launcher process. Exits when the plugin closes its
+/// end of the socket.
+static void LauncherMain(int sock)
+{
+    static char payload[kLauncherMaxMessage];
+    LauncherHeader header;
+    struct sigaction action;
+    struct pollfd fds[2];
+    sigset_t signalMask;
+    int wakeFds[2];
+    char drain[64];
+    int passedFds[kLauncherMaxDescriptors];
+    int passedFdCount;
+    int fd;
+    
+    // Close everything inherited from the plugin host. This is safe as
+    // the launcher never calls into libdispatch.
+    SanitizeDescriptors(STDERR_FILENO + 1, sock, kDescriptorClose, &fd);
+    
+    // Wake up the main loop whenever a script exits.
+    if (pipe(wakeFds) != 0) {
+        _exit(EX_OSERR);
+    }
+    fcntl(wakeFds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(wakeFds[1], F_SETFD, FD_CLOEXEC);
+    fcntl(wakeFds[0], F_SETFL, O_NONBLOCK);
+    fcntl(wakeFds[1], F_SETFL, O_NONBLOCK);
+    gLauncherWakeFd = wakeFds[1];
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = LauncherSignalHandler;
+    action.sa_flags = SA_NOCLDSTOP;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGCHLD, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+    sigemptyset(&signalMask);
+    sigaddset(&signalMask, SIGCHLD);
+    sigprocmask(SIG_UNBLOCK, &signalMask, NULL);
+    
+    fds[0].fd = sock;
+    fds[0].events = POLLIN;
+    fds[1].fd = wakeFds[0];
+    fds[1].events = POLLIN;
+    
+    for (;;) {
+        if (poll(fds, 2, -1) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            _exit(EX_OSERR);
+        }
+        
+        if (fds[1].revents & POLLIN) {
+            while (read(wakeFds[0], drain, sizeof(drain)) > 0) {
+                ;
+            }
+            LauncherReapChildren(sock);
+        }
+        
+        if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+            if (! LauncherReceiveHeader(sock, &header, passedFds, &passedFdCount)) {
+                // The plugin is gone.
+                _exit(EX_OK);
+            }
+            if (header.fType == kLauncherReap && header.fLength == 0 && passedFdCount == 0) {
+                LauncherHandleReap(sock, header.fKey);
+                continue;
+            }
+            if (header.fType != kLauncherSpawn || header.fLength > sizeof(payload)) {
+                _exit(EX_PROTOCOL);
+            }
+            if (! ReadFully(sock, payload, header.fLength)) {
+                _exit(EX_OK);
+            }
+            LauncherHandleSpawn(sock, wakeFds[0], header.fKey, payload, header.fLength, passedFds, passedFdCount);
+        }
+    }
+}
+
+/// Fork the launcher process.
+///
+/// Must be called with the launcher lock held, or before the plugin is
+/// published.
+bool StartLauncher(PluginRecord *plugin)
+{
+    LauncherRecord *launcher = &plugin->fLauncher;
+    int fds[2];
+    int on = 1;
+    pid_t pid;
+    
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+        asl_log(plugin->fLogClient, NULL, ASL_LEVEL_ERR,
+                "Creating launcher socket failed with errno %d", errno);
+        return false;
+    }
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    setsockopt(fds[0], SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+    
+    pid = fork();
+    if (pid == -1) {
+        asl_log(plugin->fLogClient, NULL, ASL_LEVEL_ERR,
+                "Forking launcher failed with errno %d", errno);
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    } else if (pid == 0) {
+        LauncherMain(fds[1]);
+    }
+    
+    close(fds[1]);
+    launcher->fPid = pid;
+    launcher->fSocket = fds[0];
+    
+    asl_log(plugin->fLogClient, NULL, ASL_LEVEL_DEBUG,
+            "Started launcher with pid %d", pid);
+    
+    return true;
+}
+
+/// Append a reply to the queue of unclaimed launcher replies.
+static bool LauncherQueueReply(LauncherRecord *launcher, const LauncherReply *reply)
+{
+    LauncherReply *replies;
+    size_t capacity;
+    
+    if (launcher->fReplyCount == launcher->fReplyCapacity) {
+        capacity = launcher->fReplyCapacity ? launcher->fReplyCapacity * 2 : 8;
+        replies = realloc(launcher->fReplies, capacity * sizeof(*replies));
+        if (replies == NULL) {
+            return false;
+        }
+        launcher->fReplies = replies;
+        launcher->fReplyCapacity = capacity;
+    }
+    launcher->fReplies[launcher->fReplyCount++] = *reply;
+    return true;
+}
+
+/// Remove and return the queued reply with the given type and key.
+static bool LauncherClaimReply(LauncherRecord *launcher, uint32_t type, int32_t key, LauncherReply *reply)
+{
+    size_t i;
+    
+    for (i = 0; i < launcher->fReplyCount; i++) {
+        if (launcher->fReplies[i].fType == type && launcher->fReplies[i].fKey == key) {
+            *reply = launcher->fReplies[i];
+            launcher->fReplies[i] = launcher->fReplies[--launcher->fReplyCount];
+            return true;
+        }
+    }
+    return false;
+}
+
+/// Add or remove pid from the list of scripts owned by the launcher.
+static void LauncherTrackChild(LauncherRecord *launcher, pid_t pid, bool running)
+{
+    pid_t *children;
+    size_t capacity;
+    size_t i;
+    
+    if (running) {
+        if (launcher->fChildCount == launcher->fChildCapacity) {
+            capacity = launcher->fChildCapacity ? launcher->fChildCapacity * 2 : 8;
+            children = realloc(launcher->fChildren, capacity * sizeof(*children));
+            if (children == NULL) {
+                return;
+            }
+            launcher->fChildren = children;
+            launcher->fChildCapacity = capacity;
+        }
+        launcher->fChildren[launcher->fChildCount++] = pid;
+    } else {
+        for (i = 0; i < launcher->fChildCount; i++) {
+            if (launcher->fChildren[i] == pid) {
+                launcher->fChildren[i] = launcher->fChildren[--launcher->fChildCount];
+                return;
+            }
+        }
+    }
+}
+
+/// Forget about a launcher that has exited or stopped responding.
+///
+/// Scripts it had started are reported as lost to their waiters, and a
+/// new launcher is started on the next spawn request. Must be called
+/// with the launcher lock held.
+static void LauncherDied(PluginRecord *plugin)
+{
+    LauncherRecord *launcher = &plugin->fLauncher;
+    LauncherReply lost;
+    size_t i;
+    
+    asl_log(plugin->fLogClient, NULL, ASL_LEVEL_WARNING,
+            "Launcher with pid %d died, it will be restarted", launcher->fPid);
+    
+    close(launcher->fSocket);
+    kill(launcher->fPid, SIGKILL);
+    while (waitpid(launcher->fPid, NULL, 0) == -1 && errno == EINTR) {
+        ;
+    }
+    launcher->fPid = -1;
+    launcher->fSocket = -1;
+    launcher->fGeneration++;
+    
+    memset(&lost, 0, sizeof(lost));
+    lost.fType = kLauncherExited;
+    lost.fError = ECHILD;
+    for (i = 0; i < launcher->fChildCount; i++) {
+        lost.fKey = launcher->fChildren[i];
+        LauncherQueueReply(launcher, &lost);
+    }
+    launcher->fChildCount = 0;
+    
+    pthread_cond_broadcast(&launcher->fCondition);
+}
+
+/// Wait for the launcher reply with the given type and key.
+///
+/// Must be called with the launcher lock held. The lock is released
+/// while reading from the socket.
+///
+/// @return false if the launcher started as generation died before the
+///         reply arrived.
+static bool LauncherAwaitReply(PluginRecord *plugin, uint32_t type, int32_t key, uint32_t generation, LauncherReply *reply)
+{
+    LauncherRecord *launcher = &plugin->fLauncher;
+    LauncherHeader header;
+    LauncherStartedMessage started;
+    LauncherExitedMessage exited;
+    LauncherReply incoming;
+    bool ok;
+    int sock;
+    
+    for (;;) {
+        if (LauncherClaimReply(launcher, type, key, reply)) {
+            return true;
+        }
+        if (launcher->fGeneration != generation) {
+            return false;
+        }
+        if (launcher->fReading) {
+            pthread_cond_wait(&launcher->fCondition, &launcher->fLock);
+            continue;
+        }
+        
+        // Read the next message on behalf of all waiting threads.
+        launcher->fReading = true;
+        sock = launcher->fSocket;
+        pthread_mutex_unlock(&launcher->fLock);
+        
+        memset(&incoming, 0, sizeof(incoming));
+        ok = ReadFully(sock, &header, sizeof(header));
+        if (ok && header.fType == kLauncherStarted && header.fLength == sizeof(started)) {
+            ok = ReadFully(sock, &started, sizeof(started));
+            incoming.fValue = started.fPid;
+            incoming.fError = started.fError;
+        } else if (ok && header.fType == kLauncherExited && header.fLength == sizeof(exited)) {
+            ok = ReadFully(sock, &exited, sizeof(exited));
+            incoming.fError = exited.fError;
+            incoming.fValue = exited.fStatus;
+            incoming.fUserTime = exited.fUserTime;
+            incoming.fSystemTime = exited.fSystemTime;
+        } else {
+            ok = false;
+        }
+        incoming.fType = header.fType;
+        incoming.fKey = header.fKey;
+        
+        pthread_mutex_lock(&launcher->fLock);
+        launcher->fReading = false;
+        if (ok) {
+            if (incoming.fType == kLauncherStarted && incoming.fValue != -1) {
+                LauncherTrackChild(launcher, incoming.fValue, true);
+            } else if (incoming.fType == kLauncherExited) {
+                LauncherTrackChild(launcher, incoming.fKey, false);
+            }
+            LauncherQueueReply(launcher, &incoming);
+        } else if (launcher->fGeneration == generation) {
+            LauncherDied(plugin);
+        }
+        pthread_cond_broadcast(&launcher->fCondition);
+    }
+}
+
+/// Serialize request as a kLauncherSpawn payload.
+///
+/// @return A buffer to be released with free(), or NULL if the request
+///         doesn't fit in a launcher message.
+static char *LauncherEncodeSpawn(const SpawnRequest *request, uint32_t *length)
+{
+    LauncherSpawnMessage message;
+    size_t size;
+    size_t i;
+    char *buffer;
+    char *p;
+    
+    memset(&message, 0, sizeof(message));
+    size = sizeof(message) + strlen(request->fPath) + 1;
+    for (i = 0; request->fArgv[i] != NULL; i++) {
+        size += strlen(request->fArgv[i]) + 1;
+    }
+    message.fArgc = (uint32_t)i;
+    for (i = 0; request->fEnvp[i] != NULL; i++) {
+        size += strlen(request->fEnvp[i]) + 1;
+    }
+    message.fEnvc = (uint32_t)i;
+    if (size > kLauncherMaxMessage
+        || message.fArgc > kLauncherMaxStrings
+        || message.fEnvc > kLauncherMaxStrings) {
+        errno = E2BIG;
+        return NULL;
+    }
+    
+    if ((buffer = malloc(size)) == NULL) {
+        return NULL;
+    }
+    message.fUid = request->fUid;
+    message.fGid = request->fGid;
+    message.fContext = request->fContext;
+    message.fFlags = (request->fOutputFd != -1 ? kLauncherHasOutputFd : 0)
+                   | (request->fNotifyFd != -1 ? kLauncherHasNotifyFd : 0);
+    message.fLimits = request->fLimits;
+    message.fPriority = request->fPriority;
+    memcpy(buffer, &message, sizeof(message));
+    p = buffer + sizeof(message);
+    p = stpcpy(p, request->fPath) + 1;
+    for (i = 0; request->fArgv[i] != NULL; i++) {
+        p = stpcpy(p, request->fArgv[i]) + 1;
+    }
+    for (i = 0; request->fEnvp[i] != NULL; i++) {
+        p = stpcpy(p, request->fEnvp[i]) + 1;
+    }
+    *length = (uint32_t)size;
+    return buffer;
+}
+
+/// Spawn a script through the launcher process, restarting the launcher
+/// if it has died. Falls back to ForkSpawn() if no launcher can be
+/// started.
+static pid_t LauncherSpawn(PluginRecord *plugin, const SpawnRequest *request)
+{
+    LauncherRecord *launcher = &plugin->fLauncher;
+    LauncherReply reply;
+    uint32_t generation;
+    uint32_t length;
+    int32_t serial;
+    char *payload;
+    int attempt;
+    int fds[kLauncherMaxDescriptors];
+    int fdCount;
+    
+    if ((payload = LauncherEncodeSpawn(request, &length)) == NULL) {
+        return -1;
+    }
+    fdCount = 0;
+    if (request->fOutputFd != -1) {
+        fds[fdCount++] = request->fOutputFd;
+    }
+    if (request->fNotifyFd != -1) {
+        fds[fdCount++] = request->fNotifyFd;
+    }
+    
+    pthread_mutex_lock(&launcher->fLock);
+    for (attempt = 0; attempt < 2; attempt++) {
+        if (launcher->fPid == -1 && ! StartLauncher(plugin)) {
+            break;
+        }
+        generation = launcher->fGeneration;
+        serial = (int32_t)++launcher->fSerial;
+        if (! LauncherSend(launcher->fSocket, kLauncherSpawn, serial, payload, length, fds, fdCount)) {
+            LauncherDied(plugin);
+            continue;
+        }
+        if (! LauncherAwaitReply(plugin, kLauncherStarted, serial, generation, &reply)) {
+            continue;
+        }
+        pthread_mutex_unlock(&launcher->fLock);
+        free(payload);
+        if (reply.fValue == -1) {
+            errno = reply.fError;
+        }
+        return reply.fValue;
+    }
+    pthread_mutex_unlock(&launcher->fLock);
+    free(payload);
+    
+    asl_log(plugin->fLogClient, NULL, ASL_LEVEL_WARNING,
+            "Launcher unavailable, forking %s", request->fPath);
+    return ForkSpawn(plugin, request);
+}
+
+/// Wait for a script started by the launcher, or by the ForkSpawn()
+/// fallback, to exit, and have it reaped.
+static int LauncherWait(PluginRecord *plugin, pid_t pid, SpawnStatus *status)
+{
+    LauncherRecord *launcher = &plugin->fLauncher;
+    LauncherReply reply;
+    bool found;
+    size_t i;
+    
+    pthread_mutex_lock(&launcher->fLock);
+    found = false;
+    for (i = 0; i < launcher->fChildCount; i++) {
+        found = found || launcher->fChildren[i] == pid;
+    }
+    if (! found && ! LauncherClaimReply(launcher, kLauncherExited, pid, &reply)) {
+        // Not one of the launcher's, so it must be our own child.
+        pthread_mutex_unlock(&launcher->fLock);
+        return LocalWait(plugin, pid, status);
+    }
+    if (found && ! LauncherSend(launcher->fSocket, kLauncherReap, pid, NULL, 0, NULL, 0)) {
+        // Its scripts are reported as lost.
+        LauncherDied(plugin);
+    }
+    if (! found || LauncherAwaitReply(plugin, kLauncherExited, pid, launcher->fGeneration, &reply)) {
+        pthread_mutex_unlock(&launcher->fLock);
+        if (reply.fError != 0) {
+            errno = reply.fError;
+            return -1;
+        }
+        status->fStatus = reply.fValue;
+        status->fUserTime = reply.fUserTime;
+        status->fSystemTime = reply.fSystemTime;
+        return 0;
+    }
+    pthread_mutex_unlock(&launcher->fLock);
+    errno = ECHILD;
+    return -1;
+}
+
+/// Shut down the launcher. Scripts it has started keep running.
+void StopLauncher(PluginRecord *plugin)
+{
+    LauncherRecord *launcher = &plugin->fLauncher;
+    
+    pthread_mutex_lock(&launcher->fLock);
+    if (launcher->fPid != -1) {
+        // The launcher exits when it sees the end of the stream.
+        close(launcher->fSocket);
+        while (waitpid(launcher->fPid, NULL, 0) == -1 && errno == EINTR) {
+            ;
+        }
+        launcher->fPid = -1;
+        launcher->fSocket = -1;
+    }
+    free(launcher->fReplies);
+    free(launcher->fChildren);
+    launcher->fReplies = NULL;
+    launcher->fChildren = NULL;
+    launcher->fReplyCount = launcher->fReplyCapacity = 0;
+    launcher->fChildCount = launcher->fChildCapacity = 0;
+    pthread_mutex_unlock(&launcher->fLock);
+    
+    pthread_cond_destroy(&launcher->fCondition);
+    pthread_mutex_destroy(&launcher->fLock);
+}
+
+const SpawnBackend kLauncherBackend = { "launcher", &LauncherSpawn, &LauncherWait };
+static const SpawnBackend kForkBackend = { "fork", &ForkSpawn, &LocalWait };
+static const SpawnBackend kPosixSpawnBackend = { "posix_spawn", &PosixSpawn, &LocalWait };
+
+/// Look up a spawn backend by the name used in the manifest.
+const SpawnBackend *SpawnBackendNamed(const char *name)
+{
+    if (strcmp(name, kLauncherBackend.fName) == 0) {
+        return &kLauncherBackend;
+    } else if (strcmp(name, kForkBackend.fName) == 0) {
+        return &kForkBackend;
+    } else if (strcmp(name, kPosixSpawnBackend.fName) == 0) {
+        return &kPosixSpawnBackend;
+    }
+    return NULL;
+}
@@ -0,0 +1,54 @@
+//
+//  Launcher.h
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+#ifndef __LoginScriptPlugin__Launcher__
+#define __LoginScriptPlugin__Launcher__
+
+#include "Common.h"
+#include "Spawn.h"
+
+extern const SpawnBackend kLauncherBackend;
+
+/// LauncherReply is a message from the launcher that hasn't been claimed
+/// by the thread waiting for it yet.
+typedef struct {
+    uint32_t fType;
+    int32_t fKey;          // request serial or pid, depending on fType
+    int32_t fValue;        // pid or wait status
+    int32_t fError;
+    struct timeval fUserTime;
+    struct timeval fSystemTime;
+} LauncherReply;
+
+/// LauncherRecord tracks the pre-forked launcher process.
+///
+/// The launcher is forked from the plugin host while it's still small,
+/// and creates all script processes on behalf of the plugin. Any thread
+/// may read from the socket, but only one at a time; replies meant for
+/// other threads are queued in fReplies and announced with fCondition.
+typedef struct {
+    pthread_mutex_t fLock;
+    pthread_cond_t fCondition;
+    pid_t fPid;            // -1 if the launcher isn't running
+    int fSocket;
+    uint32_t fGeneration;  // incremented every time the launcher dies
+    uint32_t fSerial;
+    bool fReading;
+    pid_t *fChildren;      // scripts started by the launcher that haven't been reaped
+    size_t fChildCount;
+    size_t fChildCapacity;
+    LauncherReply *fReplies;
+    size_t fReplyCount;
+    size_t fReplyCapacity;
+} LauncherRecord;
+
+bool WriteFully(int fd, const void *buf, size_t len);
+bool StartLauncher(PluginRecord *plugin);
+void StopLauncher(PluginRecord *plugin);
+const SpawnBackend *SpawnBackendNamed(const char *name);
+
+#endif /* defined(__LoginScriptPlugin__Launcher__) */
@@ -0,0 +1,88 @@
+//
+//  LeftoverProcesses.c
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+#include "LeftoverProcesses.h"
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Leftover Processes
+/////////////////////////////////////////////////////////////////////
+
+
+enum {
+    kProcessListSize = 1024
+};
+
+/// Return the number of processes in the process group pgid other than
+/// its leader, or -1 if they can't be listed.
+static int CountProcessGroup(pid_t pgid)
+{
+    pid_t pids[kProcessListSize];
+    int size;
+    int count;
+    int i;
+    
+    size = proc_listpids(PROC_PGRP_ONLY, (uint32_t)pgid, pids, sizeof(pids));
+    if (size < 0) {
+        return -1;
+    }
+    count = 0;
+    for (i = 0; i < size / (int)sizeof(pids[0]); i++) {
+        if (pids[i] != 0 && pids[i] != pgid) {
+            count++;
+        }
+    }
+    return count;
+}
+
+/// Log, and optionally kill, the processes the script at path left behind
+/// in its process group.
+///
+/// Must be called after the script has exited but before it is reaped,
+/// so that the group id can't have been reused. Processes that moved to a
+/// group or session of their own aren't found.
+void CleanUpProcessGroup(pid_t pgid, const char *path, bool kill, aslclient logClient)
+{
+    int count;
+    
+    count = CountProcessGroup(pgid);
+    if (count == -1) {
+        asl_log(logClient, NULL, ASL_LEVEL_WARNING,
+                "Listing the processes left behind by %s failed with errno %d", path, errno);
+    } else if (count > 0) {
+        asl_log(logClient, NULL, ASL_LEVEL_NOTICE,
+                "%s left %d processes behind%s", path, count, kill ? ", killing them" : "");
+    }
+    if (kill && count != 0 && killpg(pgid, SIGKILL) == -1 && errno != ESRCH) {
+        asl_log(logClient, NULL, ASL_LEVEL_WARNING,
+                "Killing the processes left behind by %s failed with errno %d", path, errno);
+    }
+}
+
+/// Return the physical footprint of the processes in the process group
+/// pgid in bytes, or -1 if they can't be listed.
+int64_t ProcessGroupFootprint(pid_t pgid)
+{
+    pid_t pids[kProcessListSize];
+    struct rusage_info_v2 info;
+    int64_t footprint;
+    int size;
+    int i;
+    
+    size = proc_listpids(PROC_PGRP_ONLY, (uint32_t)pgid, pids, sizeof(pids));
+    if (size < 0) {
+        return -1;
+    }
+    footprint = 0;
+    for (i = 0; i < size / (int)sizeof(pids[0]); i++) {
+        if (pids[i] != 0 && proc_pid_rusage(pids[i], RUSAGE_INFO_V2, (rusage_info_t *)&info) == 0) {
+            footprint += (int64_t)info.ri_phys_footprint;
+        }
+    }
+    return footprint;
+}
@@ -0,0 +1,16 @@
+//
+//  LeftoverProcesses.h
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+#ifndef __LoginScriptPlugin__LeftoverProcesses__
+#define __LoginScriptPlugin__LeftoverProcesses__
+
+#include "Common.h"
+
+void CleanUpProcessGroup(pid_t pgid, const char *path, bool kill, aslclient logClient);
+int64_t ProcessGroupFootprint(pid_t pgid);
+
+#endif /* defined(__LoginScriptPlugin__LeftoverProcesses__) */
@@ -0,0 +1,115 @@
+//
+//  LoginRequests.c
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+#include "LoginRequests.h"
+
+#include "EventLoop.h"
+#include "ScriptExecution.h"
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Login Requests
+/////////////////////////////////////////////////////////////////////
+
+
+/// Resident workers and the policy service are told about a login with
+/// "login <length>\n" followed by length bytes of "key=value\n" lines with
+/// the uid, gid, home, phase and context, and answer with a line reading
+/// "allow" or "deny".
+
+/// Return the login request for invocation, and its length in length.
+///
+/// @return The request, which must be released with free(), or NULL if
+///         memory allocation failed.
+char *FormatLoginRequest(const InvocationRecord *invocation, size_t *length)
+{
+    char *payload;
+    char *request;
+    int n;
+    
+    n = asprintf(&payload, "uid=%s\ngid=%s\nhome=%s\nphase=%s\ncontext=%s\n",
+                 invocation->fUidStr, invocation->fGidStr, invocation->fHome,
+                 invocation->fPhase == kRunBeforeHomedirMount ? "premount" : "postmount",
+                 invocation->fContext == kRunAsRoot ? "root" : "user");
+    if (n == -1) {
+        return NULL;
+    }
+    n = asprintf(&request, "login %d\n%s", n, payload);
+    free(payload);
+    if (n == -1) {
+        return NULL;
+    }
+    *length = (size_t)n;
+    return request;
+}
+
+/// Return how many milliseconds to wait for the answer to a login request
+/// of invocation: seconds, but no longer than the login budget allows.
+long LoginRequestTimeout(const InvocationRecord *invocation, long seconds)
+{
+    long timeout = seconds * 1000L;
+    
+    if (invocation->fDeadline.tv_sec != 0 && TimeUntil(&invocation->fDeadline) < timeout) {
+        timeout = TimeUntil(&invocation->fDeadline);
+    }
+    return timeout;
+}
+
+/// Read the answer to a login request from fd, giving up after timeout
+/// milliseconds.
+///
+/// @return false if there was no complete answer in time.
+bool ReadLoginReply(int fd, long timeout, char *reply, size_t size)
+{
+    struct timeval deadline;
+    struct pollfd pfd;
+    size_t length;
+    ssize_t n;
+    long left;
+    int ready;
+    
+    gettimeofday(&deadline, NULL);
+    deadline.tv_sec += timeout / 1000;
+    deadline.tv_usec += (timeout % 1000) * 1000;
+    if (deadline.tv_usec >= 1000000) {
+        deadline.tv_sec++;
+        deadline.tv_usec -= 1000000;
+    }
+    
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    length = 0;
+    while (length < size - 1) {
+        if ((left = TimeUntil(&deadline)) <= 0) {
+            errno = ETIMEDOUT;
+            return false;
+        }
+        ready = poll(&pfd, 1, (int)left);
+        if (ready == -1 && errno != EINTR) {
+            return false;
+        }
+        if (ready <= 0) {
+            continue;
+        }
+        n = read(fd, reply + length, 1);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            errno = n == 0 ? EPIPE : errno;
+            return false;
+        }
+        if (reply[length] == '\n') {
+            reply[length] = '\0';
+            return true;
+        }
+        length++;
+    }
+    errno = EPROTO;
+    return false;
+}
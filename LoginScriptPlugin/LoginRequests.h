@@ -0,0 +1,21 @@
+//
+//  LoginRequests.h
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+#ifndef __LoginScriptPlugin__LoginRequests__
+#define __LoginScriptPlugin__LoginRequests__
+
+#include "Common.h"
+
+enum {
+    kMaxLoginReply = 64
+};
+
+char *FormatLoginRequest(const InvocationRecord *invocation, size_t *length);
+long LoginRequestTimeout(const InvocationRecord *invocation, long seconds);
+bool ReadLoginReply(int fd, long timeout, char *reply, size_t size);
+
+#endif /* defined(__LoginScriptPlugin__LoginRequests__) */
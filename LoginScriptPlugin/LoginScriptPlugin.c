@@ -6,29 +6,23 @@
 //  Copyright (c) 2014 Göteborgs universitet. All rights reserved.
 //
 
-#include <Security/AuthorizationPlugin.h>
-#include <Security/AuthSession.h>
-#include <Security/AuthorizationTags.h>
-
-#include <stdlib.h>
-#include <asl.h>
-#include <syslog.h>
-#include <unistd.h>
-#include <fcntl.h>
-#include <string.h>
-#include <assert.h>
-#include <glob.h>
-#include <sys/wait.h>
-#include <sys/errno.h>
-#include <sys/stat.h>
-#include <sys/param.h>
-#include <libgen.h>
-#include <sysexits.h>
-#include <pthread.h>
-
-
 #include "LoginScriptPlugin.h"
 
+#include "BackgroundReaper.h"
+#include "DurationHistory.h"
+#include "EarlyLaunch.h"
+#include "EventLoop.h"
+#include "Launcher.h"
+#include "LoginSessions.h"
+#include "Manifest.h"
+#include "PolicyService.h"
+#include "ResidentWorkers.h"
+#include "ScriptExecution.h"
+#include "SessionSpool.h"
+#include "Spawn.h"
+#include "SystemPressure.h"
+#include "WorkerPool.h"
+
 
 
 /////////////////////////////////////////////////////////////////////
@@ -36,51 +30,17 @@
 /////////////////////////////////////////////////////////////////////
 
 
-static const char *kLoginScriptDir = "/Library/Application Support/LoginScriptPlugin";
+const char *kLoginScriptDir = "/Library/Application Support/LoginScriptPlugin";
+const char *kManifestName = "manifest";
+const char *kLockNameCharacters = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789._-";
 
 
 
 /////////////////////////////////////////////////////////////////////
-#pragma mark ***** Core Data Structures
+#pragma mark ***** Mechanism Entry Points
 /////////////////////////////////////////////////////////////////////
 
 
-typedef struct PluginRecord PluginRecord;           // forward decl
-
-
-#pragma mark *     Mechanism
-
-typedef enum {
-    kRunAsRoot,
-    kRunAsUser
-} userContext;
-
-typedef enum {
-    kRunBeforeHomedirMount,
-    kRunAfterHomedirMount
-} scriptPhase;
-
-enum {
-    kMechanismMagic = 'MLSP'
-};
-
-/// MechanismRecord is the per-mechanism data structure.
-///
-/// One of these
-/// is created for each mechanism that's instantiated, and holds all
-/// of the data needed to run that mechanism.
-///
-/// Mechanisms are single threaded; the code does not have to guard
-/// against multiple threads running inside the mechanism simultaneously.
-struct MechanismRecord {
-    OSType fMagic;         // must be kMechanismMagic
-    AuthorizationEngineRef fEngine;
-    const PluginRecord *fPlugin;
-    userContext fContext;
-    scriptPhase fPhase;
-};
-typedef struct MechanismRecord MechanismRecord;
-
 static Boolean MechanismValid(const MechanismRecord *mechanism)
 {
     return (mechanism != NULL)
@@ -89,24 +49,6 @@ static Boolean MechanismValid(const MechanismRecord *mechanism)
     && (mechanism->fPlugin != NULL);
 }
 
-
-#pragma mark *     Plugin
-
-enum {
-    kPluginMagic = 'PLSP'
-};
-
-/// PluginRecord is the per-plugin data structure.
-///
-/// As a plugin may host multiple mechanism, and there's no guarantee
-/// that these mechanisms won't be running on different threads, data
-/// in this record should be protected from multiple concurrent access.
-struct PluginRecord {
-    OSType fMagic;         // must be kPluginMagic
-    const AuthorizationCallbacks *fCallbacks;
-    aslclient fLogClient;
-};
-
 static Boolean PluginValid(const PluginRecord *plugin)
 {
     return (plugin != NULL)
@@ -116,13 +58,6 @@ static Boolean PluginValid(const PluginRecord *plugin)
     && (plugin->fLogClient != NULL);
 }
 
-
-
-/////////////////////////////////////////////////////////////////////
-#pragma mark ***** Mechanism Entry Points
-/////////////////////////////////////////////////////////////////////
-
-
 /// Called by the plugin host to create a mechanism, that is, a specific
 /// instance of authentication.
 ///
@@ -203,6 +138,8 @@ static OSStatus MechanismCreate(AuthorizationPluginRef inPlugin,
     mechanism->fPlugin = plugin;
     mechanism->fContext = context;
     mechanism->fPhase = phase;
+    mechanism->fJoinedSession = false;
+    mechanism->fSessionUid = (uid_t)-1;
     
     *outMechanism = mechanism;
     
@@ -240,13 +177,14 @@ static bool GetParentDir(const char *path, char **parent) {
     return true;
 }
 
-/// Verify that a script is suitable for launching as root.
+/// Verify that a file is trusted enough to act on as root.
 ///
-/// The script itself and its containing directories should all be owned
+/// The file itself and its containing directories should all be owned
 /// by root, and not writable by anyone other than root:wheel or root:admin.
 /// The path should be absolute, on the boot volume, and must not contain
-/// any symbolic links.
-static bool VerifyScript(const char *path, aslclient logClient)
+/// any symbolic links. If executable is true the file must also be
+/// executable by its owner.
+bool VerifyPath(const char *path, bool executable, aslclient logClient)
 {
     struct stat info;
     struct stat rootInfo;
@@ -298,7 +236,7 @@ static bool VerifyScript(const char *path, aslclient logClient)
     }
     
     // Path must be executable.
-    if (! (info.st_mode & S_IXUSR)) {
+    if (executable && ! (info.st_mode & S_IXUSR)) {
         asl_log(logClient, NULL, ASL_LEVEL_WARNING, "%s isn't executable", path);
         pathOK = false;
     }
@@ -321,116 +259,19 @@ static bool VerifyScript(const char *path, aslclient logClient)
             return false;
         }
         
-        pathOK = VerifyScript(parent, logClient) && pathOK;
+        pathOK = VerifyPath(parent, true, logClient) && pathOK;
         free(parent);
         return pathOK;
     }
 }
 
-/// Execute the script at path as uid/gid.
-///
-/// Fail authorization if the script exits with EX_NOPERM, otherwise proceed.
-static AuthorizationResult ExecuteScript(const char *path,
-                                         uid_t uid,
-                                         gid_t gid,
-                                         const char *home,
-                                         userContext context,
-                                         aslclient logClient)
+/// Verify that a script is suitable for launching as root.
+bool VerifyScript(const char *path, aslclient logClient)
 {
-    AuthorizationResult result;
-    pid_t childPid;
-    int childStatus;
-    long maxfd;
-    long fd;
-    char uidStr[3 * sizeof(uid_t) + 1];
-    char gidStr[3 * sizeof(gid_t) + 1];
-    char cfUserTextEncoding[2 * sizeof(uid_t) + 7];
-    
-    result = kAuthorizationResultAllow;
-    
-    if (! VerifyScript(path, logClient)) {
-        asl_log(logClient, NULL, ASL_LEVEL_WARNING,
-                "Not executing %s", path);
-        return result;
-    }
-    
-    asl_log(logClient, NULL, ASL_LEVEL_NOTICE,
-            "Executing %s with uid=%d, gid=%d, home='%s'", path, uid, gid, home);
-    
-    childPid = fork();
-    if (childPid == -1) {
-        // Error.
-        asl_log(logClient, NULL, ASL_LEVEL_WARNING,
-                "Fork failed with errno %d", errno);
-    } else if (childPid == 0) {
-        // Child.
-#warning REVIEW: User commands still run in root's session.
-        if (context == kRunAsUser) {
-            if (setgid(gid) || setuid(uid)) {
-                asl_log(logClient, NULL, ASL_LEVEL_ERR,
-                        "setgid/setuid failed, aborting execution of %s", path);
-                exit(EX_NOPERM);
-            }
-        }
-        
-        // Mark any stray file descriptors for closing.
-        maxfd = sysconf(_SC_OPEN_MAX);
-        if (maxfd < 0) {
-            maxfd = OPEN_MAX;
-        }
-        for (fd = STDERR_FILENO + 1; fd < maxfd; fd++) {
-            // Use FD_CLOEXEC instead of close to avoid libdispatch crash.
-            if (fcntl((int)fd, F_SETFD, FD_CLOEXEC) == -1) {
-                if (errno != EBADF) {
-                    asl_log(logClient, NULL, ASL_LEVEL_ERR,
-                            "Marking file descriptor %ld for closing failed with errno %d", fd, errno);
-                    exit(EX_NOPERM);
-                }
-            }
-        }
-        
-        // Set default text encoding for Core Foundation.
-        snprintf(cfUserTextEncoding, sizeof(cfUserTextEncoding), "0x%X:0:0", getuid());
-        if (setenv("__CF_USER_TEXT_ENCODING", cfUserTextEncoding, 1) != 0) {
-            asl_log(logClient, NULL, ASL_LEVEL_WARNING,
-                    "Couldn't set __CF_USER_TEXT_ENCODING");
-        }
-        
-        snprintf(uidStr, sizeof(uidStr), "%d", uid);
-        snprintf(gidStr, sizeof(gidStr), "%d", gid);
-        execl(path, path, uidStr, gidStr, home, (char *)NULL);
-        // The following only executes if execl() fails.
-        asl_log(logClient, NULL, ASL_LEVEL_ERR,
-                "Executing %s failed with errno %d", path, errno);
-        exit(EX_NOPERM);
-        
-    } else {
-        // Parent.
-        asl_log(logClient, NULL, ASL_LEVEL_DEBUG,
-                "Waiting for child with pid %d", childPid);
-        if (waitpid(childPid, &childStatus, 0) != childPid) {
-            asl_log(logClient, NULL, ASL_LEVEL_DEBUG,
-                    "Received errno %d while waiting for child", errno);
-        }
-        if (WIFSIGNALED(childStatus)) {
-            asl_log(logClient, NULL, ASL_LEVEL_WARNING,
-                    "%s died with signal %d", path, WTERMSIG(childStatus));
-        } else {
-            asl_log(logClient, NULL, ASL_LEVEL_WARNING,
-                    "%s exited with status %d", path, WEXITSTATUS(childStatus));
-            if (WEXITSTATUS(childStatus) == EX_NOPERM) {
-                // Fail authorization.
-                asl_log(logClient, NULL, ASL_LEVEL_NOTICE,
-                        "%s denied authorization", path);
-                result = kAuthorizationResultDeny;
-            }
-        }
-    }
-    
-    return result;
+    return VerifyPath(path, true, logClient);
 }
 
-#define NOBODY -2
+#define NOBODY ((uid_t)-2)
 
 /// Called by the system to invoke a mechanism.
 ///
@@ -448,9 +289,10 @@ static OSStatus MechanismInvoke(AuthorizationMechanismRef inMechanism)
     AuthorizationContextFlags authContextFlags;
     const AuthorizationValue *value;
     
-    glob_t g;
-    char scriptPattern[MAXPATHLEN];
-    int i;
+    ManifestRecord manifest;
+    InvocationRecord invocation;
+    char pressure[128];
+    size_t spooled;
     
     mechanism = (MechanismRecord *) inMechanism;
     asl_log(mechanism->fPlugin->fLogClient, NULL, ASL_LEVEL_DEBUG, "LoginScriptPlugin:MechanismInvoke: inMechanism=%p", inMechanism);
@@ -485,20 +327,86 @@ static OSStatus MechanismInvoke(AuthorizationMechanismRef inMechanism)
                 "Can't execute script, homedir lookup failed");
     } else {
         
-        // Find all scripts matching the current phase and context, aborting if
-        // execution doesn't return kAuthorizationResultAllow.
-        snprintf(scriptPattern, sizeof(scriptPattern), "%s/%s-%s*",
-                 kLoginScriptDir,
-                 mechanism->fPhase == kRunBeforeHomedirMount ? "premount" : "postmount",
-                 mechanism->fContext == kRunAsRoot ? "root" : "user");
-        glob(scriptPattern, 0, NULL, &g);
-        for (i = 0; i < g.gl_pathc; i++) {
-            result = ExecuteScript(g.gl_pathv[i], uid, gid, home, mechanism->fContext, mechanism->fPlugin->fLogClient);
-            if (result != kAuthorizationResultAllow) {
-                break;
+        LoadManifest(&manifest, mechanism->fPlugin->fLogClient);
+        SetWorkerPoolLimit(&mechanism->fPlugin->fPool, manifest.fMaxJobs);
+        
+        memset(&invocation, 0, sizeof(invocation));
+        invocation.fPlugin = mechanism->fPlugin;
+        invocation.fManifest = &manifest;
+        invocation.fContext = mechanism->fContext;
+        invocation.fPhase = mechanism->fPhase;
+        invocation.fUid = uid;
+        invocation.fGid = gid;
+        invocation.fHome = home;
+        snprintf(invocation.fUidStr, sizeof(invocation.fUidStr), "%d", uid);
+        snprintf(invocation.fGidStr, sizeof(invocation.fGidStr), "%d", gid);
+        
+        // The login budget covers every mechanism of this login, counted
+        // from when the first one was invoked.
+        // So does the system pressure sample that optional scripts are
+        // shed by.
+        if (! mechanism->fJoinedSession && ! JoinLoginSession(mechanism, uid)) {
+            asl_log(mechanism->fPlugin->fLogClient, NULL, ASL_LEVEL_WARNING,
+                    "Can't track login session, memory allocation failed");
+            SampleSystemPressure(&invocation.fPressure);
+        } else {
+            invocation.fPressure = mechanism->fSessionPressure;
+            if (manifest.fLoginBudget != 0) {
+                invocation.fDeadline = mechanism->fSessionStart;
+                invocation.fDeadline.tv_sec += manifest.fLoginBudget;
+                asl_log(mechanism->fPlugin->fLogClient, NULL, ASL_LEVEL_DEBUG,
+                        "%.3f s left of the login budget", TimeUntil(&invocation.fDeadline) / 1e3);
+            }
+        }
+        invocation.fUnderPressure = SystemUnderPressure(&manifest, &invocation.fPressure);
+        FormatSystemPressure(&invocation.fPressure, pressure, sizeof(pressure));
+        asl_log(mechanism->fPlugin->fLogClient, NULL, ASL_LEVEL_DEBUG,
+                "The login started with %s%s", pressure,
+                invocation.fUnderPressure ? ", optional scripts will be shed" : "");
+        
+        // Ask the policy service, if there is one, then find all scripts
+        // matching the current phase and context, and run them, failing
+        // authorization if any of them doesn't return
+        // kAuthorizationResultAllow.
+        if (manifest.fPolicySocket != NULL) {
+            result = AskPolicyService(&invocation);
+        }
+        if (result != kAuthorizationResultAllow) {
+            asl_log(mechanism->fPlugin->fLogClient, NULL, ASL_LEVEL_NOTICE,
+                    "Not executing %s scripts, the policy service denied authorization",
+                    PhasePrefix(mechanism->fPhase, mechanism->fContext));
+        } else if ((invocation.fEnvp = CreateEnvironment(uid, home, mechanism->fContext, mechanism->fPlugin->fLogClient)) == NULL
+            || ! CreateScripts(&invocation)) {
+            asl_log(mechanism->fPlugin->fLogClient, NULL, ASL_LEVEL_WARNING,
+                    "Can't execute scripts, memory allocation failed");
+        } else {
+            if (mechanism->fPhase == kRunAfterHomedirMount && mechanism->fContext == kRunAsRoot
+                && mechanism->fJoinedSession) {
+                ClaimEarlyScripts(mechanism, &invocation);
+            }
+            spooled = 0;
+            if (mechanism->fPhase == kRunAfterHomedirMount && mechanism->fContext == kRunAsUser) {
+                spooled = SpoolSessionScripts(&invocation);
+            }
+            if (invocation.fScriptCount > spooled) {
+                asl_log(mechanism->fPlugin->fLogClient, NULL, ASL_LEVEL_NOTICE,
+                        "Executing %zu %s scripts with uid=%d, gid=%d, home='%s'", invocation.fScriptCount - spooled,
+                        PhasePrefix(mechanism->fPhase, mechanism->fContext), uid, gid, home);
+                result = RunScripts(&invocation);
+            }
+            
+            // Postmount-root scripts that don't need the home directory
+            // run while it's being mounted, once the last premount
+            // mechanism has allowed the login.
+            if (result == kAuthorizationResultAllow && mechanism->fPhase == kRunBeforeHomedirMount
+                && mechanism->fContext == kRunAsUser && mechanism->fJoinedSession) {
+                LaunchEarlyScripts(mechanism, &invocation);
             }
         }
-        globfree(&g);
+        
+        FreeScripts(&invocation);
+        FreeEnvironment(invocation.fEnvp);
+        FreeManifest(&manifest);
         
     }
     
@@ -542,6 +450,10 @@ static OSStatus MechanismDestroy(AuthorizationMechanismRef inMechanism)
     asl_log(mechanism->fPlugin->fLogClient, NULL, ASL_LEVEL_DEBUG, "LoginScriptPlugin:MechanismDestroy: inMechanism=%p", inMechanism);
     assert(MechanismValid(mechanism));
     
+    if (LeaveLoginSession(mechanism)) {
+        AbandonEarlyScripts(mechanism->fPlugin, mechanism);
+    }
+    
     free(mechanism);
     
     return errAuthorizationSuccess;
@@ -563,6 +475,15 @@ static OSStatus PluginDestroy(AuthorizationPluginRef inPlugin)
     plugin = (PluginRecord *) inPlugin;
     assert(PluginValid(plugin));
     
+    StopResidentWorkers(plugin);
+    StopPolicyConnections(&plugin->fPolicy);
+    DestroyDurationHistory(&plugin->fHistory);
+    StopEarlyScripts(plugin);
+    StopBackgroundReaper(plugin);
+    StopLauncher(plugin);
+    DestroyWorkerPool(&plugin->fPool);
+    DestroySessionTable(&plugin->fSessions);
+    
     asl_close(plugin->fLogClient);
     
     free(plugin);
@@ -624,6 +545,31 @@ extern OSStatus AuthorizationPluginCreate(const AuthorizationCallbacks *callback
     plugin->fMagic     = kPluginMagic;
     plugin->fCallbacks = callbacks;
     plugin->fLogClient = log_client;
+    InitWorkerPool(&plugin->fPool);
+    InitSessionTable(&plugin->fSessions);
+    InitBackgroundReaper(&plugin->fReaper);
+    InitResidentWorkers(&plugin->fResidents);
+    InitPolicyConnections(&plugin->fPolicy);
+    InitDurationHistory(&plugin->fHistory);
+    InitEarlyScriptTable(&plugin->fEarlyScripts);
+    
+    // Start the launcher while the plugin host is still small.
+    pthread_mutex_init(&plugin->fLauncher.fLock, NULL);
+    pthread_cond_init(&plugin->fLauncher.fCondition, NULL);
+    plugin->fLauncher.fPid = -1;
+    plugin->fLauncher.fSocket = -1;
+    plugin->fLauncher.fGeneration = 0;
+    plugin->fLauncher.fSerial = 0;
+    plugin->fLauncher.fReading = false;
+    plugin->fLauncher.fChildren = NULL;
+    plugin->fLauncher.fChildCount = 0;
+    plugin->fLauncher.fChildCapacity = 0;
+    plugin->fLauncher.fReplies = NULL;
+    plugin->fLauncher.fReplyCount = 0;
+    plugin->fLauncher.fReplyCapacity = 0;
+    if (! StartLauncher(plugin)) {
+        asl_log(log_client, NULL, ASL_LEVEL_WARNING, "Launcher not started, scripts will be forked");
+    }
     
     *outPlugin = plugin;
     *outPluginInterface = &gPluginInterface;
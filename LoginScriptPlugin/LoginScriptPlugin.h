@@ -9,6 +9,84 @@
 #ifndef __LoginScriptPlugin__LoginScriptPlugin__
 #define __LoginScriptPlugin__LoginScriptPlugin__
 
-#include <stdio.h>
+#include "Common.h"
+#include "BackgroundReaper.h"
+#include "DurationHistory.h"
+#include "EarlyLaunch.h"
+#include "Launcher.h"
+#include "LoginSessions.h"
+#include "PolicyService.h"
+#include "ResidentWorkers.h"
+#include "SystemPressure.h"
+#include "WorkerPool.h"
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Core Data Structures
+/////////////////////////////////////////////////////////////////////
+
+
+#pragma mark *     Mechanism
+
+enum {
+    kMechanismMagic = 'MLSP'
+};
+
+/// MechanismRecord is the per-mechanism data structure.
+///
+/// One of these
+/// is created for each mechanism that's instantiated, and holds all
+/// of the data needed to run that mechanism.
+///
+/// Mechanisms are single threaded; the code does not have to guard
+/// against multiple threads running inside the mechanism simultaneously.
+struct MechanismRecord {
+    OSType fMagic;         // must be kMechanismMagic
+    AuthorizationEngineRef fEngine;
+    PluginRecord *fPlugin;
+    userContext fContext;
+    scriptPhase fPhase;
+    bool fJoinedSession;   // counted in the plugin's login session for fEngine
+    uid_t fSessionUid;
+    struct timeval fSessionStart;
+    SystemPressure fSessionPressure;
+};
+
+
+#pragma mark *     Plugin
+
+enum {
+    kPluginMagic = 'PLSP'
+};
+
+/// PluginRecord is the per-plugin data structure.
+///
+/// As a plugin may host multiple mechanism, and there's no guarantee
+/// that these mechanisms won't be running on different threads, data
+/// in this record should be protected from multiple concurrent access.
+struct PluginRecord {
+    OSType fMagic;         // must be kPluginMagic
+    const AuthorizationCallbacks *fCallbacks;
+    aslclient fLogClient;
+    LauncherRecord fLauncher;
+    WorkerPool fPool;
+    SessionTable fSessions;
+    BackgroundReaper fReaper;
+    ResidentWorkerTable fResidents;
+    PolicyConnectionPool fPolicy;
+    DurationHistory fHistory;
+    EarlyScriptTable fEarlyScripts;
+};
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Mechanism Entry Points
+/////////////////////////////////////////////////////////////////////
+
+
+bool VerifyPath(const char *path, bool executable, aslclient logClient);
+bool VerifyScript(const char *path, aslclient logClient);
 
 #endif /* defined(__LoginScriptPlugin__LoginScriptPlugin__) */
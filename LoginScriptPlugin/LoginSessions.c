@@ -0,0 +1,132 @@
+//
+//  LoginSessions.c
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+#include "LoginSessions.h"
+
+#include "LoginScriptPlugin.h"
+#include "SystemPressure.h"
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Login Sessions
+/////////////////////////////////////////////////////////////////////
+
+
+// All mechanisms of one login are evaluated by the same authorization
+// engine, so the engine and the uid logging in identify a login. The
+// first mechanism invoked for a login starts the clock for the login
+// budget, and the session is forgotten when its last mechanism is
+// destroyed. Sessions whose mechanisms are never destroyed expire.
+
+/// Set up an empty session table.
+void InitSessionTable(SessionTable *table)
+{
+    pthread_mutex_init(&table->fLock, NULL);
+    table->fSessions = NULL;
+    table->fCount = 0;
+    table->fCapacity = 0;
+}
+
+/// Release the resources held by table.
+void DestroySessionTable(SessionTable *table)
+{
+    free(table->fSessions);
+    table->fSessions = NULL;
+    table->fCount = table->fCapacity = 0;
+    pthread_mutex_destroy(&table->fLock);
+}
+
+/// Count mechanism in the login session for its engine and uid, starting
+/// a new session if there is none, and remember when the session started
+/// and how loaded the machine was then.
+///
+/// @return false if memory allocation failed.
+bool JoinLoginSession(MechanismRecord *mechanism, uid_t uid)
+{
+    SessionTable *table = &mechanism->fPlugin->fSessions;
+    LoginSession *sessions;
+    LoginSession *session;
+    struct timeval now;
+    size_t capacity;
+    size_t i;
+    
+    gettimeofday(&now, NULL);
+    
+    pthread_mutex_lock(&table->fLock);
+    
+    session = NULL;
+    for (i = 0; i < table->fCount; ) {
+        if (now.tv_sec - table->fSessions[i].fStartTime.tv_sec > kSessionExpirySeconds) {
+            table->fSessions[i] = table->fSessions[--table->fCount];
+            continue;
+        }
+        if (table->fSessions[i].fEngine == mechanism->fEngine && table->fSessions[i].fUid == uid) {
+            session = &table->fSessions[i];
+        }
+        i++;
+    }
+    
+    if (session == NULL) {
+        if (table->fCount == table->fCapacity) {
+            capacity = table->fCapacity ? table->fCapacity * 2 : 4;
+            sessions = realloc(table->fSessions, capacity * sizeof(*sessions));
+            if (sessions == NULL) {
+                pthread_mutex_unlock(&table->fLock);
+                return false;
+            }
+            table->fSessions = sessions;
+            table->fCapacity = capacity;
+        }
+        session = &table->fSessions[table->fCount++];
+        session->fEngine = mechanism->fEngine;
+        session->fUid = uid;
+        session->fStartTime = now;
+        SampleSystemPressure(&session->fPressure);
+        session->fMechanisms = 0;
+    }
+    session->fMechanisms++;
+    mechanism->fSessionStart = session->fStartTime;
+    mechanism->fSessionPressure = session->fPressure;
+    
+    pthread_mutex_unlock(&table->fLock);
+    
+    mechanism->fJoinedSession = true;
+    mechanism->fSessionUid = uid;
+    return true;
+}
+
+/// Remove mechanism from its login session, forgetting the session when
+/// no mechanisms are left.
+///
+/// @return true if the session was forgotten, that is, the login is over.
+bool LeaveLoginSession(MechanismRecord *mechanism)
+{
+    SessionTable *table = &mechanism->fPlugin->fSessions;
+    bool ended;
+    size_t i;
+    
+    if (! mechanism->fJoinedSession) {
+        return false;
+    }
+    
+    ended = false;
+    pthread_mutex_lock(&table->fLock);
+    for (i = 0; i < table->fCount; i++) {
+        if (table->fSessions[i].fEngine == mechanism->fEngine && table->fSessions[i].fUid == mechanism->fSessionUid) {
+            if (--table->fSessions[i].fMechanisms <= 0) {
+                table->fSessions[i] = table->fSessions[--table->fCount];
+                ended = true;
+            }
+            break;
+        }
+    }
+    pthread_mutex_unlock(&table->fLock);
+    
+    mechanism->fJoinedSession = false;
+    return ended;
+}
@@ -0,0 +1,41 @@
+//
+//  LoginSessions.h
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+#ifndef __LoginScriptPlugin__LoginSessions__
+#define __LoginScriptPlugin__LoginSessions__
+
+#include "Common.h"
+#include "SystemPressure.h"
+
+enum {
+    kSessionExpirySeconds = 60 * 60
+};
+
+/// LoginSession tracks the time spent on a single login, across all the
+/// mechanisms that run for it.
+typedef struct {
+    AuthorizationEngineRef fEngine;
+    uid_t fUid;
+    struct timeval fStartTime;
+    SystemPressure fPressure;          // sampled when the login started
+    int fMechanisms;       // mechanisms that have joined and not been destroyed
+} LoginSession;
+
+/// SessionTable holds the logins in progress.
+typedef struct {
+    pthread_mutex_t fLock;
+    LoginSession *fSessions;
+    size_t fCount;
+    size_t fCapacity;
+} SessionTable;
+
+void InitSessionTable(SessionTable *table);
+void DestroySessionTable(SessionTable *table);
+bool JoinLoginSession(MechanismRecord *mechanism, uid_t uid);
+bool LeaveLoginSession(MechanismRecord *mechanism);
+
+#endif /* defined(__LoginScriptPlugin__LoginSessions__) */
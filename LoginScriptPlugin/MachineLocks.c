@@ -0,0 +1,151 @@
+//
+//  MachineLocks.c
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+#include "MachineLocks.h"
+
+#include "LoginScriptPlugin.h"
+#include "ScriptExecution.h"
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Machine Locks
+/////////////////////////////////////////////////////////////////////
+
+
+/// Named locks and weighted slots are files in kMachineLockDir, locked
+/// with flock(), so that they are shared by every plugin host on the
+/// machine and let go of automatically if a host dies. A script with a
+/// lock holds "lock.<name>", and a script with weight n holds n of the
+/// files "slot.0" up to the manifest's machine_slots.
+const char *kMachineLockDir = _PATH_VARRUN "LoginScriptPlugin.locks";
+
+/// Open and lock the file name in kMachineLockDir without waiting.
+///
+/// @return The locked file, or -1 with errno set. EWOULDBLOCK means
+///         someone else holds it.
+static int LockMachineFile(const char *name)
+{
+    char path[MAXPATHLEN];
+    int fd;
+    
+    snprintf(path, sizeof(path), "%s/%s", kMachineLockDir, name);
+    if ((fd = open(path, O_RDONLY | O_CREAT | O_NOFOLLOW | O_CLOEXEC, S_IRUSR | S_IWUSR)) == -1) {
+        return -1;
+    }
+    if (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/// Create kMachineLockDir if necessary, and make sure only root can
+/// create files in it.
+static bool PrepareMachineLockDir(aslclient logClient)
+{
+    struct stat info;
+    
+    if (mkdir(kMachineLockDir, S_IRWXU) != 0 && errno != EEXIST) {
+        asl_log(logClient, NULL, ASL_LEVEL_WARNING,
+                "Can't create %s, errno %d", kMachineLockDir, errno);
+        return false;
+    }
+    if (lstat(kMachineLockDir, &info) != 0 || ! S_ISDIR(info.st_mode) || info.st_uid != 0
+        || (info.st_mode & (S_IWGRP | S_IWOTH)) != 0) {
+        asl_log(logClient, NULL, ASL_LEVEL_WARNING,
+                "Not using machine-wide locks, %s must be a directory only writable by root", kMachineLockDir);
+        return false;
+    }
+    return true;
+}
+
+/// Let go of the machine-wide locks script holds.
+void ReleaseMachineLocks(ScriptRecord *script)
+{
+    MachineLocks *locks = &script->fMachineLocks;
+    
+    if (locks->fLockFd != -1) {
+        close(locks->fLockFd);
+        locks->fLockFd = -1;
+    }
+    while (locks->fSlotCount > 0) {
+        close(locks->fSlotFds[--locks->fSlotCount]);
+    }
+}
+
+/// Take the machine-wide lock and slots script needs, without waiting.
+///
+/// If the lock files can't be used at all, the script runs without them
+/// rather than holding up the login.
+///
+/// @return false if another login holds them, in which case the attempt
+///         should be repeated later.
+bool AcquireMachineLocks(InvocationRecord *invocation, ScriptRecord *script)
+{
+    const ScriptSettings *settings = script->fSettings;
+    MachineLocks *locks = &script->fMachineLocks;
+    aslclient logClient = invocation->fPlugin->fLogClient;
+    struct timeval now;
+    char name[64];
+    long slots;
+    long weight;
+    long i;
+    int fd;
+    
+    if (settings->fLock == NULL && settings->fWeight == 0) {
+        return true;
+    }
+    if (! PrepareMachineLockDir(logClient)) {
+        return true;
+    }
+    
+    if (settings->fLock != NULL) {
+        snprintf(name, sizeof(name), "lock.%s", settings->fLock);
+        if ((locks->fLockFd = LockMachineFile(name)) == -1 && errno != EWOULDBLOCK) {
+            asl_log(logClient, NULL, ASL_LEVEL_WARNING,
+                    "Can't lock %s/%s for %s, errno %d", kMachineLockDir, name, script->fPath, errno);
+        } else if (locks->fLockFd == -1) {
+            goto busy;
+        }
+    }
+    
+    slots = invocation->fManifest->fMachineSlots;
+    if (slots <= 0 && (slots = sysconf(_SC_NPROCESSORS_ONLN)) <= 0) {
+        slots = 1;
+    }
+    weight = settings->fWeight < slots ? settings->fWeight : slots;
+    for (i = 0; i < slots && (long)locks->fSlotCount < weight; i++) {
+        snprintf(name, sizeof(name), "slot.%ld", i);
+        if ((fd = LockMachineFile(name)) != -1) {
+            locks->fSlotFds[locks->fSlotCount++] = fd;
+        } else if (errno != EWOULDBLOCK) {
+            asl_log(logClient, NULL, ASL_LEVEL_WARNING,
+                    "Can't lock %s/%s for %s, errno %d", kMachineLockDir, name, script->fPath, errno);
+            weight--;
+        }
+    }
+    if ((long)locks->fSlotCount < weight) {
+        goto busy;
+    }
+    
+    if (locks->fWaitStart.tv_sec != 0) {
+        gettimeofday(&now, NULL);
+        locks->fWaited = (now.tv_sec - locks->fWaitStart.tv_sec)
+                       + (now.tv_usec - locks->fWaitStart.tv_usec) / 1e6;
+    }
+    return true;
+    
+busy:
+    ReleaseMachineLocks(script);
+    if (locks->fWaitStart.tv_sec == 0) {
+        gettimeofday(&locks->fWaitStart, NULL);
+        asl_log(logClient, NULL, ASL_LEVEL_DEBUG,
+                "Waiting for another login to release the machine-wide locks of %s", script->fPath);
+    }
+    return false;
+}
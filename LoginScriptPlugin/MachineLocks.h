@@ -0,0 +1,32 @@
+//
+//  MachineLocks.h
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+#ifndef __LoginScriptPlugin__MachineLocks__
+#define __LoginScriptPlugin__MachineLocks__
+
+#include "Common.h"
+
+extern const char *kMachineLockDir;
+
+enum {
+    kMachineLockRetryMilliseconds = 100    // between attempts while another login holds the locks
+};
+
+/// MachineLocks are the machine-wide locks and slots a script holds while
+/// it runs, shared with the other logins on the machine.
+typedef struct {
+    int fLockFd;           // flock()ed lock file, -1 if not held
+    int fSlotFds[kMaxScriptWeight];    // flock()ed slot files
+    size_t fSlotCount;
+    struct timeval fWaitStart;         // first failed attempt, zero if the locks were free
+    double fWaited;        // seconds spent waiting for the locks
+} MachineLocks;
+
+void ReleaseMachineLocks(ScriptRecord *script);
+bool AcquireMachineLocks(InvocationRecord *invocation, ScriptRecord *script);
+
+#endif /* defined(__LoginScriptPlugin__MachineLocks__) */
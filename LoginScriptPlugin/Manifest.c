@@ -0,0 +1,562 @@
+//
+//  Manifest.c
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+#include "Manifest.h"
+
+#include "Launcher.h"
+#include "LoginScriptPlugin.h"
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Manifest
+/////////////////////////////////////////////////////////////////////
+
+
+/// Strip leading and trailing whitespace from str in place.
+static char *TrimWhitespace(char *str)
+{
+    char *end;
+    
+    while (isspace((unsigned char)*str)) {
+        str++;
+    }
+    end = str + strlen(str);
+    while (end > str && isspace((unsigned char)end[-1])) {
+        *--end = '\0';
+    }
+    return str;
+}
+
+/// Fill in manifest with the default settings.
+void InitManifest(ManifestRecord *manifest)
+{
+    manifest->fSpawnBackend = &kLauncherBackend;
+    manifest->fMaxJobs = 0;
+    manifest->fLoginBudget = 0;
+    manifest->fPolicySocket = NULL;
+    manifest->fPolicyTimeout = 0;
+    manifest->fPolicyFailureResult = kAuthorizationResultAllow;
+    manifest->fMachineSlots = 0;
+    manifest->fShedLoad = 1.0;
+    manifest->fShedFreeMemory = 0;
+    manifest->fShedSwapUsed = 0;
+    memset(&manifest->fDefaults, 0, sizeof(manifest->fDefaults));
+    manifest->fDefaults.fTimeout = 0;
+    manifest->fDefaults.fTimeoutResult = kAuthorizationResultAllow;
+    manifest->fScripts = NULL;
+    manifest->fScriptCount = 0;
+}
+
+/// Release the memory held by settings.
+static void FreeScriptSettings(ScriptSettings *settings)
+{
+    free(settings->fName);
+    free(settings->fGroup);
+    free(settings->fAfter);
+    free(settings->fPredicates.fUids);
+    free(settings->fPredicates.fGroups);
+    free(settings->fPredicates.fHomes);
+    free(settings->fPredicates.fHosts);
+    free(settings->fPredicates.fExists);
+    free(settings->fPredicates.fMissing);
+    free(settings->fLock);
+}
+
+/// Set *copy to a copy of the string original, which may be NULL.
+static bool CopyStringValue(char **copy, const char *original)
+{
+    *copy = NULL;
+    return original == NULL || (*copy = strdup(original)) != NULL;
+}
+
+/// Release the memory held by manifest.
+void FreeManifest(ManifestRecord *manifest)
+{
+    size_t i;
+    
+    for (i = 0; i < manifest->fScriptCount; i++) {
+        FreeScriptSettings(&manifest->fScripts[i]);
+    }
+    free(manifest->fScripts);
+    FreeScriptSettings(&manifest->fDefaults);
+    free(manifest->fPolicySocket);
+    InitManifest(manifest);
+}
+
+/// Start a new [name] section in manifest, inheriting the defaults set
+/// before the first section.
+///
+/// @return The settings for the section, or NULL if memory allocation
+///         failed.
+static ScriptSettings *AddScriptSettings(ManifestRecord *manifest, const char *name)
+{
+    ScriptSettings *scripts;
+    ScriptSettings *settings;
+    
+    scripts = realloc(manifest->fScripts, (manifest->fScriptCount + 1) * sizeof(*scripts));
+    if (scripts == NULL) {
+        return NULL;
+    }
+    manifest->fScripts = scripts;
+    settings = &scripts[manifest->fScriptCount];
+    memset(settings, 0, sizeof(*settings));
+    settings->fTimeout = manifest->fDefaults.fTimeout;
+    settings->fTimeoutResult = manifest->fDefaults.fTimeoutResult;
+    settings->fDetach = manifest->fDefaults.fDetach;
+    settings->fNotifyReady = manifest->fDefaults.fNotifyReady;
+    settings->fKillLeftovers = manifest->fDefaults.fKillLeftovers;
+    settings->fLimits = manifest->fDefaults.fLimits;
+    settings->fPriority = manifest->fDefaults.fPriority;
+    settings->fBatch = manifest->fDefaults.fBatch;
+    settings->fResident = manifest->fDefaults.fResident;
+    settings->fWeight = manifest->fDefaults.fWeight;
+    settings->fShedding = manifest->fDefaults.fShedding;
+    settings->fHomeIndependent = manifest->fDefaults.fHomeIndependent;
+    settings->fInSession = manifest->fDefaults.fInSession;
+    if ((settings->fName = strdup(name)) == NULL
+        || ! CopyStringValue(&settings->fLock, manifest->fDefaults.fLock)
+        || ! CopyStringValue(&settings->fPredicates.fUids, manifest->fDefaults.fPredicates.fUids)
+        || ! CopyStringValue(&settings->fPredicates.fGroups, manifest->fDefaults.fPredicates.fGroups)
+        || ! CopyStringValue(&settings->fPredicates.fHomes, manifest->fDefaults.fPredicates.fHomes)
+        || ! CopyStringValue(&settings->fPredicates.fHosts, manifest->fDefaults.fPredicates.fHosts)
+        || ! CopyStringValue(&settings->fPredicates.fExists, manifest->fDefaults.fPredicates.fExists)
+        || ! CopyStringValue(&settings->fPredicates.fMissing, manifest->fDefaults.fPredicates.fMissing)) {
+        FreeScriptSettings(settings);
+        return NULL;
+    }
+    manifest->fScriptCount++;
+    return settings;
+}
+
+/// Find the settings for the script with the given file name.
+const ScriptSettings *LookupScriptSettings(const ManifestRecord *manifest, const char *name)
+{
+    size_t i;
+    
+    for (i = 0; i < manifest->fScriptCount; i++) {
+        if (strcmp(manifest->fScripts[i].fName, name) == 0) {
+            return &manifest->fScripts[i];
+        }
+    }
+    return &manifest->fDefaults;
+}
+
+/// Replace the string *field with a copy of value.
+bool SetStringValue(char **field, const char *value)
+{
+    char *copy;
+    
+    if ((copy = strdup(value)) == NULL) {
+        return false;
+    }
+    free(*field);
+    *field = copy;
+    return true;
+}
+
+/// Parse a non-negative decimal number.
+static bool ParseNumber(const char *value, long *number)
+{
+    char *end;
+    
+    errno = 0;
+    *number = strtol(value, &end, 10);
+    return *value != '\0' && *end == '\0' && *number >= 0 && errno == 0;
+}
+
+/// Parse a non-negative number that may have a fractional part. number is
+/// left alone if value isn't one.
+static bool ParseDecimal(const char *value, double *number)
+{
+    char *end;
+    double parsed;
+    
+    errno = 0;
+    parsed = strtod(value, &end);
+    if (*value == '\0' || *end != '\0' || parsed < 0 || errno != 0) {
+        return false;
+    }
+    *number = parsed;
+    return true;
+}
+
+/// Parse a yes/no value.
+static bool ParseBoolean(const char *value, bool *flag)
+{
+    if (strcmp(value, "yes") == 0 || strcmp(value, "true") == 0) {
+        *flag = true;
+    } else if (strcmp(value, "no") == 0 || strcmp(value, "false") == 0) {
+        *flag = false;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/// Parse an allow/deny value.
+bool ParseResult(const char *value, AuthorizationResult *result)
+{
+    if (strcmp(value, "allow") == 0) {
+        *result = kAuthorizationResultAllow;
+    } else if (strcmp(value, "deny") == 0) {
+        *result = kAuthorizationResultDeny;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/// Copy the next item of the list *list, separated by spaces or commas,
+/// into item, and advance *list past it.
+///
+/// @return false at the end of the list.
+bool NextListItem(const char **list, char *item, size_t size)
+{
+    size_t length;
+    
+    *list += strspn(*list, " \t,");
+    if (**list == '\0') {
+        return false;
+    }
+    length = strcspn(*list, " \t,");
+    snprintf(item, size, "%.*s", (int)length, *list);
+    *list += length;
+    return true;
+}
+
+/// Parse a uid, or a range of uids like 500-999, 1000- or -499.
+bool ParseUidRange(const char *value, uid_t *low, uid_t *high)
+{
+    char *end;
+    unsigned long number;
+    
+    *low = 0;
+    *high = (uid_t)-1;
+    if (*value != '-') {
+        if (! isdigit((unsigned char)*value)) {
+            return false;
+        }
+        errno = 0;
+        number = strtoul(value, &end, 10);
+        if (errno != 0 || number > UINT32_MAX) {
+            return false;
+        }
+        *low = (uid_t)number;
+        if (*end == '\0') {
+            *high = *low;
+            return true;
+        }
+        value = end;
+    }
+    if (*value++ != '-') {
+        return false;
+    }
+    if (*value == '\0') {
+        return true;
+    }
+    if (! isdigit((unsigned char)*value)) {
+        return false;
+    }
+    errno = 0;
+    number = strtoul(value, &end, 10);
+    if (errno != 0 || number > UINT32_MAX || *end != '\0') {
+        return false;
+    }
+    *high = (uid_t)number;
+    return *low <= *high;
+}
+
+/// Check that every item of list is a valid uid range.
+static bool ParseUidList(const char *list)
+{
+    char item[64];
+    uid_t low;
+    uid_t high;
+    bool empty = true;
+    
+    while (NextListItem(&list, item, sizeof(item))) {
+        if (! ParseUidRange(item, &low, &high)) {
+            return false;
+        }
+        empty = false;
+    }
+    return ! empty;
+}
+
+/// Apply a single key = value setting to manifest.
+///
+/// section is the script section the setting appears in, or NULL for
+/// settings before the first section.
+///
+/// @return false if the key or value isn't recognized.
+static bool SetManifestValue(ManifestRecord *manifest, ScriptSettings *section, const char *key, const char *value)
+{
+    ScriptSettings *settings;
+    const SpawnBackend *backend;
+    long number;
+    
+    // Script settings, which are defaults for all scripts outside sections.
+    settings = section != NULL ? section : &manifest->fDefaults;
+    if (strcmp(key, "timeout") == 0) {
+        if (! ParseNumber(value, &number)) {
+            return false;
+        }
+        settings->fTimeout = number;
+        return true;
+    } else if (strcmp(key, "timeout_action") == 0) {
+        return ParseResult(value, &settings->fTimeoutResult);
+    } else if (strcmp(key, "detach") == 0) {
+        return ParseBoolean(value, &settings->fDetach);
+    } else if (strcmp(key, "notify_ready") == 0) {
+        return ParseBoolean(value, &settings->fNotifyReady);
+    } else if (strcmp(key, "cpu_limit") == 0) {
+        if (! ParseNumber(value, &number)) {
+            return false;
+        }
+        settings->fLimits.fCPUTime = (uint64_t)number;
+        return true;
+    } else if (strcmp(key, "memory_limit") == 0) {
+        if (! ParseNumber(value, &number)) {
+            return false;
+        }
+        settings->fLimits.fMemory = (uint64_t)number * 1024 * 1024;
+        return true;
+    } else if (strcmp(key, "file_size_limit") == 0) {
+        if (! ParseNumber(value, &number)) {
+            return false;
+        }
+        settings->fLimits.fFileSize = (uint64_t)number * 1024 * 1024;
+        return true;
+    } else if (strcmp(key, "batch") == 0) {
+        return ParseBoolean(value, &settings->fBatch);
+    } else if (strcmp(key, "resident") == 0) {
+        return ParseBoolean(value, &settings->fResident);
+    } else if (strcmp(key, "lock") == 0) {
+        return *value != '\0' && strspn(value, kLockNameCharacters) == strlen(value)
+            && SetStringValue(&settings->fLock, value);
+    } else if (strcmp(key, "weight") == 0) {
+        if (! ParseNumber(value, &number) || number > kMaxScriptWeight) {
+            return false;
+        }
+        settings->fWeight = number;
+        return true;
+    } else if (strcmp(key, "if_uid") == 0) {
+        return ParseUidList(value) && SetStringValue(&settings->fPredicates.fUids, value);
+    } else if (strcmp(key, "if_group") == 0) {
+        return *value != '\0' && SetStringValue(&settings->fPredicates.fGroups, value);
+    } else if (strcmp(key, "if_home") == 0) {
+        return *value != '\0' && SetStringValue(&settings->fPredicates.fHomes, value);
+    } else if (strcmp(key, "if_host") == 0) {
+        return *value != '\0' && SetStringValue(&settings->fPredicates.fHosts, value);
+    } else if (strcmp(key, "if_exists") == 0) {
+        return (*value == '/' || strncmp(value, "~/", 2) == 0)
+            && SetStringValue(&settings->fPredicates.fExists, value);
+    } else if (strcmp(key, "if_missing") == 0) {
+        return (*value == '/' || strncmp(value, "~/", 2) == 0)
+            && SetStringValue(&settings->fPredicates.fMissing, value);
+    } else if (strcmp(key, "priority") == 0) {
+        if (strcmp(value, "critical") == 0) {
+            settings->fPriority = kPriorityCritical;
+        } else if (strcmp(value, "normal") == 0) {
+            settings->fPriority = kPriorityNormal;
+        } else if (strcmp(value, "background") == 0) {
+            settings->fPriority = kPriorityBackground;
+        } else {
+            return false;
+        }
+        return true;
+    } else if (strcmp(key, "in_session") == 0) {
+        return ParseBoolean(value, &settings->fInSession);
+    } else if (strcmp(key, "home_independent") == 0) {
+        return ParseBoolean(value, &settings->fHomeIndependent);
+    } else if (strcmp(key, "optional") == 0) {
+        if (strcmp(value, "no") == 0) {
+            settings->fShedding = kShedNever;
+        } else if (strcmp(value, "skip") == 0) {
+            settings->fShedding = kShedSkip;
+        } else if (strcmp(value, "defer") == 0) {
+            settings->fShedding = kShedDefer;
+        } else {
+            return false;
+        }
+        return true;
+    } else if (strcmp(key, "leftovers") == 0) {
+        if (strcmp(value, "keep") == 0) {
+            settings->fKillLeftovers = false;
+        } else if (strcmp(value, "kill") == 0) {
+            settings->fKillLeftovers = true;
+        } else {
+            return false;
+        }
+        return true;
+    }
+    
+    if (section == NULL) {
+        // Global settings.
+        if (strcmp(key, "spawn") == 0) {
+            if ((backend = SpawnBackendNamed(value)) == NULL) {
+                return false;
+            }
+            manifest->fSpawnBackend = backend;
+            return true;
+        } else if (strcmp(key, "jobs") == 0) {
+            if (! ParseNumber(value, &number)) {
+                return false;
+            }
+            manifest->fMaxJobs = number;
+            return true;
+        } else if (strcmp(key, "login_budget") == 0) {
+            if (! ParseNumber(value, &number)) {
+                return false;
+            }
+            manifest->fLoginBudget = number;
+            return true;
+        } else if (strcmp(key, "policy_socket") == 0) {
+            return *value == '/' && SetStringValue(&manifest->fPolicySocket, value);
+        } else if (strcmp(key, "policy_timeout") == 0) {
+            if (! ParseNumber(value, &number)) {
+                return false;
+            }
+            manifest->fPolicyTimeout = number;
+            return true;
+        } else if (strcmp(key, "machine_slots") == 0) {
+            if (! ParseNumber(value, &number)) {
+                return false;
+            }
+            manifest->fMachineSlots = number;
+            return true;
+        } else if (strcmp(key, "shed_load") == 0) {
+            return ParseDecimal(value, &manifest->fShedLoad);
+        } else if (strcmp(key, "shed_free_memory") == 0) {
+            if (! ParseNumber(value, &number)) {
+                return false;
+            }
+            manifest->fShedFreeMemory = number;
+            return true;
+        } else if (strcmp(key, "shed_swap_used") == 0) {
+            if (! ParseNumber(value, &number)) {
+                return false;
+            }
+            manifest->fShedSwapUsed = number;
+            return true;
+        } else if (strcmp(key, "policy_failure") == 0) {
+            return ParseResult(value, &manifest->fPolicyFailureResult);
+        }
+    } else {
+        // Settings that only make sense for a single script.
+        if (strcmp(key, "group") == 0) {
+            return *value != '\0' && SetStringValue(&section->fGroup, value);
+        } else if (strcmp(key, "after") == 0) {
+            return SetStringValue(&section->fAfter, value);
+        } else if (strcmp(key, "gate") == 0) {
+            return ParseBoolean(value, &section->fGate);
+        }
+    }
+    return false;
+}
+
+/// Read the settings in file into manifest, which has its defaults
+/// filled in. path is what file is called in log messages.
+///
+/// The manifest has one "key = value" setting per line. Settings for
+/// individual scripts follow a line with the script's file name in
+/// brackets. Blank lines and lines starting with # are ignored. Invalid
+/// lines are logged and skipped.
+void ReadManifest(ManifestRecord *manifest, FILE *file, const char *path, aslclient logClient)
+{
+    char line[1024];
+    char *key;
+    char *value;
+    char *separator;
+    ScriptSettings *section;
+    int lineNumber;
+    size_t i;
+    
+    section = NULL;
+    for (lineNumber = 1; fgets(line, sizeof(line), file) != NULL; lineNumber++) {
+        key = TrimWhitespace(line);
+        if (*key == '\0' || *key == '#') {
+            continue;
+        }
+        if (*key == '[') {
+            if ((separator = strchr(key, ']')) == NULL || separator[1] != '\0') {
+                asl_log(logClient, NULL, ASL_LEVEL_WARNING,
+                        "%s:%d: expected [script name]", path, lineNumber);
+                continue;
+            }
+            *separator = '\0';
+            if ((section = AddScriptSettings(manifest, TrimWhitespace(key + 1))) == NULL) {
+                asl_log(logClient, NULL, ASL_LEVEL_WARNING, "memory allocation failed");
+                break;
+            }
+            continue;
+        }
+        if ((separator = strchr(key, '=')) == NULL) {
+            asl_log(logClient, NULL, ASL_LEVEL_WARNING,
+                    "%s:%d: expected key = value", path, lineNumber);
+            continue;
+        }
+        *separator = '\0';
+        key = TrimWhitespace(key);
+        value = TrimWhitespace(separator + 1);
+        if (! SetManifestValue(manifest, section, key, value)) {
+            asl_log(logClient, NULL, ASL_LEVEL_WARNING,
+                    "%s:%d: invalid setting %s = %s", path, lineNumber, key, value);
+        }
+    }
+    
+    // The login has to wait for the verdict of a gate, so it can't be
+    // slowed down or left out either.
+    for (i = 0; i < manifest->fScriptCount; i++) {
+        if (manifest->fScripts[i].fGate) {
+            manifest->fScripts[i].fDetach = false;
+            manifest->fScripts[i].fNotifyReady = false;
+            manifest->fScripts[i].fShedding = kShedNever;
+            manifest->fScripts[i].fInSession = false;
+            if (manifest->fScripts[i].fPriority == kPriorityBackground) {
+                manifest->fScripts[i].fPriority = kPriorityCritical;
+            }
+        }
+    }
+}
+
+/// Load the manifest from kLoginScriptDir.
+///
+/// The manifest is an optional text file read by ReadManifest(). Missing
+/// or untrusted manifests leave the default settings in place.
+///
+/// The manifest must be released with FreeManifest().
+void LoadManifest(ManifestRecord *manifest, aslclient logClient)
+{
+    char path[MAXPATHLEN];
+    FILE *file;
+    
+    InitManifest(manifest);
+    
+    snprintf(path, sizeof(path), "%s/%s", kLoginScriptDir, kManifestName);
+    if (access(path, F_OK) != 0) {
+        return;
+    }
+    if (! VerifyPath(path, false, logClient)) {
+        asl_log(logClient, NULL, ASL_LEVEL_WARNING,
+                "Ignoring untrusted manifest %s", path);
+        return;
+    }
+    if ((file = fopen(path, "r")) == NULL) {
+        asl_log(logClient, NULL, ASL_LEVEL_WARNING,
+                "Can't open %s, errno %d", path, errno);
+        return;
+    }
+    ReadManifest(manifest, file, path, logClient);
+    fclose(file);
+    
+    asl_log(logClient, NULL, ASL_LEVEL_DEBUG,
+            "Loaded manifest %s, spawn=%s, jobs=%ld, login_budget=%ld, policy_socket=%s, %zu script sections", path,
+            manifest->fSpawnBackend->fName, manifest->fMaxJobs, manifest->fLoginBudget,
+            manifest->fPolicySocket != NULL ? manifest->fPolicySocket : "none", manifest->fScriptCount);
+}
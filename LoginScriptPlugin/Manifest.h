@@ -0,0 +1,76 @@
+//
+//  Manifest.h
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+#ifndef __LoginScriptPlugin__Manifest__
+#define __LoginScriptPlugin__Manifest__
+
+#include "Common.h"
+#include "RunPredicates.h"
+#include "Spawn.h"
+
+typedef enum {
+    kShedNever,            // always run, however loaded the machine is
+    kShedSkip,             // not run while the machine is under pressure
+    kShedDefer             // detached and run in the background while the machine is under pressure
+} scriptShedding;
+
+/// ScriptSettings holds the manifest settings for a single script, or the
+/// defaults for scripts that don't have a section of their own.
+typedef struct {
+    char *fName;           // script file name, NULL for the defaults
+    char *fGroup;          // scripts in the same group may run concurrently
+    char *fAfter;          // names of scripts or groups to wait for, NULL for the previous group
+    long fTimeout;         // seconds before the script is killed, 0 for no limit
+    AuthorizationResult fTimeoutResult;
+    bool fDetach;          // run in the background without holding up the login
+    bool fNotifyReady;     // the script may signal readiness on kNotifyFileno
+    bool fGate;            // runs before the other scripts, and a deny cancels the rest
+    bool fKillLeftovers;   // kill what the script leaves behind in its process group
+    ResourceLimits fLimits;
+    scriptPriority fPriority;
+    bool fBatch;           // may be run by the shell server
+    bool fResident;        // asked by a resident worker instead of being run each time
+    RunPredicates fPredicates;
+    char *fLock;           // machine-wide lock held while the script runs, NULL for none
+    long fWeight;          // machine-wide slots taken while the script runs, 0 for none
+    scriptShedding fShedding;
+    bool fHomeIndependent; // may be started by the premount mechanism, postmount-root scripts only
+    bool fInSession;       // run by the session agent after login, postmount-user scripts only
+} ScriptSettings;
+
+/// ManifestRecord holds the deployment settings read from the manifest
+/// file in kLoginScriptDir.
+///
+/// A fresh copy is loaded for every mechanism invocation, so changes
+/// take effect at the next login without restarting the plugin host.
+struct ManifestRecord {
+    const SpawnBackend *fSpawnBackend;
+    long fMaxJobs;         // 0 for the number of online CPUs
+    long fLoginBudget;     // seconds all mechanisms of a login may take together, 0 for no limit
+    char *fPolicySocket;   // path of the policy service, NULL for none
+    long fPolicyTimeout;   // seconds to wait for the policy service, 0 for the default
+    AuthorizationResult fPolicyFailureResult;
+    long fMachineSlots;    // machine-wide slots shared by weighted scripts, 0 for the number of online CPUs
+    double fShedLoad;      // load average per online CPU above which optional scripts are shed, 0 for no limit
+    long fShedFreeMemory;  // MB of free memory below which optional scripts are shed, 0 for no limit
+    long fShedSwapUsed;    // MB of swap in use above which optional scripts are shed, 0 for no limit
+    ScriptSettings fDefaults;
+    ScriptSettings *fScripts;
+    size_t fScriptCount;
+};
+
+void InitManifest(ManifestRecord *manifest);
+void FreeManifest(ManifestRecord *manifest);
+const ScriptSettings *LookupScriptSettings(const ManifestRecord *manifest, const char *name);
+bool SetStringValue(char **field, const char *value);
+bool ParseResult(const char *value, AuthorizationResult *result);
+bool NextListItem(const char **list, char *item, size_t size);
+bool ParseUidRange(const char *value, uid_t *low, uid_t *high);
+void ReadManifest(ManifestRecord *manifest, FILE *file, const char *path, aslclient logClient);
+void LoadManifest(ManifestRecord *manifest, aslclient logClient);
+
+#endif /* defined(__LoginScriptPlugin__Manifest__) */
@@ -0,0 +1,204 @@
+//
+//  PolicyService.c
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+#include "PolicyService.h"
+
+#include "Launcher.h"
+#include "LoginRequests.h"
+#include "LoginScriptPlugin.h"
+#include "Manifest.h"
+#include "ScriptExecution.h"
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Policy Service
+/////////////////////////////////////////////////////////////////////
+
+
+/// The policy service is a daemon running as root that listens on the
+/// Unix domain socket named by policy_socket, and decides on login
+/// requests before any script runs. Connections are kept open between
+/// logins, and a connection may carry any number of requests.
+
+enum {
+    kPolicyTimeoutSeconds = 5          // when the manifest doesn't set policy_timeout
+};
+
+/// Set up pool without any connections.
+void InitPolicyConnections(PolicyConnectionPool *pool)
+{
+    pthread_mutex_init(&pool->fLock, NULL);
+    pool->fPath = NULL;
+    pool->fCount = 0;
+}
+
+/// Connect to the policy service at path, which must be run by root.
+///
+/// @return The connected socket, or -1 with errno set.
+static int ConnectPolicyService(const char *path)
+{
+    struct sockaddr_un addr;
+    uid_t peerUid;
+    gid_t peerGid;
+    int on = 1;
+    int fd;
+    
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, path, strlen(path) + 1);
+    
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {
+        return -1;
+    }
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+    
+    // A service that doesn't accept connections fails right away instead
+    // of blocking the login.
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0
+        || getpeereid(fd, &peerUid, &peerGid) != 0) {
+        close(fd);
+        return -1;
+    }
+    if (peerUid != 0) {
+        close(fd);
+        errno = EPERM;
+        return -1;
+    }
+    fcntl(fd, F_SETFL, 0);
+    return fd;
+}
+
+/// Take an idle connection to the policy service at path from pool, or
+/// connect if there is none. Idle connections to a service the manifest
+/// no longer names are closed.
+///
+/// @return The connection, or -1 with errno set. *pooled tells whether it
+///         was idle before.
+static int TakePolicyConnection(PolicyConnectionPool *pool, const char *path, bool *pooled)
+{
+    int fd;
+    
+    pthread_mutex_lock(&pool->fLock);
+    if (pool->fPath != NULL && strcmp(pool->fPath, path) != 0) {
+        while (pool->fCount > 0) {
+            close(pool->fSockets[--pool->fCount]);
+        }
+    }
+    if (pool->fPath == NULL || strcmp(pool->fPath, path) != 0) {
+        SetStringValue(&pool->fPath, path);
+    }
+    fd = pool->fCount > 0 ? pool->fSockets[--pool->fCount] : -1;
+    pthread_mutex_unlock(&pool->fLock);
+    
+    *pooled = fd != -1;
+    if (fd == -1) {
+        fd = ConnectPolicyService(path);
+    }
+    return fd;
+}
+
+/// Keep fd, a connection to the policy service at path that has answered
+/// a request, for later logins.
+static void ReturnPolicyConnection(PolicyConnectionPool *pool, const char *path, int fd)
+{
+    pthread_mutex_lock(&pool->fLock);
+    if (pool->fPath != NULL && strcmp(pool->fPath, path) == 0 && pool->fCount < kMaxPolicyConnections) {
+        pool->fSockets[pool->fCount++] = fd;
+        fd = -1;
+    }
+    pthread_mutex_unlock(&pool->fLock);
+    if (fd != -1) {
+        close(fd);
+    }
+}
+
+/// Ask the policy service named by the manifest of invocation whether the
+/// login may go on.
+///
+/// A pooled connection that turns out to be closed, for instance because
+/// the service was restarted, is replaced by a new one. If the service
+/// can't be reached, doesn't answer in time or gives an invalid answer,
+/// the manifest's policy_failure result applies.
+AuthorizationResult AskPolicyService(InvocationRecord *invocation)
+{
+    const ManifestRecord *manifest = invocation->fManifest;
+    PolicyConnectionPool *pool = &invocation->fPlugin->fPolicy;
+    aslclient logClient = invocation->fPlugin->fLogClient;
+    AuthorizationResult result;
+    struct timeval start;
+    struct timeval end;
+    char reply[kMaxLoginReply];
+    char *request;
+    size_t length;
+    long timeout;
+    bool pooled;
+    bool ok;
+    int fd;
+    
+    if ((request = FormatLoginRequest(invocation, &length)) == NULL) {
+        asl_log(logClient, NULL, ASL_LEVEL_WARNING,
+                "Can't ask the policy service, memory allocation failed");
+        return manifest->fPolicyFailureResult;
+    }
+    timeout = LoginRequestTimeout(invocation, manifest->fPolicyTimeout != 0
+                                              ? manifest->fPolicyTimeout : kPolicyTimeoutSeconds);
+    
+    gettimeofday(&start, NULL);
+    do {
+        ok = false;
+        if ((fd = TakePolicyConnection(pool, manifest->fPolicySocket, &pooled)) == -1) {
+            break;
+        }
+        ok = WriteFully(fd, request, length)
+          && ReadLoginReply(fd, timeout, reply, sizeof(reply));
+        if (! ok) {
+            close(fd);
+        }
+    } while (! ok && pooled && errno != ETIMEDOUT);
+    gettimeofday(&end, NULL);
+    free(request);
+    
+    if (! ok) {
+        asl_log(logClient, NULL, ASL_LEVEL_ERR,
+                "Asking the policy service at %s failed with errno %d, %s", manifest->fPolicySocket, errno,
+                manifest->fPolicyFailureResult == kAuthorizationResultAllow ? "allowing" : "denying");
+        return manifest->fPolicyFailureResult;
+    }
+    if (! ParseResult(reply, &result)) {
+        close(fd);
+        asl_log(logClient, NULL, ASL_LEVEL_ERR,
+                "The policy service at %s gave an invalid answer, %s", manifest->fPolicySocket,
+                manifest->fPolicyFailureResult == kAuthorizationResultAllow ? "allowing" : "denying");
+        return manifest->fPolicyFailureResult;
+    }
+    ReturnPolicyConnection(pool, manifest->fPolicySocket, fd);
+    
+    asl_log(logClient, NULL, result == kAuthorizationResultAllow ? ASL_LEVEL_DEBUG : ASL_LEVEL_NOTICE,
+            "The policy service answered %s in %.3f s", reply,
+            (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6);
+    return result;
+}
+
+/// Close all idle connections to the policy service.
+void StopPolicyConnections(PolicyConnectionPool *pool)
+{
+    pthread_mutex_lock(&pool->fLock);
+    while (pool->fCount > 0) {
+        close(pool->fSockets[--pool->fCount]);
+    }
+    free(pool->fPath);
+    pool->fPath = NULL;
+    pthread_mutex_unlock(&pool->fLock);
+    pthread_mutex_destroy(&pool->fLock);
+}
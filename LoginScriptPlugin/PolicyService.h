@@ -0,0 +1,30 @@
+//
+//  PolicyService.h
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+#ifndef __LoginScriptPlugin__PolicyService__
+#define __LoginScriptPlugin__PolicyService__
+
+#include "Common.h"
+
+enum {
+    kMaxPolicyConnections = 4
+};
+
+/// PolicyConnectionPool holds idle connections to the policy service, so
+/// that most logins don't have to connect first.
+typedef struct {
+    pthread_mutex_t fLock;
+    char *fPath;           // socket the connections go to, NULL before the first one
+    int fSockets[kMaxPolicyConnections];
+    size_t fCount;
+} PolicyConnectionPool;
+
+void InitPolicyConnections(PolicyConnectionPool *pool);
+AuthorizationResult AskPolicyService(InvocationRecord *invocation);
+void StopPolicyConnections(PolicyConnectionPool *pool);
+
+#endif /* defined(__LoginScriptPlugin__PolicyService__) */
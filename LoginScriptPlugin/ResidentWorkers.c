@@ -0,0 +1,286 @@
+//
+//  ResidentWorkers.c
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+#include "ResidentWorkers.h"
+
+#include "EventLoop.h"
+#include "Launcher.h"
+#include "LoginRequests.h"
+#include "LoginScriptPlugin.h"
+#include "Manifest.h"
+#include "ScriptExecution.h"
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Resident Workers
+/////////////////////////////////////////////////////////////////////
+
+
+/// A resident worker is started with kResidentArgument as its only
+/// argument, and gets a socket as kNotifyFileno on which it receives
+/// login requests.
+static const char *kResidentArgument = "--resident";
+
+enum {
+    kResidentTimeoutSeconds = 10,      // for workers of scripts without a timeout
+    kRetireGraceSeconds = 5            // time between SIGTERM and SIGKILL
+};
+
+/// Return the user the resident workers of invocation run as. Workers of
+/// root scripts serve every login.
+static uid_t ResidentUser(const InvocationRecord *invocation)
+{
+    return invocation->fContext == kRunAsRoot ? 0 : invocation->fUid;
+}
+
+/// Set up table without any workers.
+void InitResidentWorkers(ResidentWorkerTable *table)
+{
+    pthread_mutex_init(&table->fLock, NULL);
+    table->fWorkers = NULL;
+    table->fCount = 0;
+    table->fCapacity = 0;
+}
+
+/// Tell worker to stop.
+///
+/// Closing the socket tells the worker to exit. A worker that has failed
+/// is killed right away, the others get SIGTERM.
+static void SignalResidentWorker(ResidentWorker *worker, bool failed)
+{
+    close(worker->fSocket);
+    if (killpg(worker->fPid, failed ? SIGKILL : SIGTERM) == -1) {
+        (void)kill(worker->fPid, failed ? SIGKILL : SIGTERM);
+    }
+}
+
+/// Tell worker to stop, and move it out of the table of plugin into
+/// retired. Must be called with the table lock held, and followed by
+/// ReapRetiredWorker() once it's released.
+static void RetireResidentWorker(PluginRecord *plugin, ResidentWorker *worker, bool failed, ResidentWorker *retired)
+{
+    ResidentWorkerTable *table = &plugin->fResidents;
+    
+    SignalResidentWorker(worker, failed);
+    *retired = *worker;
+    *worker = table->fWorkers[--table->fCount];
+}
+
+/// Wait for a worker retired with RetireResidentWorker() to exit, and
+/// release it. A worker that is still running kRetireGraceSeconds later
+/// is killed along with its process group, so that one that ignores
+/// SIGTERM can't hold up the login or the plugin host.
+static void ReapRetiredWorker(PluginRecord *plugin, ResidentWorker *retired)
+{
+    SpawnStatus status;
+    EventLoop loop;
+    Event event;
+    bool watched;
+    bool gone;
+    
+    watched = false;
+    gone = false;
+    if (EventLoopCreate(&loop)) {
+        watched = EventLoopWatchProcess(&loop, retired->fPid, retired);
+        gone = ! watched && errno == ESRCH;
+        watched = watched && EventLoopSetTimer(&loop, retired, kRetireGraceSeconds * 1000L);
+        while (watched && EventLoopNext(&loop, &event) && event.fKind != kEventProcessExited) {
+            if (event.fKind == kEventTimer) {
+                asl_log(plugin->fLogClient, NULL, ASL_LEVEL_NOTICE,
+                        "Resident %s still running %d seconds after SIGTERM, killing", retired->fPath, kRetireGraceSeconds);
+                if (killpg(retired->fPid, SIGKILL) == -1) {
+                    (void)kill(retired->fPid, SIGKILL);
+                }
+            }
+        }
+        EventLoopDestroy(&loop);
+    }
+    if (! watched && ! gone) {
+        // It can't be waited for with a time limit, so don't give it one.
+        if (killpg(retired->fPid, SIGKILL) == -1) {
+            (void)kill(retired->fPid, SIGKILL);
+        }
+    }
+    if (retired->fBackend->fWait(plugin, retired->fPid, &status) != 0) {
+        asl_log(plugin->fLogClient, NULL, ASL_LEVEL_WARNING,
+                "Received errno %d while waiting for resident %s", errno, retired->fPath);
+    }
+    free(retired->fPath);
+}
+
+/// Start the resident worker for script as the user of invocation,
+/// replacing any worker of the same script that runs as another user,
+/// which is retired into replaced. Must be called with the table lock
+/// held.
+static ResidentWorker *StartResidentWorker(InvocationRecord *invocation, ScriptRecord *script,
+                                           ResidentWorker *replaced, size_t *replacedCount)
+{
+    PluginRecord *plugin = invocation->fPlugin;
+    ResidentWorkerTable *table = &plugin->fResidents;
+    ResidentWorker *workers;
+    ResidentWorker *worker;
+    SpawnRequest request;
+    char *argv[3];
+    size_t capacity;
+    size_t i;
+    int fds[2];
+    int on = 1;
+    
+    for (i = 0; i < table->fCount; i++) {
+        if (strcmp(table->fWorkers[i].fPath, script->fPath) == 0) {
+            RetireResidentWorker(plugin, &table->fWorkers[i], false, &replaced[(*replacedCount)++]);
+            break;
+        }
+    }
+    if (table->fCount == table->fCapacity) {
+        capacity = table->fCapacity ? table->fCapacity * 2 : 4;
+        if ((workers = realloc(table->fWorkers, capacity * sizeof(*workers))) == NULL) {
+            return NULL;
+        }
+        table->fWorkers = workers;
+        table->fCapacity = capacity;
+    }
+    worker = &table->fWorkers[table->fCount];
+    if ((worker->fPath = strdup(script->fPath)) == NULL) {
+        return NULL;
+    }
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+        free(worker->fPath);
+        return NULL;
+    }
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    setsockopt(fds[0], SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+    
+    argv[0] = script->fPath;
+    argv[1] = (char *)kResidentArgument;
+    argv[2] = NULL;
+    
+    request.fPath = script->fPath;
+    request.fArgv = argv;
+    request.fEnvp = invocation->fEnvp;
+    request.fUid = invocation->fUid;
+    request.fGid = invocation->fGid;
+    request.fContext = invocation->fContext;
+    request.fOutputFd = -1;
+    request.fNotifyFd = fds[1];
+    request.fLimits = script->fSettings->fLimits;
+    request.fPriority = script->fSettings->fPriority;
+    
+    worker->fUid = ResidentUser(invocation);
+    worker->fBackend = invocation->fManifest->fSpawnBackend;
+    worker->fPid = worker->fBackend->fSpawn(plugin, &request);
+    close(fds[1]);
+    if (worker->fPid == -1) {
+        asl_log(plugin->fLogClient, NULL, ASL_LEVEL_WARNING,
+                "Starting resident %s failed with errno %d", script->fPath, errno);
+        close(fds[0]);
+        free(worker->fPath);
+        return NULL;
+    }
+    worker->fSocket = fds[0];
+    table->fCount++;
+    
+    asl_log(plugin->fLogClient, NULL, ASL_LEVEL_NOTICE,
+            "Started resident %s with pid %d", script->fPath, worker->fPid);
+    return worker;
+}
+
+/// Ask the resident worker of script about the login of invocation,
+/// starting the worker first if necessary.
+///
+/// A worker that fails to answer properly in time is stopped, and started
+/// again at the next login. The answer is waited for right here, so the
+/// other scripts of invocation aren't looked after meanwhile.
+///
+/// @return false if there is no answer, in which case the script should
+///         be run the usual way.
+bool CallResidentWorker(InvocationRecord *invocation, ScriptRecord *script, AuthorizationResult *result)
+{
+    PluginRecord *plugin = invocation->fPlugin;
+    ResidentWorkerTable *table = &plugin->fResidents;
+    ResidentWorker *worker;
+    ResidentWorker retired[2];
+    size_t retiredCount;
+    char reply[kMaxLoginReply];
+    char *request;
+    size_t length;
+    long timeout;
+    size_t i;
+    bool ok;
+    
+    if ((request = FormatLoginRequest(invocation, &length)) == NULL) {
+        return false;
+    }
+    timeout = LoginRequestTimeout(invocation, script->fSettings->fTimeout != 0
+                                              ? script->fSettings->fTimeout : kResidentTimeoutSeconds);
+    
+    retiredCount = 0;
+    pthread_mutex_lock(&table->fLock);
+    worker = NULL;
+    for (i = 0; i < table->fCount; i++) {
+        if (strcmp(table->fWorkers[i].fPath, script->fPath) == 0 && table->fWorkers[i].fUid == ResidentUser(invocation)) {
+            worker = &table->fWorkers[i];
+        }
+    }
+    if (worker == NULL) {
+        worker = StartResidentWorker(invocation, script, retired, &retiredCount);
+    }
+    ok = worker != NULL;
+    if (ok) {
+        script->fPid = worker->fPid;
+        ok = WriteFully(worker->fSocket, request, length)
+          && ReadLoginReply(worker->fSocket, timeout, reply, sizeof(reply));
+        if (! ok || ! ParseResult(reply, result)) {
+            if (ok) {
+                asl_log(plugin->fLogClient, NULL, ASL_LEVEL_WARNING,
+                        "Resident %s gave an invalid answer, restarting it", script->fPath);
+            } else {
+                asl_log(plugin->fLogClient, NULL, ASL_LEVEL_WARNING,
+                        "Resident %s failed with errno %d, restarting it", script->fPath, errno);
+            }
+            RetireResidentWorker(plugin, worker, true, &retired[retiredCount++]);
+            script->fPid = -1;
+            ok = false;
+        }
+    }
+    pthread_mutex_unlock(&table->fLock);
+    
+    for (i = 0; i < retiredCount; i++) {
+        ReapRetiredWorker(plugin, &retired[i]);
+    }
+    free(request);
+    return ok;
+}
+
+/// Stop all resident workers.
+void StopResidentWorkers(PluginRecord *plugin)
+{
+    ResidentWorkerTable *table = &plugin->fResidents;
+    ResidentWorker *workers;
+    size_t count;
+    size_t i;
+    
+    pthread_mutex_lock(&table->fLock);
+    workers = table->fWorkers;
+    count = table->fCount;
+    table->fWorkers = NULL;
+    table->fCount = 0;
+    table->fCapacity = 0;
+    pthread_mutex_unlock(&table->fLock);
+    
+    // All of them get SIGTERM first, so that they shut down side by side.
+    for (i = 0; i < count; i++) {
+        SignalResidentWorker(&workers[i], false);
+    }
+    for (i = 0; i < count; i++) {
+        ReapRetiredWorker(plugin, &workers[i]);
+    }
+    free(workers);
+    pthread_mutex_destroy(&table->fLock);
+}
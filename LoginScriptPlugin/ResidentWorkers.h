@@ -0,0 +1,37 @@
+//
+//  ResidentWorkers.h
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+#ifndef __LoginScriptPlugin__ResidentWorkers__
+#define __LoginScriptPlugin__ResidentWorkers__
+
+#include "Common.h"
+#include "Spawn.h"
+
+/// ResidentWorker is a script that keeps running for the lifetime of the
+/// plugin host, and decides on logins as they happen.
+typedef struct {
+    char *fPath;
+    uid_t fUid;            // the user it runs as
+    pid_t fPid;
+    int fSocket;           // kNotifyFileno of the worker
+    const SpawnBackend *fBackend;
+} ResidentWorker;
+
+/// ResidentWorkerTable holds the resident workers that are running. The
+/// lock is held for the duration of each call to a worker.
+typedef struct {
+    pthread_mutex_t fLock;
+    ResidentWorker *fWorkers;
+    size_t fCount;
+    size_t fCapacity;
+} ResidentWorkerTable;
+
+void InitResidentWorkers(ResidentWorkerTable *table);
+bool CallResidentWorker(InvocationRecord *invocation, ScriptRecord *script, AuthorizationResult *result);
+void StopResidentWorkers(PluginRecord *plugin);
+
+#endif /* defined(__LoginScriptPlugin__ResidentWorkers__) */
@@ -0,0 +1,139 @@
+//
+//  RunPredicates.c
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+#include "RunPredicates.h"
+
+#include "LoginScriptPlugin.h"
+#include "Manifest.h"
+#include "ScriptExecution.h"
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Run Predicates
+/////////////////////////////////////////////////////////////////////
+
+
+/// Return true if uid is in one of the ranges of list.
+static bool MatchesUid(const char *list, uid_t uid)
+{
+    char item[64];
+    uid_t low;
+    uid_t high;
+    
+    while (NextListItem(&list, item, sizeof(item))) {
+        if (ParseUidRange(item, &low, &high) && uid >= low && uid <= high) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/// Return true if the user uid is a member of one of the groups of list,
+/// given by name or gid. Nested groups count.
+static bool MatchesGroup(const char *list, uid_t uid, aslclient logClient)
+{
+    struct group grp;
+    struct group *grpResult;
+    char grpBuffer[4096];
+    char item[256];
+    uuid_t userUUID;
+    uuid_t groupUUID;
+    gid_t gid;
+    char *end;
+    int isMember;
+    
+    if (mbr_uid_to_uuid(uid, userUUID) != 0) {
+        asl_log(logClient, NULL, ASL_LEVEL_WARNING,
+                "Can't look up group memberships of uid %d", uid);
+        return false;
+    }
+    while (NextListItem(&list, item, sizeof(item))) {
+        gid = (gid_t)strtoul(item, &end, 10);
+        if (*end != '\0' || end == item) {
+            if (getgrnam_r(item, &grp, grpBuffer, sizeof(grpBuffer), &grpResult) != 0 || grpResult == NULL) {
+                asl_log(logClient, NULL, ASL_LEVEL_WARNING,
+                        "Can't look up group %s", item);
+                continue;
+            }
+            gid = grp.gr_gid;
+        }
+        if (mbr_gid_to_uuid(gid, groupUUID) == 0
+            && mbr_check_membership(userUUID, groupUUID, &isMember) == 0 && isMember) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/// Return true if string matches one of the shell patterns of list.
+static bool MatchesPattern(const char *list, const char *string, int flags)
+{
+    char item[MAXPATHLEN];
+    
+    while (NextListItem(&list, item, sizeof(item))) {
+        if (fnmatch(item, string, flags) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/// Return true if path exists, where "~/" stands for the home directory
+/// of invocation.
+static bool PathExists(const InvocationRecord *invocation, const char *path)
+{
+    char expanded[MAXPATHLEN];
+    struct stat info;
+    
+    if (strncmp(path, "~/", 2) == 0) {
+        snprintf(expanded, sizeof(expanded), "%s/%s", invocation->fHome, path + 2);
+        path = expanded;
+    }
+    return lstat(path, &info) == 0;
+}
+
+/// Evaluate the run predicates of script for invocation, and log the
+/// decision for scripts that have any.
+///
+/// @return true if the script should run.
+bool RunPredicatesMatch(const InvocationRecord *invocation, const ScriptRecord *script)
+{
+    const RunPredicates *predicates = &script->fSettings->fPredicates;
+    aslclient logClient = invocation->fPlugin->fLogClient;
+    char hostName[MAXHOSTNAMELEN];
+    const char *failed;
+    
+    failed = NULL;
+    if (predicates->fUids != NULL && ! MatchesUid(predicates->fUids, invocation->fUid)) {
+        failed = "if_uid";
+    } else if (predicates->fGroups != NULL && ! MatchesGroup(predicates->fGroups, invocation->fUid, logClient)) {
+        failed = "if_group";
+    } else if (predicates->fHomes != NULL && ! MatchesPattern(predicates->fHomes, invocation->fHome, 0)) {
+        failed = "if_home";
+    } else if (predicates->fHosts != NULL
+               && (gethostname(hostName, sizeof(hostName)) != 0
+                   || ! MatchesPattern(predicates->fHosts, hostName, FNM_CASEFOLD))) {
+        failed = "if_host";
+    } else if (predicates->fExists != NULL && ! PathExists(invocation, predicates->fExists)) {
+        failed = "if_exists";
+    } else if (predicates->fMissing != NULL && PathExists(invocation, predicates->fMissing)) {
+        failed = "if_missing";
+    } else if (predicates->fUids == NULL && predicates->fGroups == NULL && predicates->fHomes == NULL
+               && predicates->fHosts == NULL && predicates->fExists == NULL && predicates->fMissing == NULL) {
+        return true;
+    }
+    
+    if (failed != NULL) {
+        asl_log(logClient, NULL, ASL_LEVEL_DEBUG,
+                "Skipping %s, %s doesn't match", script->fPath, failed);
+        return false;
+    }
+    asl_log(logClient, NULL, ASL_LEVEL_DEBUG,
+            "Running %s, its predicates match", script->fPath);
+    return true;
+}
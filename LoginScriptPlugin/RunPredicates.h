@@ -0,0 +1,27 @@
+//
+//  RunPredicates.h
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+#ifndef __LoginScriptPlugin__RunPredicates__
+#define __LoginScriptPlugin__RunPredicates__
+
+#include "Common.h"
+
+/// RunPredicates are the conditions a script only runs under. Each is
+/// NULL if the script doesn't care, or a list separated by spaces or
+/// commas, any item of which may match.
+typedef struct {
+    char *fUids;           // uids and ranges like 500-999 or 1000-
+    char *fGroups;         // names or gids of groups the user must be a member of
+    char *fHomes;          // fnmatch() patterns for the home directory
+    char *fHosts;          // fnmatch() patterns for the host name
+    char *fExists;         // a path that must exist, not a list
+    char *fMissing;        // a path that must not exist, not a list
+} RunPredicates;
+
+bool RunPredicatesMatch(const InvocationRecord *invocation, const ScriptRecord *script);
+
+#endif /* defined(__LoginScriptPlugin__RunPredicates__) */
@@ -0,0 +1,999 @@
+//
+//  ScriptExecution.c
+//  LoginScriptPlugin
+//
+//  Split out of LoginScriptPlugin.c, created by Per Olofsson on 2014-11-21.
+//  Copyright (c) 2014 Göteborgs universitet. All rights reserved.
+//
+
+#include "ScriptExecution.h"
+
+#include "Actions.h"
+#include "BackgroundReaper.h"
+#include "DurationHistory.h"
+#include "EarlyLaunch.h"
+#include "EventLoop.h"
+#include "LeftoverProcesses.h"
+#include "LoginScriptPlugin.h"
+#include "MachineLocks.h"
+#include "Manifest.h"
+#include "ResidentWorkers.h"
+#include "RunPredicates.h"
+#include "ScriptGraph.h"
+#include "ScriptOutput.h"
+#include "ShellServer.h"
+#include "SystemPressure.h"
+#include "WorkerPool.h"
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Script Execution
+/////////////////////////////////////////////////////////////////////
+
+
+enum {
+    kSlowScriptSeconds = 10,           // log scripts that take longer than this
+    kTimeoutGraceSeconds = 5,          // time between SIGTERM and SIGKILL
+    kMemoryCheckMilliseconds = 500     // how often scripts with a memory limit are measured
+};
+
+/// Return the script name prefix for phase and context.
+const char *PhasePrefix(scriptPhase phase, userContext context)
+{
+    if (phase == kRunBeforeHomedirMount) {
+        return context == kRunAsRoot ? "premount-root" : "premount-user";
+    } else {
+        return context == kRunAsRoot ? "postmount-root" : "postmount-user";
+    }
+}
+
+/// Release the scripts of invocation.
+void FreeScripts(InvocationRecord *invocation)
+{
+    size_t i;
+    
+    for (i = 0; i < invocation->fScriptCount; i++) {
+        if (invocation->fScripts[i].fEarly != NULL) {
+            if (invocation->fScripts[i].fPid == -1) {
+                // Never joined, because the login was denied or ran out of budget.
+                AbandonEarlyScript(invocation->fPlugin, invocation->fScripts[i].fEarly);
+            } else {
+                FreeEarlyScript(invocation->fScripts[i].fEarly);
+            }
+        }
+        free(invocation->fScripts[i].fPath);
+        free(invocation->fScripts[i].fDeps);
+        FreeOutputBuffer(&invocation->fScripts[i].fOutput);
+    }
+    free(invocation->fScripts);
+    invocation->fScripts = NULL;
+    invocation->fScriptCount = 0;
+    free(invocation->fOrder);
+    invocation->fOrder = NULL;
+}
+
+/// Find all scripts matching the phase and context of invocation, and
+/// verify them up front so that the trust checks are logged in order.
+bool CreateScripts(InvocationRecord *invocation)
+{
+    aslclient logClient = invocation->fPlugin->fLogClient;
+    ScriptRecord *script;
+    char scriptPattern[MAXPATHLEN];
+    glob_t g;
+    size_t i;
+    
+    snprintf(scriptPattern, sizeof(scriptPattern), "%s/%s*",
+             kLoginScriptDir, PhasePrefix(invocation->fPhase, invocation->fContext));
+    if (glob(scriptPattern, 0, NULL, &g) != 0) {
+        // No scripts.
+        return true;
+    }
+    
+    invocation->fScripts = calloc(g.gl_pathc, sizeof(*invocation->fScripts));
+    if (invocation->fScripts == NULL) {
+        globfree(&g);
+        return false;
+    }
+    for (i = 0; i < g.gl_pathc; i++) {
+        script = &invocation->fScripts[invocation->fScriptCount];
+        if ((script->fPath = strdup(g.gl_pathv[i])) == NULL) {
+            globfree(&g);
+            return false;
+        }
+        invocation->fScriptCount++;
+        script->fName = strrchr(script->fPath, '/') + 1;
+        script->fSettings = LookupScriptSettings(invocation->fManifest, script->fName);
+        script->fTrusted = VerifyScript(script->fPath, logClient);
+        script->fActions = IsActionFile(script->fName);
+        script->fState = kScriptPending;
+        script->fPid = -1;
+        script->fResult = kAuthorizationResultAllow;
+        InitOutputBuffer(&script->fOutput);
+        script->fNotifyFd = -1;
+        script->fMachineLocks.fLockFd = -1;
+    }
+    globfree(&g);
+    
+    return BuildScriptGraph(invocation);
+}
+
+/// Create a pipe for script to write to, with a non-blocking read end
+/// that is stored in readFd.
+///
+/// @return The write end for the child, or -1 on failure.
+static int CreateScriptPipe(InvocationRecord *invocation, ScriptRecord *script, const char *purpose, int *readFd)
+{
+    int fds[2];
+    
+    if (pipe(fds) != 0) {
+        asl_log(invocation->fPlugin->fLogClient, NULL, ASL_LEVEL_WARNING,
+                "Creating %s pipe for %s failed with errno %d", purpose, script->fPath, errno);
+        return -1;
+    }
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    *readFd = fds[0];
+    return fds[1];
+}
+
+/// Close the readiness pipe of script, if it has one.
+static void CloseScriptNotification(ScriptRecord *script)
+{
+    if (script->fNotifyFd != -1) {
+        close(script->fNotifyFd);
+        script->fNotifyFd = -1;
+    }
+}
+
+/// Read what script has written to its readiness pipe so far.
+///
+/// @return true once the script has written kReadyToken.
+static bool ReadScriptNotification(InvocationRecord *invocation, ScriptRecord *script)
+{
+    size_t tokenLength = strlen(kReadyToken);
+    ssize_t n;
+    
+    while (script->fNotifyFd != -1 && script->fNotificationLength < tokenLength) {
+        n = read(script->fNotifyFd, script->fNotification + script->fNotificationLength,
+                 tokenLength - script->fNotificationLength);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n == -1 && errno == EAGAIN) {
+            return false;
+        }
+        if (n <= 0) {
+            // Closed without signalling, so the script is waited for as usual.
+            CloseScriptNotification(script);
+            return false;
+        }
+        script->fNotificationLength += (size_t)n;
+        if (memcmp(script->fNotification, kReadyToken, script->fNotificationLength) != 0) {
+            asl_log(invocation->fPlugin->fLogClient, NULL, ASL_LEVEL_WARNING,
+                    "Ignoring unexpected readiness notification from %s", script->fPath);
+            CloseScriptNotification(script);
+            return false;
+        }
+    }
+    return script->fNotificationLength == tokenLength;
+}
+
+/// Send sig to the process group of script, or to the script alone if
+/// the group doesn't exist.
+static void SignalScript(InvocationRecord *invocation, ScriptRecord *script, int sig)
+{
+    if (killpg(script->fPid, sig) == -1 && kill(script->fPid, sig) == -1 && errno != ESRCH) {
+        asl_log(invocation->fPlugin->fLogClient, NULL, ASL_LEVEL_WARNING,
+                "Sending signal %d to %s failed with errno %d", sig, script->fPath, errno);
+    }
+}
+
+/// Work out the next step of the timeout sequence of script, skipping
+/// the steps that don't apply.
+///
+/// A running script first gets a notice when it's slow, then SIGTERM when
+/// it has timed out, and finally SIGKILL if it's still around after
+/// kTimeoutGraceSeconds.
+///
+/// @return The milliseconds until the step is due, which may be negative
+///         if it's overdue already, or 0 for kScriptTimerNone.
+static long NextScriptTimer(InvocationRecord *invocation, ScriptRecord *script)
+{
+    long timeout = script->fSettings->fTimeout;
+    long elapsed;
+    bool limited;          // the script has a timeout or a login budget
+    long untilTimeout;     // may be negative if it's overdue already
+    long untilBudget;
+    struct timeval now;
+    
+    // Work out how long the script has left, whether it's the script's
+    // own timeout or the login budget that runs out first.
+    gettimeofday(&now, NULL);
+    elapsed = (now.tv_sec - script->fStartTime.tv_sec) * 1000L
+            + (now.tv_usec - script->fStartTime.tv_usec) / 1000;
+    limited = timeout != 0;
+    untilTimeout = limited ? timeout * 1000L - elapsed : 0;
+    if (invocation->fDeadline.tv_sec != 0) {
+        untilBudget = TimeUntil(&invocation->fDeadline);
+        if (! limited || untilBudget < untilTimeout) {
+            untilTimeout = untilBudget;
+            limited = true;
+        }
+    }
+    
+    if (script->fTimer == kScriptTimerSlow && limited && untilTimeout <= kSlowScriptSeconds * 1000L - elapsed) {
+        script->fTimer = kScriptTimerTimeout;
+    }
+    if (script->fTimer == kScriptTimerTimeout && ! limited) {
+        script->fTimer = kScriptTimerNone;
+    }
+    
+    switch (script->fTimer) {
+        case kScriptTimerSlow:
+            return kSlowScriptSeconds * 1000L - elapsed;
+        case kScriptTimerTimeout:
+            return untilTimeout;
+        case kScriptTimerKill:
+            return kTimeoutGraceSeconds * 1000L;
+        case kScriptTimerNone:
+        default:
+            return 0;
+    }
+}
+
+/// Return true if the memory of script is measured while it runs, which
+/// is until it has been sent SIGTERM.
+static bool ScriptMemoryChecked(const ScriptRecord *script)
+{
+    return script->fSettings->fLimits.fMemory != 0 && script->fTimer != kScriptTimerKill;
+}
+
+/// Set the timer for the next step of the timeout sequence of script, or
+/// for its next memory check if that comes first.
+static void ArmScriptTimer(InvocationRecord *invocation, ScriptRecord *script)
+{
+    long milliseconds;
+    
+    milliseconds = NextScriptTimer(invocation, script);
+    if (ScriptMemoryChecked(script)
+        && (script->fTimer == kScriptTimerNone || milliseconds > kMemoryCheckMilliseconds)) {
+        milliseconds = kMemoryCheckMilliseconds;
+    } else if (script->fTimer == kScriptTimerNone) {
+        return;
+    }
+    if (milliseconds < 1) {
+        milliseconds = 1;
+    }
+    if (! EventLoopSetTimer(invocation->fLoop, script, milliseconds)) {
+        asl_log(invocation->fPlugin->fLogClient, NULL, ASL_LEVEL_ERR,
+                "Setting timer for %s failed with errno %d", script->fPath, errno);
+    }
+}
+
+/// Kill script if its process group uses more memory than its limit.
+///
+/// The limit is also set as RLIMIT_DATA, but macOS doesn't apply that to
+/// the memory malloc() maps, so the physical footprint is what counts.
+///
+/// @return true if the script was killed.
+static bool CheckScriptMemory(InvocationRecord *invocation, ScriptRecord *script)
+{
+    int64_t footprint;
+    
+    footprint = ProcessGroupFootprint(script->fPid);
+    if (footprint < 0 || (uint64_t)footprint <= script->fSettings->fLimits.fMemory) {
+        return false;
+    }
+    asl_log(invocation->fPlugin->fLogClient, NULL, ASL_LEVEL_NOTICE,
+            "%s is using %lld MB, over its memory limit, killing", script->fPath,
+            (long long)footprint / (1024 * 1024));
+    script->fOverMemory = true;
+    SignalScript(invocation, script, SIGKILL);
+    script->fTimer = kScriptTimerNone;
+    return true;
+}
+
+/// Take the next step of the timeout sequence of script, once it's due,
+/// and check its memory on the way.
+static void HandleScriptTimer(InvocationRecord *invocation, ScriptRecord *script)
+{
+    aslclient logClient = invocation->fPlugin->fLogClient;
+    
+    if (ScriptMemoryChecked(script)) {
+        if (CheckScriptMemory(invocation, script)) {
+            return;
+        }
+        if (script->fTimer == kScriptTimerNone || NextScriptTimer(invocation, script) > 0) {
+            ArmScriptTimer(invocation, script);
+            return;
+        }
+    }
+    
+    switch (script->fTimer) {
+        case kScriptTimerSlow:
+            asl_log(logClient, NULL, ASL_LEVEL_NOTICE,
+                    "%s is still running after %d seconds", script->fPath, kSlowScriptSeconds);
+            script->fTimer = kScriptTimerTimeout;
+            break;
+        case kScriptTimerTimeout:
+            script->fOverBudget = invocation->fDeadline.tv_sec != 0 && TimeUntil(&invocation->fDeadline) <= 0;
+            if (script->fOverBudget) {
+                asl_log(logClient, NULL, ASL_LEVEL_NOTICE,
+                        "Login budget exhausted, terminating %s", script->fPath);
+            } else {
+                asl_log(logClient, NULL, ASL_LEVEL_NOTICE,
+                        "%s timed out after %ld seconds, terminating", script->fPath, script->fSettings->fTimeout);
+            }
+            script->fTimedOut = true;
+            SignalScript(invocation, script, SIGTERM);
+            script->fTimer = kScriptTimerKill;
+            break;
+        case kScriptTimerKill:
+            asl_log(logClient, NULL, ASL_LEVEL_NOTICE,
+                    "%s still running %d seconds after SIGTERM, killing", script->fPath, kTimeoutGraceSeconds);
+            SignalScript(invocation, script, SIGKILL);
+            script->fTimer = kScriptTimerNone;
+            break;
+        case kScriptTimerNone:
+            return;
+    }
+    ArmScriptTimer(invocation, script);
+}
+
+/// Return the worker pool slot and the machine-wide locks held by script.
+static void ReleaseScriptSlots(InvocationRecord *invocation, ScriptRecord *script)
+{
+    ReleaseWorker(&invocation->fPlugin->fPool);
+    ReleaseMachineLocks(script);
+}
+
+/// Shed the optional script while the machine is under pressure, either
+/// skipping it or deferring it to the background, where it no longer
+/// holds up the login.
+///
+/// @return true if the script should still be started.
+static bool ShedOptionalScript(InvocationRecord *invocation, ScriptRecord *script)
+{
+    char pressure[128];
+    
+    FormatSystemPressure(&invocation->fPressure, pressure, sizeof(pressure));
+    if (script->fSettings->fShedding == kShedSkip) {
+        asl_log(invocation->fPlugin->fLogClient, NULL, ASL_LEVEL_NOTICE,
+                "Skipping optional %s, the machine is under pressure with %s", script->fPath, pressure);
+        return false;
+    }
+    
+    asl_log(invocation->fPlugin->fLogClient, NULL, ASL_LEVEL_NOTICE,
+            "Deferring optional %s to the background, the machine is under pressure with %s", script->fPath, pressure);
+    
+    // The copy shares its strings with the manifest, which outlives it.
+    script->fDeferredSettings = *script->fSettings;
+    script->fDeferredSettings.fDetach = true;
+    script->fDeferredSettings.fNotifyReady = false;
+    script->fDeferredSettings.fPriority = kPriorityBackground;
+    script->fSettings = &script->fDeferredSettings;
+    return true;
+}
+
+/// Start script, unless it failed verification, its run predicates don't
+/// match or it's an optional script shed under pressure. A script the
+/// premount mechanism started early is joined instead.
+///
+/// Trusted scripts must have a slot reserved in the worker pool and hold
+/// their machine-wide locks. Both are returned here if the script can't
+/// be started, is skipped, is detached, is an action file or was answered
+/// by its resident worker, or by ReapScript(). Detached scripts are
+/// handed over to the background reaper right away, along with their
+/// output pipe.
+///
+/// @return true if a process was started that has to be waited for.
+static bool StartScript(InvocationRecord *invocation, ScriptRecord *script)
+{
+    const SpawnBackend *backend = invocation->fManifest->fSpawnBackend;
+    SpawnRequest request;
+    char *argv[5];
+    
+    gettimeofday(&script->fStartTime, NULL);
+    if (! script->fTrusted) {
+        script->fState = kScriptFinished;
+        script->fEndTime = script->fStartTime;
+        return false;
+    }
+    if (script->fEarly != NULL) {
+        // Started by the premount mechanism, so there's only its outcome
+        // left to collect.
+        script->fStartTime = script->fEarly->fStartTime;
+        script->fPid = script->fEarly->fPid;
+        script->fOutput.fFd = script->fEarly->fOutputFd;
+        script->fEarly->fOutputFd = -1;
+        if (invocation->fLoop != NULL && script->fOutput.fFd != -1
+            && ! EventLoopWatchReadable(invocation->fLoop, script->fOutput.fFd, script)) {
+            CloseOutputBuffer(&script->fOutput);
+        }
+        script->fTimer = kScriptTimerSlow;
+        if (invocation->fLoop != NULL) {
+            ArmScriptTimer(invocation, script);
+        }
+        asl_log(invocation->fPlugin->fLogClient, NULL, ASL_LEVEL_DEBUG,
+                "Joined %s with pid %d, which was started early", script->fPath, script->fPid);
+        script->fState = kScriptRunning;
+        return true;
+    }
+    if (! RunPredicatesMatch(invocation, script)) {
+        script->fSkipped = true;
+        script->fState = kScriptFinished;
+        script->fEndTime = script->fStartTime;
+        ReleaseScriptSlots(invocation, script);
+        return false;
+    }
+    if (script->fSettings->fShedding != kShedNever && invocation->fUnderPressure && ! ShedOptionalScript(invocation, script)) {
+        script->fSkipped = true;
+        script->fState = kScriptFinished;
+        script->fEndTime = script->fStartTime;
+        ReleaseScriptSlots(invocation, script);
+        return false;
+    }
+    if (script->fActions) {
+        script->fError = RunActionFile(invocation, script);
+        gettimeofday(&script->fEndTime, NULL);
+        script->fState = kScriptFinished;
+        ReleaseScriptSlots(invocation, script);
+        return false;
+    }
+    if (script->fSettings->fResident && CallResidentWorker(invocation, script, &script->fResult)) {
+        gettimeofday(&script->fEndTime, NULL);
+        script->fAnswered = true;
+        script->fState = kScriptFinished;
+        ReleaseScriptSlots(invocation, script);
+        return false;
+    }
+    if (script->fSettings->fResident) {
+        // The timeout starts over for the one-shot run.
+        gettimeofday(&script->fStartTime, NULL);
+    }
+    
+    argv[0] = script->fPath;
+    argv[1] = invocation->fUidStr;
+    argv[2] = invocation->fGidStr;
+    argv[3] = (char *)invocation->fHome;
+    argv[4] = NULL;
+    
+    request.fPath = script->fPath;
+    request.fArgv = argv;
+    request.fEnvp = invocation->fEnvp;
+    request.fUid = invocation->fUid;
+    request.fGid = invocation->fGid;
+    request.fContext = invocation->fContext;
+    request.fOutputFd = -1;
+    request.fNotifyFd = -1;
+    request.fLimits = script->fSettings->fLimits;
+    request.fPriority = script->fSettings->fPriority;
+    
+    script->fBatched = ScriptCanBatch(invocation, script) && ! invocation->fShellServer.fFailed
+        && (invocation->fShellServer.fPid != -1 || StartShellServer(invocation));
+    
+    // Without an event loop the pipes can't be drained while the script
+    // runs, so it inherits the host's output and can't signal readiness.
+    if (invocation->fLoop != NULL) {
+        request.fOutputFd = CreateScriptPipe(invocation, script, "output", &script->fOutput.fFd);
+        if (request.fOutputFd != -1 && ! script->fSettings->fDetach
+            && ! EventLoopWatchReadable(invocation->fLoop, script->fOutput.fFd, script)) {
+            CloseOutputBuffer(&script->fOutput);
+            close(request.fOutputFd);
+            request.fOutputFd = -1;
+        }
+        if (script->fSettings->fNotifyReady && ! script->fSettings->fDetach) {
+            request.fNotifyFd = CreateScriptPipe(invocation, script, "readiness", &script->fNotifyFd);
+            if (request.fNotifyFd != -1
+                && ! EventLoopWatchReadable(invocation->fLoop, script->fNotifyFd, script)) {
+                CloseScriptNotification(script);
+                close(request.fNotifyFd);
+                request.fNotifyFd = -1;
+            }
+        }
+    }
+    
+    if (script->fBatched && (script->fPid = ShellServerSpawn(invocation, script, request.fOutputFd)) == -1) {
+        script->fBatched = false;
+    }
+    if (! script->fBatched) {
+        script->fPid = backend->fSpawn(invocation->fPlugin, &request);
+    }
+    if (script->fPid == -1) {
+        script->fError = errno;
+    }
+    if (request.fOutputFd != -1) {
+        close(request.fOutputFd);
+    }
+    if (request.fNotifyFd != -1) {
+        close(request.fNotifyFd);
+    }
+    if (script->fPid == -1) {
+        CloseOutputBuffer(&script->fOutput);
+        CloseScriptNotification(script);
+        ReleaseScriptSlots(invocation, script);
+        script->fState = kScriptFinished;
+        script->fEndTime = script->fStartTime;
+        return false;
+    }
+    if (script->fSettings->fDetach) {
+        if (AdoptDetachedScript(invocation->fPlugin, script->fPath, script->fPid, backend,
+                                &script->fStartTime, script->fSettings->fKillLeftovers, &script->fOutput)) {
+            asl_log(invocation->fPlugin->fLogClient, NULL, ASL_LEVEL_DEBUG,
+                    "Detached %s with pid %d", script->fPath, script->fPid);
+            ReleaseScriptSlots(invocation, script);
+            script->fState = kScriptDetached;
+            return false;
+        }
+        asl_log(invocation->fPlugin->fLogClient, NULL, ASL_LEVEL_WARNING,
+                "Can't detach %s, waiting for it instead", script->fPath);
+        if (script->fOutput.fFd != -1
+            && ! EventLoopWatchReadable(invocation->fLoop, script->fOutput.fFd, script)) {
+            CloseOutputBuffer(&script->fOutput);
+        }
+    }
+    
+    script->fTimer = kScriptTimerSlow;
+    if (invocation->fLoop != NULL) {
+        ArmScriptTimer(invocation, script);
+    } else if (script->fSettings->fTimeout != 0) {
+        asl_log(invocation->fPlugin->fLogClient, NULL, ASL_LEVEL_WARNING,
+                "Can't time out %s without an event loop", script->fPath);
+    }
+    
+    asl_log(invocation->fPlugin->fLogClient, NULL, ASL_LEVEL_DEBUG,
+            "Started %s with pid %d", script->fPath, script->fPid);
+    script->fState = kScriptRunning;
+    return true;
+}
+
+/// Collect the exit status and remaining output of a script that has
+/// exited.
+///
+/// Output written after the script exited, by processes it left behind,
+/// isn't collected. Fail authorization if the script exited with
+/// EX_NOPERM, or timed out and the manifest says timeouts deny.
+static void ReapScript(InvocationRecord *invocation, ScriptRecord *script)
+{
+    const SpawnBackend *backend = script->fEarly != NULL ? script->fEarly->fBackend
+                                                         : invocation->fManifest->fSpawnBackend;
+    int err;
+    
+    // Don't leave anything from a stopped script behind.
+    CleanUpProcessGroup(script->fPid, script->fPath,
+                        script->fSettings->fKillLeftovers || script->fTimedOut || script->fCancelled,
+                        invocation->fPlugin->fLogClient);
+    if (script->fBatched) {
+        err = ShellServerWait(invocation, script->fPid, &script->fStatus);
+    } else {
+        err = backend->fWait(invocation->fPlugin, script->fPid, &script->fStatus);
+    }
+    if (err != 0) {
+        script->fError = errno;
+    } else if (script->fCancelled) {
+        // The login is denied already.
+    } else if (script->fTimedOut) {
+        script->fResult = script->fSettings->fTimeoutResult;
+    } else if (WIFEXITED(script->fStatus.fStatus) && WEXITSTATUS(script->fStatus.fStatus) == EX_NOPERM) {
+        script->fResult = kAuthorizationResultDeny;
+    }
+    gettimeofday(&script->fEndTime, NULL);
+    script->fState = kScriptFinished;
+    ReleaseScriptSlots(invocation, script);
+    
+    if (invocation->fLoop != NULL) {
+        EventLoopCancelTimer(invocation->fLoop, script);
+    }
+    ReadOutputBuffer(&script->fOutput);
+    CloseOutputBuffer(&script->fOutput);
+    CloseScriptNotification(script);
+    
+    asl_log(invocation->fPlugin->fLogClient, NULL, ASL_LEVEL_DEBUG,
+            "Reaped %s with pid %d", script->fPath, script->fPid);
+}
+
+/// Kill every running script of invocation, after a gate has denied
+/// authorization.
+static void CancelScripts(InvocationRecord *invocation)
+{
+    ScriptRecord *script;
+    size_t i;
+    
+    for (i = 0; i < invocation->fScriptCount; i++) {
+        script = &invocation->fScripts[i];
+        if (script->fState == kScriptRunning && ! script->fCancelled) {
+            script->fCancelled = true;
+            SignalScript(invocation, script, SIGKILL);
+        }
+    }
+}
+
+/// Start script, which holds its slots already, and watch it with the
+/// event loop, or wait for it right away if it can't be watched. If the
+/// script denies authorization, result is set, and if the script is a
+/// gate, the running scripts are cancelled.
+///
+/// @return true if the script is running.
+static bool LaunchScript(InvocationRecord *invocation, ScriptRecord *script, AuthorizationResult *result)
+{
+    if (! StartScript(invocation, script)) {
+        if (script->fResult != kAuthorizationResultAllow) {
+            // Denied by its resident worker.
+            *result = script->fResult;
+            if (script->fSettings->fGate) {
+                CancelScripts(invocation);
+            }
+        }
+        return false;
+    }
+    if (invocation->fLoop != NULL && EventLoopWatchProcess(invocation->fLoop, script->fPid, script)) {
+        return true;
+    }
+    // Already gone, or it can't be watched, so wait for it now.
+    ReapScript(invocation, script);
+    if (script->fResult != kAuthorizationResultAllow) {
+        *result = script->fResult;
+        if (script->fSettings->fGate) {
+            CancelScripts(invocation);
+        }
+    }
+    return false;
+}
+
+/// Hand a running script that has signalled readiness over to the
+/// background reaper, so that login can go on without it.
+///
+/// @return false if the reaper can't take it, in which case the script
+///         is waited for as usual.
+static bool ReleaseReadyScript(InvocationRecord *invocation, ScriptRecord *script)
+{
+    PluginRecord *plugin = invocation->fPlugin;
+    
+    CloseScriptNotification(script);
+    if (script->fOutput.fFd != -1) {
+        EventLoopUnwatchReadable(invocation->fLoop, script->fOutput.fFd);
+    }
+    if (! AdoptDetachedScript(plugin, script->fPath, script->fPid, invocation->fManifest->fSpawnBackend,
+                              &script->fStartTime, script->fSettings->fKillLeftovers, &script->fOutput)) {
+        asl_log(plugin->fLogClient, NULL, ASL_LEVEL_WARNING,
+                "Can't release %s to the background, waiting for it instead", script->fPath);
+        if (script->fOutput.fFd != -1
+            && ! EventLoopWatchReadable(invocation->fLoop, script->fOutput.fFd, script)) {
+            CloseOutputBuffer(&script->fOutput);
+        }
+        return false;
+    }
+    EventLoopCancelTimer(invocation->fLoop, script);
+    gettimeofday(&script->fEndTime, NULL);
+    script->fState = kScriptReady;
+    ReleaseScriptSlots(invocation, script);
+    
+    asl_log(plugin->fLogClient, NULL, ASL_LEVEL_DEBUG,
+            "Released %s with pid %d", script->fPath, script->fPid);
+    return true;
+}
+
+/// Return true if script was stopped by its CPU time limit, either with
+/// SIGXCPU or, if it ignored that, with SIGKILL at the hard limit.
+static bool ExceededCPULimit(const ScriptRecord *script)
+{
+    const SpawnStatus *status = &script->fStatus;
+    
+    if (! WIFSIGNALED(status->fStatus) || script->fSettings->fLimits.fCPUTime == 0) {
+        return false;
+    }
+    return WTERMSIG(status->fStatus) == SIGXCPU
+        || (WTERMSIG(status->fStatus) == SIGKILL
+            && (uint64_t)(status->fUserTime.tv_sec + status->fSystemTime.tv_sec) >= script->fSettings->fLimits.fCPUTime);
+}
+
+/// Log what happened to script.
+static void LogScriptOutcome(const InvocationRecord *invocation, const ScriptRecord *script)
+{
+    aslclient logClient = invocation->fPlugin->fLogClient;
+    const SpawnStatus *status = &script->fStatus;
+    double elapsed;
+    
+    if (! script->fTrusted) {
+        asl_log(logClient, NULL, ASL_LEVEL_WARNING,
+                "Not executing %s", script->fPath);
+        return;
+    }
+    if (script->fSkipped) {
+        // Logged at debug level when the predicates were evaluated.
+        return;
+    }
+    if (script->fState == kScriptSpooled) {
+        asl_log(logClient, NULL, ASL_LEVEL_NOTICE,
+                "%s was queued for the session agent", script->fPath);
+        return;
+    }
+    if (script->fMachineLocks.fWaitStart.tv_sec != 0) {
+        if (script->fState == kScriptNotRun || script->fState == kScriptOverBudget) {
+            asl_log(logClient, NULL, ASL_LEVEL_NOTICE,
+                    "%s was still waiting for its machine-wide locks", script->fPath);
+        } else {
+            asl_log(logClient, NULL, ASL_LEVEL_NOTICE,
+                    "%s waited %.3f s for its machine-wide locks", script->fPath, script->fMachineLocks.fWaited);
+        }
+    }
+    if (script->fState == kScriptNotRun) {
+        asl_log(logClient, NULL, ASL_LEVEL_NOTICE,
+                "Not executing %s, authorization was denied", script->fPath);
+        return;
+    }
+    if (script->fState == kScriptOverBudget) {
+        asl_log(logClient, NULL, ASL_LEVEL_WARNING,
+                "Not executing %s, the login budget is exhausted", script->fPath);
+        return;
+    }
+    if (script->fActions) {
+        elapsed = (script->fEndTime.tv_sec - script->fStartTime.tv_sec)
+                + (script->fEndTime.tv_usec - script->fStartTime.tv_usec) / 1e6;
+        if (script->fError == 0) {
+            asl_log(logClient, NULL, ASL_LEVEL_NOTICE,
+                    "%s carried out %zu actions in %.3f s", script->fPath, script->fActionCount, elapsed);
+        } else if (script->fFailedLine != 0) {
+            asl_log(logClient, NULL, ASL_LEVEL_WARNING,
+                    "%s failed at line %u with errno %d, after %zu actions", script->fPath,
+                    script->fFailedLine, script->fError, script->fActionCount);
+        } else {
+            asl_log(logClient, NULL, ASL_LEVEL_WARNING,
+                    "Carrying out %s failed with errno %d", script->fPath, script->fError);
+        }
+        return;
+    }
+    if (script->fAnswered) {
+        elapsed = (script->fEndTime.tv_sec - script->fStartTime.tv_sec)
+                + (script->fEndTime.tv_usec - script->fStartTime.tv_usec) / 1e6;
+        asl_log(logClient, NULL, ASL_LEVEL_NOTICE,
+                "%s answered %s in %.3f s from its resident worker with pid %d", script->fPath,
+                script->fResult == kAuthorizationResultAllow ? "allow" : "deny", elapsed, script->fPid);
+        return;
+    }
+    if (script->fPid == -1) {
+        asl_log(logClient, NULL, ASL_LEVEL_WARNING,
+                "Spawning %s with %s failed with errno %d", script->fPath,
+                invocation->fManifest->fSpawnBackend->fName, script->fError);
+        return;
+    }
+    if (script->fState == kScriptDetached) {
+        asl_log(logClient, NULL, ASL_LEVEL_NOTICE,
+                "%s is running in the background with pid %d", script->fPath, script->fPid);
+        return;
+    }
+    if (script->fState == kScriptReady) {
+        elapsed = (script->fEndTime.tv_sec - script->fStartTime.tv_sec)
+                + (script->fEndTime.tv_usec - script->fStartTime.tv_usec) / 1e6;
+        asl_log(logClient, NULL, ASL_LEVEL_NOTICE,
+                "%s was ready after %.3f s and is running in the background with pid %d",
+                script->fPath, elapsed, script->fPid);
+        return;
+    }
+    if (script->fError != 0) {
+        asl_log(logClient, NULL, ASL_LEVEL_WARNING,
+                "Received errno %d while waiting for %s", script->fError, script->fPath);
+        return;
+    }
+    
+    elapsed = (script->fEndTime.tv_sec - script->fStartTime.tv_sec)
+            + (script->fEndTime.tv_usec - script->fStartTime.tv_usec) / 1e6;
+    asl_log(logClient, NULL, ASL_LEVEL_NOTICE,
+            "%s ran for %.3f s (user %.3f s, system %.3f s)", script->fPath, elapsed,
+            status->fUserTime.tv_sec + status->fUserTime.tv_usec / 1e6,
+            status->fSystemTime.tv_sec + status->fSystemTime.tv_usec / 1e6);
+    LogOutputBuffer(&script->fOutput, script->fName, logClient);
+    if (script->fCancelled) {
+        asl_log(logClient, NULL, ASL_LEVEL_NOTICE,
+                "%s was cancelled, authorization was denied", script->fPath);
+    } else if (script->fTimedOut) {
+        if (script->fOverBudget) {
+            asl_log(logClient, NULL, ASL_LEVEL_WARNING,
+                    "%s was stopped when the login budget ran out", script->fPath);
+        } else {
+            asl_log(logClient, NULL, ASL_LEVEL_WARNING,
+                    "%s timed out after %ld seconds", script->fPath, script->fSettings->fTimeout);
+        }
+        if (script->fResult == kAuthorizationResultDeny) {
+            asl_log(logClient, NULL, ASL_LEVEL_NOTICE,
+                    "%s denied authorization by timing out", script->fPath);
+        }
+    } else if (script->fOverMemory) {
+        asl_log(logClient, NULL, ASL_LEVEL_WARNING,
+                "%s exceeded its memory limit of %llu MB", script->fPath,
+                (unsigned long long)script->fSettings->fLimits.fMemory / (1024 * 1024));
+    } else if (ExceededCPULimit(script)) {
+        asl_log(logClient, NULL, ASL_LEVEL_WARNING,
+                "%s exceeded its CPU time limit of %llu seconds", script->fPath,
+                (unsigned long long)script->fSettings->fLimits.fCPUTime);
+    } else if (WIFSIGNALED(status->fStatus) && WTERMSIG(status->fStatus) == SIGXFSZ) {
+        asl_log(logClient, NULL, ASL_LEVEL_WARNING,
+                "%s exceeded its file size limit of %llu MB", script->fPath,
+                (unsigned long long)script->fSettings->fLimits.fFileSize / (1024 * 1024));
+    } else if (WIFSIGNALED(status->fStatus)) {
+        asl_log(logClient, NULL, ASL_LEVEL_WARNING,
+                "%s died with signal %d", script->fPath, WTERMSIG(status->fStatus));
+    } else {
+        asl_log(logClient, NULL, ASL_LEVEL_WARNING,
+                "%s exited with status %d", script->fPath, WEXITSTATUS(status->fStatus));
+        if (script->fResult == kAuthorizationResultDeny) {
+            asl_log(logClient, NULL, ASL_LEVEL_NOTICE,
+                    "%s denied authorization", script->fPath);
+        }
+    }
+}
+
+/// Run the scripts of invocation, starting each one as soon as the scripts
+/// it depends on have finished and the worker pool has room for it. When
+/// several are ready at once, they start in the order chosen by
+/// ScheduleScripts().
+///
+/// Script exits, output and readiness notifications are collected by an
+/// event loop as they happen. A script that signals readiness is handed to
+/// the background reaper and counts as done.
+/// Scripts whose machine-wide locks are held by another login are tried
+/// again every kMachineLockRetryMilliseconds, without holding up the rest.
+/// Once a script denies authorization no more scripts are started, but the
+/// ones that are already running are waited for, unless the script was a
+/// gate, in which case they are killed. When the login budget
+/// runs out, running scripts are stopped as if they had timed out, and
+/// the rest are skipped. The outcome of each
+/// script is logged in glob order when all are done, regardless of the
+/// order they finished in.
+AuthorizationResult RunScripts(InvocationRecord *invocation)
+{
+    aslclient logClient = invocation->fPlugin->fLogClient;
+    AuthorizationResult result;
+    ScriptRecord *script;
+    EventLoop loop;
+    Event event;
+    struct timeval start;
+    struct timeval end;
+    size_t running;
+    size_t batched;
+    size_t i;
+    bool progress;
+    bool waiting;
+    
+    result = kAuthorizationResultAllow;
+    running = 0;
+    gettimeofday(&start, NULL);
+    InitShellServer(&invocation->fShellServer);
+    ScheduleScripts(invocation);
+    
+    if (EventLoopCreate(&loop)) {
+        invocation->fLoop = &loop;
+    } else {
+        asl_log(logClient, NULL, ASL_LEVEL_WARNING,
+                "Event loop not created, errno %d, running scripts one at a time", errno);
+        invocation->fLoop = NULL;
+    }
+    
+    // Scripts the premount mechanism started early have held worker pool
+    // slots since then, so they are joined before any other script can
+    // wait for one. They are running already, whether or not the scripts
+    // they depend on have finished.
+    for (i = 0; result == kAuthorizationResultAllow && i < invocation->fScriptCount; i++) {
+        script = &invocation->fScripts[i];
+        if (script->fState == kScriptPending && script->fEarly != NULL) {
+            running += LaunchScript(invocation, script, &result);
+        }
+    }
+    
+    for (;;) {
+        // Start every script that is ready to go.
+        waiting = false;
+        do {
+            progress = false;
+            for (i = 0; result == kAuthorizationResultAllow && i < invocation->fScriptCount; i++) {
+                script = &invocation->fScripts[invocation->fOrder != NULL ? invocation->fOrder[i] : i];
+                if (script->fState == kScriptPending && invocation->fDeadline.tv_sec != 0
+                    && TimeUntil(&invocation->fDeadline) <= 0) {
+                    script->fState = kScriptOverBudget;
+                }
+                if (script->fState != kScriptPending || ! ScriptReady(invocation, script)) {
+                    continue;
+                }
+                if (script->fTrusted && ! AcquireWorker(&invocation->fPlugin->fPool, running == 0,
+                                                        &invocation->fDeadline)) {
+                    if (running == 0) {
+                        // Other logins held the pool until the budget ran out.
+                        script->fState = kScriptOverBudget;
+                        continue;
+                    }
+                    // The pool is full, wait for one of our scripts to exit.
+                    break;
+                }
+                if (script->fTrusted && ! AcquireMachineLocks(invocation, script)) {
+                    // Another login holds its locks, try again shortly.
+                    ReleaseWorker(&invocation->fPlugin->fPool);
+                    waiting = true;
+                    continue;
+                }
+                progress = true;
+                running += LaunchScript(invocation, script, &result);
+            }
+        } while (progress);
+        
+        if (waiting && running == 0) {
+            usleep(kMachineLockRetryMilliseconds * 1000);
+            continue;
+        }
+        if (running == 0) {
+            break;
+        }
+        if (waiting) {
+            (void)EventLoopSetTimer(invocation->fLoop, invocation, kMachineLockRetryMilliseconds);
+        }
+        
+        if (! EventLoopNext(invocation->fLoop, &event)) {
+            asl_log(logClient, NULL, ASL_LEVEL_ERR,
+                    "Waiting for events failed with errno %d", errno);
+            for (i = 0; i < invocation->fScriptCount; i++) {
+                if (invocation->fScripts[i].fState == kScriptRunning) {
+                    ReapScript(invocation, &invocation->fScripts[i]);
+                    running--;
+                }
+            }
+            continue;
+        }
+        script = event.fContext;
+        switch (event.fKind) {
+            case kEventProcessExited:
+                if (script->fState != kScriptRunning) {
+                    // Released to the background reaper, which reaps it.
+                    break;
+                }
+                ReapScript(invocation, script);
+                running--;
+                if (script->fResult != kAuthorizationResultAllow) {
+                    result = script->fResult;
+                    if (script->fSettings->fGate) {
+                        CancelScripts(invocation);
+                    }
+                }
+                break;
+            case kEventReadable:
+                if (event.fFd != script->fNotifyFd) {
+                    ReadOutputBuffer(&script->fOutput);
+                } else if (ReadScriptNotification(invocation, script) && ! script->fTimedOut
+                           && ReleaseReadyScript(invocation, script)) {
+                    running--;
+                }
+                break;
+            case kEventTimer:
+                if (event.fContext != invocation) {
+                    HandleScriptTimer(invocation, script);
+                }
+                break;
+            case kEventWakeup:
+                break;
+        }
+    }
+    
+    if (invocation->fLoop != NULL) {
+        EventLoopDestroy(&loop);
+        invocation->fLoop = NULL;
+    }
+    StopShellServer(invocation);
+    gettimeofday(&end, NULL);
+    RecordDurations(invocation);
+    
+    batched = 0;
+    for (i = 0; i < invocation->fScriptCount; i++) {
+        script = &invocation->fScripts[i];
+        if (script->fState == kScriptPending) {
+            script->fState = kScriptNotRun;
+        }
+        LogScriptOutcome(invocation, script);
+        batched += script->fBatched;
+    }
+    asl_log(logClient, NULL, ASL_LEVEL_NOTICE,
+            "Ran %zu %s scripts in %.3f s, %zu of them in the shell server", invocation->fScriptCount,
+            PhasePrefix(invocation->fPhase, invocation->fContext),
+            (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6, batched);
+    
+    return result;
+}
@@ -0,0 +1,105 @@
+//
+//  ScriptExecution.h
+//  LoginScriptPlugin
+//
+//  Split out of LoginScriptPlugin.c, created by Per Olofsson on 2014-11-21.
+//  Copyright (c) 2014 Göteborgs universitet. All rights reserved.
+//
+
+#ifndef __LoginScriptPlugin__ScriptExecution__
+#define __LoginScriptPlugin__ScriptExecution__
+
+#include "Common.h"
+#include "EarlyLaunch.h"
+#include "EventLoop.h"
+#include "MachineLocks.h"
+#include "Manifest.h"
+#include "ScriptOutput.h"
+#include "ShellServer.h"
+#include "Spawn.h"
+#include "SystemPressure.h"
+
+typedef enum {
+    kScriptTimerSlow,      // next timer logs that the script is slow
+    kScriptTimerTimeout,   // next timer sends SIGTERM to the process group
+    kScriptTimerKill,      // next timer sends SIGKILL to the process group
+    kScriptTimerNone
+} scriptTimer;
+
+typedef enum {
+    kScriptPending,        // waiting for its dependencies
+    kScriptRunning,
+    kScriptFinished,
+    kScriptDetached,       // handed over to the background reaper
+    kScriptReady,          // signalled readiness and handed over to the background reaper
+    kScriptNotRun,         // never started because authorization was denied
+    kScriptOverBudget,     // never started because the login budget ran out
+    kScriptSpooled         // queued for the session agent
+} scriptState;
+
+/// ScriptRecord tracks a single script during a mechanism invocation.
+struct ScriptRecord {
+    char *fPath;
+    const char *fName;     // file name, points into fPath
+    const ScriptSettings *fSettings;
+    bool fTrusted;
+    size_t *fDeps;         // indexes of the scripts that must finish first
+    size_t fDepCount;
+    scriptState fState;
+    pid_t fPid;            // -1 if the script couldn't be started
+    int fError;            // errno if spawning or reaping the script failed
+    SpawnStatus fStatus;
+    struct timeval fStartTime;
+    struct timeval fEndTime;
+    AuthorizationResult fResult;
+    scriptTimer fTimer;
+    bool fTimedOut;
+    bool fOverBudget;      // stopped because the login budget ran out
+    bool fOverMemory;      // killed for using more memory than its limit
+    bool fCancelled;       // killed because a gate denied authorization
+    OutputBuffer fOutput;
+    int fNotifyFd;         // read end of the readiness pipe, -1 once closed
+    char fNotification[8];
+    size_t fNotificationLength;
+    bool fBatched;         // run by the shell server instead of the spawn backend
+    bool fAnswered;        // decided by its resident worker, fPid is the worker's
+    bool fSkipped;         // not run because a run predicate didn't match or the machine was under pressure
+    ScriptSettings fDeferredSettings;  // fSettings of an optional script deferred under pressure
+    EarlyScript *fEarly;   // started by the premount mechanism, NULL if it wasn't
+    bool fActions;         // an action file, run in-process
+    size_t fActionCount;   // actions carried out
+    unsigned fFailedLine;  // line of the action that failed, 0 if none did
+    double fExpected;      // seconds the script is expected to take
+    double fRank;          // expected seconds from its start to the end of the scripts that wait for it
+    MachineLocks fMachineLocks;
+};
+
+/// InvocationRecord holds the state shared by all the scripts that are run
+/// by one mechanism invocation.
+struct InvocationRecord {
+    PluginRecord *fPlugin;
+    const ManifestRecord *fManifest;
+    userContext fContext;
+    scriptPhase fPhase;
+    uid_t fUid;
+    gid_t fGid;
+    const char *fHome;
+    char fUidStr[3 * sizeof(uid_t) + 1];
+    char fGidStr[3 * sizeof(gid_t) + 1];
+    char **fEnvp;
+    ScriptRecord *fScripts;
+    size_t fScriptCount;
+    size_t *fOrder;        // indexes of fScripts in the order they should start, NULL for file order
+    EventLoop *fLoop;      // NULL if scripts have to be waited for one at a time
+    struct timeval fDeadline;          // end of the login budget, zero for none
+    SystemPressure fPressure;          // sampled when the login started
+    bool fUnderPressure;   // fPressure is over one of the manifest's shed thresholds
+    ShellServer fShellServer;
+};
+
+const char *PhasePrefix(scriptPhase phase, userContext context);
+void FreeScripts(InvocationRecord *invocation);
+bool CreateScripts(InvocationRecord *invocation);
+AuthorizationResult RunScripts(InvocationRecord *invocation);
+
+#endif /* defined(__LoginScriptPlugin__ScriptExecution__) */
@@ -0,0 +1,358 @@
+//
+//  ScriptGraph.c
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+#include "ScriptGraph.h"
+
+#include "DurationHistory.h"
+#include "LoginScriptPlugin.h"
+#include "ScriptExecution.h"
+#include "WorkerPool.h"
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Script Graph
+/////////////////////////////////////////////////////////////////////
+
+
+/// Return true if script is called name, or belongs to the group name.
+static bool ScriptMatches(const ScriptRecord *script, const char *name)
+{
+    return strcmp(script->fName, name) == 0
+    || (script->fSettings->fGroup != NULL && strcmp(script->fSettings->fGroup, name) == 0);
+}
+
+/// Add script index dep to the dependencies of script, once.
+static void AddDependency(ScriptRecord *script, size_t dep)
+{
+    size_t i;
+    
+    for (i = 0; i < script->fDepCount; i++) {
+        if (script->fDeps[i] == dep) {
+            return;
+        }
+    }
+    script->fDeps[script->fDepCount++] = dep;
+}
+
+/// Return true if the dependencies of the scripts form a cycle.
+static bool HasDependencyCycle(const InvocationRecord *invocation)
+{
+    size_t count = invocation->fScriptCount;
+    bool *done;
+    bool progress;
+    bool ready;
+    size_t remaining;
+    size_t i;
+    size_t j;
+    
+    if ((done = calloc(count, sizeof(*done))) == NULL) {
+        return true;
+    }
+    remaining = count;
+    do {
+        progress = false;
+        for (i = 0; i < count; i++) {
+            if (done[i]) {
+                continue;
+            }
+            ready = true;
+            for (j = 0; j < invocation->fScripts[i].fDepCount; j++) {
+                ready = ready && done[invocation->fScripts[i].fDeps[j]];
+            }
+            if (ready) {
+                done[i] = true;
+                remaining--;
+                progress = true;
+            }
+        }
+    } while (progress);
+    free(done);
+    return remaining != 0;
+}
+
+/// Work out which scripts each script has to wait for.
+///
+/// Scripts are divided into stages in glob order, where every script is a
+/// stage of its own, except that scripts in the same group share the
+/// stage of the first one. Each stage waits for the whole stage before it,
+/// so without any manifest settings scripts run one after another like
+/// they always have. A script with an "after" setting instead waits for
+/// the named scripts and groups only, and an empty "after" lets it start
+/// right away. If the result has a cycle, the plugin falls back to running
+/// the scripts one after another.
+///
+/// Gates are left out of the stages. They all start right away, and every
+/// other script waits for all of them, so that a deny is known before
+/// anything else runs.
+bool BuildScriptGraph(InvocationRecord *invocation)
+{
+    aslclient logClient = invocation->fPlugin->fLogClient;
+    size_t count = invocation->fScriptCount;
+    ScriptRecord *scripts = invocation->fScripts;
+    size_t *stages;
+    size_t stageCount;
+    char *after;
+    char *token;
+    char *state;
+    bool matched;
+    size_t previous;
+    size_t i;
+    size_t j;
+    
+    if ((stages = calloc(count, sizeof(*stages))) == NULL) {
+        return false;
+    }
+    for (i = 0; i < count; i++) {
+        if ((scripts[i].fDeps = calloc(count, sizeof(*scripts[i].fDeps))) == NULL) {
+            free(stages);
+            return false;
+        }
+    }
+    
+    stageCount = 0;
+    for (i = 0; i < count; i++) {
+        if (scripts[i].fSettings->fGate) {
+            stages[i] = SIZE_MAX;
+            continue;
+        }
+        stages[i] = stageCount;
+        for (j = 0; j < i; j++) {
+            if (scripts[i].fSettings->fGroup != NULL && stages[j] != SIZE_MAX
+                && ScriptMatches(&scripts[j], scripts[i].fSettings->fGroup)) {
+                stages[i] = stages[j];
+                break;
+            }
+        }
+        if (stages[i] == stageCount) {
+            stageCount++;
+        }
+    }
+    
+    for (i = 0; i < count; i++) {
+        if (scripts[i].fSettings->fGate) {
+            continue;
+        }
+        if (scripts[i].fSettings->fAfter == NULL) {
+            for (j = 0; j < count; j++) {
+                if (stages[i] > 0 && stages[j] == stages[i] - 1) {
+                    AddDependency(&scripts[i], j);
+                }
+            }
+            continue;
+        }
+        if ((after = strdup(scripts[i].fSettings->fAfter)) == NULL) {
+            free(stages);
+            return false;
+        }
+        for (token = strtok_r(after, " \t,", &state); token != NULL; token = strtok_r(NULL, " \t,", &state)) {
+            matched = false;
+            for (j = 0; j < count; j++) {
+                if (j != i && ScriptMatches(&scripts[j], token)) {
+                    AddDependency(&scripts[i], j);
+                    matched = true;
+                }
+            }
+            if (! matched) {
+                asl_log(logClient, NULL, ASL_LEVEL_WARNING,
+                        "%s: ignoring unknown dependency %s", scripts[i].fName, token);
+            }
+        }
+        free(after);
+    }
+    free(stages);
+    
+    if (HasDependencyCycle(invocation)) {
+        asl_log(logClient, NULL, ASL_LEVEL_ERR,
+                "Script dependencies for %s form a cycle, running scripts in order",
+                PhasePrefix(invocation->fPhase, invocation->fContext));
+        previous = SIZE_MAX;
+        for (i = 0; i < count; i++) {
+            scripts[i].fDepCount = 0;
+            if (scripts[i].fSettings->fGate) {
+                continue;
+            }
+            if (previous != SIZE_MAX) {
+                AddDependency(&scripts[i], previous);
+            }
+            previous = i;
+        }
+    }
+    
+    for (i = 0; i < count; i++) {
+        for (j = 0; j < count; j++) {
+            if (! scripts[i].fSettings->fGate && scripts[j].fSettings->fGate) {
+                AddDependency(&scripts[i], j);
+            }
+        }
+    }
+    
+    for (i = 0; i < count; i++) {
+        asl_log(logClient, NULL, ASL_LEVEL_DEBUG,
+                "%s waits for %zu scripts", scripts[i].fName, scripts[i].fDepCount);
+    }
+    
+    return true;
+}
+
+/// Simulate running the scripts of invocation in the order of fOrder with
+/// slots scripts at a time, taking their expected durations.
+///
+/// @return The predicted time until all scripts are done, in seconds.
+double PredictMakespan(const InvocationRecord *invocation, long slots)
+{
+    size_t count = invocation->fScriptCount;
+    const ScriptRecord *script;
+    double *finish;        // when each script finishes, negative until it has started
+    double now;
+    double next;
+    size_t index;
+    size_t i;
+    size_t j;
+    long running;
+    bool progress;
+    bool ready;
+    
+    if ((finish = malloc(count * sizeof(*finish))) == NULL) {
+        return 0;
+    }
+    for (i = 0; i < count; i++) {
+        finish[i] = -1;
+    }
+    now = 0;
+    for (;;) {
+        running = 0;
+        for (i = 0; i < count; i++) {
+            running += finish[i] > now && invocation->fScripts[i].fTrusted;
+        }
+        
+        // Start what's ready, in order, while there are free slots, the
+        // way RunScripts() does.
+        do {
+            progress = false;
+            for (i = 0; i < count; i++) {
+                index = invocation->fOrder[i];
+                script = &invocation->fScripts[index];
+                if (finish[index] >= 0) {
+                    continue;
+                }
+                ready = true;
+                for (j = 0; j < script->fDepCount; j++) {
+                    ready = ready && finish[script->fDeps[j]] >= 0 && finish[script->fDeps[j]] <= now;
+                }
+                if (! ready) {
+                    continue;
+                }
+                if (script->fTrusted && running >= slots) {
+                    break;
+                }
+                running += script->fTrusted;
+                finish[index] = now + script->fExpected;
+                progress = true;
+            }
+        } while (progress);
+        
+        // Move on to when the next script finishes.
+        next = -1;
+        for (i = 0; i < count; i++) {
+            if (finish[i] > now && (next < 0 || finish[i] < next)) {
+                next = finish[i];
+            }
+        }
+        if (next < 0) {
+            break;
+        }
+        now = next;
+    }
+    free(finish);
+    return now;
+}
+
+/// Decide the order the scripts of invocation start in when several are
+/// ready at once: by upward rank, that is the longest expected chain of
+/// scripts from the start of a script to the end of the last script that
+/// waits for it. Without dependencies this is longest expected first.
+///
+/// The order and predicted duration are logged. If memory allocation
+/// fails, the scripts start in file order.
+void ScheduleScripts(InvocationRecord *invocation)
+{
+    aslclient logClient = invocation->fPlugin->fLogClient;
+    size_t count = invocation->fScriptCount;
+    ScriptRecord *scripts = invocation->fScripts;
+    char summary[2048];
+    size_t length;
+    size_t pass;
+    size_t i;
+    size_t j;
+    size_t k;
+    double rank;
+    bool changed;
+    
+    if (count == 0 || (invocation->fOrder = malloc(count * sizeof(*invocation->fOrder))) == NULL) {
+        return;
+    }
+    LookUpDurations(invocation);
+    
+    // Relax the ranks along the dependencies until they settle, which
+    // takes at most count passes in an acyclic graph.
+    for (i = 0; i < count; i++) {
+        scripts[i].fRank = scripts[i].fExpected;
+    }
+    for (pass = 0, changed = true; changed && pass < count; pass++) {
+        changed = false;
+        for (i = 0; i < count; i++) {
+            for (k = 0; k < scripts[i].fDepCount; k++) {
+                j = scripts[i].fDeps[k];
+                rank = scripts[j].fExpected + scripts[i].fRank;
+                if (rank > scripts[j].fRank) {
+                    scripts[j].fRank = rank;
+                    changed = true;
+                }
+            }
+        }
+    }
+    
+    // Insertion sort by descending rank, keeping file order for ties.
+    for (i = 0; i < count; i++) {
+        for (j = i; j > 0 && scripts[invocation->fOrder[j - 1]].fRank < scripts[i].fRank; j--) {
+            invocation->fOrder[j] = invocation->fOrder[j - 1];
+        }
+        invocation->fOrder[j] = i;
+    }
+    
+    length = 0;
+    for (i = 0; i < count && length < sizeof(summary); i++) {
+        length += snprintf(summary + length, sizeof(summary) - length, "%s%s (%.3f s)",
+                           i > 0 ? ", " : "", scripts[invocation->fOrder[i]].fName,
+                           scripts[invocation->fOrder[i]].fExpected);
+    }
+    asl_log(logClient, NULL, ASL_LEVEL_NOTICE,
+            "Starting %s scripts in the order %s, predicted to take %.3f s",
+            PhasePrefix(invocation->fPhase, invocation->fContext), summary,
+            PredictMakespan(invocation, WorkerPoolLimit(&invocation->fPlugin->fPool)));
+}
+
+/// Return true if every dependency of script has finished, has signalled
+/// readiness, or has been started in the background.
+bool ScriptReady(const InvocationRecord *invocation, const ScriptRecord *script)
+{
+    size_t i;
+    
+    for (i = 0; i < script->fDepCount; i++) {
+        switch (invocation->fScripts[script->fDeps[i]].fState) {
+            case kScriptFinished:
+            case kScriptDetached:
+            case kScriptReady:
+            case kScriptSpooled:
+                break;
+            default:
+                return false;
+        }
+    }
+    return true;
+}
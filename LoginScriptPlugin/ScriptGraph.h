@@ -0,0 +1,18 @@
+//
+//  ScriptGraph.h
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+#ifndef __LoginScriptPlugin__ScriptGraph__
+#define __LoginScriptPlugin__ScriptGraph__
+
+#include "Common.h"
+
+bool BuildScriptGraph(InvocationRecord *invocation);
+double PredictMakespan(const InvocationRecord *invocation, long slots);
+void ScheduleScripts(InvocationRecord *invocation);
+bool ScriptReady(const InvocationRecord *invocation, const ScriptRecord *script);
+
+#endif /* defined(__LoginScriptPlugin__ScriptGraph__) */
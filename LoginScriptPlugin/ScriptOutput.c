@@ -0,0 +1,113 @@
+//
+//  ScriptOutput.c
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+#include "ScriptOutput.h"
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Script Output
+/////////////////////////////////////////////////////////////////////
+
+
+enum {
+    kMaxScriptOutput = 16 * 1024       // bytes of output kept per script
+};
+
+/// What a script writes to kNotifyFileno once login can go on without it.
+const char kReadyToken[] = "READY";
+
+/// Set up an empty output buffer without a pipe.
+void InitOutputBuffer(OutputBuffer *output)
+{
+    output->fFd = -1;
+    output->fData = NULL;
+    output->fLength = 0;
+    output->fTruncated = false;
+}
+
+/// Stop collecting output.
+void CloseOutputBuffer(OutputBuffer *output)
+{
+    if (output->fFd != -1) {
+        close(output->fFd);
+        output->fFd = -1;
+    }
+}
+
+/// Release the resources held by output.
+void FreeOutputBuffer(OutputBuffer *output)
+{
+    CloseOutputBuffer(output);
+    free(output->fData);
+    InitOutputBuffer(output);
+}
+
+/// Read whatever output is available, without blocking.
+///
+/// Output beyond kMaxScriptOutput is discarded. The pipe is closed when
+/// the script and anything it started have closed their end.
+void ReadOutputBuffer(OutputBuffer *output)
+{
+    char buffer[4096];
+    char *data;
+    size_t keep;
+    ssize_t n;
+    
+    while (output->fFd != -1) {
+        n = read(output->fFd, buffer, sizeof(buffer));
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n == -1 && errno == EAGAIN) {
+            return;
+        }
+        if (n <= 0) {
+            CloseOutputBuffer(output);
+            return;
+        }
+        keep = (size_t)n;
+        if (keep > kMaxScriptOutput - output->fLength) {
+            keep = kMaxScriptOutput - output->fLength;
+            output->fTruncated = true;
+        }
+        if (keep == 0) {
+            continue;
+        }
+        if ((data = realloc(output->fData, output->fLength + keep)) == NULL) {
+            output->fTruncated = true;
+            continue;
+        }
+        memcpy(data + output->fLength, buffer, keep);
+        output->fData = data;
+        output->fLength += keep;
+    }
+}
+
+/// Log the output of the script called name, one line at a time.
+void LogOutputBuffer(const OutputBuffer *output, const char *name, aslclient logClient)
+{
+    const char *line;
+    const char *end;
+    const char *newline;
+    
+    line = output->fData;
+    end = output->fData + output->fLength;
+    while (line < end) {
+        newline = memchr(line, '\n', (size_t)(end - line));
+        if (newline == NULL) {
+            newline = end;
+        }
+        asl_log(logClient, NULL, ASL_LEVEL_NOTICE,
+                "%s: %.*s", name, (int)(newline - line), line);
+        line = newline + 1;
+    }
+    if (output->fTruncated) {
+        asl_log(logClient, NULL, ASL_LEVEL_NOTICE,
+                "%s: output truncated to %d bytes", name, kMaxScriptOutput);
+    }
+}
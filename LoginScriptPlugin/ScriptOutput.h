@@ -0,0 +1,29 @@
+//
+//  ScriptOutput.h
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+#ifndef __LoginScriptPlugin__ScriptOutput__
+#define __LoginScriptPlugin__ScriptOutput__
+
+#include "Common.h"
+
+extern const char kReadyToken[];
+
+/// OutputBuffer collects what a script writes to stdout and stderr.
+typedef struct {
+    int fFd;               // read end of the output pipe, -1 once closed
+    char *fData;
+    size_t fLength;
+    bool fTruncated;
+} OutputBuffer;
+
+void InitOutputBuffer(OutputBuffer *output);
+void CloseOutputBuffer(OutputBuffer *output);
+void FreeOutputBuffer(OutputBuffer *output);
+void ReadOutputBuffer(OutputBuffer *output);
+void LogOutputBuffer(const OutputBuffer *output, const char *name, aslclient logClient);
+
+#endif /* defined(__LoginScriptPlugin__ScriptOutput__) */
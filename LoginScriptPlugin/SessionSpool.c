@@ -0,0 +1,237 @@
+//
+//  SessionSpool.c
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+#include "SessionSpool.h"
+
+#include "LoginScriptPlugin.h"
+#include "Manifest.h"
+#include "RunPredicates.h"
+#include "ScriptExecution.h"
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Session Spool
+/////////////////////////////////////////////////////////////////////
+
+
+// Postmount-user scripts marked in_session don't run during login at
+// all. The postmount-user mechanism queues them in a spool file for the
+// user, and kSessionAgentPath, started by launchd in the user's session
+// once it's up, runs them and empties the file. The spool is a text
+// file in kSessionSpoolDir named after the uid, owned by the user:
+//
+//     LoginScriptPlugin 1
+//     <uid> TAB <gid> TAB <home>
+//     <timeout> TAB <path>
+//     ...
+//
+// with one line for each script, in an order the agent can run them one
+// at a time in without any of them starting before a script it waits for.
+// Scripts that a script run during login waits for stay in the login,
+// since they wouldn't have run yet when it starts.
+
+const char *kSessionSpoolDir = _PATH_VARRUN "LoginScriptPlugin.spool";
+const char *kSessionAgentPath = "/usr/local/libexec/loginscriptagent";
+static const char *kSessionSpoolHeader = "LoginScriptPlugin 1";
+
+/// Create kSessionSpoolDir if necessary, and make sure only root can
+/// create files in it.
+static bool PrepareSessionSpoolDir(aslclient logClient)
+{
+    struct stat info;
+    
+    if (mkdir(kSessionSpoolDir, S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH) != 0 && errno != EEXIST) {
+        asl_log(logClient, NULL, ASL_LEVEL_WARNING,
+                "Can't create %s, errno %d", kSessionSpoolDir, errno);
+        return false;
+    }
+    if (lstat(kSessionSpoolDir, &info) != 0 || ! S_ISDIR(info.st_mode) || info.st_uid != 0
+        || (info.st_mode & (S_IWGRP | S_IWOTH)) != 0) {
+        asl_log(logClient, NULL, ASL_LEVEL_WARNING,
+                "Not queueing scripts, %s must be a directory only writable by root", kSessionSpoolDir);
+        return false;
+    }
+    return true;
+}
+
+/// Return true if script can be left to the session agent. Its run
+/// predicates are evaluated now, with the rest of the login.
+static bool ScriptCanSpool(const InvocationRecord *invocation, const ScriptRecord *script)
+{
+    const ScriptSettings *settings = script->fSettings;
+    
+    return settings->fInSession && script->fTrusted && ! script->fActions
+        && strpbrk(script->fPath, "\t\n") == NULL
+        && ! (settings->fShedding != kShedNever && invocation->fUnderPressure)
+        && RunPredicatesMatch(invocation, script);
+}
+
+/// Mark the scripts of invocation that can be left to the session agent as
+/// kScriptSpooled, except those that a script staying in the login waits
+/// for, directly or through other scripts.
+///
+/// @return The number of scripts marked.
+static size_t MarkSessionScripts(InvocationRecord *invocation)
+{
+    ScriptRecord *scripts = invocation->fScripts;
+    size_t spooled;
+    size_t i;
+    size_t j;
+    bool changed;
+    
+    spooled = 0;
+    for (i = 0; i < invocation->fScriptCount; i++) {
+        if (ScriptCanSpool(invocation, &scripts[i])) {
+            scripts[i].fState = kScriptSpooled;
+            spooled++;
+        }
+    }
+    do {
+        changed = false;
+        for (i = 0; i < invocation->fScriptCount; i++) {
+            if (scripts[i].fState == kScriptSpooled) {
+                continue;
+            }
+            for (j = 0; j < scripts[i].fDepCount; j++) {
+                if (scripts[scripts[i].fDeps[j]].fState == kScriptSpooled) {
+                    asl_log(invocation->fPlugin->fLogClient, NULL, ASL_LEVEL_DEBUG,
+                            "Running %s during login, %s waits for it",
+                            scripts[scripts[i].fDeps[j]].fName, scripts[i].fName);
+                    scripts[scripts[i].fDeps[j]].fState = kScriptPending;
+                    spooled--;
+                    changed = true;
+                }
+            }
+        }
+    } while (changed);
+    return spooled;
+}
+
+/// Write the spooled scripts of invocation to file, each after the
+/// scripts it waits for.
+static void WriteSessionScripts(InvocationRecord *invocation, FILE *file)
+{
+    ScriptRecord *scripts = invocation->fScripts;
+    bool *written;
+    bool progress;
+    bool ready;
+    size_t i;
+    size_t j;
+    
+    // The dependencies don't form a cycle, BuildScriptGraph() sees to that,
+    // so only running out of memory leaves scripts for name order.
+    written = calloc(invocation->fScriptCount, sizeof(*written));
+    do {
+        progress = false;
+        for (i = 0; written != NULL && i < invocation->fScriptCount; i++) {
+            if (scripts[i].fState != kScriptSpooled || written[i]) {
+                continue;
+            }
+            ready = true;
+            for (j = 0; j < scripts[i].fDepCount; j++) {
+                ready = ready && (written[scripts[i].fDeps[j]] || scripts[scripts[i].fDeps[j]].fState != kScriptSpooled);
+            }
+            if (ready) {
+                fprintf(file, "%ld\t%s\n", scripts[i].fSettings->fTimeout, scripts[i].fPath);
+                written[i] = true;
+                progress = true;
+            }
+        }
+    } while (progress);
+    for (i = 0; i < invocation->fScriptCount; i++) {
+        if (scripts[i].fState == kScriptSpooled && (written == NULL || ! written[i])) {
+            fprintf(file, "%ld\t%s\n", scripts[i].fSettings->fTimeout, scripts[i].fPath);
+        }
+    }
+    free(written);
+}
+
+/// Queue the postmount-user scripts of invocation that run in the session
+/// for the session agent, replacing whatever an earlier login of the
+/// user left in the spool.
+///
+/// The file is written next to its final name and renamed into place, so
+/// the agent never sees a partial spool. If anything goes wrong, nothing
+/// is queued and the scripts run during login as usual.
+///
+/// @return The number of scripts queued, which are kScriptSpooled now.
+size_t SpoolSessionScripts(InvocationRecord *invocation)
+{
+    aslclient logClient = invocation->fPlugin->fLogClient;
+    char path[MAXPATHLEN];
+    char temp[MAXPATHLEN];
+    FILE *file;
+    size_t spooled;
+    size_t i;
+    int fd;
+    
+    if ((spooled = MarkSessionScripts(invocation)) == 0) {
+        return 0;
+    }
+    if (access(kSessionAgentPath, X_OK) != 0) {
+        asl_log(logClient, NULL, ASL_LEVEL_WARNING,
+                "Running %zu in_session scripts during login, %s isn't installed", spooled, kSessionAgentPath);
+        goto fail;
+    }
+    if (strpbrk(invocation->fHome, "\t\n") != NULL) {
+        asl_log(logClient, NULL, ASL_LEVEL_WARNING,
+                "Running %zu in_session scripts during login, the home directory can't be queued", spooled);
+        goto fail;
+    }
+    if (! PrepareSessionSpoolDir(logClient)) {
+        goto fail;
+    }
+    
+    if (snprintf(path, sizeof(path), "%s/%u", kSessionSpoolDir, (unsigned)invocation->fUid) >= (int)sizeof(path)
+        || snprintf(temp, sizeof(temp), "%s.new", path) >= (int)sizeof(temp)) {
+        asl_log(logClient, NULL, ASL_LEVEL_WARNING,
+                "Running %zu in_session scripts during login, the spool path is too long", spooled);
+        goto fail;
+    }
+    (void)unlink(temp);
+    if ((fd = open(temp, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, S_IRUSR | S_IWUSR)) == -1) {
+        asl_log(logClient, NULL, ASL_LEVEL_WARNING,
+                "Can't create %s, errno %d", temp, errno);
+        goto fail;
+    }
+    if (fchown(fd, invocation->fUid, invocation->fGid) != 0 || (file = fdopen(fd, "w")) == NULL) {
+        asl_log(logClient, NULL, ASL_LEVEL_WARNING,
+                "Can't prepare %s, errno %d", temp, errno);
+        close(fd);
+        (void)unlink(temp);
+        goto fail;
+    }
+    
+    fprintf(file, "%s\n%u\t%u\t%s\n", kSessionSpoolHeader,
+            (unsigned)invocation->fUid, (unsigned)invocation->fGid, invocation->fHome);
+    WriteSessionScripts(invocation, file);
+    if (ferror(file)) {
+        fclose(file);
+        errno = EIO;
+        goto fail_written;
+    }
+    if (fclose(file) != 0 || rename(temp, path) != 0) {
+        goto fail_written;
+    }
+    
+    asl_log(logClient, NULL, ASL_LEVEL_NOTICE,
+            "Queued %zu in_session scripts for the session agent in %s", spooled, path);
+    return spooled;
+    
+fail_written:
+    asl_log(logClient, NULL, ASL_LEVEL_WARNING,
+            "Writing %s failed with errno %d", path, errno);
+    (void)unlink(temp);
+fail:
+    for (i = 0; i < invocation->fScriptCount; i++) {
+        if (invocation->fScripts[i].fState == kScriptSpooled) {
+            invocation->fScripts[i].fState = kScriptPending;
+        }
+    }
+    return 0;
+}
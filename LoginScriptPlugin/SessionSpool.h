@@ -0,0 +1,18 @@
+//
+//  SessionSpool.h
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+#ifndef __LoginScriptPlugin__SessionSpool__
+#define __LoginScriptPlugin__SessionSpool__
+
+#include "Common.h"
+
+extern const char *kSessionSpoolDir;
+extern const char *kSessionAgentPath;
+
+size_t SpoolSessionScripts(InvocationRecord *invocation);
+
+#endif /* defined(__LoginScriptPlugin__SessionSpool__) */
@@ -0,0 +1,479 @@
+//
+//  ShellServer.c
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+#include <limits.h>
+
+#include "ShellServer.h"
+
+#include "EventLoop.h"
+#include "Launcher.h"
+#include "LoginScriptPlugin.h"
+#include "ScriptExecution.h"
+#include "Spawn.h"
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Shell Server
+/////////////////////////////////////////////////////////////////////
+
+
+static const char *kShellServerPath = "/bin/bash";
+
+/// The shell server reads requests of the form "id path uid gid home",
+/// separated by kShellSeparator, from kNotifyFileno. Each script is
+/// sourced in a subshell of a background job, which job control puts in a
+/// process group of its own, with its path as $0 where bash allows it and
+/// none of the variables of the server left. The server reports
+/// "started id pid" when the job is running, and "exit id status" or
+/// "signal id number" when the script is done. The output of the script is
+/// left in a file named after the id.
+///
+/// Job control notices go to the server's stderr, which is discarded, so
+/// that they don't pile up in the report pipe.
+///
+/// The shell reports death by a signal as 128 plus the signal number, just
+/// like an exit with that status, so a script only counts as killed if the
+/// job got the same signal too, which it does when the process group is
+/// signalled.
+static const char kShellServerScript[] =
+    "dir=$1\n"
+    "exec 2>/dev/null\n"
+    "set -m\n"
+    "while IFS=$'\\037' read -r -u 3 id path uid gid home; do\n"
+    "    {\n"
+    "        trap 'sig=1' HUP; trap 'sig=2' INT; trap 'sig=3' QUIT; trap 'sig=15' TERM\n"
+    "        ( exec 3<&- </dev/null >\"$dir/$id\" 2>&1\n"
+    "          set -- \"$path\" \"$uid\" \"$gid\" \"$home\"\n"
+    "          if (( BASH_VERSINFO[0] >= 5 )); then BASH_ARGV0=$1; fi\n"
+    "          unset dir id path uid gid home sig\n"
+    "          . \"$@\" )\n"
+    "        status=$?\n"
+    "        if [[ -n $sig && $status -eq 128+sig ]]; then\n"
+    "            echo \"signal $id $sig\"\n"
+    "        else\n"
+    "            echo \"exit $id $status\"\n"
+    "        fi\n"
+    "    } &\n"
+    "    echo \"started $id $!\"\n"
+    "done\n"
+    "wait\n";
+
+enum {
+    kShellSeparator = '\037',
+    kShellPollMilliseconds = 100,      // how often a waiter checks that its script still exists
+    kShellMaxOutput = 64 * 1024,       // bytes of output passed on per script
+    kShellMaxScript = 16 * 1024        // larger scripts aren't batched
+};
+
+/// Set up server as not running.
+void InitShellServer(ShellServer *server)
+{
+    memset(server, 0, sizeof(*server));
+    server->fPid = -1;
+    server->fCommands = -1;
+    server->fReports = -1;
+}
+
+/// Return true if script can be run by the shell server.
+///
+/// Only bash and sh scripts qualify, and only if they don't need anything
+/// a subshell of the server can't provide. That includes $0, which the
+/// /bin/bash of the system is too old to set for a subshell.
+bool ScriptCanBatch(const InvocationRecord *invocation, const ScriptRecord *script)
+{
+    const ScriptSettings *settings = script->fSettings;
+    char text[kShellMaxScript + 1];
+    size_t length;
+    size_t end;
+    ssize_t n;
+    int fd;
+    
+    if (! settings->fBatch || ! script->fTrusted || settings->fDetach || settings->fNotifyReady
+        || HasResourceLimits(&settings->fLimits) || settings->fPriority != kPriorityNormal
+        || strpbrk(script->fPath, "\037\n") != NULL || strpbrk(invocation->fHome, "\037\n") != NULL) {
+        return false;
+    }
+    if ((fd = open(script->fPath, O_RDONLY | O_NOFOLLOW | O_CLOEXEC)) == -1) {
+        return false;
+    }
+    length = 0;
+    while (length < sizeof(text) && (n = read(fd, text + length, sizeof(text) - length)) > 0) {
+        length += (size_t)n;
+    }
+    close(fd);
+    if (length == 0 || length == sizeof(text)) {
+        return false;
+    }
+    end = 0;
+    while (end < length && strchr(" \t\r\n", text[end]) == NULL) {
+        end++;
+    }
+    if (! (end == 9 && memcmp(text, "#!/bin/sh", 9) == 0) && ! (end == 11 && memcmp(text, "#!/bin/bash", 11) == 0)) {
+        return false;
+    }
+    return memmem(text, length, "$0", 2) == NULL && memmem(text, length, "${0", 3) == NULL;
+}
+
+/// Start the shell server of invocation with the spawn backend, as the
+/// user the scripts of invocation run as.
+bool StartShellServer(InvocationRecord *invocation)
+{
+    ShellServer *server = &invocation->fShellServer;
+    aslclient logClient = invocation->fPlugin->fLogClient;
+    SpawnRequest request;
+    char *argv[6];
+    int commands[2];
+    int reports[2];
+    int on = 1;
+    
+    snprintf(server->fDirectory, sizeof(server->fDirectory), "%sLoginScriptPlugin.XXXXXX", _PATH_VARRUN);
+    if (mkdtemp(server->fDirectory) == NULL) {
+        asl_log(logClient, NULL, ASL_LEVEL_WARNING,
+                "Creating shell server directory failed with errno %d", errno);
+        server->fDirectory[0] = '\0';
+        server->fFailed = true;
+        return false;
+    }
+    if (invocation->fContext == kRunAsUser && chown(server->fDirectory, invocation->fUid, invocation->fGid) != 0) {
+        asl_log(logClient, NULL, ASL_LEVEL_WARNING,
+                "Changing owner of %s failed with errno %d", server->fDirectory, errno);
+        goto fail;
+    }
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, commands) != 0) {
+        goto fail;
+    }
+    if (pipe(reports) != 0) {
+        close(commands[0]);
+        close(commands[1]);
+        goto fail;
+    }
+    fcntl(commands[0], F_SETFD, FD_CLOEXEC);
+    fcntl(commands[1], F_SETFD, FD_CLOEXEC);
+    fcntl(reports[0], F_SETFD, FD_CLOEXEC);
+    fcntl(reports[1], F_SETFD, FD_CLOEXEC);
+    setsockopt(commands[0], SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+    
+    argv[0] = "bash";
+    argv[1] = "-c";
+    argv[2] = (char *)kShellServerScript;
+    argv[3] = "LoginScriptPlugin";     // $0 of the server and the scripts it runs
+    argv[4] = server->fDirectory;
+    argv[5] = NULL;
+    
+    request.fPath = kShellServerPath;
+    request.fArgv = argv;
+    request.fEnvp = invocation->fEnvp;
+    request.fUid = invocation->fUid;
+    request.fGid = invocation->fGid;
+    request.fContext = invocation->fContext;
+    request.fOutputFd = reports[1];
+    request.fNotifyFd = commands[1];
+    memset(&request.fLimits, 0, sizeof(request.fLimits));
+    request.fPriority = kPriorityNormal;
+    
+    server->fPid = invocation->fManifest->fSpawnBackend->fSpawn(invocation->fPlugin, &request);
+    if (server->fPid == -1) {
+        asl_log(logClient, NULL, ASL_LEVEL_WARNING,
+                "Starting shell server failed with errno %d", errno);
+    }
+    close(commands[1]);
+    close(reports[1]);
+    if (server->fPid == -1) {
+        close(commands[0]);
+        close(reports[0]);
+        goto fail;
+    }
+    server->fCommands = commands[0];
+    server->fReports = reports[0];
+    
+    asl_log(logClient, NULL, ASL_LEVEL_DEBUG,
+            "Started shell server with pid %d", server->fPid);
+    return true;
+    
+fail:
+    rmdir(server->fDirectory);
+    server->fDirectory[0] = '\0';
+    server->fFailed = true;
+    return false;
+}
+
+/// Return the job of server with the given id, or NULL.
+static ShellJob *ShellServerJob(ShellServer *server, unsigned id)
+{
+    size_t i;
+    
+    for (i = 0; i < server->fJobCount; i++) {
+        if (server->fJobs[i].fId == id) {
+            return &server->fJobs[i];
+        }
+    }
+    return NULL;
+}
+
+/// Apply a single report line from the shell server.
+static void HandleShellReport(InvocationRecord *invocation, char *line)
+{
+    ShellServer *server = &invocation->fShellServer;
+    ShellJob *job;
+    unsigned id;
+    int value;
+    
+    if (sscanf(line, "started %u %d", &id, &value) == 2 && (job = ShellServerJob(server, id)) != NULL) {
+        job->fPid = value;
+    } else if (sscanf(line, "exit %u %d", &id, &value) == 2 && (job = ShellServerJob(server, id)) != NULL) {
+        job->fExited = true;
+        job->fStatus = (value & 0xff) << 8;
+    } else if (sscanf(line, "signal %u %d", &id, &value) == 2 && (job = ShellServerJob(server, id)) != NULL) {
+        job->fExited = true;
+        job->fStatus = value & 0x7f;
+    } else {
+        asl_log(invocation->fPlugin->fLogClient, NULL, ASL_LEVEL_DEBUG,
+                "Shell server: %s", line);
+    }
+}
+
+/// Read and apply the reports of the shell server, waiting up to timeout
+/// milliseconds for them.
+///
+/// @return The number of bytes read, or -1 if the server has gone away.
+static ssize_t ReadShellReports(InvocationRecord *invocation, int timeout)
+{
+    ShellServer *server = &invocation->fShellServer;
+    struct pollfd pfd;
+    char *newline;
+    ssize_t n;
+    int ready;
+    
+    pfd.fd = server->fReports;
+    pfd.events = POLLIN;
+    ready = poll(&pfd, 1, timeout);
+    if (ready == -1) {
+        return errno == EINTR ? 0 : -1;
+    }
+    if (ready == 0) {
+        return 0;
+    }
+    
+    n = read(server->fReports, server->fBuffer + server->fBufferLength,
+             sizeof(server->fBuffer) - server->fBufferLength - 1);
+    if (n == -1) {
+        return errno == EINTR ? 0 : -1;
+    }
+    if (n == 0) {
+        return -1;
+    }
+    server->fBufferLength += (size_t)n;
+    server->fBuffer[server->fBufferLength] = '\0';
+    while ((newline = strchr(server->fBuffer, '\n')) != NULL) {
+        *newline = '\0';
+        HandleShellReport(invocation, server->fBuffer);
+        server->fBufferLength -= (size_t)(newline + 1 - server->fBuffer);
+        memmove(server->fBuffer, newline + 1, server->fBufferLength + 1);
+    }
+    if (server->fBufferLength == sizeof(server->fBuffer) - 1) {
+        // Not a report, so drop it.
+        server->fBufferLength = 0;
+    }
+    return n;
+}
+
+/// Have the shell server run script, with its output going to outputFd
+/// once it's done.
+///
+/// If the server doesn't respond before the login budget runs out, it is
+/// marked as failed, and scripts aren't batched anymore.
+///
+/// @return The pid of the subshell running script, or -1 with errno set.
+pid_t ShellServerSpawn(InvocationRecord *invocation, ScriptRecord *script, int outputFd)
+{
+    ShellServer *server = &invocation->fShellServer;
+    ShellJob *jobs;
+    ShellJob *job;
+    char *command;
+    size_t capacity;
+    unsigned id;
+    int length;
+    long left;
+    int timeout;
+    bool sent;
+    
+    if (server->fJobCount == server->fJobCapacity) {
+        capacity = server->fJobCapacity ? server->fJobCapacity * 2 : 8;
+        if ((jobs = realloc(server->fJobs, capacity * sizeof(*jobs))) == NULL) {
+            return -1;
+        }
+        server->fJobs = jobs;
+        server->fJobCapacity = capacity;
+    }
+    length = asprintf(&command, "%u%c%s%c%s%c%s%c%s\n", server->fSerial + 1,
+                      kShellSeparator, script->fPath, kShellSeparator, invocation->fUidStr,
+                      kShellSeparator, invocation->fGidStr, kShellSeparator, invocation->fHome);
+    if (length == -1) {
+        return -1;
+    }
+    id = ++server->fSerial;
+    job = &server->fJobs[server->fJobCount++];
+    job->fId = id;
+    job->fPid = -1;
+    job->fOutputFd = outputFd != -1 ? dup(outputFd) : -1;
+    job->fExited = false;
+    job->fStatus = 0;
+    if (job->fOutputFd != -1) {
+        fcntl(job->fOutputFd, F_SETFD, FD_CLOEXEC);
+        fcntl(job->fOutputFd, F_SETFL, O_NONBLOCK);
+    }
+    
+    sent = WriteFully(server->fCommands, command, (size_t)length);
+    free(command);
+    while (sent && (job = ShellServerJob(server, id))->fPid == -1) {
+        // A server that doesn't answer isn't waited for past the login budget.
+        timeout = -1;
+        if (invocation->fDeadline.tv_sec != 0) {
+            if ((left = TimeUntil(&invocation->fDeadline)) <= 0) {
+                break;
+            }
+            timeout = left < INT_MAX ? (int)left : INT_MAX;
+        }
+        if (ReadShellReports(invocation, timeout) == -1) {
+            break;
+        }
+    }
+    job = ShellServerJob(server, id);
+    if (job->fPid == -1) {
+        asl_log(invocation->fPlugin->fLogClient, NULL, ASL_LEVEL_WARNING,
+                "Shell server with pid %d stopped responding", server->fPid);
+        server->fFailed = true;
+        if (job->fOutputFd != -1) {
+            close(job->fOutputFd);
+        }
+        *job = server->fJobs[--server->fJobCount];
+        errno = ECHILD;
+        return -1;
+    }
+    return job->fPid;
+}
+
+/// Pass on the output the shell server has stored for job, as far as it
+/// fits in the output pipe, and remove it.
+static void CopyShellOutput(InvocationRecord *invocation, ShellJob *job)
+{
+    ShellServer *server = &invocation->fShellServer;
+    char path[MAXPATHLEN];
+    char buffer[4096];
+    struct stat sb;
+    size_t copied;
+    ssize_t n;
+    int fd;
+    
+    if (snprintf(path, sizeof(path), "%s/%u", server->fDirectory, job->fId) >= (int)sizeof(path)) {
+        return;
+    }
+    fd = open(path, O_RDONLY | O_NOFOLLOW | O_NONBLOCK | O_CLOEXEC);
+    (void)unlink(path);
+    if (fd == -1) {
+        return;
+    }
+    // The directory belongs to the user for user scripts, so don't pass
+    // on anything but the file the server created, which has no links
+    // left now.
+    if (fstat(fd, &sb) != 0 || ! S_ISREG(sb.st_mode) || sb.st_nlink != 0
+        || sb.st_uid != (invocation->fContext == kRunAsUser ? invocation->fUid : 0)) {
+        close(fd);
+        return;
+    }
+    copied = 0;
+    while (job->fOutputFd != -1 && copied < kShellMaxOutput && (n = read(fd, buffer, sizeof(buffer))) > 0) {
+        if (! WriteFully(job->fOutputFd, buffer, (size_t)n)) {
+            break;
+        }
+        copied += (size_t)n;
+    }
+    close(fd);
+}
+
+/// Wait for the script the shell server runs as pid to be done.
+///
+/// A script that was killed can't report its status, so it is reported as
+/// killed by SIGKILL once the subshell is gone. The shell server can't
+/// measure the CPU time of scripts.
+int ShellServerWait(InvocationRecord *invocation, pid_t pid, SpawnStatus *status)
+{
+    ShellServer *server = &invocation->fShellServer;
+    ShellJob *job;
+    ssize_t n;
+    size_t i;
+    bool gone;
+    
+    for (;;) {
+        job = NULL;
+        for (i = 0; i < server->fJobCount; i++) {
+            if (server->fJobs[i].fPid == pid) {
+                job = &server->fJobs[i];
+            }
+        }
+        if (job == NULL) {
+            errno = ECHILD;
+            return -1;
+        }
+        if (job->fExited) {
+            break;
+        }
+        // The subshell reports before it exits, so once it's gone the
+        // report is either in the pipe or never coming.
+        gone = kill(pid, 0) == -1 && errno == ESRCH;
+        n = ReadShellReports(invocation, gone ? 0 : kShellPollMilliseconds);
+        if (gone && n <= 0) {
+            break;
+        }
+        if (n == -1) {
+            // The server is gone, but the subshell may still be running.
+            usleep(kShellPollMilliseconds * 1000);
+        }
+    }
+    
+    memset(status, 0, sizeof(*status));
+    status->fStatus = job->fExited ? job->fStatus : SIGKILL;
+    CopyShellOutput(invocation, job);
+    if (job->fOutputFd != -1) {
+        close(job->fOutputFd);
+    }
+    *job = server->fJobs[--server->fJobCount];
+    return 0;
+}
+
+/// Shut down the shell server of invocation, once all its scripts are done.
+void StopShellServer(InvocationRecord *invocation)
+{
+    ShellServer *server = &invocation->fShellServer;
+    SpawnStatus status;
+    size_t i;
+    
+    if (server->fCommands != -1) {
+        // The server exits when it sees the end of the requests.
+        close(server->fCommands);
+    }
+    if (server->fReports != -1) {
+        // Nothing is waiting for reports anymore, and a server blocked on
+        // a full pipe would never exit.
+        close(server->fReports);
+    }
+    if (server->fPid != -1) {
+        (void)invocation->fManifest->fSpawnBackend->fWait(invocation->fPlugin, server->fPid, &status);
+    }
+    for (i = 0; i < server->fJobCount; i++) {
+        if (server->fJobs[i].fOutputFd != -1) {
+            close(server->fJobs[i].fOutputFd);
+        }
+    }
+    free(server->fJobs);
+    if (server->fDirectory[0] != '\0' && rmdir(server->fDirectory) != 0) {
+        asl_log(invocation->fPlugin->fLogClient, NULL, ASL_LEVEL_WARNING,
+                "Removing %s failed with errno %d", server->fDirectory, errno);
+    }
+    InitShellServer(server);
+}
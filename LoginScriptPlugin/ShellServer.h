@@ -0,0 +1,46 @@
+//
+//  ShellServer.h
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+#ifndef __LoginScriptPlugin__ShellServer__
+#define __LoginScriptPlugin__ShellServer__
+
+#include "Common.h"
+#include "Spawn.h"
+
+/// ShellJob is a script run by the shell server.
+typedef struct {
+    unsigned fId;
+    pid_t fPid;            // of the subshell running the script, -1 until it has started
+    int fOutputFd;         // receives the output of the script once it's done
+    bool fExited;
+    int fStatus;           // as returned by waitpid()
+} ShellJob;
+
+/// ShellServer is a shell process that runs batched scripts in subshells
+/// of its own, so that they don't pay for starting an interpreter each.
+typedef struct {
+    pid_t fPid;            // -1 if not running
+    bool fFailed;          // couldn't be started or stopped responding
+    int fCommands;         // the server reads script requests from this socket
+    int fReports;          // and reports on them in this pipe
+    char fDirectory[MAXPATHLEN];       // where the server stores the output of scripts
+    char fBuffer[256];     // incomplete report line
+    size_t fBufferLength;
+    ShellJob *fJobs;
+    size_t fJobCount;
+    size_t fJobCapacity;
+    unsigned fSerial;
+} ShellServer;
+
+void InitShellServer(ShellServer *server);
+bool ScriptCanBatch(const InvocationRecord *invocation, const ScriptRecord *script);
+bool StartShellServer(InvocationRecord *invocation);
+pid_t ShellServerSpawn(InvocationRecord *invocation, ScriptRecord *script, int outputFd);
+int ShellServerWait(InvocationRecord *invocation, pid_t pid, SpawnStatus *status);
+void StopShellServer(InvocationRecord *invocation);
+
+#endif /* defined(__LoginScriptPlugin__ShellServer__) */
@@ -0,0 +1,434 @@
+//
+//  Spawn.c
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+#include "Spawn.h"
+
+#include "LoginScriptPlugin.h"
+
+// Private SPI in libsystem_kernel (spawn_private.h), available from 10.15.
+// Weakly imported so that the posix_spawn backend can fall back to fork()
+// on older systems where user scripts can't be spawned with dropped
+// privileges.
+extern int posix_spawnattr_set_uid_np(const posix_spawnattr_t *attr, uid_t uid) __attribute__((weak_import));
+extern int posix_spawnattr_set_gid_np(const posix_spawnattr_t *attr, gid_t gid) __attribute__((weak_import));
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** File Descriptor Hygiene
+/////////////////////////////////////////////////////////////////////
+
+
+enum {
+    kDescriptorListSize = 512      // entries in the on-stack descriptor list
+};
+
+/// Apply action to a single descriptor.
+///
+/// @return 0, or an errno value if the descriptor is open but the action
+///         failed.
+static int SanitizeDescriptor(int fd, descriptorAction action)
+{
+    if (action == kDescriptorClose) {
+        close(fd);
+        return 0;
+    }
+    // Use FD_CLOEXEC instead of close to avoid libdispatch crash.
+    if (fcntl(fd, F_SETFD, FD_CLOEXEC) == -1 && errno != EBADF) {
+        return errno;
+    }
+    return 0;
+}
+
+/// Close, or mark for closing on exec, every descriptor number from lowfd
+/// up to the open file limit except keepfd (pass -1 to keep none), open
+/// or not.
+///
+/// @param failedfd Set to the descriptor that couldn't be sanitized.
+/// @return 0, or the errno value of the first failure.
+int SanitizeDescriptorRange(int lowfd, int keepfd, descriptorAction action, int *failedfd)
+{
+    long maxfd;
+    long fd;
+    int err;
+    
+    maxfd = sysconf(_SC_OPEN_MAX);
+    if (maxfd < 0) {
+        maxfd = OPEN_MAX;
+    }
+    for (fd = lowfd; fd < maxfd; fd++) {
+        if (fd == keepfd) {
+            continue;
+        }
+        if ((err = SanitizeDescriptor((int)fd, action)) != 0) {
+            *failedfd = (int)fd;
+            return err;
+        }
+    }
+    return 0;
+}
+
+/// Close, or mark for closing on exec, every descriptor from lowfd and up
+/// except keepfd (pass -1 to keep none).
+///
+/// Only descriptors that are actually open are visited, as reported by
+/// proc_pidinfo(). If the list can't be retrieved or doesn't fit, every
+/// number up to the open file limit is tried instead, with
+/// SanitizeDescriptorRange(). No memory is allocated, so this is safe to
+/// call between fork() and exec().
+///
+/// @param failedfd Set to the descriptor that couldn't be sanitized.
+/// @return 0, or the errno value of the first failure.
+int SanitizeDescriptors(int lowfd, int keepfd, descriptorAction action, int *failedfd)
+{
+    struct proc_fdinfo fds[kDescriptorListSize];
+    int size;
+    int count;
+    int i;
+    int err;
+    
+    size = proc_pidinfo(getpid(), PROC_PIDLISTFDS, 0, fds, sizeof(fds));
+    if (size > 0 && (size_t)size < sizeof(fds)) {
+        // The list is complete.
+        count = size / (int)sizeof(fds[0]);
+        for (i = 0; i < count; i++) {
+            if (fds[i].proc_fd < lowfd || fds[i].proc_fd == keepfd) {
+                continue;
+            }
+            if ((err = SanitizeDescriptor(fds[i].proc_fd, action)) != 0) {
+                *failedfd = fds[i].proc_fd;
+                return err;
+            }
+        }
+        return 0;
+    }
+    
+    return SanitizeDescriptorRange(lowfd, keepfd, action, failedfd);
+}
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Spawn Backends
+/////////////////////////////////////////////////////////////////////
+
+
+/// Release an environment created by CreateEnvironment().
+void FreeEnvironment(char **envp)
+{
+    size_t i;
+    
+    if (envp == NULL) {
+        return;
+    }
+    for (i = 0; envp[i] != NULL; i++) {
+        free(envp[i]);
+    }
+    free(envp);
+}
+
+/// Build the environment for scripts running in context.
+///
+/// Scripts don't inherit the plugin host's environment. They get a
+/// small, predictable set of variables describing the account they run
+/// as: the user logging in for user scripts, and root for root scripts
+/// (so that root scripts don't write root owned files into the user's
+/// home by accident). PATH only contains system directories.
+///
+/// @return A NULL terminated array that should be released with
+///         FreeEnvironment(), or NULL if memory allocation failed.
+char **CreateEnvironment(uid_t uid, const char *home, userContext context, aslclient logClient)
+{
+    enum { kMaxVariables = 6 };
+    struct passwd pwd;
+    struct passwd *pwdResult;
+    char pwdBuffer[1024];
+    const char *name;
+    const char *shell;
+    char **envp;
+    int count;
+    
+    if (context == kRunAsRoot) {
+        uid = 0;
+    }
+    name = NULL;
+    shell = _PATH_BSHELL;
+    if (getpwuid_r(uid, &pwd, pwdBuffer, sizeof(pwdBuffer), &pwdResult) == 0 && pwdResult != NULL) {
+        name = pwd.pw_name;
+        if (pwd.pw_shell != NULL && pwd.pw_shell[0] == '/') {
+            shell = pwd.pw_shell;
+        }
+        if (context == kRunAsRoot) {
+            home = pwd.pw_dir;
+        }
+    } else {
+        asl_log(logClient, NULL, ASL_LEVEL_WARNING,
+                "Can't look up user with uid %d, USER and LOGNAME won't be set", uid);
+    }
+    
+    envp = calloc(kMaxVariables + 1, sizeof(*envp));
+    if (envp == NULL) {
+        return NULL;
+    }
+    count = 0;
+    if (asprintf(&envp[count++], "__CF_USER_TEXT_ENCODING=0x%X:0:0", uid) == -1
+        || asprintf(&envp[count++], "PATH=%s", _PATH_STDPATH) == -1
+        || asprintf(&envp[count++], "SHELL=%s", shell) == -1) {
+        goto fail;
+    }
+    if (home != NULL && asprintf(&envp[count++], "HOME=%s", home) == -1) {
+        goto fail;
+    }
+    if (name != NULL && (asprintf(&envp[count++], "USER=%s", name) == -1
+                         || asprintf(&envp[count++], "LOGNAME=%s", name) == -1)) {
+        goto fail;
+    }
+    return envp;
+    
+fail:
+    // asprintf() leaves the failed pointer undefined.
+    envp[count - 1] = NULL;
+    FreeEnvironment(envp);
+    return NULL;
+}
+
+/// Return true if limits restricts anything.
+bool HasResourceLimits(const ResourceLimits *limits)
+{
+    return limits->fCPUTime != 0 || limits->fMemory != 0 || limits->fFileSize != 0;
+}
+
+/// Lower the resource limit resource of the calling process to value, if
+/// value isn't 0. The hard limit is set to hardValue so that an
+/// unprivileged script can't raise it again.
+static int SetResourceLimit(int resource, uint64_t value, uint64_t hardValue)
+{
+    struct rlimit limit;
+    
+    if (value == 0) {
+        return 0;
+    }
+    limit.rlim_cur = (rlim_t)value;
+    limit.rlim_max = (rlim_t)hardValue;
+    return setrlimit(resource, &limit);
+}
+
+enum {
+    kBackgroundNice = 10
+};
+
+/// Set the CPU and I/O priority of the calling process for priority.
+static int SetScriptPriority(scriptPriority priority)
+{
+    switch (priority) {
+        case kPriorityNormal:
+            break;
+        case kPriorityCritical:
+            if (setpriority(PRIO_PROCESS, 0, 0) != 0
+                || setiopolicy_np(IOPOL_TYPE_DISK, IOPOL_SCOPE_PROCESS, IOPOL_IMPORTANT) != 0) {
+                return -1;
+            }
+            break;
+        case kPriorityBackground:
+            if (setpriority(PRIO_PROCESS, 0, kBackgroundNice) != 0
+                || setiopolicy_np(IOPOL_TYPE_DISK, IOPOL_SCOPE_PROCESS, IOPOL_THROTTLE) != 0) {
+                return -1;
+            }
+            break;
+    }
+    return 0;
+}
+
+/// Turn the calling process, a newly created child, into the script
+/// described by request. Never returns.
+void ExecChild(const SpawnRequest *request, aslclient logClient)
+{
+    int fd;
+    int err;
+    
+    if (request->fOutputFd != -1) {
+        if (dup2(request->fOutputFd, STDOUT_FILENO) == -1 || dup2(request->fOutputFd, STDERR_FILENO) == -1) {
+            exit(EX_OSERR);
+        }
+    }
+    if (request->fNotifyFd != -1) {
+        // dup2() doesn't clear close-on-exec if the descriptors are equal.
+        if (dup2(request->fNotifyFd, kNotifyFileno) == -1 || fcntl(kNotifyFileno, F_SETFD, 0) == -1) {
+            exit(EX_OSERR);
+        }
+    }
+    
+    // Give the script a process group of its own, so that it can be
+    // timed out together with anything it starts.
+    (void)setpgid(0, 0);
+    
+    // Limits are set while still root, so that user scripts can't raise
+    // them. Going over the CPU time limit sends SIGXCPU, and SIGKILL a
+    // second later if that is ignored.
+    if (SetResourceLimit(RLIMIT_CPU, request->fLimits.fCPUTime, request->fLimits.fCPUTime + 1) != 0
+        || SetResourceLimit(RLIMIT_DATA, request->fLimits.fMemory, request->fLimits.fMemory) != 0
+        || SetResourceLimit(RLIMIT_FSIZE, request->fLimits.fFileSize, request->fLimits.fFileSize) != 0) {
+        asl_log(logClient, NULL, ASL_LEVEL_ERR,
+                "Setting resource limits failed with errno %d, aborting execution of %s", errno, request->fPath);
+        exit(EX_OSERR);
+    }
+    if (SetScriptPriority(request->fPriority) != 0) {
+        asl_log(logClient, NULL, ASL_LEVEL_ERR,
+                "Setting priority failed with errno %d, aborting execution of %s", errno, request->fPath);
+        exit(EX_OSERR);
+    }
+    
+    // REVIEW: User commands still run in root's session.
+    if (request->fContext == kRunAsUser) {
+        if (setgid(request->fGid) || setuid(request->fUid)) {
+            asl_log(logClient, NULL, ASL_LEVEL_ERR,
+                    "setgid/setuid failed, aborting execution of %s", request->fPath);
+            exit(EX_NOPERM);
+        }
+    }
+    
+    // Mark any stray file descriptors for closing.
+    err = SanitizeDescriptors(request->fNotifyFd != -1 ? kNotifyFileno + 1 : STDERR_FILENO + 1,
+                              -1, kDescriptorCloseOnExec, &fd);
+    if (err != 0) {
+        asl_log(logClient, NULL, ASL_LEVEL_ERR,
+                "Marking file descriptor %d for closing failed with errno %d", fd, err);
+        exit(EX_NOPERM);
+    }
+    
+    execve(request->fPath, request->fArgv, request->fEnvp);
+    // The following only executes if execve() fails.
+    asl_log(logClient, NULL, ASL_LEVEL_ERR,
+            "Executing %s failed with errno %d", request->fPath, errno);
+    exit(EX_NOPERM);
+}
+
+/// Spawn a script by forking the plugin host.
+///
+/// This is the original strategy, and works everywhere, but the cost of
+/// fork() grows with the resident size of the host process.
+pid_t ForkSpawn(PluginRecord *plugin, const SpawnRequest *request)
+{
+    pid_t childPid;
+    
+    childPid = fork();
+    if (childPid == 0) {
+        // Child.
+        ExecChild(request, plugin->fLogClient);
+    }
+    
+    // Parent, or error. The group is set from both sides so that it
+    // exists before either process moves on.
+    if (childPid > 0) {
+        (void)setpgid(childPid, childPid);
+    }
+    return childPid;
+}
+
+/// Reap a script that is a child of the plugin host.
+int LocalWait(PluginRecord *plugin, pid_t pid, SpawnStatus *status)
+{
+    struct rusage usage;
+    pid_t result;
+    
+    (void)plugin;
+    do {
+        result = wait4(pid, &status->fStatus, 0, &usage);
+    } while (result == -1 && errno == EINTR);
+    if (result != pid) {
+        return -1;
+    }
+    status->fUserTime = usage.ru_utime;
+    status->fSystemTime = usage.ru_stime;
+    return 0;
+}
+
+/// Spawn a script with posix_spawn().
+///
+/// The kernel creates the child without duplicating the host's address
+/// space, so the cost doesn't depend on the size of the host. The
+/// uid/gid drop is done with spawn attributes, and descriptors other than
+/// stdin/stdout/stderr (or the output pipe duplicated onto them) and the
+/// readiness descriptor are closed with POSIX_SPAWN_CLOEXEC_DEFAULT.
+///
+/// User scripts fall back to ForkSpawn() if the system lacks the spawn
+/// attributes needed to drop privileges.
+pid_t PosixSpawn(PluginRecord *plugin, const SpawnRequest *request)
+{
+    posix_spawnattr_t attr;
+    posix_spawn_file_actions_t actions;
+    sigset_t signalMask;
+    sigset_t defaultSignals;
+    pid_t childPid;
+    int fd;
+    int err;
+    
+    if (request->fContext == kRunAsUser
+        && (posix_spawnattr_set_uid_np == NULL || posix_spawnattr_set_gid_np == NULL)) {
+        asl_log(plugin->fLogClient, NULL, ASL_LEVEL_DEBUG,
+                "posix_spawn can't drop privileges on this system, forking %s", request->fPath);
+        return ForkSpawn(plugin, request);
+    }
+    if (HasResourceLimits(&request->fLimits) || request->fPriority != kPriorityNormal) {
+        asl_log(plugin->fLogClient, NULL, ASL_LEVEL_DEBUG,
+                "posix_spawn can't set resource limits or priority, forking %s", request->fPath);
+        return ForkSpawn(plugin, request);
+    }
+    
+    if ((err = posix_spawnattr_init(&attr)) != 0) {
+        errno = err;
+        return -1;
+    }
+    if ((err = posix_spawn_file_actions_init(&actions)) != 0) {
+        posix_spawnattr_destroy(&attr);
+        errno = err;
+        return -1;
+    }
+    
+    // Start with a clean signal state in a new process group, and close
+    // every descriptor that isn't explicitly inherited.
+    sigemptyset(&signalMask);
+    sigfillset(&defaultSignals);
+    err = posix_spawnattr_setflags(&attr, POSIX_SPAWN_CLOEXEC_DEFAULT | POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETPGROUP);
+    if (err == 0) {
+        err = posix_spawnattr_setpgroup(&attr, 0);
+    }
+    if (err == 0) {
+        err = posix_spawnattr_setsigmask(&attr, &signalMask);
+    }
+    if (err == 0) {
+        err = posix_spawnattr_setsigdefault(&attr, &defaultSignals);
+    }
+    for (fd = STDIN_FILENO; err == 0 && fd <= STDERR_FILENO; fd++) {
+        if (fd == STDIN_FILENO || request->fOutputFd == -1) {
+            err = posix_spawn_file_actions_addinherit_np(&actions, fd);
+        } else {
+            err = posix_spawn_file_actions_adddup2(&actions, request->fOutputFd, fd);
+        }
+    }
+    if (err == 0 && request->fNotifyFd != -1) {
+        err = posix_spawn_file_actions_adddup2(&actions, request->fNotifyFd, kNotifyFileno);
+    }
+    if (err == 0 && request->fContext == kRunAsUser) {
+        err = posix_spawnattr_set_gid_np(&attr, request->fGid);
+        if (err == 0) {
+            err = posix_spawnattr_set_uid_np(&attr, request->fUid);
+        }
+    }
+    if (err == 0) {
+        err = posix_spawn(&childPid, request->fPath, &actions, &attr, request->fArgv, request->fEnvp);
+    }
+    
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+    
+    if (err != 0) {
+        errno = err;
+        return -1;
+    }
+    return childPid;
+}
@@ -0,0 +1,79 @@
+//
+//  Spawn.h
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+#ifndef __LoginScriptPlugin__Spawn__
+#define __LoginScriptPlugin__Spawn__
+
+#include "Common.h"
+
+typedef enum {
+    kDescriptorCloseOnExec,
+    kDescriptorClose
+} descriptorAction;
+
+typedef enum {
+    kPriorityNormal,       // inherited from the plugin host
+    kPriorityCritical,     // full CPU and I/O priority, whatever the host has
+    kPriorityBackground    // lowered CPU priority and throttled I/O
+} scriptPriority;
+
+/// ResourceLimits holds the setrlimit() limits for a script, where 0
+/// means no limit.
+typedef struct {
+    uint64_t fCPUTime;     // seconds of CPU time, RLIMIT_CPU
+    uint64_t fMemory;      // bytes of memory, RLIMIT_DATA and checked while the script runs
+    uint64_t fFileSize;    // bytes per written file, RLIMIT_FSIZE
+} ResourceLimits;
+
+/// SpawnRequest describes a script to launch.
+///
+/// Everything the child needs is computed by the parent before any
+/// process is created, so backends don't have to allocate or format
+/// strings in the child.
+typedef struct {
+    const char *fPath;
+    char *const *fArgv;
+    char *const *fEnvp;
+    uid_t fUid;
+    gid_t fGid;
+    userContext fContext;
+    int fOutputFd;         // receives stdout and stderr, -1 to inherit them
+    int fNotifyFd;         // becomes kNotifyFileno in the child, -1 for none
+    ResourceLimits fLimits;
+    scriptPriority fPriority;
+} SpawnRequest;
+
+/// SpawnStatus is the outcome of a script process.
+typedef struct {
+    int fStatus;           // as returned by waitpid()
+    struct timeval fUserTime;
+    struct timeval fSystemTime;
+} SpawnStatus;
+
+/// SpawnBackend is the strategy used to create script processes.
+///
+/// fSpawn starts the script described by request and returns the pid of
+/// the child, or -1 with errno set if no process could be created.
+/// fWait blocks until the process has exited and returns 0 with status
+/// filled in, or -1 with errno set if the outcome can't be determined.
+typedef struct {
+    const char *fName;
+    pid_t (*fSpawn)(PluginRecord *plugin, const SpawnRequest *request);
+    int (*fWait)(PluginRecord *plugin, pid_t pid, SpawnStatus *status);
+} SpawnBackend;
+
+int SanitizeDescriptorRange(int lowfd, int keepfd, descriptorAction action, int *failedfd);
+int SanitizeDescriptors(int lowfd, int keepfd, descriptorAction action, int *failedfd);
+void FreeEnvironment(char **envp);
+char **CreateEnvironment(uid_t uid, const char *home, userContext context, aslclient logClient);
+bool HasResourceLimits(const ResourceLimits *limits);
+void ExecChild(const SpawnRequest *request, aslclient logClient);
+pid_t ForkSpawn(PluginRecord *plugin, const SpawnRequest *request);
+int LocalWait(PluginRecord *plugin, pid_t pid, SpawnStatus *status);
+pid_t PosixSpawn(PluginRecord *plugin, const SpawnRequest *request);
+
+#endif /* defined(__LoginScriptPlugin__Spawn__) */
@@ -0,0 +1,81 @@
+//
+//  SystemPressure.c
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+#include "SystemPressure.h"
+
+#include "Manifest.h"
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** System Pressure
+/////////////////////////////////////////////////////////////////////
+
+
+// Optional scripts are shed when the machine is already struggling at
+// the start of a login, where they would only make the login slower
+// still. The machine is sampled once per login, so that every mechanism
+// of the login sheds the same scripts.
+
+/// Measure how loaded the machine is right now.
+void SampleSystemPressure(SystemPressure *pressure)
+{
+    double load;
+    long cpus;
+    uint32_t freePages;
+    struct xsw_usage swap;
+    size_t size;
+    
+    pressure->fLoad = -1;
+    pressure->fFreeMemory = -1;
+    pressure->fSwapUsed = -1;
+    
+    cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (getloadavg(&load, 1) == 1 && cpus > 0) {
+        pressure->fLoad = load / cpus;
+    }
+    size = sizeof(freePages);
+    if (sysctlbyname("vm.page_free_count", &freePages, &size, NULL, 0) == 0 && size == sizeof(freePages)) {
+        pressure->fFreeMemory = (long)((uint64_t)freePages * getpagesize() / (1024 * 1024));
+    }
+    size = sizeof(swap);
+    if (sysctlbyname("vm.swapusage", &swap, &size, NULL, 0) == 0 && size == sizeof(swap)) {
+        pressure->fSwapUsed = (long)(swap.xsu_used / (1024 * 1024));
+    }
+}
+
+/// Describe pressure in buffer for the log.
+void FormatSystemPressure(const SystemPressure *pressure, char *buffer, size_t size)
+{
+    char load[32];
+    char freeMemory[32];
+    char swapUsed[32];
+    
+    strcpy(load, "unknown");
+    strcpy(freeMemory, "unknown");
+    strcpy(swapUsed, "unknown");
+    if (pressure->fLoad >= 0) {
+        snprintf(load, sizeof(load), "%.2f", pressure->fLoad);
+    }
+    if (pressure->fFreeMemory >= 0) {
+        snprintf(freeMemory, sizeof(freeMemory), "%ld MB", pressure->fFreeMemory);
+    }
+    if (pressure->fSwapUsed >= 0) {
+        snprintf(swapUsed, sizeof(swapUsed), "%ld MB", pressure->fSwapUsed);
+    }
+    snprintf(buffer, size, "load %s per CPU, %s free memory, %s swap used", load, freeMemory, swapUsed);
+}
+
+/// Check whether pressure is over any of the shed thresholds in manifest.
+/// Metrics that couldn't be measured don't count.
+bool SystemUnderPressure(const ManifestRecord *manifest, const SystemPressure *pressure)
+{
+    return (manifest->fShedLoad != 0 && pressure->fLoad > manifest->fShedLoad)
+        || (manifest->fShedFreeMemory != 0 && pressure->fFreeMemory >= 0
+            && pressure->fFreeMemory < manifest->fShedFreeMemory)
+        || (manifest->fShedSwapUsed != 0 && pressure->fSwapUsed > manifest->fShedSwapUsed);
+}
@@ -0,0 +1,25 @@
+//
+//  SystemPressure.h
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+#ifndef __LoginScriptPlugin__SystemPressure__
+#define __LoginScriptPlugin__SystemPressure__
+
+#include "Common.h"
+
+/// SystemPressure is how loaded the machine was at the start of a login.
+/// Each field is negative if it couldn't be measured.
+typedef struct {
+    double fLoad;          // 1 minute load average per online CPU
+    long fFreeMemory;      // MB of free memory
+    long fSwapUsed;        // MB of swap in use
+} SystemPressure;
+
+void SampleSystemPressure(SystemPressure *pressure);
+void FormatSystemPressure(const SystemPressure *pressure, char *buffer, size_t size);
+bool SystemUnderPressure(const ManifestRecord *manifest, const SystemPressure *pressure);
+
+#endif /* defined(__LoginScriptPlugin__SystemPressure__) */
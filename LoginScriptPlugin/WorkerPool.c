@@ -0,0 +1,107 @@
+//
+//  WorkerPool.c
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+#include "WorkerPool.h"
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Worker Pool
+/////////////////////////////////////////////////////////////////////
+
+
+/// Change the number of scripts pool lets run at once, 0 meaning the
+/// number of online CPUs.
+///
+/// Scripts already running aren't affected if the limit shrinks, but no
+/// new ones start until the count has dropped below it.
+void SetWorkerPoolLimit(WorkerPool *pool, long maxInFlight)
+{
+    if (maxInFlight <= 0) {
+        maxInFlight = sysconf(_SC_NPROCESSORS_ONLN);
+        if (maxInFlight <= 0) {
+            maxInFlight = 1;
+        }
+    }
+    
+    pthread_mutex_lock(&pool->fLock);
+    pool->fMaxInFlight = maxInFlight;
+    pthread_cond_broadcast(&pool->fCondition);
+    pthread_mutex_unlock(&pool->fLock);
+}
+
+/// Set up pool with room for one script per online CPU.
+void InitWorkerPool(WorkerPool *pool)
+{
+    pthread_mutex_init(&pool->fLock, NULL);
+    pthread_cond_init(&pool->fCondition, NULL);
+    pool->fMaxInFlight = 1;
+    pool->fInFlight = 0;
+    SetWorkerPoolLimit(pool, 0);
+}
+
+/// Release the resources held by pool.
+void DestroyWorkerPool(WorkerPool *pool)
+{
+    pthread_cond_destroy(&pool->fCondition);
+    pthread_mutex_destroy(&pool->fLock);
+}
+
+/// Reserve a slot in pool for a new script.
+///
+/// If wait is false, return false right away when the pool is full.
+/// Otherwise block until another invocation releases a slot, or until
+/// deadline has passed if it's set. Callers with children of their own
+/// running shouldn't wait, as the slot they're waiting for may be one
+/// they have to release themselves.
+bool AcquireWorker(WorkerPool *pool, bool wait, const struct timeval *deadline)
+{
+    struct timespec until = { 0, 0 };
+    bool acquired;
+    
+    if (deadline != NULL && deadline->tv_sec != 0) {
+        until.tv_sec = deadline->tv_sec;
+        until.tv_nsec = deadline->tv_usec * 1000L;
+    }
+    
+    pthread_mutex_lock(&pool->fLock);
+    while (wait && pool->fInFlight >= pool->fMaxInFlight) {
+        if (deadline == NULL || deadline->tv_sec == 0) {
+            pthread_cond_wait(&pool->fCondition, &pool->fLock);
+        } else if (pthread_cond_timedwait(&pool->fCondition, &pool->fLock, &until) == ETIMEDOUT) {
+            break;
+        }
+    }
+    acquired = pool->fInFlight < pool->fMaxInFlight;
+    if (acquired) {
+        pool->fInFlight++;
+    }
+    pthread_mutex_unlock(&pool->fLock);
+    
+    return acquired;
+}
+
+/// Return the number of scripts pool lets run at once.
+long WorkerPoolLimit(WorkerPool *pool)
+{
+    long limit;
+    
+    pthread_mutex_lock(&pool->fLock);
+    limit = pool->fMaxInFlight;
+    pthread_mutex_unlock(&pool->fLock);
+    return limit;
+}
+
+/// Return a slot reserved with AcquireWorker() to pool.
+void ReleaseWorker(WorkerPool *pool)
+{
+    pthread_mutex_lock(&pool->fLock);
+    assert(pool->fInFlight > 0);
+    pool->fInFlight--;
+    pthread_cond_signal(&pool->fCondition);
+    pthread_mutex_unlock(&pool->fLock);
+}
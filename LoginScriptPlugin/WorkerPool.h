@@ -0,0 +1,31 @@
+//
+//  WorkerPool.h
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+#ifndef __LoginScriptPlugin__WorkerPool__
+#define __LoginScriptPlugin__WorkerPool__
+
+#include "Common.h"
+
+/// WorkerPool limits the number of scripts that run at the same time.
+///
+/// The pool is shared by all mechanisms of the plugin, so concurrent
+/// invocations together never exceed fMaxInFlight children.
+typedef struct {
+    pthread_mutex_t fLock;
+    pthread_cond_t fCondition;
+    long fMaxInFlight;
+    long fInFlight;
+} WorkerPool;
+
+void SetWorkerPoolLimit(WorkerPool *pool, long maxInFlight);
+void InitWorkerPool(WorkerPool *pool);
+void DestroyWorkerPool(WorkerPool *pool);
+bool AcquireWorker(WorkerPool *pool, bool wait, const struct timeval *deadline);
+long WorkerPoolLimit(WorkerPool *pool);
+void ReleaseWorker(WorkerPool *pool);
+
+#endif /* defined(__LoginScriptPlugin__WorkerPool__) */
@@ -0,0 +1,251 @@
+//
+//  ActionsTests.c
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+#include "TestPlugin.h"
+
+#include "Actions.h"
+
+#include "Test.h"
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Helpers
+/////////////////////////////////////////////////////////////////////
+
+
+enum {
+    kTestUid = 48213,      // a user that doesn't own anything outside the test
+    kTestGid = 48213
+};
+
+static PluginRecord gPlugin;
+static ManifestRecord gManifest;
+static ScriptSettings gSettings;
+static char *gDir;
+static char gHome[MAXPATHLEN];
+static char gOutside[MAXPATHLEN];
+
+/// Start a test with an empty home directory owned by owner, and an
+/// empty directory outside it that only root can write to.
+static void SetUp(uid_t owner)
+{
+    gDir = CreateTestDirectory();
+    snprintf(gHome, sizeof(gHome), "%s/home", gDir);
+    snprintf(gOutside, sizeof(gOutside), "%s/outside", gDir);
+    if (mkdir(gHome, 0755) != 0 || chown(gHome, owner, owner) != 0 || mkdir(gOutside, 0755) != 0) {
+        perror(gDir);
+        exit(2);
+    }
+}
+
+static void TearDown(void)
+{
+    RemoveTestDirectory(gDir);
+}
+
+/// Carry out the action file text in context, for the test user.
+///
+/// @return 0, or the errno value of the first failure, with the line of
+///         the action that failed in failedLine.
+static int RunActions(userContext context, const char *text, unsigned *failedLine, size_t *actionCount)
+{
+    InvocationRecord invocation;
+    ScriptRecord script;
+    char *path;
+    int err;
+    
+    path = WriteTestFile(gDir, "postmount-root-10-test.actions", text, 0644);
+    InitTestInvocation(&invocation, &gPlugin, &gManifest, context);
+    invocation.fUid = kTestUid;
+    invocation.fGid = kTestGid;
+    invocation.fHome = gHome;
+    InitTestScript(&script, path, &gSettings);
+    script.fActions = true;
+    err = RunActionFile(&invocation, &script);
+    *failedLine = script.fFailedLine;
+    if (actionCount != NULL) {
+        *actionCount = script.fActionCount;
+    }
+    FreeTestInvocation(&invocation);
+    free(path);
+    return err;
+}
+
+/// Return the path of name in dir, in one of two static buffers, so that
+/// two paths can be passed to the same call.
+static const char *PathIn(const char *dir, const char *name)
+{
+    static char paths[2][MAXPATHLEN];
+    static unsigned next;
+    char *path = paths[next++ % 2];
+    
+    if ((size_t)snprintf(path, MAXPATHLEN, "%s/%s", dir, name) >= MAXPATHLEN) {
+        fprintf(stderr, "%s/%s: path too long\n", dir, name);
+        exit(2);
+    }
+    return path;
+}
+
+static bool Exists(const char *path)
+{
+    struct stat info;
+    
+    return lstat(path, &info) == 0;
+}
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Tests
+/////////////////////////////////////////////////////////////////////
+
+
+/// Each kind of action does what it says, relative to the home directory.
+static void TestActions(void)
+{
+    char target[MAXPATHLEN];
+    struct stat info;
+    unsigned failedLine;
+    size_t count;
+    ssize_t length;
+    
+    SetUp(0);
+    CHECK(RunActions(kRunAsRoot,
+                     "# Set up the home directory.\n"
+                     "mkdir ~/dir 0700\n"
+                     "\n"
+                     "touch \"~/dir/a file\"\n"
+                     "symlink ~/link /var/empty\n"
+                     "chown ~/dir\n"
+                     "chmod \"~/dir/a file\" 0600\n"
+                     "mkdir ~/dir\n",
+                     &failedLine, &count) == 0);
+    CHECK(failedLine == 0);
+    CHECK(count == 6);
+    CHECK(lstat(PathIn(gHome, "dir"), &info) == 0 && S_ISDIR(info.st_mode));
+    CHECK((info.st_mode & 07777) == 0700);
+    CHECK(info.st_uid == kTestUid && info.st_gid == kTestGid);
+    CHECK(lstat(PathIn(gHome, "dir/a file"), &info) == 0 && S_ISREG(info.st_mode));
+    CHECK((info.st_mode & 07777) == 0600);
+    CHECK(info.st_uid == 0);
+    length = readlink(PathIn(gHome, "link"), target, sizeof(target) - 1);
+    CHECK(length == (ssize_t)strlen("/var/empty") && strncmp(target, "/var/empty", length) == 0);
+    TearDown();
+}
+
+/// An invalid or failing action stops the file, and its line is reported.
+static void TestFailedLine(void)
+{
+    unsigned failedLine;
+    size_t count;
+    
+    SetUp(0);
+    CHECK(RunActions(kRunAsRoot, "touch ~/one\nfrobnicate ~/two\ntouch ~/three\n", &failedLine, &count) == EINVAL);
+    CHECK(failedLine == 2);
+    CHECK(count == 1);
+    CHECK(Exists(PathIn(gHome, "one")));
+    CHECK(! Exists(PathIn(gHome, "three")));
+    
+    CHECK(RunActions(kRunAsRoot, "touch relative\n", &failedLine, NULL) == EINVAL);
+    CHECK(RunActions(kRunAsRoot, "chmod ~/one 999\n", &failedLine, NULL) == EINVAL);
+    CHECK(RunActions(kRunAsRoot, "touch \"~/unclosed\n", &failedLine, NULL) == EINVAL);
+    CHECK(RunActions(kRunAsRoot, "symlink ~/link /var/empty\nsymlink ~/link /tmp\n", &failedLine, NULL) == EEXIST);
+    CHECK(failedLine == 2);
+    TearDown();
+}
+
+/// For root, no component of a "~/" path is followed if it's a symbolic
+/// link, and ".." is refused, so a user can't point root's actions
+/// outside their home directory.
+static void TestRootWalk(void)
+{
+    unsigned failedLine;
+    struct stat info;
+    
+    SetUp(kTestUid);
+    CHECK(symlink(gOutside, PathIn(gHome, "elsewhere")) == 0);
+    CHECK(symlink(PathIn(gOutside, "file"), PathIn(gHome, "file")) == 0);
+    free(WriteTestFile(gOutside, "file", "", 0644));
+    
+    CHECK(RunActions(kRunAsRoot, "touch ~/elsewhere/owned\n", &failedLine, NULL) != 0);
+    CHECK(failedLine == 1);
+    CHECK(! Exists(PathIn(gOutside, "owned")));
+    CHECK(RunActions(kRunAsRoot, "mkdir ~/elsewhere/sub/dir\n", &failedLine, NULL) != 0);
+    CHECK(RunActions(kRunAsRoot, "chown ~/elsewhere/file\n", &failedLine, NULL) != 0);
+    CHECK(lstat(PathIn(gOutside, "file"), &info) == 0 && info.st_uid == 0);
+    
+    // The last component isn't followed either.
+    CHECK(RunActions(kRunAsRoot, "chmod ~/file 0666\n", &failedLine, NULL) != 0);
+    CHECK(lstat(PathIn(gOutside, "file"), &info) == 0 && (info.st_mode & 07777) == 0644);
+    CHECK(RunActions(kRunAsRoot, "chown ~/file\n", &failedLine, NULL) == 0);
+    CHECK(lstat(PathIn(gOutside, "file"), &info) == 0 && info.st_uid == 0);
+    
+    CHECK(RunActions(kRunAsRoot, "touch ~/../escaped\n", &failedLine, NULL) == EINVAL);
+    CHECK(RunActions(kRunAsRoot, "touch ~/..\n", &failedLine, NULL) == EINVAL);
+    CHECK(! Exists(PathIn(gDir, "escaped")));
+    
+    // Real directories are walked as usual.
+    CHECK(RunActions(kRunAsRoot, "mkdir ~/real\ntouch ~/./real//file\n", &failedLine, NULL) == 0);
+    CHECK(Exists(PathIn(gHome, "real/file")));
+    TearDown();
+}
+
+/// For user mechanisms, actions run as the user, who can only change what
+/// they could change themselves, while the rest of the host stays root.
+static void TestUserContext(void)
+{
+    char text[MAXPATHLEN + 32];
+    unsigned failedLine;
+    struct stat info;
+    
+    SetUp(kTestUid);
+    CHECK(RunActions(kRunAsUser, "mkdir ~/dir\ntouch ~/dir/file\n", &failedLine, NULL) == 0);
+    CHECK(lstat(PathIn(gHome, "dir/file"), &info) == 0 && info.st_uid == kTestUid && info.st_gid == kTestGid);
+    CHECK(geteuid() == 0 && getegid() == 0);
+    
+    snprintf(text, sizeof(text), "touch ~/dir/one\ntouch %s\n", PathIn(gOutside, "byuser"));
+    CHECK(RunActions(kRunAsUser, text, &failedLine, NULL) == EACCES);
+    CHECK(failedLine == 2);
+    CHECK(! Exists(PathIn(gOutside, "byuser")));
+    CHECK(geteuid() == 0 && getegid() == 0);
+    
+    // The user's own links are followed, as the user.
+    CHECK(symlink(PathIn(gHome, "dir"), PathIn(gHome, "link")) == 0);
+    CHECK(RunActions(kRunAsUser, "touch ~/link/through\n", &failedLine, NULL) == 0);
+    CHECK(Exists(PathIn(gHome, "dir/through")));
+    TearDown();
+}
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Main
+/////////////////////////////////////////////////////////////////////
+
+
+int main(void)
+{
+    // Actions for other users can only be tested by root.
+    if (geteuid() != 0) {
+        fprintf(stderr, "skip ActionsTests, not running as root\n");
+        return 0;
+    }
+    alarm(60);
+    umask(022);
+    
+    InitTestPlugin(&gPlugin);
+    InitTestManifest(&gManifest, "fork");
+    gSettings = gManifest.fDefaults;
+    
+    RUN_TEST(TestActions);
+    RUN_TEST(TestFailedLine);
+    RUN_TEST(TestRootWalk);
+    RUN_TEST(TestUserContext);
+    
+    return TestResult();
+}
@@ -0,0 +1,323 @@
+//
+//  Compat.c
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <grp.h>
+#include <pwd.h>
+#include <unistd.h>
+#include <sys/param.h>
+#include <sys/syscall.h>
+
+#include <asl.h>
+#include <libproc.h>
+#include <membership.h>
+#include <sys/kauth.h>
+#include <sys/sysctl.h>
+
+#undef dirname
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Logging
+/////////////////////////////////////////////////////////////////////
+
+
+aslclient asl_open(const char *ident, const char *facility, unsigned opts)
+{
+    (void)ident;
+    (void)facility;
+    (void)opts;
+    return (aslclient)stderr;
+}
+
+void asl_close(aslclient asl)
+{
+    (void)asl;
+}
+
+int asl_log(aslclient asl, aslmsg msg, int level, const char *format, ...)
+{
+    va_list ap;
+    
+    (void)asl;
+    (void)msg;
+    if (getenv("TEST_VERBOSE") == NULL) {
+        return 0;
+    }
+    va_start(ap, format);
+    fprintf(stderr, "[%d] ", level);
+    vfprintf(stderr, format, ap);
+    fputc('\n', stderr);
+    va_end(ap);
+    return 0;
+}
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Processes
+/////////////////////////////////////////////////////////////////////
+
+
+int posix_spawn_file_actions_addinherit_np(posix_spawn_file_actions_t *actions, int fd)
+{
+    (void)actions;
+    (void)fd;
+    return 0;
+}
+
+int setiopolicy_np(int type, int scope, int policy)
+{
+    (void)type;
+    (void)scope;
+    (void)policy;
+    return 0;
+}
+
+int pthread_setugid_np(uid_t uid, gid_t gid)
+{
+    if (uid == KAUTH_UID_NONE) {
+        if (syscall(SYS_setresuid, -1, 0, -1) != 0) {
+            return -1;
+        }
+        return (int)syscall(SYS_setresgid, -1, 0, -1);
+    }
+    if (syscall(SYS_setresgid, -1, gid, -1) != 0) {
+        return -1;
+    }
+    return (int)syscall(SYS_setresuid, -1, uid, -1);
+}
+
+/// List the processes in process group typeinfo, PROC_PGRP_ONLY only.
+int proc_listpids(uint32_t type, uint32_t typeinfo, void *buffer, int buffersize)
+{
+    DIR *dir;
+    struct dirent *entry;
+    char path[64];
+    char line[512];
+    char *end;
+    char state;
+    int *pids = buffer;
+    int count = 0;
+    int pid, ppid, pgrp;
+    FILE *f;
+    
+    if (type != PROC_PGRP_ONLY || (dir = opendir("/proc")) == NULL) {
+        return -1;
+    }
+    while ((entry = readdir(dir)) != NULL) {
+        if ((pid = atoi(entry->d_name)) <= 0) {
+            continue;
+        }
+        snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+        if ((f = fopen(path, "r")) == NULL) {
+            continue;
+        }
+        if (fgets(line, sizeof(line), f) != NULL && (end = strrchr(line, ')')) != NULL
+            && sscanf(end + 2, "%c %d %d", &state, &ppid, &pgrp) == 3
+            && pgrp == (int)typeinfo && (count + 1) * (int)sizeof(int) <= buffersize) {
+            pids[count++] = pid;
+        }
+        fclose(f);
+    }
+    closedir(dir);
+    return count * (int)sizeof(int);
+}
+
+/// List the open descriptors of the calling process, PROC_PIDLISTFDS only.
+int proc_pidinfo(int pid, int flavor, uint64_t arg, void *buffer, int buffersize)
+{
+    struct proc_fdinfo *fds = buffer;
+    struct dirent *entry;
+    DIR *dir;
+    int count = 0;
+    int fd;
+    
+    (void)arg;
+    if (flavor != PROC_PIDLISTFDS || pid != getpid() || (dir = opendir("/proc/self/fd")) == NULL) {
+        errno = ENOTSUP;
+        return -1;
+    }
+    while ((entry = readdir(dir)) != NULL && (count + 1) * (int)sizeof(*fds) <= buffersize) {
+        if (entry->d_name[0] == '.' || (fd = atoi(entry->d_name)) == dirfd(dir)) {
+            continue;
+        }
+        fds[count].proc_fd = fd;
+        fds[count].proc_fdtype = 0;
+        count++;
+    }
+    closedir(dir);
+    return count * (int)sizeof(*fds);
+}
+
+int proc_pid_rusage(int pid, int flavor, rusage_info_t *buffer)
+{
+    struct rusage_info_v2 *info = (struct rusage_info_v2 *)buffer;
+    unsigned long size, resident;
+    char path[64];
+    FILE *f;
+    int found;
+    
+    snprintf(path, sizeof(path), "/proc/%d/statm", pid);
+    if (flavor != RUSAGE_INFO_V2 || (f = fopen(path, "r")) == NULL) {
+        errno = ESRCH;
+        return -1;
+    }
+    found = fscanf(f, "%lu %lu", &size, &resident);
+    fclose(f);
+    if (found != 2) {
+        errno = ESRCH;
+        return -1;
+    }
+    memset(info, 0, sizeof(*info));
+    info->ri_phys_footprint = (uint64_t)resident * (uint64_t)sysconf(_SC_PAGESIZE);
+    return 0;
+}
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Accounts
+/////////////////////////////////////////////////////////////////////
+
+
+// The uuids just carry the id, with the last byte telling users and
+// groups apart.
+
+int mbr_uid_to_uuid(uid_t uid, uuid_t uu)
+{
+    memset(uu, 0, sizeof(uuid_t));
+    memcpy(uu, &uid, sizeof(uid));
+    uu[15] = 'u';
+    return 0;
+}
+
+int mbr_gid_to_uuid(gid_t gid, uuid_t uu)
+{
+    memset(uu, 0, sizeof(uuid_t));
+    memcpy(uu, &gid, sizeof(gid));
+    uu[15] = 'g';
+    return 0;
+}
+
+int mbr_check_membership(const uuid_t user, const uuid_t group, int *ismember)
+{
+    struct passwd *pw;
+    gid_t groups[256];
+    int count = 256;
+    uid_t uid;
+    gid_t gid;
+    int i;
+    
+    memcpy(&uid, user, sizeof(uid));
+    memcpy(&gid, group, sizeof(gid));
+    *ismember = 0;
+    if ((pw = getpwuid(uid)) == NULL || getgrouplist(pw->pw_name, pw->pw_gid, groups, &count) < 0) {
+        return 0;
+    }
+    for (i = 0; i < count; i++) {
+        if (groups[i] == gid) {
+            *ismember = 1;
+        }
+    }
+    return 0;
+}
+
+int getpeereid(int fd, uid_t *uid, gid_t *gid)
+{
+    struct ucred cred;
+    socklen_t length = sizeof(cred);
+    
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &length) != 0) {
+        return -1;
+    }
+    *uid = cred.uid;
+    *gid = cred.gid;
+    return 0;
+}
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** System
+/////////////////////////////////////////////////////////////////////
+
+
+/// Return the value of key in /proc/meminfo in KB, or -1.
+static long MemInfo(const char *key)
+{
+    char line[256];
+    long value = -1;
+    FILE *f;
+    
+    if ((f = fopen("/proc/meminfo", "r")) == NULL) {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (strncmp(line, key, strlen(key)) == 0) {
+            value = atol(line + strlen(key));
+            break;
+        }
+    }
+    fclose(f);
+    return value;
+}
+
+/// vm.page_free_count, in 4 KB pages, and vm.swapusage.
+int sysctlbyname(const char *name, void *oldp, size_t *oldlenp, void *newp, size_t newlen)
+{
+    struct xsw_usage *swap;
+    
+    if (newp != NULL || newlen != 0) {
+        errno = EPERM;
+        return -1;
+    }
+    if (strcmp(name, "vm.page_free_count") == 0 && *oldlenp >= sizeof(uint32_t)) {
+        *(uint32_t *)oldp = (uint32_t)(MemInfo("MemFree:") / 4);
+        *oldlenp = sizeof(uint32_t);
+        return 0;
+    }
+    if (strcmp(name, "vm.swapusage") == 0 && *oldlenp >= sizeof(*swap)) {
+        swap = oldp;
+        memset(swap, 0, sizeof(*swap));
+        swap->xsu_used = (uint64_t)(MemInfo("SwapTotal:") - MemInfo("SwapFree:")) * 1024;
+        *oldlenp = sizeof(*swap);
+        return 0;
+    }
+    errno = ENOENT;
+    return -1;
+}
+
+#if ! __GLIBC_PREREQ(2, 38)
+size_t strlcpy(char *dst, const char *src, size_t size)
+{
+    size_t length = strlen(src);
+    size_t copied;
+    
+    if (size != 0) {
+        copied = length < size - 1 ? length : size - 1;
+        memcpy(dst, src, copied);
+        dst[copied] = '\0';
+    }
+    return length;
+}
+#endif
+
+char *CompatDirname(const char *path)
+{
+    static __thread char buffer[MAXPATHLEN];
+    
+    strncpy(buffer, path, sizeof(buffer) - 1);
+    buffer[sizeof(buffer) - 1] = '\0';
+    return dirname(buffer);
+}
@@ -0,0 +1,52 @@
+//
+//  Compat.h
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+#ifndef __LoginScriptPlugin__Compat__
+#define __LoginScriptPlugin__Compat__
+
+// Included ahead of every file when the tests are built on Linux, for the
+// Darwin extensions the plugin uses. The headers that only exist on macOS
+// are stood in for by the other files in this directory. They do as much
+// as the tests need, and no more: scripts still run, but descriptors
+// aren't closed by posix_spawn(), the I/O policy isn't changed, and the
+// posix_spawn backend falls back to fork() for user scripts, as on macOS
+// before 10.15.
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <spawn.h>
+#include <string.h>
+#include <libgen.h>
+
+#define OPEN_MAX 10240
+
+#define SO_NOSIGPIPE 0x1022                 // not an option on Linux, so setting it fails
+
+#define POSIX_SPAWN_CLOEXEC_DEFAULT 0
+
+#define IOPOL_TYPE_DISK     0
+#define IOPOL_SCOPE_PROCESS 0
+#define IOPOL_IMPORTANT     1
+#define IOPOL_THROTTLE      3
+
+int posix_spawn_file_actions_addinherit_np(posix_spawn_file_actions_t *actions, int fd);
+// GCC only knows weak imports as weak symbols.
+#define weak_import weak
+extern int posix_spawnattr_set_uid_np(const posix_spawnattr_t *attr, uid_t uid) __attribute__((weak));
+extern int posix_spawnattr_set_gid_np(const posix_spawnattr_t *attr, gid_t gid) __attribute__((weak));
+int setiopolicy_np(int type, int scope, int policy);
+int getpeereid(int fd, uid_t *uid, gid_t *gid);
+
+#if ! __GLIBC_PREREQ(2, 38)
+size_t strlcpy(char *dst, const char *src, size_t size);
+#endif
+
+// The dirname() of Darwin leaves its argument alone.
+char *CompatDirname(const char *path);
+#define dirname CompatDirname
+
+#endif /* defined(__LoginScriptPlugin__Compat__) */
@@ -0,0 +1,8 @@
+//
+//  AuthSession.h
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+// Nothing from AuthSession.h is used.
@@ -0,0 +1,72 @@
+//
+//  AuthorizationPlugin.h
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+// The parts of the Security framework's authorization plugin API that
+// the plugin uses, for building the tests on Linux.
+
+#ifndef __LoginScriptPlugin__Compat__AuthorizationPlugin__
+#define __LoginScriptPlugin__Compat__AuthorizationPlugin__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+typedef int32_t OSStatus;
+typedef uint32_t OSType;
+typedef unsigned char Boolean;
+typedef uint32_t UInt32;
+
+typedef void *AuthorizationEngineRef;
+typedef void *AuthorizationPluginRef;
+typedef void *AuthorizationMechanismRef;
+typedef const char *AuthorizationMechanismId;
+typedef const char *AuthorizationString;
+typedef UInt32 AuthorizationContextFlags;
+
+typedef UInt32 AuthorizationResult;
+enum {
+    kAuthorizationResultAllow,
+    kAuthorizationResultDeny,
+    kAuthorizationResultUndefined,
+    kAuthorizationResultUserCanceled
+};
+
+enum {
+    errAuthorizationSuccess = 0,
+    errAuthorizationInternal = -60008
+};
+
+enum {
+    kAuthorizationCallbacksVersion = 1,
+    kAuthorizationPluginInterfaceVersion = 0
+};
+
+typedef struct {
+    size_t length;
+    void *data;
+} AuthorizationValue;
+
+typedef struct {
+    UInt32 version;
+    OSStatus (*SetResult)(AuthorizationEngineRef inEngine, AuthorizationResult inResult);
+    OSStatus (*GetContextValue)(AuthorizationEngineRef inEngine, AuthorizationString inKey,
+                                AuthorizationContextFlags *outContextFlags, const AuthorizationValue **outValue);
+    OSStatus (*DidDeactivate)(AuthorizationEngineRef inEngine);
+} AuthorizationCallbacks;
+
+typedef struct {
+    UInt32 version;
+    OSStatus (*PluginDestroy)(AuthorizationPluginRef inPlugin);
+    OSStatus (*MechanismCreate)(AuthorizationPluginRef inPlugin, AuthorizationEngineRef inEngine,
+                                AuthorizationMechanismId mechanismId, AuthorizationMechanismRef *outMechanism);
+    OSStatus (*MechanismInvoke)(AuthorizationMechanismRef inMechanism);
+    OSStatus (*MechanismDeactivate)(AuthorizationMechanismRef inMechanism);
+    OSStatus (*MechanismDestroy)(AuthorizationMechanismRef inMechanism);
+} AuthorizationPluginInterface;
+
+#endif /* defined(__LoginScriptPlugin__Compat__AuthorizationPlugin__) */
@@ -0,0 +1,8 @@
+//
+//  AuthorizationTags.h
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+// Nothing from AuthorizationTags.h is used.
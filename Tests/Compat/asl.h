@@ -0,0 +1,30 @@
+//
+//  asl.h
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+// Apple System Log, as used by the plugin. Compat.c logs to stderr when
+// TEST_VERBOSE is set.
+
+#ifndef __LoginScriptPlugin__Compat__asl__
+#define __LoginScriptPlugin__Compat__asl__
+
+typedef void *aslclient;
+typedef void *aslmsg;
+
+#define ASL_LEVEL_EMERG   0
+#define ASL_LEVEL_ALERT   1
+#define ASL_LEVEL_CRIT    2
+#define ASL_LEVEL_ERR     3
+#define ASL_LEVEL_WARNING 4
+#define ASL_LEVEL_NOTICE  5
+#define ASL_LEVEL_INFO    6
+#define ASL_LEVEL_DEBUG   7
+
+aslclient asl_open(const char *ident, const char *facility, unsigned opts);
+void asl_close(aslclient asl);
+int asl_log(aslclient asl, aslmsg msg, int level, const char *format, ...) __attribute__((format(printf, 4, 5)));
+
+#endif /* defined(__LoginScriptPlugin__Compat__asl__) */
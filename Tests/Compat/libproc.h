@@ -0,0 +1,34 @@
+//
+//  libproc.h
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+// libproc, on top of /proc.
+
+#ifndef __LoginScriptPlugin__Compat__libproc__
+#define __LoginScriptPlugin__Compat__libproc__
+
+#include <stdint.h>
+
+#define PROC_PGRP_ONLY   2
+#define PROC_PIDLISTFDS  1
+#define RUSAGE_INFO_V2   2
+
+struct proc_fdinfo {
+    int32_t proc_fd;
+    uint32_t proc_fdtype;
+};
+
+// Only the resident size, which stands in for the footprint.
+typedef void *rusage_info_t;
+struct rusage_info_v2 {
+    uint64_t ri_phys_footprint;
+};
+
+int proc_listpids(uint32_t type, uint32_t typeinfo, void *buffer, int buffersize);
+int proc_pidinfo(int pid, int flavor, uint64_t arg, void *buffer, int buffersize);
+int proc_pid_rusage(int pid, int flavor, rusage_info_t *buffer);
+
+#endif /* defined(__LoginScriptPlugin__Compat__libproc__) */
@@ -0,0 +1,21 @@
+//
+//  membership.h
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+// Group membership, on top of getgrouplist().
+
+#ifndef __LoginScriptPlugin__Compat__membership__
+#define __LoginScriptPlugin__Compat__membership__
+
+#include <sys/types.h>
+
+typedef unsigned char uuid_t[16];
+
+int mbr_uid_to_uuid(uid_t uid, uuid_t uu);
+int mbr_gid_to_uuid(gid_t gid, uuid_t uu);
+int mbr_check_membership(const uuid_t user, const uuid_t group, int *ismember);
+
+#endif /* defined(__LoginScriptPlugin__Compat__membership__) */
@@ -0,0 +1,21 @@
+//
+//  kauth.h
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+// Per-thread credentials, on top of the per-thread setresuid() and
+// setresgid() system calls of Linux.
+
+#ifndef __LoginScriptPlugin__Compat__kauth__
+#define __LoginScriptPlugin__Compat__kauth__
+
+#include <sys/types.h>
+
+#define KAUTH_UID_NONE ((uid_t)-100)
+#define KAUTH_GID_NONE ((gid_t)-100)
+
+int pthread_setugid_np(uid_t uid, gid_t gid);
+
+#endif /* defined(__LoginScriptPlugin__Compat__kauth__) */
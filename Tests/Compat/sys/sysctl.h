@@ -0,0 +1,26 @@
+//
+//  sysctl.h
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+// The sysctls the plugin reads, on top of /proc/meminfo.
+
+#ifndef __LoginScriptPlugin__Compat__sysctl__
+#define __LoginScriptPlugin__Compat__sysctl__
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct xsw_usage {
+    uint64_t xsu_total;
+    uint64_t xsu_avail;
+    uint64_t xsu_used;
+    uint32_t xsu_pagesize;
+    int xsu_encrypted;
+};
+
+int sysctlbyname(const char *name, void *oldp, size_t *oldlenp, void *newp, size_t newlen);
+
+#endif /* defined(__LoginScriptPlugin__Compat__sysctl__) */
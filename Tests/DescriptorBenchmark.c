@@ -0,0 +1,107 @@
+//
+//  DescriptorBenchmark.c
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+#include "TestPlugin.h"
+
+#include "Spawn.h"
+
+// Times SanitizeDescriptors(), which visits the open descriptors listed by
+// proc_pidinfo(PROC_PIDLISTFDS), against SanitizeDescriptorRange(), which
+// tries every number up to the open file limit, as RLIMIT_NOFILE is
+// raised. Both mark the descriptors close-on-exec, as a forked script
+// does before exec. On Linux, proc_pidinfo() is the one in Compat, which
+// reads /proc/self/fd.
+//
+// Limits that RLIMIT_NOFILE can't be raised to, above the hard limit
+// without privileges or above OPEN_MAX on macOS, are shown as "-".
+//
+// Usage: DescriptorBenchmark [open descriptors]
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Runners
+/////////////////////////////////////////////////////////////////////
+
+
+typedef int (*Sanitizer)(int lowfd, int keepfd, descriptorAction action, int *failedfd);
+
+/// Call sanitize repeatedly for at least a fifth of a second.
+///
+/// @return The microseconds per call, or -1 if it failed.
+static double RunSanitizer(Sanitizer sanitize)
+{
+    double start, elapsed;
+    int failedfd;
+    int count = 0;
+    
+    start = TestSeconds();
+    do {
+        if (sanitize(STDERR_FILENO + 1, -1, kDescriptorCloseOnExec, &failedfd) != 0) {
+            return -1;
+        }
+        count++;
+        elapsed = TestSeconds() - start;
+    } while (elapsed < 0.2 || count < 3);
+    return elapsed * 1e6 / count;
+}
+
+/// Print microseconds as a cell of the results table.
+static void PrintResult(double microseconds)
+{
+    if (microseconds < 0) {
+        printf(" %14s", "failed");
+    } else {
+        printf(" %14.1f", microseconds);
+    }
+}
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Main
+/////////////////////////////////////////////////////////////////////
+
+
+int main(int argc, char *argv[])
+{
+    static const rlim_t limits[] = { 256, 1024, 4096, 16384, 65536, 1048576 };
+    int openCount = argc > 1 ? atoi(argv[1]) : 32;
+    struct rlimit limit;
+    size_t i;
+    int j;
+    
+    if (openCount <= 0) {
+        fprintf(stderr, "Usage: %s [open descriptors]\n", argv[0]);
+        return 2;
+    }
+    for (j = 0; j < openCount; j++) {
+        if (open("/dev/null", O_RDONLY | O_CLOEXEC) == -1) {
+            perror("/dev/null");
+            return 2;
+        }
+    }
+    
+    printf("%d open descriptors, us per call\n", openCount + 3);
+    printf("%-12s %14s %14s\n", "open limit", "open only", "every number");
+    for (i = 0; i < sizeof(limits) / sizeof(limits[0]); i++) {
+        getrlimit(RLIMIT_NOFILE, &limit);
+        limit.rlim_cur = limits[i];
+        if (limit.rlim_max != RLIM_INFINITY && limit.rlim_max < limits[i]) {
+            limit.rlim_max = limits[i];
+        }
+        if (setrlimit(RLIMIT_NOFILE, &limit) != 0) {
+            printf("%-12lu %14s %14s\n", (unsigned long)limits[i], "-", "-");
+            continue;
+        }
+        printf("%-12lu", (unsigned long)limits[i]);
+        PrintResult(RunSanitizer(SanitizeDescriptors));
+        PrintResult(RunSanitizer(SanitizeDescriptorRange));
+        printf("\n");
+    }
+    return 0;
+}
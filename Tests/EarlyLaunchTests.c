@@ -0,0 +1,356 @@
+//
+//  EarlyLaunchTests.c
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+#include "TestPlugin.h"
+
+#include "BackgroundReaper.h"
+#include "DurationHistory.h"
+#include "EarlyLaunch.h"
+#include "Launcher.h"
+#include "Manifest.h"
+#include "ScriptExecution.h"
+#include "WorkerPool.h"
+
+#include "Test.h"
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Helpers
+/////////////////////////////////////////////////////////////////////
+
+
+static PluginRecord gPlugin;
+static ManifestRecord gManifest;
+static char *gDir;
+static int gEngine;
+static int gOtherEngine;
+
+/// Start a test with an empty script directory and the manifest text.
+static void SetUp(const char *manifest)
+{
+    gDir = CreateTrustedTestDirectory();
+    kLoginScriptDir = gDir;
+    ParseTestManifest(&gManifest, manifest, gPlugin.fLogClient);
+    SetWorkerPoolLimit(&gPlugin.fPool, gManifest.fMaxJobs);
+}
+
+static void TearDown(void)
+{
+    FreeManifest(&gManifest);
+    RemoveTestDirectory(gDir);
+}
+
+/// Add a postmount-root script that runs body in the script directory.
+static void AddScript(const char *name, const char *body)
+{
+    char file[64];
+    
+    snprintf(file, sizeof(file), "postmount-root-%s", name);
+    free(WriteTestScript(gDir, file, body));
+}
+
+/// Fill in mechanism as the premount-user mechanism of a login through
+/// engine, which has joined its login session.
+static void InitTestMechanism(MechanismRecord *mechanism, int *engine)
+{
+    memset(mechanism, 0, sizeof(*mechanism));
+    mechanism->fMagic = kMechanismMagic;
+    mechanism->fEngine = (AuthorizationEngineRef)engine;
+    mechanism->fPlugin = &gPlugin;
+    mechanism->fContext = kRunAsUser;
+    mechanism->fPhase = kRunBeforeHomedirMount;
+    mechanism->fJoinedSession = true;
+    mechanism->fSessionUid = getuid();
+    gettimeofday(&mechanism->fSessionStart, NULL);
+}
+
+/// Start the early scripts of the login of mechanism, as the premount-user
+/// mechanism does once its own scripts have allowed the login.
+static void Launch(MechanismRecord *mechanism)
+{
+    InvocationRecord premount;
+    
+    InitTestInvocation(&premount, &gPlugin, &gManifest, kRunAsUser);
+    premount.fPhase = kRunBeforeHomedirMount;
+    LaunchEarlyScripts(mechanism, &premount);
+    FreeTestInvocation(&premount);
+}
+
+/// Find the postmount-root scripts, and claim the early scripts of the
+/// login of mechanism, as the postmount-root mechanism does.
+static void Claim(InvocationRecord *invocation, const MechanismRecord *mechanism)
+{
+    InitTestInvocation(invocation, &gPlugin, &gManifest, kRunAsRoot);
+    if (! CreateScripts(invocation)) {
+        fprintf(stderr, "CreateScripts failed\n");
+        exit(2);
+    }
+    ClaimEarlyScripts(mechanism, invocation);
+}
+
+static void Finish(InvocationRecord *invocation)
+{
+    FreeScripts(invocation);
+    FreeTestInvocation(invocation);
+}
+
+/// Return the number of scripts in the early script table.
+static size_t EarlyScriptCount(void)
+{
+    EarlyScript *early;
+    size_t count = 0;
+    
+    pthread_mutex_lock(&gPlugin.fEarlyScripts.fLock);
+    for (early = gPlugin.fEarlyScripts.fScripts; early != NULL; early = early->fNext) {
+        count++;
+    }
+    pthread_mutex_unlock(&gPlugin.fEarlyScripts.fLock);
+    return count;
+}
+
+static long WorkersInFlight(void)
+{
+    long inFlight;
+    
+    pthread_mutex_lock(&gPlugin.fPool.fLock);
+    inFlight = gPlugin.fPool.fInFlight;
+    pthread_mutex_unlock(&gPlugin.fPool.fLock);
+    return inFlight;
+}
+
+/// Return true if the scripts have written exactly text to "log".
+static bool LogIs(const char *text)
+{
+    char *log = ReadTestFile(gDir, "log");
+    bool same;
+    
+    same = strcmp(log != NULL ? log : "", text) == 0;
+    if (! same) {
+        fprintf(stderr, "log:\n%s", log != NULL ? log : "");
+    }
+    free(log);
+    return same;
+}
+
+/// Return true once pid has exited and been reaped, within seconds.
+static bool ProcessGone(pid_t pid, double seconds)
+{
+    double until = TestSeconds() + seconds;
+    
+    while (kill(pid, 0) == 0) {
+        if (TestSeconds() >= until) {
+            return false;
+        }
+        usleep(20 * 1000);
+    }
+    return errno == ESRCH;
+}
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Tests
+/////////////////////////////////////////////////////////////////////
+
+
+/// Only home_independent scripts that don't wait for other scripts are
+/// started early, and the postmount-root mechanism joins them.
+static void TestLaunchAndJoin(void)
+{
+    MechanismRecord mechanism;
+    InvocationRecord invocation;
+    
+    SetUp("jobs = 4\n"
+          "[postmount-root-20-early]\n"
+          "after =\n"
+          "home_independent = yes\n"
+          "[postmount-root-30-waits]\n"
+          "home_independent = yes\n");
+    AddScript("10-first", "echo first >>log");
+    AddScript("20-early", "sleep 0.5; echo early >>log");
+    AddScript("30-waits", "echo waits >>log");
+    InitTestMechanism(&mechanism, &gEngine);
+    Launch(&mechanism);
+    CHECK(EarlyScriptCount() == 1);
+    CHECK(WorkersInFlight() == 1);
+    
+    Claim(&invocation, &mechanism);
+    CHECK(EarlyScriptCount() == 0);
+    CHECK(invocation.fScripts[0].fEarly == NULL);
+    CHECK(invocation.fScripts[1].fEarly != NULL);
+    CHECK(invocation.fScripts[2].fEarly == NULL);
+    CHECK(RunScripts(&invocation) == kAuthorizationResultAllow);
+    CHECK(invocation.fScripts[1].fState == kScriptFinished);
+    CHECK(WIFEXITED(invocation.fScripts[1].fStatus.fStatus));
+    CHECK(LogIs("first\nearly\nwaits\n"));
+    CHECK(WorkersInFlight() == 0);
+    Finish(&invocation);
+    TearDown();
+}
+
+/// With a single job, the early script holds the only worker, so it has
+/// to be joined before any other script waits for a worker, or the login
+/// never finishes.
+static void TestSingleJob(void)
+{
+    MechanismRecord mechanism;
+    InvocationRecord invocation;
+    
+    SetUp("jobs = 1\n"
+          "[postmount-root-20-early]\n"
+          "after =\n"
+          "home_independent = yes\n"
+          "[postmount-root-30-later]\n"
+          "after =\n"
+          "home_independent = yes\n");
+    AddScript("10-first", "echo first >>log");
+    AddScript("20-early", "echo early >>log");
+    AddScript("30-later", "echo later >>log");
+    InitTestMechanism(&mechanism, &gEngine);
+    Launch(&mechanism);
+    
+    // The second one doesn't get a worker, and is left for later.
+    CHECK(EarlyScriptCount() == 1);
+    CHECK(WorkersInFlight() == 1);
+    
+    Claim(&invocation, &mechanism);
+    CHECK(invocation.fScripts[1].fEarly != NULL);
+    CHECK(invocation.fScripts[2].fEarly == NULL);
+    CHECK(RunScripts(&invocation) == kAuthorizationResultAllow);
+    CHECK(invocation.fScripts[0].fState == kScriptFinished);
+    CHECK(invocation.fScripts[1].fState == kScriptFinished);
+    CHECK(invocation.fScripts[2].fState == kScriptFinished);
+    CHECK(WorkersInFlight() == 0);
+    Finish(&invocation);
+    TearDown();
+}
+
+/// Early scripts are only claimed by the login they were started for,
+/// and are stopped, giving back their workers, when that login ends
+/// without getting to them.
+static void TestAbandon(void)
+{
+    MechanismRecord mechanism;
+    MechanismRecord other;
+    InvocationRecord invocation;
+    pid_t pid;
+    
+    SetUp("jobs = 1\n"
+          "[postmount-root-10-early]\n"
+          "home_independent = yes\n");
+    AddScript("10-early", "sleep 30");
+    InitTestMechanism(&mechanism, &gEngine);
+    InitTestMechanism(&other, &gOtherEngine);
+    Launch(&mechanism);
+    CHECK(EarlyScriptCount() == 1);
+    pid = gPlugin.fEarlyScripts.fScripts->fPid;
+    
+    Claim(&invocation, &other);
+    CHECK(invocation.fScripts[0].fEarly == NULL);
+    CHECK(EarlyScriptCount() == 1);
+    Finish(&invocation);
+    
+    AbandonEarlyScripts(&gPlugin, &other);
+    CHECK(EarlyScriptCount() == 1);
+    AbandonEarlyScripts(&gPlugin, &mechanism);
+    CHECK(EarlyScriptCount() == 0);
+    CHECK(WorkersInFlight() == 0);
+    CHECK(ProcessGone(pid, 5));
+    TearDown();
+}
+
+/// A login that claimed its early scripts and was denied before joining
+/// them stops them when it lets go of its scripts.
+static void TestAbandonClaimed(void)
+{
+    MechanismRecord mechanism;
+    InvocationRecord invocation;
+    pid_t pid;
+    
+    SetUp("[postmount-root-10-early]\n"
+          "home_independent = yes\n");
+    AddScript("10-early", "sleep 30");
+    InitTestMechanism(&mechanism, &gEngine);
+    Launch(&mechanism);
+    CHECK(EarlyScriptCount() == 1);
+    
+    Claim(&invocation, &mechanism);
+    CHECK(invocation.fScripts[0].fEarly != NULL);
+    pid = invocation.fScripts[0].fEarly->fPid;
+    CHECK(WorkersInFlight() == 1);
+    Finish(&invocation);
+    CHECK(WorkersInFlight() == 0);
+    CHECK(ProcessGone(pid, 5));
+    TearDown();
+}
+
+/// A repeated premount mechanism replaces the early scripts of the one
+/// before.
+static void TestRelaunch(void)
+{
+    MechanismRecord mechanism;
+    pid_t pid;
+    
+    SetUp("[postmount-root-10-early]\n"
+          "home_independent = yes\n");
+    AddScript("10-early", "sleep 30");
+    InitTestMechanism(&mechanism, &gEngine);
+    Launch(&mechanism);
+    CHECK(EarlyScriptCount() == 1);
+    pid = gPlugin.fEarlyScripts.fScripts->fPid;
+    Launch(&mechanism);
+    CHECK(EarlyScriptCount() == 1);
+    CHECK(WorkersInFlight() == 1);
+    CHECK(ProcessGone(pid, 5));
+    AbandonEarlyScripts(&gPlugin, &mechanism);
+    CHECK(WorkersInFlight() == 0);
+    TearDown();
+}
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Main
+/////////////////////////////////////////////////////////////////////
+
+
+int main(void)
+{
+    char *stateDir;
+    char *historyPath;
+    
+    // Scripts are only trusted in a directory owned by root.
+    if (geteuid() != 0) {
+        fprintf(stderr, "skip EarlyLaunchTests, not running as root\n");
+        return 0;
+    }
+    alarm(60);
+    
+    stateDir = CreateTestDirectory();
+    if (asprintf(&historyPath, "%s/durations", stateDir) == -1) {
+        return 2;
+    }
+    kDurationHistoryPath = historyPath;
+    InitTestPlugin(&gPlugin);
+    if (! StartLauncher(&gPlugin)) {
+        fprintf(stderr, "Launcher not started, its scripts will be forked\n");
+    }
+    
+    RUN_TEST(TestLaunchAndJoin);
+    RUN_TEST(TestSingleJob);
+    RUN_TEST(TestAbandon);
+    RUN_TEST(TestAbandonClaimed);
+    RUN_TEST(TestRelaunch);
+    
+    StopEarlyScripts(&gPlugin);
+    StopBackgroundReaper(&gPlugin);
+    StopLauncher(&gPlugin);
+    RemoveTestDirectory(stateDir);
+    free(historyPath);
+    return TestResult();
+}
@@ -0,0 +1,290 @@
+//
+//  EventLoopTests.c
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/wait.h>
+
+#include "EventLoop.h"
+
+#include "Test.h"
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Helpers
+/////////////////////////////////////////////////////////////////////
+
+
+static char gFirst, gSecond, gThird;   // contexts that can be told apart
+
+/// Return the milliseconds since start.
+static long Elapsed(const struct timeval *start)
+{
+    return -TimeUntil(start);
+}
+
+static void *WakeLater(void *arg)
+{
+    usleep(50 * 1000);
+    EventLoopWake(arg);
+    return NULL;
+}
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Tests
+/////////////////////////////////////////////////////////////////////
+
+
+/// A process exit is reported once with its context, and the process is
+/// left for the caller to reap.
+static void TestProcessExit(void)
+{
+    EventLoop loop;
+    Event event;
+    pid_t pid;
+    int status;
+    
+    CHECK(EventLoopCreate(&loop));
+    if ((pid = fork()) == 0) {
+        usleep(50 * 1000);
+        _exit(7);
+    }
+    CHECK(EventLoopWatchProcess(&loop, pid, &gFirst));
+    CHECK(EventLoopNext(&loop, &event));
+    CHECK(event.fKind == kEventProcessExited);
+    CHECK(event.fContext == &gFirst);
+    CHECK(waitpid(pid, &status, WNOHANG) == pid);
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 7);
+    
+    // Once reaped, there is nothing left to watch.
+    CHECK(! EventLoopWatchProcess(&loop, pid, &gFirst) && errno == ESRCH);
+    EventLoopDestroy(&loop);
+}
+
+/// A process that has exited but not been reaped is reported straight
+/// away, or refused with ESRCH, so that callers never wait for it.
+static void TestZombieProcess(void)
+{
+    EventLoop loop;
+    Event event;
+    pid_t pid;
+    siginfo_t info;
+    
+    CHECK(EventLoopCreate(&loop));
+    if ((pid = fork()) == 0) {
+        _exit(0);
+    }
+    CHECK(waitid(P_PID, (id_t)pid, &info, WEXITED | WNOWAIT) == 0);
+    if (EventLoopWatchProcess(&loop, pid, &gFirst)) {
+        CHECK(EventLoopNext(&loop, &event));
+        CHECK(event.fKind == kEventProcessExited && event.fContext == &gFirst);
+    } else {
+        CHECK(errno == ESRCH);
+    }
+    CHECK(waitpid(pid, NULL, 0) == pid);
+    EventLoopDestroy(&loop);
+}
+
+/// A descriptor is reported as long as it has data, and with fEOF once
+/// the writing end has been closed.
+static void TestReadable(void)
+{
+    EventLoop loop;
+    Event event;
+    int fds[2];
+    char buffer[8];
+    
+    CHECK(EventLoopCreate(&loop));
+    CHECK(pipe(fds) == 0);
+    CHECK(EventLoopWatchReadable(&loop, fds[0], &gFirst));
+    CHECK(write(fds[1], "ab", 2) == 2);
+    
+    CHECK(EventLoopNext(&loop, &event));
+    CHECK(event.fKind == kEventReadable);
+    CHECK(event.fContext == &gFirst);
+    CHECK(event.fFd == fds[0]);
+    CHECK(! event.fEOF);
+    CHECK(read(fds[0], buffer, 1) == 1);
+    
+    // Level triggered, the second byte is still there.
+    CHECK(EventLoopNext(&loop, &event));
+    CHECK(event.fKind == kEventReadable && event.fFd == fds[0]);
+    CHECK(read(fds[0], buffer, 1) == 1);
+    
+    close(fds[1]);
+    CHECK(EventLoopNext(&loop, &event));
+    CHECK(event.fKind == kEventReadable && event.fFd == fds[0]);
+    CHECK(event.fEOF);
+    CHECK(read(fds[0], buffer, 1) == 0);
+    
+    EventLoopUnwatchReadable(&loop, fds[0]);
+    close(fds[0]);
+    EventLoopDestroy(&loop);
+}
+
+/// A descriptor that was closed without being unwatched doesn't get in
+/// the way of a new one with the same number.
+static void TestReadableReused(void)
+{
+    EventLoop loop;
+    Event event;
+    int fds[2];
+    int fd;
+    
+    CHECK(EventLoopCreate(&loop));
+    CHECK(pipe(fds) == 0);
+    CHECK(EventLoopWatchReadable(&loop, fds[0], &gFirst));
+    fd = fds[0];
+    close(fds[0]);
+    close(fds[1]);
+    
+    CHECK(pipe(fds) == 0);
+    CHECK(fds[0] == fd);
+    CHECK(EventLoopWatchReadable(&loop, fds[0], &gSecond));
+    CHECK(write(fds[1], "a", 1) == 1);
+    CHECK(EventLoopNext(&loop, &event));
+    CHECK(event.fKind == kEventReadable && event.fFd == fds[0]);
+    CHECK(event.fContext == &gSecond);
+    
+    EventLoopUnwatchReadable(&loop, fds[0]);
+    close(fds[0]);
+    close(fds[1]);
+    EventLoopDestroy(&loop);
+}
+
+/// Timers fire once each, in order, and not before they are due. Setting
+/// a timer again replaces it, and a cancelled timer never fires.
+static void TestTimers(void)
+{
+    EventLoop loop;
+    Event event;
+    struct timeval start;
+    
+    CHECK(EventLoopCreate(&loop));
+    gettimeofday(&start, NULL);
+    CHECK(EventLoopSetTimer(&loop, &gFirst, 100));
+    CHECK(EventLoopSetTimer(&loop, &gSecond, 10000));
+    CHECK(EventLoopSetTimer(&loop, &gSecond, 50));
+    CHECK(EventLoopSetTimer(&loop, &gThird, 20));
+    EventLoopCancelTimer(&loop, &gThird);
+    
+    CHECK(EventLoopNext(&loop, &event));
+    CHECK(event.fKind == kEventTimer && event.fContext == &gSecond);
+    CHECK(Elapsed(&start) >= 49);
+    CHECK(EventLoopNext(&loop, &event));
+    CHECK(event.fKind == kEventTimer && event.fContext == &gFirst);
+    CHECK(Elapsed(&start) >= 99);
+    CHECK(Elapsed(&start) < 5000);
+    
+    // A timer that is already due fires at once.
+    CHECK(EventLoopSetTimer(&loop, &gThird, 0));
+    CHECK(EventLoopNext(&loop, &event));
+    CHECK(event.fKind == kEventTimer && event.fContext == &gThird);
+    EventLoopDestroy(&loop);
+}
+
+/// Another thread can wake up the loop, as many times as it likes.
+static void TestWakeup(void)
+{
+    EventLoop loop;
+    Event event;
+    pthread_t thread;
+    int i;
+    
+    CHECK(EventLoopCreate(&loop));
+    CHECK(EventLoopAddWakeup(&loop, &gFirst));
+    for (i = 0; i < 2; i++) {
+        CHECK(pthread_create(&thread, NULL, WakeLater, &loop) == 0);
+        CHECK(EventLoopNext(&loop, &event));
+        CHECK(event.fKind == kEventWakeup && event.fContext == &gFirst);
+        pthread_join(thread, NULL);
+    }
+    EventLoopDestroy(&loop);
+}
+
+/// Sources of every kind in one loop are all reported.
+static void TestMixed(void)
+{
+    EventLoop loop;
+    Event event;
+    pid_t pid;
+    int fds[2];
+    bool exited = false, readable = false, timer = false;
+    char c;
+    int i;
+    
+    CHECK(EventLoopCreate(&loop));
+    CHECK(pipe(fds) == 0);
+    if ((pid = fork()) == 0) {
+        close(fds[0]);
+        (void)write(fds[1], "x", 1);
+        usleep(100 * 1000);
+        _exit(0);
+    }
+    close(fds[1]);
+    CHECK(EventLoopWatchProcess(&loop, pid, &gFirst));
+    CHECK(EventLoopWatchReadable(&loop, fds[0], &gSecond));
+    CHECK(EventLoopSetTimer(&loop, &gThird, 30));
+    for (i = 0; i < 10 && ! (exited && readable && timer); i++) {
+        CHECK(EventLoopNext(&loop, &event));
+        switch (event.fKind) {
+            case kEventProcessExited:
+                CHECK(event.fContext == &gFirst);
+                exited = true;
+                break;
+            case kEventReadable:
+                CHECK(event.fContext == &gSecond);
+                if (event.fEOF) {
+                    EventLoopUnwatchReadable(&loop, fds[0]);
+                    readable = true;
+                } else {
+                    CHECK(read(fds[0], &c, 1) == 1);
+                }
+                break;
+            case kEventTimer:
+                CHECK(event.fContext == &gThird);
+                timer = true;
+                break;
+            default:
+                CHECK(false);
+                break;
+        }
+    }
+    CHECK(exited && readable && timer);
+    CHECK(waitpid(pid, NULL, 0) == pid);
+    close(fds[0]);
+    EventLoopDestroy(&loop);
+}
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Main
+/////////////////////////////////////////////////////////////////////
+
+
+int main(void)
+{
+    // Fail rather than hang if an event never arrives.
+    alarm(30);
+    
+    RUN_TEST(TestProcessExit);
+    RUN_TEST(TestZombieProcess);
+    RUN_TEST(TestReadable);
+    RUN_TEST(TestReadableReused);
+    RUN_TEST(TestTimers);
+    RUN_TEST(TestWakeup);
+    RUN_TEST(TestMixed);
+    return TestResult();
+}
@@ -0,0 +1,174 @@
+//
+//  LeftoverProcessesTests.c
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+#include "TestPlugin.h"
+
+#include "Launcher.h"
+#include "LeftoverProcesses.h"
+
+#include "Test.h"
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Helpers
+/////////////////////////////////////////////////////////////////////
+
+
+static PluginRecord gPlugin;
+static ManifestRecord gManifest;
+static char *gDir;
+
+/// Start the script body with backend, in a process group of its own.
+static pid_t Spawn(const SpawnBackend *backend, const char *body)
+{
+    InvocationRecord invocation;
+    char *path;
+    pid_t pid;
+    
+    path = WriteTestScript(gDir, "script", body);
+    InitTestInvocation(&invocation, &gPlugin, &gManifest, kRunAsRoot);
+    pid = SpawnTestScript(&invocation, backend, path, -1);
+    FreeTestInvocation(&invocation);
+    free(path);
+    return pid;
+}
+
+/// Wait for pid to exit without reaping it, as RunScripts() does.
+///
+/// @return true once it has exited.
+static bool WaitForExit(pid_t pid)
+{
+    EventLoop loop;
+    Event event;
+    bool exited;
+    
+    if (! EventLoopCreate(&loop)) {
+        return false;
+    }
+    exited = EventLoopWatchProcess(&loop, pid, &loop) && EventLoopNext(&loop, &event)
+        && event.fKind == kEventProcessExited;
+    EventLoopDestroy(&loop);
+    return exited;
+}
+
+/// Run a script with backend that leaves a process behind, which writes
+/// "log" a second later, and clean up after it the way ReapScript() does.
+///
+/// @return true if the script exited normally.
+static bool RunLeavingProcess(const SpawnBackend *backend, bool kill)
+{
+    SpawnStatus status;
+    pid_t pid;
+    
+    unlink("log");
+    if ((pid = Spawn(backend, "(sleep 1; echo left >>log) &")) == -1 || ! WaitForExit(pid)) {
+        return false;
+    }
+    CleanUpProcessGroup(pid, "script", kill, gPlugin.fLogClient);
+    return backend->fWait(&gPlugin, pid, &status) == 0 && WIFEXITED(status.fStatus);
+}
+
+static bool LeftoverRan(void)
+{
+    char *log;
+    bool ran;
+    
+    usleep(1500 * 1000);
+    log = ReadTestFile(gDir, "log");
+    ran = log != NULL && strcmp(log, "left\n") == 0;
+    free(log);
+    unlink("log");
+    return ran;
+}
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Tests
+/////////////////////////////////////////////////////////////////////
+
+
+/// What a script leaves in its process group is killed with leftovers =
+/// kill, and kept otherwise, with every backend.
+static void TestLeftovers(void)
+{
+    static const char *backends[] = { "fork", "posix_spawn", "launcher" };
+    const SpawnBackend *backend;
+    size_t i;
+    
+    for (i = 0; i < sizeof(backends) / sizeof(backends[0]); i++) {
+        backend = SpawnBackendNamed(backends[i]);
+        CHECK(RunLeavingProcess(backend, true));
+        CHECK(! LeftoverRan());
+        CHECK(RunLeavingProcess(backend, false));
+        CHECK(LeftoverRan());
+    }
+}
+
+/// The launcher doesn't reap a script until the plugin waits for it, so
+/// its pid, and with it the process group id, can't be reused while the
+/// plugin cleans up the group.
+static void TestLauncherHoldsGroup(void)
+{
+    SpawnStatus status;
+    pid_t pid;
+    
+    CHECK((pid = Spawn(&kLauncherBackend, "exit 3")) != -1);
+    CHECK(WaitForExit(pid));
+    usleep(200 * 1000);
+    CHECK(kill(pid, 0) == 0);
+    CHECK(kLauncherBackend.fWait(&gPlugin, pid, &status) == 0);
+    CHECK(WIFEXITED(status.fStatus) && WEXITSTATUS(status.fStatus) == 3);
+    CHECK(kill(pid, 0) == -1 && errno == ESRCH);
+}
+
+/// The footprint of a process group covers the processes in it.
+static void TestFootprint(void)
+{
+    SpawnStatus status;
+    pid_t pid;
+    
+    CHECK((pid = Spawn(&kLauncherBackend, "sleep 10")) != -1);
+    usleep(200 * 1000);
+    CHECK(ProcessGroupFootprint(pid) > 0);
+    killpg(pid, SIGKILL);
+    CHECK(kLauncherBackend.fWait(&gPlugin, pid, &status) == 0);
+    CHECK(ProcessGroupFootprint(pid) == 0);
+}
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Main
+/////////////////////////////////////////////////////////////////////
+
+
+int main(void)
+{
+    alarm(60);
+    
+    gDir = CreateTestDirectory();
+    if (chdir(gDir) != 0) {
+        perror(gDir);
+        return 2;
+    }
+    InitTestPlugin(&gPlugin);
+    InitTestManifest(&gManifest, "launcher");
+    if (! StartLauncher(&gPlugin)) {
+        fprintf(stderr, "Launcher not started\n");
+        return 2;
+    }
+    
+    RUN_TEST(TestLeftovers);
+    RUN_TEST(TestLauncherHoldsGroup);
+    RUN_TEST(TestFootprint);
+    
+    StopLauncher(&gPlugin);
+    RemoveTestDirectory(gDir);
+    return TestResult();
+}
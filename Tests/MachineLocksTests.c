@@ -0,0 +1,305 @@
+//
+//  MachineLocksTests.c
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+#include "TestPlugin.h"
+
+#include "MachineLocks.h"
+
+#include "Test.h"
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Helpers
+/////////////////////////////////////////////////////////////////////
+
+
+static PluginRecord gPlugin;
+static ManifestRecord gManifest;
+static InvocationRecord gInvocation;
+
+/// A script wanting the lock name, NULL for none, and weight slots.
+typedef struct {
+    ScriptSettings fSettings;
+    ScriptRecord fScript;
+} TestScript;
+
+static void InitLockScript(TestScript *test, const char *lock, long weight)
+{
+    test->fSettings = gManifest.fDefaults;
+    test->fSettings.fLock = (char *)lock;
+    test->fSettings.fWeight = weight;
+    InitTestScript(&test->fScript, (char *)"/scripts/locked", &test->fSettings);
+}
+
+static bool Acquire(TestScript *test)
+{
+    return AcquireMachineLocks(&gInvocation, &test->fScript);
+}
+
+/// Return true if test holds nothing.
+static bool HoldsNothing(const TestScript *test)
+{
+    return test->fScript.fMachineLocks.fLockFd == -1 && test->fScript.fMachineLocks.fSlotCount == 0;
+}
+
+/// Take the lock name in a child process, which holds it until the
+/// returned pipe is closed.
+///
+/// @return The write end of the pipe, or -1 if the child couldn't lock.
+static int HoldInChild(const char *name, pid_t *pid)
+{
+    TestScript test;
+    int ready[2];
+    int release[2];
+    char result;
+    
+    if (pipe(ready) != 0 || pipe(release) != 0) {
+        perror("pipe");
+        exit(2);
+    }
+    if ((*pid = fork()) == -1) {
+        perror("fork");
+        exit(2);
+    }
+    if (*pid == 0) {
+        close(ready[0]);
+        close(release[1]);
+        InitLockScript(&test, name, 0);
+        result = Acquire(&test) && test.fScript.fMachineLocks.fLockFd != -1;
+        write(ready[1], &result, 1);
+        read(release[0], &result, 1);
+        _exit(0);
+    }
+    close(ready[1]);
+    close(release[0]);
+    if (read(ready[0], &result, 1) != 1 || ! result) {
+        close(release[1]);
+        release[1] = -1;
+    }
+    close(ready[0]);
+    return release[1];
+}
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Tests
+/////////////////////////////////////////////////////////////////////
+
+
+/// A script without a lock or weight takes nothing.
+static void TestNoLocks(void)
+{
+    TestScript test;
+    
+    InitLockScript(&test, NULL, 0);
+    CHECK(Acquire(&test));
+    CHECK(HoldsNothing(&test));
+    CHECK(test.fScript.fMachineLocks.fWaitStart.tv_sec == 0);
+}
+
+/// A named lock is held by one script at a time, and other names don't
+/// get in the way.
+static void TestNamedLock(void)
+{
+    TestScript first;
+    TestScript second;
+    TestScript other;
+    
+    InitLockScript(&first, "db", 0);
+    InitLockScript(&second, "db", 0);
+    InitLockScript(&other, "cache", 0);
+    CHECK(Acquire(&first));
+    CHECK(first.fScript.fMachineLocks.fLockFd != -1);
+    CHECK(! Acquire(&second));
+    CHECK(HoldsNothing(&second));
+    CHECK(Acquire(&other));
+    CHECK(other.fScript.fMachineLocks.fLockFd != -1);
+    
+    ReleaseMachineLocks(&first.fScript);
+    CHECK(HoldsNothing(&first));
+    CHECK(Acquire(&second));
+    CHECK(! Acquire(&first));
+    ReleaseMachineLocks(&second.fScript);
+    ReleaseMachineLocks(&other.fScript);
+    
+    // Releasing twice is harmless.
+    ReleaseMachineLocks(&other.fScript);
+    CHECK(HoldsNothing(&other));
+}
+
+/// A named lock held by another process, like another plugin host, is
+/// waited for, and is free again when that process dies.
+static void TestAcrossProcesses(void)
+{
+    TestScript test;
+    int status;
+    pid_t pid;
+    int release;
+    
+    InitLockScript(&test, "db", 0);
+    if ((release = HoldInChild("db", &pid)) == -1) {
+        CHECK(release != -1);
+        waitpid(pid, &status, 0);
+        return;
+    }
+    CHECK(! Acquire(&test));
+    CHECK(! Acquire(&test));
+    close(release);
+    CHECK(waitpid(pid, &status, 0) == pid);
+    CHECK(Acquire(&test));
+    ReleaseMachineLocks(&test.fScript);
+}
+
+/// Weighted scripts share machine_slots slots, and a script asking for
+/// more than there are gets all of them.
+static void TestWeights(void)
+{
+    TestScript heavy;
+    TestScript heavier;
+    TestScript light;
+    TestScript greedy;
+    
+    gManifest.fMachineSlots = 3;
+    InitLockScript(&heavy, NULL, 2);
+    InitLockScript(&heavier, NULL, 2);
+    InitLockScript(&light, NULL, 1);
+    InitLockScript(&greedy, NULL, 5);
+    CHECK(Acquire(&heavy));
+    CHECK(heavy.fScript.fMachineLocks.fSlotCount == 2);
+    
+    // A script that can't get all its slots holds none of them.
+    CHECK(! Acquire(&heavier));
+    CHECK(HoldsNothing(&heavier));
+    CHECK(Acquire(&light));
+    CHECK(light.fScript.fMachineLocks.fSlotCount == 1);
+    CHECK(! Acquire(&greedy));
+    
+    ReleaseMachineLocks(&heavy.fScript);
+    CHECK(HoldsNothing(&heavy));
+    CHECK(Acquire(&heavier));
+    ReleaseMachineLocks(&heavier.fScript);
+    ReleaseMachineLocks(&light.fScript);
+    
+    CHECK(Acquire(&greedy));
+    CHECK(greedy.fScript.fMachineLocks.fSlotCount == 3);
+    ReleaseMachineLocks(&greedy.fScript);
+    gManifest.fMachineSlots = 0;
+}
+
+/// Both a lock and slots are needed, and neither is kept while waiting
+/// for the other.
+static void TestLockAndWeight(void)
+{
+    TestScript both;
+    TestScript slots;
+    TestScript lock;
+    
+    gManifest.fMachineSlots = 1;
+    InitLockScript(&both, "db", 1);
+    InitLockScript(&slots, NULL, 1);
+    InitLockScript(&lock, "db", 0);
+    CHECK(Acquire(&slots));
+    CHECK(! Acquire(&both));
+    CHECK(HoldsNothing(&both));
+    CHECK(Acquire(&lock));
+    ReleaseMachineLocks(&lock.fScript);
+    ReleaseMachineLocks(&slots.fScript);
+    CHECK(Acquire(&both));
+    ReleaseMachineLocks(&both.fScript);
+    gManifest.fMachineSlots = 0;
+}
+
+/// The time from the first failed attempt until the locks are taken is
+/// recorded, the way the plugin logs it.
+static void TestWaitTime(void)
+{
+    TestScript first;
+    TestScript second;
+    MachineLocks *locks = &second.fScript.fMachineLocks;
+    
+    InitLockScript(&first, "db", 0);
+    InitLockScript(&second, "db", 0);
+    CHECK(Acquire(&first));
+    CHECK(! Acquire(&second));
+    CHECK(locks->fWaitStart.tv_sec != 0);
+    usleep(kMachineLockRetryMilliseconds * 1000);
+    CHECK(! Acquire(&second));
+    usleep(kMachineLockRetryMilliseconds * 1000);
+    ReleaseMachineLocks(&first.fScript);
+    CHECK(Acquire(&second));
+    CHECK(locks->fWaited >= 2 * kMachineLockRetryMilliseconds / 1e3);
+    CHECK(locks->fWaited < 10);
+    ReleaseMachineLocks(&second.fScript);
+    
+    // Locks that are free right away record no wait.
+    InitLockScript(&first, "db", 0);
+    CHECK(Acquire(&first));
+    CHECK(first.fScript.fMachineLocks.fWaitStart.tv_sec == 0);
+    CHECK(first.fScript.fMachineLocks.fWaited == 0);
+    ReleaseMachineLocks(&first.fScript);
+}
+
+/// A lock directory that others can write to isn't trusted, and scripts
+/// then run without machine-wide locks rather than not at all.
+static void TestUnsafeDirectory(void)
+{
+    TestScript first;
+    TestScript second;
+    
+    chmod(kMachineLockDir, 0777);
+    InitLockScript(&first, "db", 1);
+    InitLockScript(&second, "db", 1);
+    CHECK(Acquire(&first));
+    CHECK(Acquire(&second));
+    CHECK(HoldsNothing(&first));
+    CHECK(HoldsNothing(&second));
+    chmod(kMachineLockDir, 0700);
+}
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Main
+/////////////////////////////////////////////////////////////////////
+
+
+int main(void)
+{
+    char *dir;
+    char *lockDir;
+    
+    // The lock directory has to be owned by root to be used at all.
+    if (geteuid() != 0) {
+        fprintf(stderr, "skip MachineLocksTests, not running as root\n");
+        return 0;
+    }
+    alarm(60);
+    
+    dir = CreateTestDirectory();
+    if (asprintf(&lockDir, "%s/locks", dir) == -1) {
+        return 2;
+    }
+    kMachineLockDir = lockDir;
+    InitTestPlugin(&gPlugin);
+    InitTestManifest(&gManifest, "fork");
+    InitTestInvocation(&gInvocation, &gPlugin, &gManifest, kRunAsRoot);
+    
+    RUN_TEST(TestNoLocks);
+    RUN_TEST(TestNamedLock);
+    RUN_TEST(TestAcrossProcesses);
+    RUN_TEST(TestWeights);
+    RUN_TEST(TestLockAndWeight);
+    RUN_TEST(TestUnsafeDirectory);
+    RUN_TEST(TestWaitTime);
+    
+    FreeTestInvocation(&gInvocation);
+    RemoveTestDirectory(dir);
+    free(lockDir);
+    return TestResult();
+}
@@ -0,0 +1,317 @@
+//
+//  ManifestTests.c
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+#include "TestPlugin.h"
+
+#include "Launcher.h"
+#include "Manifest.h"
+
+#include "Test.h"
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Helpers
+/////////////////////////////////////////////////////////////////////
+
+
+static PluginRecord gPlugin;
+
+/// Fill in manifest with the defaults and the settings in text.
+static void ParseManifestText(ManifestRecord *manifest, const char *text)
+{
+    ParseTestManifest(manifest, text, gPlugin.fLogClient);
+}
+
+/// Return true if value parses as the uid range low to high.
+static bool UidRangeIs(const char *value, uid_t low, uid_t high)
+{
+    uid_t parsedLow, parsedHigh;
+    
+    return ParseUidRange(value, &parsedLow, &parsedHigh) && parsedLow == low && parsedHigh == high;
+}
+
+static bool StringIs(const char *string, const char *expected)
+{
+    return string != NULL && strcmp(string, expected) == 0;
+}
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Tests
+/////////////////////////////////////////////////////////////////////
+
+
+/// An empty manifest leaves the defaults, which every script gets.
+static void TestDefaults(void)
+{
+    ManifestRecord manifest;
+    
+    ParseManifestText(&manifest, "");
+    CHECK(manifest.fSpawnBackend == &kLauncherBackend);
+    CHECK(manifest.fMaxJobs == 0);
+    CHECK(manifest.fLoginBudget == 0);
+    CHECK(manifest.fPolicySocket == NULL);
+    CHECK(manifest.fPolicyFailureResult == kAuthorizationResultAllow);
+    CHECK(manifest.fShedLoad == 1.0);
+    CHECK(manifest.fScriptCount == 0);
+    CHECK(manifest.fDefaults.fName == NULL);
+    CHECK(manifest.fDefaults.fTimeout == 0);
+    CHECK(manifest.fDefaults.fTimeoutResult == kAuthorizationResultAllow);
+    CHECK(! manifest.fDefaults.fBatch);
+    CHECK(LookupScriptSettings(&manifest, "10-script") == &manifest.fDefaults);
+    FreeManifest(&manifest);
+}
+
+/// Settings before the first section apply to the plugin and are the
+/// defaults of all scripts.
+static void TestGlobalSettings(void)
+{
+    ManifestRecord manifest;
+    
+    ParseManifestText(&manifest,
+                      "# Lab machines\n"
+                      "\n"
+                      "spawn = fork\n"
+                      "  jobs=4  \n"
+                      "login_budget = 30\n"
+                      "policy_socket = /var/run/policy.sock\n"
+                      "policy_timeout = 5\n"
+                      "policy_failure = deny\n"
+                      "machine_slots = 3\n"
+                      "shed_load = 1.5\n"
+                      "shed_free_memory = 100\n"
+                      "shed_swap_used = 200\n"
+                      "timeout = 10\n"
+                      "timeout_action = deny\n"
+                      "batch = yes\n"
+                      "priority = background\n"
+                      "optional = defer\n"
+                      "if_uid = 500-999, 1000\n");
+    CHECK(manifest.fSpawnBackend == SpawnBackendNamed("fork"));
+    CHECK(manifest.fMaxJobs == 4);
+    CHECK(manifest.fLoginBudget == 30);
+    CHECK(StringIs(manifest.fPolicySocket, "/var/run/policy.sock"));
+    CHECK(manifest.fPolicyTimeout == 5);
+    CHECK(manifest.fPolicyFailureResult == kAuthorizationResultDeny);
+    CHECK(manifest.fMachineSlots == 3);
+    CHECK(manifest.fShedLoad == 1.5);
+    CHECK(manifest.fShedFreeMemory == 100);
+    CHECK(manifest.fShedSwapUsed == 200);
+    CHECK(manifest.fDefaults.fTimeout == 10);
+    CHECK(manifest.fDefaults.fTimeoutResult == kAuthorizationResultDeny);
+    CHECK(manifest.fDefaults.fBatch);
+    CHECK(manifest.fDefaults.fPriority == kPriorityBackground);
+    CHECK(manifest.fDefaults.fShedding == kShedDefer);
+    CHECK(StringIs(manifest.fDefaults.fPredicates.fUids, "500-999, 1000"));
+    CHECK(manifest.fScriptCount == 0);
+    FreeManifest(&manifest);
+}
+
+/// A section starts with the defaults set before it, and only changes the
+/// settings of its own script.
+static void TestScriptSections(void)
+{
+    ManifestRecord manifest;
+    const ScriptSettings *settings;
+    
+    ParseManifestText(&manifest,
+                      "timeout = 10\n"
+                      "lock = network\n"
+                      "memory_limit = 64\n"
+                      "[10-mount]\n"
+                      "timeout = 20\n"
+                      "group = mounts\n"
+                      "after = 05-network, printers\n"
+                      "weight = 2\n"
+                      "[ 20-dock ]\n"
+                      "detach = yes\n"
+                      "if_exists = ~/Library/Preferences\n");
+    CHECK(manifest.fScriptCount == 2);
+    CHECK(manifest.fDefaults.fTimeout == 10);
+    CHECK(manifest.fDefaults.fGroup == NULL);
+    
+    settings = LookupScriptSettings(&manifest, "10-mount");
+    CHECK(StringIs(settings->fName, "10-mount"));
+    CHECK(settings->fTimeout == 20);
+    CHECK(StringIs(settings->fLock, "network"));
+    CHECK(settings->fLimits.fMemory == 64 * 1024 * 1024);
+    CHECK(StringIs(settings->fGroup, "mounts"));
+    CHECK(StringIs(settings->fAfter, "05-network, printers"));
+    CHECK(settings->fWeight == 2);
+    CHECK(! settings->fDetach);
+    
+    settings = LookupScriptSettings(&manifest, "20-dock");
+    CHECK(StringIs(settings->fName, "20-dock"));
+    CHECK(settings->fTimeout == 10);
+    CHECK(settings->fDetach);
+    CHECK(settings->fGroup == NULL);
+    CHECK(StringIs(settings->fPredicates.fExists, "~/Library/Preferences"));
+    
+    // Names are matched exactly.
+    CHECK(LookupScriptSettings(&manifest, "20-Dock") == &manifest.fDefaults);
+    FreeManifest(&manifest);
+}
+
+/// A gate can't be detached, wait for readiness, be shed, run in the
+/// session or run in the background.
+static void TestGate(void)
+{
+    ManifestRecord manifest;
+    const ScriptSettings *settings;
+    
+    ParseManifestText(&manifest,
+                      "optional = skip\n"
+                      "[00-gate]\n"
+                      "gate = yes\n"
+                      "detach = yes\n"
+                      "notify_ready = yes\n"
+                      "in_session = yes\n"
+                      "priority = background\n"
+                      "[10-other]\n"
+                      "detach = yes\n");
+    settings = LookupScriptSettings(&manifest, "00-gate");
+    CHECK(settings->fGate);
+    CHECK(! settings->fDetach);
+    CHECK(! settings->fNotifyReady);
+    CHECK(! settings->fInSession);
+    CHECK(settings->fShedding == kShedNever);
+    CHECK(settings->fPriority == kPriorityCritical);
+    
+    settings = LookupScriptSettings(&manifest, "10-other");
+    CHECK(! settings->fGate);
+    CHECK(settings->fDetach);
+    CHECK(settings->fShedding == kShedSkip);
+    FreeManifest(&manifest);
+}
+
+/// Invalid lines are skipped, leaving the settings they would have
+/// changed as they were.
+static void TestInvalidLines(void)
+{
+    ManifestRecord manifest;
+    const ScriptSettings *settings;
+    
+    ParseManifestText(&manifest,
+                      "jobs = 2\n"
+                      "jobs = -1\n"
+                      "jobs = 3 cpus\n"
+                      "spawn = vfork\n"
+                      "timeout = 5\n"
+                      "timeout = soon\n"
+                      "shed_load = 2\n"
+                      "shed_load = high\n"
+                      "policy_failure = maybe\n"
+                      "policy_socket = relative.sock\n"
+                      "batch = sometimes\n"
+                      "lock = two words\n"
+                      "weight = 17\n"
+                      "if_uid = 1000-500\n"
+                      "if_exists = Library\n"
+                      "priority = urgent\n"
+                      "no separator\n"
+                      "unknown = 1\n"
+                      "group = mounts\n"
+                      "[unterminated\n"
+                      "[10-script]\n"
+                      "jobs = 8\n"
+                      "login_budget = 60\n"
+                      "gate = perhaps\n"
+                      "[20-script] trailing\n"
+                      "timeout = 7\n");
+    CHECK(manifest.fMaxJobs == 2);
+    CHECK(manifest.fSpawnBackend == &kLauncherBackend);
+    CHECK(manifest.fShedLoad == 2);
+    CHECK(manifest.fLoginBudget == 0);
+    CHECK(manifest.fPolicyFailureResult == kAuthorizationResultAllow);
+    CHECK(manifest.fPolicySocket == NULL);
+    CHECK(manifest.fDefaults.fTimeout == 5);
+    CHECK(! manifest.fDefaults.fBatch);
+    CHECK(manifest.fDefaults.fLock == NULL);
+    CHECK(manifest.fDefaults.fWeight == 0);
+    CHECK(manifest.fDefaults.fPredicates.fUids == NULL);
+    CHECK(manifest.fDefaults.fPredicates.fExists == NULL);
+    CHECK(manifest.fDefaults.fPriority == kPriorityNormal);
+    CHECK(manifest.fDefaults.fGroup == NULL);
+    
+    // The settings after a broken section header belong to the section
+    // before it.
+    CHECK(manifest.fScriptCount == 1);
+    settings = LookupScriptSettings(&manifest, "10-script");
+    CHECK(StringIs(settings->fName, "10-script"));
+    CHECK(! settings->fGate);
+    CHECK(settings->fTimeout == 7);
+    FreeManifest(&manifest);
+}
+
+/// Single uids and open or closed ranges parse, anything else doesn't.
+static void TestUidRanges(void)
+{
+    uid_t low, high;
+    
+    CHECK(UidRangeIs("501", 501, 501));
+    CHECK(UidRangeIs("0", 0, 0));
+    CHECK(UidRangeIs("500-999", 500, 999));
+    CHECK(UidRangeIs("1000-", 1000, (uid_t)-1));
+    CHECK(UidRangeIs("-499", 0, 499));
+    CHECK(UidRangeIs("7-7", 7, 7));
+    CHECK(UidRangeIs("-", 0, (uid_t)-1));
+    CHECK(UidRangeIs("4294967295", 4294967295u, 4294967295u));
+    
+    CHECK(! ParseUidRange("", &low, &high));
+    CHECK(! ParseUidRange("999-500", &low, &high));
+    CHECK(! ParseUidRange("4294967296", &low, &high));
+    CHECK(! ParseUidRange("12345678901234567890", &low, &high));
+    CHECK(! ParseUidRange("+5", &low, &high));
+    CHECK(! ParseUidRange(" 5", &low, &high));
+    CHECK(! ParseUidRange("5 ", &low, &high));
+    CHECK(! ParseUidRange("5-x", &low, &high));
+    CHECK(! ParseUidRange("5--9", &low, &high));
+    CHECK(! ParseUidRange("5-9-", &low, &high));
+    CHECK(! ParseUidRange("--5", &low, &high));
+    CHECK(! ParseUidRange("abc", &low, &high));
+}
+
+/// Lists are separated by commas, spaces or tabs, in any number.
+static void TestListItems(void)
+{
+    const char *list = " 500-999,1000\t, ,admin  ";
+    char item[8];
+    
+    CHECK(NextListItem(&list, item, sizeof(item)) && strcmp(item, "500-999") == 0);
+    CHECK(NextListItem(&list, item, sizeof(item)) && strcmp(item, "1000") == 0);
+    CHECK(NextListItem(&list, item, sizeof(item)) && strcmp(item, "admin") == 0);
+    CHECK(! NextListItem(&list, item, sizeof(item)));
+    
+    // Items that don't fit are cut short, and the next one starts after
+    // them.
+    list = "staff-members,x";
+    CHECK(NextListItem(&list, item, sizeof(item)) && strcmp(item, "staff-m") == 0);
+    CHECK(NextListItem(&list, item, sizeof(item)) && strcmp(item, "x") == 0);
+}
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Main
+/////////////////////////////////////////////////////////////////////
+
+
+int main(void)
+{
+    InitTestPlugin(&gPlugin);
+    
+    RUN_TEST(TestDefaults);
+    RUN_TEST(TestGlobalSettings);
+    RUN_TEST(TestScriptSections);
+    RUN_TEST(TestGate);
+    RUN_TEST(TestInvalidLines);
+    RUN_TEST(TestUidRanges);
+    RUN_TEST(TestListItems);
+    return TestResult();
+}
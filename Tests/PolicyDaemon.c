@@ -0,0 +1,190 @@
+//
+//  PolicyDaemon.c
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// A stand-in for a policy service, for trying out policy_socket and for
+// PolicyServiceTests. It listens on socket, reads login requests from any
+// number of connections, and gives every request the same answer:
+// "allow", "deny", anything else to send an invalid answer, or "hang" to
+// never answer. It prints "ready" once it accepts connections.
+//
+// Usage: PolicyDaemon [-c] [-l log] socket answer
+//
+//   -c      close each connection after answering a request
+//   -l log  append each request to log, and "connection" for each
+//           connection accepted
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Connections
+/////////////////////////////////////////////////////////////////////
+
+
+enum {
+    kMaxConnections = 16,
+    kMaxRequest = 4096
+};
+
+static const char *gAnswer;
+static bool gCloseAfterAnswer = false;
+static FILE *gLog = NULL;
+
+/// Read exactly size bytes from fd.
+static bool ReadFully(int fd, char *buffer, size_t size)
+{
+    ssize_t n;
+    
+    while (size > 0) {
+        if ((n = read(fd, buffer, size)) == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        buffer += n;
+        size -= n;
+    }
+    return true;
+}
+
+/// Read a login request from fd and answer it.
+///
+/// @return false if the connection should be closed.
+static bool AnswerRequest(int fd)
+{
+    char header[32];
+    char payload[kMaxRequest];
+    char reply[kMaxRequest];
+    size_t length;
+    int size;
+    
+    // The header is "login <length>\n", read a byte at a time so that
+    // nothing of the payload is consumed.
+    for (length = 0; length < sizeof(header) - 1; length++) {
+        if (! ReadFully(fd, &header[length], 1)) {
+            return false;
+        }
+        if (header[length] == '\n') {
+            break;
+        }
+    }
+    header[length] = '\0';
+    if (sscanf(header, "login %d", &size) != 1 || size < 0 || size >= kMaxRequest
+        || ! ReadFully(fd, payload, size)) {
+        return false;
+    }
+    payload[size] = '\0';
+    if (gLog != NULL) {
+        fprintf(gLog, "%s\n%s", header, payload);
+        fflush(gLog);
+    }
+    
+    if (strcmp(gAnswer, "hang") == 0) {
+        return true;
+    }
+    snprintf(reply, sizeof(reply), "%s\n", gAnswer);
+    if (write(fd, reply, strlen(reply)) != (ssize_t)strlen(reply)) {
+        return false;
+    }
+    return ! gCloseAfterAnswer;
+}
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Main
+/////////////////////////////////////////////////////////////////////
+
+
+int main(int argc, char *argv[])
+{
+    struct pollfd fds[kMaxConnections + 1];
+    struct sockaddr_un addr;
+    nfds_t count;
+    nfds_t i;
+    int option;
+    int fd;
+    
+    while ((option = getopt(argc, argv, "cl:")) != -1) {
+        switch (option) {
+            case 'c':
+                gCloseAfterAnswer = true;
+                break;
+            case 'l':
+                if ((gLog = fopen(optarg, "a")) == NULL) {
+                    perror(optarg);
+                    return 1;
+                }
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-c] [-l log] socket answer\n", argv[0]);
+                return 2;
+        }
+    }
+    if (argc - optind != 2 || strlen(argv[optind]) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Usage: %s [-c] [-l log] socket answer\n", argv[0]);
+        return 2;
+    }
+    gAnswer = argv[optind + 1];
+    signal(SIGPIPE, SIG_IGN);
+    
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, argv[optind]);
+    unlink(addr.sun_path);
+    if ((fds[0].fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1
+        || bind(fds[0].fd, (struct sockaddr *)&addr, sizeof(addr)) != 0
+        || listen(fds[0].fd, kMaxConnections) != 0) {
+        perror(addr.sun_path);
+        return 1;
+    }
+    fds[0].events = POLLIN;
+    count = 1;
+    printf("ready\n");
+    fflush(stdout);
+    
+    for (;;) {
+        if (poll(fds, count, -1) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("poll");
+            return 1;
+        }
+        for (i = count - 1; i > 0; i--) {
+            if (fds[i].revents != 0 && ! AnswerRequest(fds[i].fd)) {
+                close(fds[i].fd);
+                fds[i] = fds[--count];
+            }
+        }
+        if ((fds[0].revents & POLLIN) != 0 && (fd = accept(fds[0].fd, NULL, NULL)) != -1) {
+            if (count == kMaxConnections + 1) {
+                close(fd);
+                continue;
+            }
+            if (gLog != NULL) {
+                fprintf(gLog, "connection\n");
+                fflush(gLog);
+            }
+            fds[count].fd = fd;
+            fds[count].events = POLLIN;
+            fds[count].revents = 0;
+            count++;
+        }
+    }
+}
@@ -0,0 +1,249 @@
+//
+//  PolicyServiceTests.c
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+#include "TestPlugin.h"
+
+#include "PolicyService.h"
+
+#include "Test.h"
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Helpers
+/////////////////////////////////////////////////////////////////////
+
+
+static PluginRecord gPlugin;
+static ManifestRecord gManifest;
+static char *gSocketPath;
+static char *gLogPath;
+
+/// Start PolicyDaemon on gSocketPath, giving every request answer and
+/// logging to gLogPath, which is emptied first. Extra options, such as
+/// "-c", may be given in option.
+///
+/// @return The pid of the daemon, once it accepts connections.
+static pid_t StartDaemon(const char *answer, const char *option)
+{
+    char line[16];
+    int fds[2];
+    pid_t pid;
+    
+    truncate(gLogPath, 0);
+    if (pipe(fds) != 0 || (pid = fork()) == -1) {
+        perror("fork");
+        exit(2);
+    }
+    if (pid == 0) {
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        if (option != NULL) {
+            execl("./PolicyDaemon", "PolicyDaemon", option, "-l", gLogPath, gSocketPath, answer, (char *)NULL);
+        } else {
+            execl("./PolicyDaemon", "PolicyDaemon", "-l", gLogPath, gSocketPath, answer, (char *)NULL);
+        }
+        perror("./PolicyDaemon");
+        _exit(2);
+    }
+    close(fds[1]);
+    if (read(fds[0], line, sizeof(line)) <= 0) {
+        fprintf(stderr, "PolicyDaemon didn't start\n");
+        exit(2);
+    }
+    close(fds[0]);
+    return pid;
+}
+
+static void StopDaemon(pid_t pid)
+{
+    int status;
+    
+    kill(pid, SIGTERM);
+    waitpid(pid, &status, 0);
+    unlink(gSocketPath);
+}
+
+/// Ask the policy service for a login of the user running the tests,
+/// with the given policy_timeout and policy_failure.
+static AuthorizationResult Ask(long timeout, AuthorizationResult failure)
+{
+    InvocationRecord invocation;
+    AuthorizationResult result;
+    
+    gManifest.fPolicyTimeout = timeout;
+    gManifest.fPolicyFailureResult = failure;
+    InitTestInvocation(&invocation, &gPlugin, &gManifest, kRunAsRoot);
+    result = AskPolicyService(&invocation);
+    FreeTestInvocation(&invocation);
+    return result;
+}
+
+/// Return true if the daemon has logged exactly text.
+static bool LogIs(const char *text)
+{
+    char log[4096];
+    FILE *file;
+    size_t length;
+    
+    if ((file = fopen(gLogPath, "r")) == NULL) {
+        return false;
+    }
+    length = fread(log, 1, sizeof(log) - 1, file);
+    fclose(file);
+    log[length] = '\0';
+    if (strcmp(log, text) != 0) {
+        fprintf(stderr, "daemon log:\n%s", log);
+        return false;
+    }
+    return true;
+}
+
+/// Return the number of connections the daemon has logged.
+static int LoggedConnections(void)
+{
+    char line[256];
+    FILE *file;
+    int count = 0;
+    
+    if ((file = fopen(gLogPath, "r")) == NULL) {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), file) != NULL) {
+        count += strcmp(line, "connection\n") == 0;
+    }
+    fclose(file);
+    return count;
+}
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Tests
+/////////////////////////////////////////////////////////////////////
+
+
+/// The request carries the login's context after a "login <length>"
+/// header, and the answer decides the result.
+static void TestProtocol(void)
+{
+    char expected[256];
+    char payload[128];
+    pid_t pid;
+    
+    snprintf(payload, sizeof(payload), "uid=%d\ngid=%d\nhome=/tmp\nphase=postmount\ncontext=root\n",
+             getuid(), getgid());
+    snprintf(expected, sizeof(expected), "connection\nlogin %zu\n%s", strlen(payload), payload);
+    
+    pid = StartDaemon("allow", NULL);
+    CHECK(Ask(1, kAuthorizationResultDeny) == kAuthorizationResultAllow);
+    CHECK(LogIs(expected));
+    StopDaemon(pid);
+    
+    pid = StartDaemon("deny", NULL);
+    CHECK(Ask(1, kAuthorizationResultAllow) == kAuthorizationResultDeny);
+    StopDaemon(pid);
+}
+
+/// Connections are kept for the next login, and one the daemon has
+/// closed, or that belongs to a daemon that was restarted, is replaced.
+static void TestConnectionReuse(void)
+{
+    pid_t pid;
+    
+    pid = StartDaemon("allow", NULL);
+    CHECK(Ask(1, kAuthorizationResultDeny) == kAuthorizationResultAllow);
+    CHECK(Ask(1, kAuthorizationResultDeny) == kAuthorizationResultAllow);
+    CHECK(Ask(1, kAuthorizationResultDeny) == kAuthorizationResultAllow);
+    CHECK(LoggedConnections() == 1);
+    StopDaemon(pid);
+    
+    pid = StartDaemon("allow", NULL);
+    CHECK(Ask(1, kAuthorizationResultDeny) == kAuthorizationResultAllow);
+    CHECK(LoggedConnections() == 1);
+    StopDaemon(pid);
+    
+    pid = StartDaemon("deny", "-c");
+    CHECK(Ask(1, kAuthorizationResultAllow) == kAuthorizationResultDeny);
+    CHECK(Ask(1, kAuthorizationResultAllow) == kAuthorizationResultDeny);
+    CHECK(LoggedConnections() == 2);
+    StopDaemon(pid);
+}
+
+/// A daemon that doesn't answer is given up on after policy_timeout
+/// seconds, and policy_failure decides.
+static void TestTimeout(void)
+{
+    double start;
+    double elapsed;
+    pid_t pid;
+    
+    pid = StartDaemon("hang", NULL);
+    start = TestSeconds();
+    CHECK(Ask(1, kAuthorizationResultDeny) == kAuthorizationResultDeny);
+    elapsed = TestSeconds() - start;
+    CHECK(elapsed >= 0.9 && elapsed < 3);
+    CHECK(Ask(1, kAuthorizationResultAllow) == kAuthorizationResultAllow);
+    StopDaemon(pid);
+}
+
+/// policy_failure also decides when there is no daemon, or it gives an
+/// invalid answer.
+static void TestPolicyFailure(void)
+{
+    pid_t pid;
+    
+    unlink(gSocketPath);
+    CHECK(Ask(1, kAuthorizationResultDeny) == kAuthorizationResultDeny);
+    CHECK(Ask(1, kAuthorizationResultAllow) == kAuthorizationResultAllow);
+    
+    pid = StartDaemon("maybe", NULL);
+    CHECK(Ask(1, kAuthorizationResultDeny) == kAuthorizationResultDeny);
+    CHECK(Ask(1, kAuthorizationResultAllow) == kAuthorizationResultAllow);
+    StopDaemon(pid);
+}
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Main
+/////////////////////////////////////////////////////////////////////
+
+
+int main(void)
+{
+    char *dir;
+    
+    // The plugin only talks to a policy service run by root.
+    if (geteuid() != 0) {
+        fprintf(stderr, "skip PolicyServiceTests, not running as root\n");
+        return 0;
+    }
+    alarm(60);
+    signal(SIGPIPE, SIG_IGN);
+    
+    dir = CreateTestDirectory();
+    if (asprintf(&gSocketPath, "%s/policy", dir) == -1 || asprintf(&gLogPath, "%s/policy.log", dir) == -1) {
+        return 2;
+    }
+    InitTestPlugin(&gPlugin);
+    InitTestManifest(&gManifest, "fork");
+    gManifest.fPolicySocket = gSocketPath;
+    
+    RUN_TEST(TestProtocol);
+    RUN_TEST(TestConnectionReuse);
+    RUN_TEST(TestTimeout);
+    RUN_TEST(TestPolicyFailure);
+    
+    StopPolicyConnections(&gPlugin.fPolicy);
+    gManifest.fPolicySocket = NULL;
+    RemoveTestDirectory(dir);
+    free(gSocketPath);
+    free(gLogPath);
+    return TestResult();
+}
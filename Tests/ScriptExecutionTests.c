@@ -0,0 +1,475 @@
+//
+//  ScriptExecutionTests.c
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+#include "TestPlugin.h"
+
+#include "BackgroundReaper.h"
+#include "DurationHistory.h"
+#include "Launcher.h"
+#include "Manifest.h"
+#include "ScriptExecution.h"
+#include "WorkerPool.h"
+
+#include "Test.h"
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Helpers
+/////////////////////////////////////////////////////////////////////
+
+
+static PluginRecord gPlugin;
+static ManifestRecord gManifest;
+static InvocationRecord gInvocation;
+static char *gDir;
+
+/// Start a test with an empty script directory and the manifest text.
+static void SetUp(const char *manifest)
+{
+    gDir = CreateTrustedTestDirectory();
+    kLoginScriptDir = gDir;
+    ParseTestManifest(&gManifest, manifest, gPlugin.fLogClient);
+    SetWorkerPoolLimit(&gPlugin.fPool, gManifest.fMaxJobs);
+}
+
+/// Add a postmount-root script that runs body in the script directory.
+static void AddScript(const char *name, const char *body)
+{
+    char file[64];
+    
+    snprintf(file, sizeof(file), "postmount-root-%s", name);
+    free(WriteTestScript(gDir, file, body));
+}
+
+/// Find the scripts of the test, as the postmount-root mechanism does.
+static void Prepare(void)
+{
+    InitTestInvocation(&gInvocation, &gPlugin, &gManifest, kRunAsRoot);
+    if (! CreateScripts(&gInvocation)) {
+        fprintf(stderr, "CreateScripts failed\n");
+        exit(2);
+    }
+}
+
+/// Run the scripts found by Prepare().
+///
+/// @return The result, with the time it took in seconds.
+static AuthorizationResult Run(double *seconds)
+{
+    AuthorizationResult result;
+    double start;
+    
+    start = TestSeconds();
+    result = RunScripts(&gInvocation);
+    *seconds = TestSeconds() - start;
+    return result;
+}
+
+static void TearDown(void)
+{
+    FreeScripts(&gInvocation);
+    FreeTestInvocation(&gInvocation);
+    FreeManifest(&gManifest);
+    RemoveTestDirectory(gDir);
+}
+
+/// Return the script with the given name, without its prefix.
+static ScriptRecord *Script(const char *name)
+{
+    size_t i;
+    
+    for (i = 0; i < gInvocation.fScriptCount; i++) {
+        if (strcmp(gInvocation.fScripts[i].fName + strlen("postmount-root-"), name) == 0) {
+            return &gInvocation.fScripts[i];
+        }
+    }
+    fprintf(stderr, "No script %s\n", name);
+    exit(2);
+}
+
+/// Return true if the scripts have written exactly text to "log", once
+/// any scripts still running in the background have had up to seconds
+/// to write it.
+static bool LogBecomes(const char *text, double seconds)
+{
+    double until = TestSeconds() + seconds;
+    char *log;
+    bool same;
+    
+    for (;;) {
+        log = ReadTestFile(gDir, "log");
+        same = strcmp(log != NULL ? log : "", text) == 0;
+        if (same || TestSeconds() >= until) {
+            break;
+        }
+        free(log);
+        usleep(20 * 1000);
+    }
+    if (! same) {
+        fprintf(stderr, "log:\n%s", log != NULL ? log : "");
+    }
+    free(log);
+    return same;
+}
+
+static bool LogIs(const char *text)
+{
+    return LogBecomes(text, 0);
+}
+
+/// Return true once nothing is left in the process group pgid, giving
+/// init a moment to reap what was left behind.
+static bool GroupGone(pid_t pgid)
+{
+    double until = TestSeconds() + 2;
+    
+    while (killpg(pgid, 0) == 0) {
+        if (TestSeconds() >= until) {
+            return false;
+        }
+        usleep(20 * 1000);
+    }
+    return errno == ESRCH;
+}
+
+static bool OutputContains(const ScriptRecord *script, const char *text)
+{
+    return script->fOutput.fData != NULL && memmem(script->fOutput.fData, script->fOutput.fLength,
+                                                   text, strlen(text)) != NULL;
+}
+
+static bool KilledBy(const ScriptRecord *script, int sig)
+{
+    return WIFSIGNALED(script->fStatus.fStatus) && WTERMSIG(script->fStatus.fStatus) == sig;
+}
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Tests
+/////////////////////////////////////////////////////////////////////
+
+
+/// Scripts run one after another by default, their output is collected,
+/// and an exit status of 77 denies the login and stops the scripts after it.
+static void TestExitStatus(void)
+{
+    double seconds;
+    
+    SetUp("");
+    AddScript("10-first", "echo first >>log");
+    AddScript("20-deny", "echo denied; exit 77");
+    AddScript("30-later", "echo later >>log");
+    Prepare();
+    CHECK(Run(&seconds) == kAuthorizationResultDeny);
+    CHECK(Script("10-first")->fState == kScriptFinished);
+    CHECK(Script("10-first")->fResult == kAuthorizationResultAllow);
+    CHECK(Script("20-deny")->fResult == kAuthorizationResultDeny);
+    CHECK(OutputContains(Script("20-deny"), "denied"));
+    CHECK(Script("30-later")->fState == kScriptNotRun);
+    CHECK(LogIs("first\n"));
+    TearDown();
+}
+
+/// A script that runs past its timeout gets SIGTERM, and timeout_action
+/// decides the result.
+static void TestTimeout(void)
+{
+    double seconds;
+    
+    SetUp("timeout = 1\n"
+          "[postmount-root-20-deny]\n"
+          "timeout_action = deny\n");
+    AddScript("10-allow", "sleep 30");
+    AddScript("20-deny", "sleep 30");
+    Prepare();
+    CHECK(Run(&seconds) == kAuthorizationResultDeny);
+    CHECK(seconds >= 1.9 && seconds < 5);
+    CHECK(Script("10-allow")->fTimedOut);
+    CHECK(KilledBy(Script("10-allow"), SIGTERM));
+    CHECK(Script("10-allow")->fResult == kAuthorizationResultAllow);
+    CHECK(Script("20-deny")->fTimedOut);
+    CHECK(Script("20-deny")->fResult == kAuthorizationResultDeny);
+    TearDown();
+}
+
+/// A script that ignores SIGTERM gets SIGKILL 5 seconds later, and so
+/// does everything it started in its process group.
+static void TestTimeoutEscalation(void)
+{
+    ScriptRecord *script;
+    double seconds;
+    
+    SetUp("timeout = 1\n");
+    AddScript("10-stubborn", "trap '' TERM\n"
+                             "sleep 30 &\n"
+                             "sleep 30");
+    Prepare();
+    CHECK(Run(&seconds) == kAuthorizationResultAllow);
+    script = Script("10-stubborn");
+    CHECK(seconds >= 5.5 && seconds < 10);
+    CHECK(script->fTimedOut);
+    CHECK(KilledBy(script, SIGKILL));
+    CHECK(GroupGone(script->fPid));
+    TearDown();
+}
+
+/// Scripts in a group run at the same time, as far as jobs allows, and a
+/// script waits for the group it comes after.
+static void TestGroupsAndJobs(void)
+{
+    static const char *manifest =
+        "[postmount-root-10-a]\n"
+        "group = pair\n"
+        "[postmount-root-11-b]\n"
+        "group = pair\n"
+        "[postmount-root-20-c]\n"
+        "after = pair\n";
+    char text[256];
+    double seconds;
+    char *log;
+    
+    snprintf(text, sizeof(text), "jobs = 2\n%s", manifest);
+    SetUp(text);
+    AddScript("10-a", "sleep 1; echo a >>log");
+    AddScript("11-b", "sleep 1; echo b >>log");
+    AddScript("20-c", "echo c >>log");
+    Prepare();
+    CHECK(Run(&seconds) == kAuthorizationResultAllow);
+    CHECK(seconds >= 0.9 && seconds < 1.8);
+    log = ReadTestFile(gDir, "log");
+    CHECK(log != NULL && (strcmp(log, "a\nb\nc\n") == 0 || strcmp(log, "b\na\nc\n") == 0));
+    free(log);
+    TearDown();
+    
+    snprintf(text, sizeof(text), "jobs = 1\n%s", manifest);
+    SetUp(text);
+    AddScript("10-a", "sleep 1; echo a >>log");
+    AddScript("11-b", "sleep 1; echo b >>log");
+    AddScript("20-c", "echo c >>log");
+    Prepare();
+    CHECK(Run(&seconds) == kAuthorizationResultAllow);
+    CHECK(seconds >= 1.9);
+    TearDown();
+}
+
+/// A detached script doesn't hold up the login, and finishes in the
+/// background.
+static void TestDetach(void)
+{
+    double seconds;
+    
+    SetUp("[postmount-root-10-detached]\n"
+          "detach = yes\n");
+    AddScript("10-detached", "sleep 1; echo detached >>log");
+    AddScript("20-next", "echo next >>log");
+    Prepare();
+    CHECK(Run(&seconds) == kAuthorizationResultAllow);
+    CHECK(seconds < 0.9);
+    CHECK(Script("10-detached")->fState == kScriptDetached);
+    CHECK(LogIs("next\n"));
+    CHECK(LogBecomes("next\ndetached\n", 5));
+    TearDown();
+}
+
+/// A script that signals readiness is released to the background, and
+/// the scripts that wait for it start right away.
+static void TestNotifyReady(void)
+{
+    double seconds;
+    
+    SetUp("[postmount-root-10-ready]\n"
+          "notify_ready = yes\n");
+    AddScript("10-ready", "printf READY >&3; sleep 1; echo ready >>log");
+    AddScript("20-next", "echo next >>log");
+    Prepare();
+    CHECK(Run(&seconds) == kAuthorizationResultAllow);
+    CHECK(seconds < 0.9);
+    CHECK(Script("10-ready")->fState == kScriptReady);
+    CHECK(Script("20-next")->fState == kScriptFinished);
+    CHECK(LogBecomes("next\nready\n", 5));
+    TearDown();
+}
+
+/// A gate that denies the login kills the other gates, and none of the
+/// other scripts run.
+static void TestGateCancels(void)
+{
+    double seconds;
+    
+    SetUp("jobs = 4\n"
+          "[postmount-root-10-deny]\n"
+          "gate = yes\n"
+          "[postmount-root-20-slow]\n"
+          "gate = yes\n");
+    AddScript("05-normal", "echo normal >>log");
+    AddScript("10-deny", "sleep 0.2; exit 77");
+    AddScript("20-slow", "sleep 30");
+    Prepare();
+    CHECK(Run(&seconds) == kAuthorizationResultDeny);
+    CHECK(seconds < 3);
+    CHECK(Script("10-deny")->fResult == kAuthorizationResultDeny);
+    CHECK(Script("20-slow")->fCancelled);
+    CHECK(KilledBy(Script("20-slow"), SIGKILL));
+    CHECK(Script("05-normal")->fState == kScriptNotRun);
+    CHECK(LogIs(""));
+    TearDown();
+}
+
+/// Scripts whose run predicates don't match are skipped, and if_exists
+/// sees what earlier scripts did.
+static void TestRunPredicates(void)
+{
+    char manifest[512];
+    double seconds;
+    
+    snprintf(manifest, sizeof(manifest),
+             "[postmount-root-20-exists]\n"
+             "if_exists = ~/created\n"
+             "[postmount-root-30-missing]\n"
+             "if_missing = ~/created\n"
+             "[postmount-root-40-other-user]\n"
+             "if_uid = %u\n",
+             (unsigned)getuid() + 1);
+    SetUp(manifest);
+    AddScript("10-create", "touch created; echo create >>log");
+    AddScript("20-exists", "echo exists >>log");
+    AddScript("30-missing", "echo missing >>log");
+    AddScript("40-other-user", "echo other >>log");
+    Prepare();
+    gInvocation.fHome = gDir;
+    CHECK(Run(&seconds) == kAuthorizationResultAllow);
+    CHECK(! Script("20-exists")->fSkipped);
+    CHECK(Script("30-missing")->fSkipped);
+    CHECK(Script("40-other-user")->fSkipped);
+    CHECK(LogIs("create\nexists\n"));
+    TearDown();
+}
+
+/// Under pressure, optional scripts are skipped or deferred to the
+/// background.
+static void TestShedding(void)
+{
+    double seconds;
+    
+    SetUp("[postmount-root-10-skip]\n"
+          "optional = skip\n"
+          "[postmount-root-20-defer]\n"
+          "optional = defer\n");
+    AddScript("10-skip", "echo skip >>log");
+    AddScript("20-defer", "sleep 1; echo defer >>log");
+    Prepare();
+    gInvocation.fUnderPressure = true;
+    CHECK(Run(&seconds) == kAuthorizationResultAllow);
+    CHECK(seconds < 0.9);
+    CHECK(Script("10-skip")->fSkipped);
+    CHECK(Script("20-defer")->fState == kScriptDetached);
+    CHECK(LogBecomes("defer\n", 5));
+    TearDown();
+    
+    // Without pressure they run like any other script.
+    SetUp("[postmount-root-10-skip]\n"
+          "optional = skip\n");
+    AddScript("10-skip", "echo skip >>log");
+    Prepare();
+    CHECK(Run(&seconds) == kAuthorizationResultAllow);
+    CHECK(! Script("10-skip")->fSkipped);
+    CHECK(LogIs("skip\n"));
+    TearDown();
+}
+
+/// A login that can't get a worker because other logins hold them all
+/// gives up when its budget runs out, instead of waiting for good.
+static void TestBudgetWhilePoolFull(void)
+{
+    double seconds;
+    
+    SetUp("jobs = 1\n");
+    AddScript("10-script", "echo script >>log");
+    Prepare();
+    CHECK(AcquireWorker(&gPlugin.fPool, false, NULL));
+    gettimeofday(&gInvocation.fDeadline, NULL);
+    gInvocation.fDeadline.tv_sec += 1;
+    CHECK(Run(&seconds) == kAuthorizationResultAllow);
+    CHECK(seconds >= 0.9 && seconds < 3);
+    CHECK(Script("10-script")->fState == kScriptOverBudget);
+    CHECK(LogIs(""));
+    ReleaseWorker(&gPlugin.fPool);
+    TearDown();
+}
+
+/// A script whose process group grows past memory_limit is killed while
+/// it runs. On Linux the resident size stands in for the footprint, and
+/// a shell running sleep takes more than a megabyte.
+static void TestMemoryLimit(void)
+{
+    double seconds;
+    
+    SetUp("[postmount-root-10-big]\n"
+          "memory_limit = 1\n"
+          "[postmount-root-20-small]\n"
+          "memory_limit = 256\n");
+    AddScript("10-big", "sleep 10");
+    AddScript("20-small", "sleep 1");
+    Prepare();
+    CHECK(Run(&seconds) == kAuthorizationResultAllow);
+    CHECK(seconds < 4);
+    CHECK(Script("10-big")->fOverMemory);
+    CHECK(KilledBy(Script("10-big"), SIGKILL));
+    CHECK(! Script("20-small")->fOverMemory);
+    CHECK(WIFEXITED(Script("20-small")->fStatus.fStatus));
+    TearDown();
+}
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Main
+/////////////////////////////////////////////////////////////////////
+
+
+int main(void)
+{
+    char *stateDir;
+    char *historyPath;
+    
+    // Scripts are only trusted in a directory owned by root.
+    if (geteuid() != 0) {
+        fprintf(stderr, "skip ScriptExecutionTests, not running as root\n");
+        return 0;
+    }
+    alarm(60);
+    
+    stateDir = CreateTestDirectory();
+    if (asprintf(&historyPath, "%s/durations", stateDir) == -1) {
+        return 2;
+    }
+    kDurationHistoryPath = historyPath;
+    InitTestPlugin(&gPlugin);
+    if (! StartLauncher(&gPlugin)) {
+        fprintf(stderr, "Launcher not started, its scripts will be forked\n");
+    }
+    
+    RUN_TEST(TestExitStatus);
+    RUN_TEST(TestTimeout);
+    RUN_TEST(TestTimeoutEscalation);
+    RUN_TEST(TestGroupsAndJobs);
+    RUN_TEST(TestDetach);
+    RUN_TEST(TestNotifyReady);
+    RUN_TEST(TestGateCancels);
+    RUN_TEST(TestRunPredicates);
+    RUN_TEST(TestShedding);
+    RUN_TEST(TestBudgetWhilePoolFull);
+    RUN_TEST(TestMemoryLimit);
+    
+    StopBackgroundReaper(&gPlugin);
+    StopLauncher(&gPlugin);
+    RemoveTestDirectory(stateDir);
+    free(historyPath);
+    return TestResult();
+}
@@ -0,0 +1,343 @@
+//
+//  ScriptGraphTests.c
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+#include <math.h>
+
+#include "TestPlugin.h"
+
+#include "DurationHistory.h"
+#include "Manifest.h"
+#include "ScriptGraph.h"
+#include "WorkerPool.h"
+
+#include "Test.h"
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Helpers
+/////////////////////////////////////////////////////////////////////
+
+
+static PluginRecord gPlugin;
+
+/// A phase of scripts with the settings of a manifest, ready to be
+/// scheduled.
+typedef struct {
+    ManifestRecord fManifest;
+    InvocationRecord fInvocation;
+    ScriptRecord fScripts[8];
+} TestPhase;
+
+/// Fill in phase with the scripts in names, which is NULL terminated,
+/// with the settings of manifest, and build their dependency graph.
+static void InitTestPhase(TestPhase *phase, const char *manifest, const char *names[])
+{
+    FILE *file;
+    char *path;
+    size_t i;
+    
+    InitManifest(&phase->fManifest);
+    if ((file = fmemopen((void *)manifest, strlen(manifest), "r")) == NULL) {
+        perror("fmemopen");
+        exit(2);
+    }
+    ReadManifest(&phase->fManifest, file, "manifest", gPlugin.fLogClient);
+    fclose(file);
+    
+    InitTestInvocation(&phase->fInvocation, &gPlugin, &phase->fManifest, kRunAsRoot);
+    for (i = 0; names[i] != NULL; i++) {
+        if (asprintf(&path, "/scripts/%s", names[i]) == -1) {
+            exit(2);
+        }
+        InitTestScript(&phase->fScripts[i], path, LookupScriptSettings(&phase->fManifest, names[i]));
+    }
+    phase->fInvocation.fScripts = phase->fScripts;
+    phase->fInvocation.fScriptCount = i;
+    CHECK(BuildScriptGraph(&phase->fInvocation));
+}
+
+static void FreeTestPhase(TestPhase *phase)
+{
+    size_t i;
+    
+    for (i = 0; i < phase->fInvocation.fScriptCount; i++) {
+        free(phase->fScripts[i].fPath);
+        free(phase->fScripts[i].fDeps);
+    }
+    free(phase->fInvocation.fOrder);
+    FreeTestInvocation(&phase->fInvocation);
+    FreeManifest(&phase->fManifest);
+}
+
+/// Set the average duration of the script name in the history.
+static void SetDuration(const char *name, double seconds)
+{
+    DurationHistory *history = &gPlugin.fHistory;
+    ScriptDuration *entry;
+    
+    if (history->fCount == history->fCapacity) {
+        history->fCapacity = history->fCapacity ? history->fCapacity * 2 : 16;
+        if ((history->fEntries = realloc(history->fEntries, history->fCapacity * sizeof(*entry))) == NULL) {
+            exit(2);
+        }
+    }
+    entry = &history->fEntries[history->fCount++];
+    if (asprintf(&entry->fPath, "/scripts/%s", name) == -1) {
+        exit(2);
+    }
+    entry->fSeconds = seconds;
+}
+
+/// Return true if script index of phase waits for exactly the scripts in
+/// deps, which is terminated by -1.
+static bool DependsOn(const TestPhase *phase, size_t index, const int deps[])
+{
+    const ScriptRecord *script = &phase->fScripts[index];
+    size_t count;
+    size_t i;
+    size_t j;
+    bool found;
+    
+    for (count = 0; deps[count] != -1; count++) {
+        found = false;
+        for (j = 0; j < script->fDepCount; j++) {
+            found = found || script->fDeps[j] == (size_t)deps[count];
+        }
+        if (! found) {
+            return false;
+        }
+    }
+    for (i = 0; i < script->fDepCount; i++) {
+        for (j = i + 1; j < script->fDepCount; j++) {
+            if (script->fDeps[i] == script->fDeps[j]) {
+                return false;
+            }
+        }
+    }
+    return script->fDepCount == count;
+}
+
+/// Return true if the scripts of phase start in the order given by the
+/// indexes in order.
+static bool OrderIs(const TestPhase *phase, const size_t order[])
+{
+    size_t i;
+    
+    for (i = 0; i < phase->fInvocation.fScriptCount; i++) {
+        if (phase->fInvocation.fOrder == NULL || phase->fInvocation.fOrder[i] != order[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool Near(double value, double expected)
+{
+    return fabs(value - expected) < 1e-9;
+}
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Tests
+/////////////////////////////////////////////////////////////////////
+
+
+/// Scripts wait for the stage before them, where a group is one stage,
+/// unless "after" names what they wait for. Everything waits for the
+/// gates, which wait for nothing.
+static void TestDependencies(void)
+{
+    static const char *names[] = { "00-gate", "10-a", "20-b", "30-c", "40-d", "50-e", "60-f", NULL };
+    TestPhase phase;
+    
+    InitTestPhase(&phase,
+                  "[00-gate]\ngate = yes\n"
+                  "[20-b]\ngroup = mounts\n"
+                  "[30-c]\ngroup = mounts\n"
+                  "[50-e]\nafter = 10-a\n"
+                  "[60-f]\nafter =\n",
+                  names);
+    CHECK(DependsOn(&phase, 0, (int[]){ -1 }));
+    CHECK(DependsOn(&phase, 1, (int[]){ 0, -1 }));
+    CHECK(DependsOn(&phase, 2, (int[]){ 0, 1, -1 }));
+    CHECK(DependsOn(&phase, 3, (int[]){ 0, 1, -1 }));
+    CHECK(DependsOn(&phase, 4, (int[]){ 0, 2, 3, -1 }));
+    CHECK(DependsOn(&phase, 5, (int[]){ 0, 1, -1 }));
+    CHECK(DependsOn(&phase, 6, (int[]){ 0, -1 }));
+    FreeTestPhase(&phase);
+    
+    // A group can be waited for by name, and unknown names are ignored.
+    InitTestPhase(&phase,
+                  "[20-b]\ngroup = mounts\n"
+                  "[30-c]\ngroup = mounts\n"
+                  "[40-d]\nafter = mounts, 00-gate, nonexistent\n"
+                  "[50-e]\nafter = 40-d 60-f\n"
+                  "[60-f]\nafter =\n",
+                  names);
+    CHECK(DependsOn(&phase, 4, (int[]){ 0, 2, 3, -1 }));
+    CHECK(DependsOn(&phase, 5, (int[]){ 4, 6, -1 }));
+    FreeTestPhase(&phase);
+}
+
+/// Scripts whose dependencies form a cycle run one after another, in file
+/// order.
+static void TestCycle(void)
+{
+    static const char *names[] = { "10-a", "20-b", "30-c", NULL };
+    TestPhase phase;
+    
+    InitTestPhase(&phase, "[10-a]\nafter = 30-c\n[30-c]\nafter = 10-a\n", names);
+    CHECK(DependsOn(&phase, 0, (int[]){ -1 }));
+    CHECK(DependsOn(&phase, 1, (int[]){ 0, -1 }));
+    CHECK(DependsOn(&phase, 2, (int[]){ 1, -1 }));
+    FreeTestPhase(&phase);
+}
+
+/// Ready scripts start when everything they wait for has finished, been
+/// detached or signalled readiness.
+static void TestReady(void)
+{
+    static const char *names[] = { "10-a", "20-b", NULL };
+    TestPhase phase;
+    
+    InitTestPhase(&phase, "", names);
+    CHECK(ScriptReady(&phase.fInvocation, &phase.fScripts[0]));
+    CHECK(! ScriptReady(&phase.fInvocation, &phase.fScripts[1]));
+    phase.fScripts[0].fState = kScriptRunning;
+    CHECK(! ScriptReady(&phase.fInvocation, &phase.fScripts[1]));
+    phase.fScripts[0].fState = kScriptNotRun;
+    CHECK(! ScriptReady(&phase.fInvocation, &phase.fScripts[1]));
+    phase.fScripts[0].fState = kScriptFinished;
+    CHECK(ScriptReady(&phase.fInvocation, &phase.fScripts[1]));
+    phase.fScripts[0].fState = kScriptDetached;
+    CHECK(ScriptReady(&phase.fInvocation, &phase.fScripts[1]));
+    phase.fScripts[0].fState = kScriptReady;
+    CHECK(ScriptReady(&phase.fInvocation, &phase.fScripts[1]));
+    phase.fScripts[0].fState = kScriptSpooled;
+    CHECK(ScriptReady(&phase.fInvocation, &phase.fScripts[1]));
+    FreeTestPhase(&phase);
+}
+
+/// Without dependencies the longest script starts first, which shortens
+/// the phase when there are fewer workers than scripts.
+static void TestLongestFirst(void)
+{
+    static const char *names[] = { "10-a", "20-b", "30-c", "40-d", NULL };
+    static const size_t fileOrder[] = { 0, 1, 2, 3 };
+    static const size_t longestFirst[] = { 3, 0, 1, 2 };
+    TestPhase phase;
+    size_t order[4];
+    
+    SetDuration("10-a", 0.1);
+    SetDuration("20-b", 0.1);
+    SetDuration("30-c", 0.1);
+    SetDuration("40-d", 0.8);
+    InitTestPhase(&phase,
+                  "[10-a]\ngroup = all\n[20-b]\ngroup = all\n"
+                  "[30-c]\ngroup = all\n[40-d]\ngroup = all\n",
+                  names);
+    
+    // What RunScripts() does without a schedule.
+    memcpy(order, fileOrder, sizeof(order));
+    phase.fInvocation.fOrder = order;
+    LookUpDurations(&phase.fInvocation);
+    CHECK(Near(PredictMakespan(&phase.fInvocation, 2), 0.9));
+    CHECK(Near(PredictMakespan(&phase.fInvocation, 4), 0.8));
+    CHECK(Near(PredictMakespan(&phase.fInvocation, 1), 1.1));
+    
+    phase.fInvocation.fOrder = NULL;
+    ScheduleScripts(&phase.fInvocation);
+    CHECK(OrderIs(&phase, longestFirst));
+    CHECK(Near(PredictMakespan(&phase.fInvocation, 2), 0.8));
+    CHECK(Near(PredictMakespan(&phase.fInvocation, 1), 1.1));
+    FreeTestPhase(&phase);
+}
+
+/// With dependencies, scripts are ranked by the longest chain they start,
+/// so a short script that a long one waits for goes first.
+static void TestCriticalPath(void)
+{
+    static const char *names[] = { "10-x", "20-y", "30-z", "40-w", NULL };
+    static const size_t byRank[] = { 0, 1, 2, 3 };
+    TestPhase phase;
+    
+    SetDuration("10-x", 1);
+    SetDuration("20-y", 3);
+    SetDuration("30-z", 2);
+    SetDuration("40-w", 0.5);
+    InitTestPhase(&phase,
+                  "[10-x]\nafter =\n"
+                  "[20-y]\nafter = 10-x\n"
+                  "[30-z]\nafter =\n"
+                  "[40-w]\nafter =\n",
+                  names);
+    ScheduleScripts(&phase.fInvocation);
+    CHECK(Near(phase.fScripts[0].fRank, 4));
+    CHECK(Near(phase.fScripts[1].fRank, 3));
+    CHECK(Near(phase.fScripts[2].fRank, 2));
+    CHECK(Near(phase.fScripts[3].fRank, 0.5));
+    CHECK(OrderIs(&phase, byRank));
+    
+    // x and z start together, y starts when x is done, and w when z is.
+    CHECK(Near(PredictMakespan(&phase.fInvocation, 2), 4));
+    CHECK(Near(PredictMakespan(&phase.fInvocation, 1), 6.5));
+    FreeTestPhase(&phase);
+}
+
+/// Scripts without a history are expected to take a second, and scripts
+/// that don't hold up the login are expected to take no time.
+static void TestUnknownDurations(void)
+{
+    static const char *names[] = { "10-new", "20-detached", "30-untrusted", "40-known", NULL };
+    TestPhase phase;
+    
+    SetDuration("20-detached", 5);
+    SetDuration("30-untrusted", 5);
+    SetDuration("40-known", 0.25);
+    InitTestPhase(&phase,
+                  "[10-new]\ngroup = all\n[20-detached]\ngroup = all\ndetach = yes\n"
+                  "[30-untrusted]\ngroup = all\n[40-known]\ngroup = all\n",
+                  names);
+    phase.fScripts[2].fTrusted = false;
+    ScheduleScripts(&phase.fInvocation);
+    CHECK(Near(phase.fScripts[0].fExpected, 1));
+    CHECK(Near(phase.fScripts[1].fExpected, 0));
+    CHECK(Near(phase.fScripts[2].fExpected, 0));
+    CHECK(Near(phase.fScripts[3].fExpected, 0.25));
+    CHECK(OrderIs(&phase, (size_t[]){ 0, 3, 1, 2 }));
+    
+    // Untrusted scripts aren't run, so they don't take a worker.
+    CHECK(Near(PredictMakespan(&phase.fInvocation, 1), 1.25));
+    FreeTestPhase(&phase);
+}
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Main
+/////////////////////////////////////////////////////////////////////
+
+
+int main(void)
+{
+    InitTestPlugin(&gPlugin);
+    SetWorkerPoolLimit(&gPlugin.fPool, 2);
+    
+    // The history is made up by the tests instead of being read from the
+    // file.
+    gPlugin.fHistory.fLoaded = true;
+    
+    RUN_TEST(TestDependencies);
+    RUN_TEST(TestCycle);
+    RUN_TEST(TestReady);
+    RUN_TEST(TestLongestFirst);
+    RUN_TEST(TestCriticalPath);
+    RUN_TEST(TestUnknownDurations);
+    return TestResult();
+}
@@ -0,0 +1,446 @@
+//
+//  SessionSpoolTests.c
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+#include "TestPlugin.h"
+
+#include "Manifest.h"
+#include "ScriptExecution.h"
+#include "SessionSpool.h"
+
+#include "Test.h"
+
+// Tests the spooling of in_session scripts, and the session agent in
+// Installer Resources running what was spooled. The agent is copied with
+// its script and spool directories pointing at the test's.
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Helpers
+/////////////////////////////////////////////////////////////////////
+
+
+static const char *kAgentSource = "../Installer Resources/Scripts/loginscriptagent";
+
+static PluginRecord gPlugin;
+static ManifestRecord gManifest;
+static InvocationRecord gInvocation;
+static char *gDir;
+static char gSpoolDir[MAXPATHLEN];
+static char gAgentPath[MAXPATHLEN];
+
+/// Start a test with an empty script directory and the manifest text.
+static void SetUp(const char *manifest)
+{
+    gDir = CreateTrustedTestDirectory();
+    kLoginScriptDir = gDir;
+    snprintf(gSpoolDir, sizeof(gSpoolDir), "%s/spool", gDir);
+    kSessionSpoolDir = gSpoolDir;
+    ParseTestManifest(&gManifest, manifest, gPlugin.fLogClient);
+}
+
+/// Add a postmount-user script that runs body in the script directory.
+static void AddScript(const char *name, const char *body)
+{
+    char file[64];
+    
+    snprintf(file, sizeof(file), "postmount-user-%s", name);
+    free(WriteTestScript(gDir, file, body));
+}
+
+/// Find the scripts of the test and spool those that run in the session,
+/// as the postmount-user mechanism does.
+///
+/// @return The number of scripts spooled.
+static size_t Spool(void)
+{
+    InitTestInvocation(&gInvocation, &gPlugin, &gManifest, kRunAsUser);
+    if (! CreateScripts(&gInvocation)) {
+        fprintf(stderr, "CreateScripts failed\n");
+        exit(2);
+    }
+    return SpoolSessionScripts(&gInvocation);
+}
+
+static void TearDown(void)
+{
+    FreeScripts(&gInvocation);
+    FreeTestInvocation(&gInvocation);
+    FreeManifest(&gManifest);
+    RemoveTestDirectory(gDir);
+}
+
+/// Return the state of the script with the given name, without its prefix.
+static scriptState StateOf(const char *name)
+{
+    size_t i;
+    
+    for (i = 0; i < gInvocation.fScriptCount; i++) {
+        if (strcmp(gInvocation.fScripts[i].fName + strlen("postmount-user-"), name) == 0) {
+            return gInvocation.fScripts[i].fState;
+        }
+    }
+    fprintf(stderr, "No script %s\n", name);
+    exit(2);
+}
+
+/// Return the spool of the user running the tests, to be released with
+/// free(), or NULL if there is none.
+static char *ReadSpool(void)
+{
+    char name[16];
+    
+    snprintf(name, sizeof(name), "%u", (unsigned)getuid());
+    return ReadTestFile(gSpoolDir, name);
+}
+
+/// Return true if the spool holds the scripts in entries, a line with a
+/// timeout, a tab and a name without its prefix for each, in that order.
+static bool SpoolIs(const char *entries)
+{
+    char expected[4096];
+    const char *name;
+    size_t length;
+    char *spool;
+    bool same;
+    
+    length = snprintf(expected, sizeof(expected), "LoginScriptPlugin 1\n%u\t%u\t%s\n",
+                      (unsigned)getuid(), (unsigned)getgid(), gInvocation.fHome);
+    while (*entries != '\0' && length < sizeof(expected)) {
+        name = strchr(entries, '\t') + 1;
+        length += snprintf(expected + length, sizeof(expected) - length, "%.*s%s/postmount-user-%.*s\n",
+                           (int)(name - entries), entries, gDir, (int)strcspn(name, "\n"), name);
+        entries = name + strcspn(name, "\n") + 1;
+    }
+    spool = ReadSpool();
+    same = spool != NULL && strcmp(spool, expected) == 0;
+    if (! same) {
+        fprintf(stderr, "spool:\n%s", spool != NULL ? spool : "(none)\n");
+    }
+    free(spool);
+    return same;
+}
+
+/// Copy the session agent to dir, with the script and spool directories
+/// of the test.
+static void InstallAgent(const char *dir)
+{
+    char line[1024];
+    FILE *source;
+    FILE *agent;
+    
+    snprintf(gAgentPath, sizeof(gAgentPath), "%s/loginscriptagent", dir);
+    if ((source = fopen(kAgentSource, "r")) == NULL || (agent = fopen(gAgentPath, "w")) == NULL) {
+        perror("loginscriptagent");
+        exit(2);
+    }
+    while (fgets(line, sizeof(line), source) != NULL) {
+        if (strncmp(line, "declare -r SCRIPT_DIR=", 22) == 0) {
+            fprintf(agent, "SCRIPT_DIR=\"$1\"\n");
+        } else if (strncmp(line, "declare -r SPOOL_DIR=", 21) == 0) {
+            fprintf(agent, "SPOOL_DIR=\"$1/spool\"\n");
+        } else {
+            fputs(line, agent);
+        }
+    }
+    fclose(source);
+    fclose(agent);
+    chmod(gAgentPath, 0755);
+    kSessionAgentPath = gAgentPath;
+}
+
+/// Run the session agent as launchd would, on the test's directories,
+/// with its output going nowhere.
+///
+/// @return Its exit status.
+static int RunAgent(void)
+{
+    int status;
+    int fd;
+    pid_t pid;
+    
+    if ((pid = fork()) == -1) {
+        perror("fork");
+        exit(2);
+    }
+    if (pid == 0) {
+        if ((fd = open("/dev/null", O_RDWR)) != -1) {
+            dup2(fd, STDIN_FILENO);
+            dup2(fd, STDOUT_FILENO);
+            dup2(fd, STDERR_FILENO);
+        }
+        execl("/bin/bash", "bash", gAgentPath, gDir, (char *)NULL);
+        _exit(127);
+    }
+    if (waitpid(pid, &status, 0) != pid || ! WIFEXITED(status)) {
+        return -1;
+    }
+    return WEXITSTATUS(status);
+}
+
+/// Return true if the scripts have written exactly text to "log", once
+/// any scripts still running in the background have had up to seconds
+/// to write it.
+static bool LogBecomes(const char *text, double seconds)
+{
+    double until = TestSeconds() + seconds;
+    char *log;
+    bool same;
+    
+    for (;;) {
+        log = ReadTestFile(gDir, "log");
+        same = strcmp(log != NULL ? log : "", text) == 0;
+        if (same || TestSeconds() >= until) {
+            break;
+        }
+        free(log);
+        usleep(20 * 1000);
+    }
+    if (! same) {
+        fprintf(stderr, "log:\n%s", log != NULL ? log : "");
+    }
+    free(log);
+    return same;
+}
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Spooling
+/////////////////////////////////////////////////////////////////////
+
+
+/// in_session scripts are spooled, each after the scripts it waits for,
+/// and the others are left for the login.
+static void TestSpoolOrder(void)
+{
+    SetUp("in_session = yes\n"
+          "[postmount-user-10-late]\n"
+          "after = postmount-user-30-early\n"
+          "timeout = 7\n"
+          "[postmount-user-20-login]\n"
+          "in_session = no\n"
+          "after =\n"
+          "[postmount-user-30-early]\n"
+          "after =\n");
+    AddScript("10-late", "");
+    AddScript("20-login", "");
+    AddScript("30-early", "");
+    CHECK(Spool() == 2);
+    CHECK(StateOf("10-late") == kScriptSpooled);
+    CHECK(StateOf("20-login") == kScriptPending);
+    CHECK(StateOf("30-early") == kScriptSpooled);
+    CHECK(SpoolIs("0\t30-early\n7\t10-late\n"));
+    TearDown();
+}
+
+/// A script that a script run during login waits for, directly or through
+/// other scripts, is run during login too.
+static void TestDependedOnStays(void)
+{
+    SetUp("[postmount-user-10-first]\n"
+          "in_session = yes\n"
+          "[postmount-user-20-second]\n"
+          "in_session = yes\n"
+          "[postmount-user-40-alone]\n"
+          "in_session = yes\n"
+          "after =\n");
+    AddScript("10-first", "");
+    AddScript("20-second", "");
+    AddScript("30-login", "");
+    AddScript("40-alone", "");
+    CHECK(Spool() == 1);
+    CHECK(StateOf("10-first") == kScriptPending);
+    CHECK(StateOf("20-second") == kScriptPending);
+    CHECK(StateOf("30-login") == kScriptPending);
+    CHECK(StateOf("40-alone") == kScriptSpooled);
+    CHECK(SpoolIs("0\t40-alone\n"));
+    TearDown();
+}
+
+/// Scripts whose run predicates don't match aren't spooled, and are left
+/// for the login, which skips them.
+static void TestPredicatesChecked(void)
+{
+    char manifest[256];
+    
+    snprintf(manifest, sizeof(manifest),
+             "in_session = yes\n"
+             "[postmount-user-20-other-user]\n"
+             "after =\n"
+             "if_uid = %u\n",
+             (unsigned)getuid() + 1);
+    SetUp(manifest);
+    AddScript("10-mine", "");
+    AddScript("20-other-user", "");
+    CHECK(Spool() == 1);
+    CHECK(StateOf("20-other-user") == kScriptPending);
+    CHECK(SpoolIs("0\t10-mine\n"));
+    TearDown();
+}
+
+/// Without the session agent, nothing is spooled and the scripts run
+/// during login as before.
+static void TestAgentMissing(void)
+{
+    const char *agentPath = kSessionAgentPath;
+    
+    SetUp("in_session = yes\n");
+    AddScript("10-session", "");
+    kSessionAgentPath = "/nonexistent/loginscriptagent";
+    CHECK(Spool() == 0);
+    CHECK(StateOf("10-session") == kScriptPending);
+    CHECK(ReadSpool() == NULL);
+    kSessionAgentPath = agentPath;
+    TearDown();
+}
+
+/// A spool of an earlier login is replaced.
+static void TestSpoolReplaced(void)
+{
+    SetUp("in_session = yes\n");
+    AddScript("10-session", "");
+    CHECK(Spool() == 1);
+    FreeScripts(&gInvocation);
+    FreeTestInvocation(&gInvocation);
+    AddScript("20-session", "");
+    CHECK(Spool() == 2);
+    CHECK(SpoolIs("0\t10-session\n0\t20-session\n"));
+    TearDown();
+}
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Session Agent
+/////////////////////////////////////////////////////////////////////
+
+
+/// The agent runs the spooled scripts in order, with the arguments they
+/// would have had during login, and empties the spool first.
+static void TestAgentRuns(void)
+{
+    char expected[256];
+    char *spool;
+    
+    SetUp("in_session = yes\n"
+          "[postmount-user-10-late]\n"
+          "after = postmount-user-20-early\n"
+          "[postmount-user-20-early]\n"
+          "after =\n");
+    AddScript("10-late", "echo late \"$1\" \"$3\" >>log");
+    AddScript("20-early", "echo early >>log");
+    CHECK(Spool() == 2);
+    CHECK(RunAgent() == 0);
+    snprintf(expected, sizeof(expected), "early\nlate %u %s\n", (unsigned)getuid(), gInvocation.fHome);
+    CHECK(LogBecomes(expected, 0));
+    spool = ReadSpool();
+    CHECK(spool != NULL && spool[0] == '\0');
+    free(spool);
+    
+    // Started again, it has nothing to do.
+    CHECK(RunAgent() == 0);
+    CHECK(LogBecomes(expected, 0));
+    TearDown();
+}
+
+/// A script that runs past its timeout in the session is stopped along
+/// with its process group, and the agent goes on with the next one.
+static void TestAgentTimeout(void)
+{
+    double start;
+    
+    SetUp("in_session = yes\n"
+          "[postmount-user-10-slow]\n"
+          "timeout = 1\n");
+    AddScript("10-slow", "(sleep 2; echo left >>log) &\n"
+                         "sleep 30");
+    AddScript("20-next", "echo next >>log");
+    CHECK(Spool() == 2);
+    start = TestSeconds();
+    CHECK(RunAgent() == 0);
+    CHECK(TestSeconds() - start < 4);
+    CHECK(LogBecomes("next\n", 0));
+    usleep(2500 * 1000);
+    CHECK(LogBecomes("next\n", 0));
+    TearDown();
+}
+
+/// The agent only runs scripts the plugin would trust, and only from a
+/// spool for the user it runs as.
+static void TestAgentChecksScripts(void)
+{
+    char spool[2048];
+    char *path;
+    char name[16];
+    
+    SetUp("");
+    AddScript("10-good", "echo good >>log");
+    chmod(path = WriteTestScript(gDir, "postmount-user-20-writable", "echo writable >>log"), 0757);
+    free(path);
+    AddScript("30-bad-timeout", "echo bad-timeout >>log");
+    free(WriteTestScript(gDir, "premount-user-40-other", "echo other >>log"));
+    mkdir(gSpoolDir, 0755);
+    snprintf(name, sizeof(name), "%u", (unsigned)getuid());
+    snprintf(spool, sizeof(spool),
+             "LoginScriptPlugin 1\n%u\t%u\t/tmp\n"
+             "0\t%s/postmount-user-20-writable\n"
+             "x\t%s/postmount-user-30-bad-timeout\n"
+             "0\t%s/premount-user-40-other\n"
+             "0\t%s/postmount-user-10-good\n",
+             (unsigned)getuid(), (unsigned)getgid(), gDir, gDir, gDir, gDir);
+    free(WriteTestFile(gSpoolDir, name, spool, 0600));
+    CHECK(RunAgent() == 0);
+    CHECK(LogBecomes("good\n", 0));
+    
+    // A spool for another user is ignored.
+    snprintf(spool, sizeof(spool),
+             "LoginScriptPlugin 1\n%u\t%u\t/tmp\n"
+             "0\t%s/postmount-user-10-good\n",
+             (unsigned)getuid() + 1, (unsigned)getgid(), gDir);
+    free(WriteTestFile(gSpoolDir, name, spool, 0600));
+    CHECK(RunAgent() == EX_DATAERR);
+    CHECK(LogBecomes("good\n", 0));
+    FreeManifest(&gManifest);
+    RemoveTestDirectory(gDir);
+}
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Main
+/////////////////////////////////////////////////////////////////////
+
+
+int main(void)
+{
+    char *agentDir;
+    
+    // Scripts are only trusted in a directory owned by root, and the spool
+    // directory has to be owned by root to be used.
+    if (geteuid() != 0) {
+        fprintf(stderr, "skip SessionSpoolTests, not running as root\n");
+        return 0;
+    }
+    alarm(60);
+    
+    agentDir = CreateTestDirectory();
+    InstallAgent(agentDir);
+    InitTestPlugin(&gPlugin);
+    
+    RUN_TEST(TestSpoolOrder);
+    RUN_TEST(TestDependedOnStays);
+    RUN_TEST(TestPredicatesChecked);
+    RUN_TEST(TestAgentMissing);
+    RUN_TEST(TestSpoolReplaced);
+    RUN_TEST(TestAgentRuns);
+    RUN_TEST(TestAgentTimeout);
+    RUN_TEST(TestAgentChecksScripts);
+    
+    RemoveTestDirectory(agentDir);
+    return TestResult();
+}
@@ -0,0 +1,164 @@
+//
+//  ShellServerBenchmark.c
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+#include "TestPlugin.h"
+
+#include "Launcher.h"
+#include "ShellServer.h"
+
+// Times running small scripts with the shell server against starting each
+// with one of the spawn backends, one script at a time so that only the
+// cost of starting a script is measured. The shell server's time includes
+// starting and stopping it, once for all the scripts, as it is once per
+// mechanism invocation.
+//
+// Usage: ShellServerBenchmark [scripts]
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Runners
+/////////////////////////////////////////////////////////////////////
+
+
+static PluginRecord gPlugin;
+static ManifestRecord gManifest;
+static ScriptSettings gSettings;
+static int gNullFd;
+
+/// Run the script at path count times with backend.
+///
+/// @return The milliseconds per script, or -1 if a script failed.
+static double RunSpawned(const SpawnBackend *backend, char *path, int count)
+{
+    InvocationRecord invocation;
+    SpawnStatus status;
+    double start, elapsed;
+    pid_t pid;
+    int i;
+    
+    InitTestInvocation(&invocation, &gPlugin, &gManifest, kRunAsUser);
+    start = TestSeconds();
+    for (i = 0; i < count; i++) {
+        if ((pid = SpawnTestScript(&invocation, backend, path, gNullFd)) == -1
+            || backend->fWait(&gPlugin, pid, &status) != 0 || status.fStatus != 0) {
+            FreeTestInvocation(&invocation);
+            return -1;
+        }
+    }
+    elapsed = TestSeconds() - start;
+    FreeTestInvocation(&invocation);
+    return elapsed * 1e3 / count;
+}
+
+/// Run the script at path count times with the shell server.
+///
+/// @return The milliseconds per script, or -1 if a script failed.
+static double RunBatched(char *path, int count)
+{
+    InvocationRecord invocation;
+    ScriptRecord script;
+    SpawnStatus status;
+    double start, elapsed;
+    pid_t pid;
+    int i;
+    
+    InitTestInvocation(&invocation, &gPlugin, &gManifest, kRunAsUser);
+    InitTestScript(&script, path, &gSettings);
+    if (! ScriptCanBatch(&invocation, &script)) {
+        FreeTestInvocation(&invocation);
+        return -1;
+    }
+    start = TestSeconds();
+    if (! StartShellServer(&invocation)) {
+        FreeTestInvocation(&invocation);
+        return -1;
+    }
+    for (i = 0; i < count; i++) {
+        if ((pid = ShellServerSpawn(&invocation, &script, gNullFd)) == -1
+            || ShellServerWait(&invocation, pid, &status) != 0 || status.fStatus != 0) {
+            break;
+        }
+    }
+    StopShellServer(&invocation);
+    elapsed = TestSeconds() - start;
+    FreeTestInvocation(&invocation);
+    return i == count ? elapsed * 1e3 / count : -1;
+}
+
+/// Print milliseconds as a cell of the results table.
+static void PrintResult(double milliseconds)
+{
+    if (milliseconds < 0) {
+        printf(" %12s", "failed");
+    } else {
+        printf(" %12.3f", milliseconds);
+    }
+}
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Main
+/////////////////////////////////////////////////////////////////////
+
+
+int main(int argc, char *argv[])
+{
+    static const char *backends[] = { "fork", "posix_spawn", "launcher" };
+    static const char *scripts[] = {
+        "#!/bin/sh\n: \"$1\" \"$2\" \"$3\"\n",
+        "#!/bin/bash\n: \"$1\" \"$2\" \"$3\"\n",
+        "#!/bin/sh\nfor i in 1 2 3; do test -d \"$3\"; done\necho done\n"
+    };
+    static const char *descriptions[] = { "sh, no commands", "bash, no commands", "sh, builtins" };
+    int count = argc > 1 ? atoi(argv[1]) : 200;
+    char *dir = CreateTestDirectory();
+    char *path;
+    char name[16];
+    size_t i, j;
+    
+    if (count <= 0) {
+        fprintf(stderr, "Usage: %s [scripts]\n", argv[0]);
+        return 2;
+    }
+    InitTestPlugin(&gPlugin);
+    InitTestManifest(&gManifest, "fork");
+    gSettings = gManifest.fDefaults;
+    gSettings.fBatch = true;
+    if (! StartLauncher(&gPlugin)) {
+        fprintf(stderr, "Launcher not started, its scripts will be forked\n");
+    }
+    if ((gNullFd = open("/dev/null", O_WRONLY | O_CLOEXEC)) == -1) {
+        perror("/dev/null");
+        return 2;
+    }
+    
+    printf("%d scripts, one at a time, ms per script\n", count);
+    printf("%-20s", "script");
+    for (j = 0; j < sizeof(backends) / sizeof(backends[0]); j++) {
+        printf(" %12s", backends[j]);
+    }
+    printf(" %12s\n", "shell server");
+    for (i = 0; i < sizeof(scripts) / sizeof(scripts[0]); i++) {
+        snprintf(name, sizeof(name), "script%zu", i);
+        path = WriteTestFile(dir, name, scripts[i], 0755);
+        printf("%-20s", descriptions[i]);
+        for (j = 0; j < sizeof(backends) / sizeof(backends[0]); j++) {
+            PrintResult(RunSpawned(SpawnBackendNamed(backends[j]), path, count));
+            fflush(stdout);
+        }
+        PrintResult(RunBatched(path, count));
+        printf("\n");
+        free(path);
+    }
+    
+    StopLauncher(&gPlugin);
+    close(gNullFd);
+    RemoveTestDirectory(dir);
+    return 0;
+}
@@ -0,0 +1,324 @@
+//
+//  ShellServerTests.c
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+#include "TestPlugin.h"
+
+#include "ShellServer.h"
+
+#include "Test.h"
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Helpers
+/////////////////////////////////////////////////////////////////////
+
+
+static PluginRecord gPlugin;
+static ManifestRecord gManifest;
+static ScriptSettings gSettings;       // batched, and otherwise the defaults
+
+/// Start the shell server of invocation, for scripts run as the user
+/// running the tests.
+static bool StartTestServer(InvocationRecord *invocation)
+{
+    InitTestInvocation(invocation, &gPlugin, &gManifest, kRunAsUser);
+    return StartShellServer(invocation);
+}
+
+/// Return ScriptCanBatch() for a trusted script with the given text and
+/// settings, written to dir.
+static bool CanBatch(const InvocationRecord *invocation, const char *dir,
+                     const ScriptSettings *settings, const char *text)
+{
+    ScriptRecord script;
+    bool batch;
+    
+    InitTestScript(&script, WriteTestFile(dir, "script", text, 0755), settings);
+    batch = ScriptCanBatch(invocation, &script);
+    free(script.fPath);
+    return batch;
+}
+
+/// Read what is left in fd into buffer, as a string.
+static void ReadOutput(int fd, char *buffer, size_t size)
+{
+    size_t length = 0;
+    ssize_t n;
+    
+    while (length < size - 1 && (n = read(fd, buffer + length, size - 1 - length)) > 0) {
+        length += (size_t)n;
+    }
+    buffer[length] = '\0';
+}
+
+/// Have the shell server of invocation run the script text, and wait for
+/// it.
+///
+/// @return The output of the script, in output.
+static bool RunBatched(InvocationRecord *invocation, const char *dir, const char *text,
+                       SpawnStatus *status, char *output, size_t size)
+{
+    ScriptRecord script;
+    int fds[2];
+    pid_t pid;
+    
+    InitTestScript(&script, WriteTestFile(dir, "script", text, 0755), &gSettings);
+    CHECK(pipe(fds) == 0);
+    pid = ShellServerSpawn(invocation, &script, fds[1]);
+    close(fds[1]);
+    CHECK(pid > 0);
+    CHECK(ShellServerWait(invocation, pid, status) == 0);
+    ReadOutput(fds[0], output, size);
+    close(fds[0]);
+    free(script.fPath);
+    return pid > 0;
+}
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Tests
+/////////////////////////////////////////////////////////////////////
+
+
+/// Only trusted sh and bash scripts that are marked batch, don't need
+/// anything of their own from the process running them, and don't use $0
+/// are batched.
+static void TestCanBatch(void)
+{
+    InvocationRecord invocation;
+    ScriptSettings settings;
+    ScriptRecord script;
+    char *dir = CreateTestDirectory();
+    char large[20 * 1024];
+    
+    InitTestInvocation(&invocation, &gPlugin, &gManifest, kRunAsUser);
+    settings = gSettings;
+    
+    CHECK(CanBatch(&invocation, dir, &settings, "#!/bin/sh\necho hello\n"));
+    CHECK(CanBatch(&invocation, dir, &settings, "#!/bin/bash\necho hello\n"));
+    CHECK(CanBatch(&invocation, dir, &settings, "#!/bin/sh -e\necho hello\n"));
+    CHECK(! CanBatch(&invocation, dir, &settings, "#!/bin/zsh\necho hello\n"));
+    CHECK(! CanBatch(&invocation, dir, &settings, "#!/bin/shell\necho hello\n"));
+    CHECK(! CanBatch(&invocation, dir, &settings, "#!/usr/bin/python\nprint('hello')\n"));
+    CHECK(! CanBatch(&invocation, dir, &settings, ""));
+    CHECK(! CanBatch(&invocation, dir, &settings, "#!/bin/sh\necho $0\n"));
+    CHECK(! CanBatch(&invocation, dir, &settings, "#!/bin/sh\necho ${0##*/}\n"));
+    
+    memset(large, '#', sizeof(large) - 1);
+    large[sizeof(large) - 1] = '\0';
+    memcpy(large, "#!/bin/sh\n", 10);
+    CHECK(! CanBatch(&invocation, dir, &settings, large));
+    
+    settings.fBatch = false;
+    CHECK(! CanBatch(&invocation, dir, &settings, "#!/bin/sh\necho hello\n"));
+    settings = gSettings;
+    settings.fDetach = true;
+    CHECK(! CanBatch(&invocation, dir, &settings, "#!/bin/sh\necho hello\n"));
+    settings = gSettings;
+    settings.fNotifyReady = true;
+    CHECK(! CanBatch(&invocation, dir, &settings, "#!/bin/sh\necho hello\n"));
+    settings = gSettings;
+    settings.fLimits.fMemory = 1024 * 1024;
+    CHECK(! CanBatch(&invocation, dir, &settings, "#!/bin/sh\necho hello\n"));
+    settings = gSettings;
+    settings.fPriority = kPriorityBackground;
+    CHECK(! CanBatch(&invocation, dir, &settings, "#!/bin/sh\necho hello\n"));
+    settings = gSettings;
+    
+    InitTestScript(&script, WriteTestFile(dir, "script", "#!/bin/sh\necho hello\n", 0755), &settings);
+    script.fTrusted = false;
+    CHECK(! ScriptCanBatch(&invocation, &script));
+    free(script.fPath);
+    
+    FreeTestInvocation(&invocation);
+    RemoveTestDirectory(dir);
+}
+
+/// A script's exit status and output are passed on once it's done, and
+/// it gets the arguments of a script run by the spawn backends.
+static void TestExitAndOutput(void)
+{
+    InvocationRecord invocation;
+    SpawnStatus status;
+    char *dir = CreateTestDirectory();
+    char output[256];
+    char expected[256];
+    
+    CHECK(StartTestServer(&invocation));
+    CHECK(RunBatched(&invocation, dir, "#!/bin/sh\necho hello\necho error >&2\nexit 3\n",
+                     &status, output, sizeof(output)));
+    CHECK(WIFEXITED(status.fStatus) && WEXITSTATUS(status.fStatus) == 3);
+    CHECK(strcmp(output, "hello\nerror\n") == 0);
+    
+    CHECK(RunBatched(&invocation, dir, "#!/bin/sh\necho \"$# $1 $2 $3\"\n",
+                     &status, output, sizeof(output)));
+    CHECK(WIFEXITED(status.fStatus) && WEXITSTATUS(status.fStatus) == 0);
+    snprintf(expected, sizeof(expected), "3 %s %s /tmp\n", invocation.fUidStr, invocation.fGidStr);
+    CHECK(strcmp(output, expected) == 0);
+    
+    StopShellServer(&invocation);
+    FreeTestInvocation(&invocation);
+    RemoveTestDirectory(dir);
+}
+
+/// None of the server's own variables are left for the scripts, and a
+/// script can't change the server's.
+static void TestNoServerVariables(void)
+{
+    InvocationRecord invocation;
+    SpawnStatus status;
+    char *dir = CreateTestDirectory();
+    char output[256];
+    
+    CHECK(StartTestServer(&invocation));
+    CHECK(RunBatched(&invocation, dir,
+                     "#!/bin/bash\necho \"[${dir-}${id-}${path-}${uid-}${gid-}${home-}${sig-}${status-}]\"\n"
+                     "dir=/nonexistent; id=1\n",
+                     &status, output, sizeof(output)));
+    CHECK(strcmp(output, "[]\n") == 0);
+    CHECK(RunBatched(&invocation, dir, "#!/bin/sh\necho again\n", &status, output, sizeof(output)));
+    CHECK(WIFEXITED(status.fStatus) && WEXITSTATUS(status.fStatus) == 0);
+    CHECK(strcmp(output, "again\n") == 0);
+    
+    StopShellServer(&invocation);
+    FreeTestInvocation(&invocation);
+    RemoveTestDirectory(dir);
+}
+
+/// A script killed by a signal is reported as such, like one run by the
+/// spawn backends, and an exit with a status above 128 isn't mistaken for
+/// a signal.
+static void TestSignals(void)
+{
+    InvocationRecord invocation;
+    ScriptRecord script;
+    SpawnStatus status;
+    char *dir = CreateTestDirectory();
+    char output[256];
+    pid_t pid;
+    
+    CHECK(StartTestServer(&invocation));
+    
+    // What a timeout does to a script.
+    InitTestScript(&script, WriteTestFile(dir, "sleeper", "#!/bin/sh\nsleep 10\n", 0755), &gSettings);
+    CHECK((pid = ShellServerSpawn(&invocation, &script, -1)) > 0);
+    usleep(100 * 1000);
+    CHECK(kill(-pid, SIGTERM) == 0);
+    CHECK(ShellServerWait(&invocation, pid, &status) == 0);
+    CHECK(WIFSIGNALED(status.fStatus) && WTERMSIG(status.fStatus) == SIGTERM);
+    free(script.fPath);
+    
+    CHECK(RunBatched(&invocation, dir, "#!/bin/sh\nexit 143\n", &status, output, sizeof(output)));
+    CHECK(WIFEXITED(status.fStatus) && WEXITSTATUS(status.fStatus) == 143);
+    
+    CHECK(RunBatched(&invocation, dir, "#!/bin/sh\nkill -TERM 0\nsleep 10\n", &status, output, sizeof(output)));
+    CHECK(WIFSIGNALED(status.fStatus) && WTERMSIG(status.fStatus) == SIGTERM);
+    
+    StopShellServer(&invocation);
+    FreeTestInvocation(&invocation);
+    RemoveTestDirectory(dir);
+}
+
+/// Scripts run concurrently, and can be waited for in any order.
+static void TestConcurrentScripts(void)
+{
+    enum { kScripts = 4 };
+    InvocationRecord invocation;
+    ScriptRecord scripts[kScripts];
+    SpawnStatus status;
+    char *dir = CreateTestDirectory();
+    char name[16];
+    char text[64];
+    char output[64];
+    char expected[64];
+    pid_t pids[kScripts];
+    int fds[kScripts][2];
+    double start;
+    int i;
+    
+    CHECK(StartTestServer(&invocation));
+    start = TestSeconds();
+    for (i = 0; i < kScripts; i++) {
+        snprintf(name, sizeof(name), "script%d", i);
+        snprintf(text, sizeof(text), "#!/bin/sh\nsleep 0.5\necho %d\nexit %d\n", i, i);
+        InitTestScript(&scripts[i], WriteTestFile(dir, name, text, 0755), &gSettings);
+        CHECK(pipe(fds[i]) == 0);
+        CHECK((pids[i] = ShellServerSpawn(&invocation, &scripts[i], fds[i][1])) > 0);
+        close(fds[i][1]);
+    }
+    for (i = kScripts - 1; i >= 0; i--) {
+        CHECK(ShellServerWait(&invocation, pids[i], &status) == 0);
+        CHECK(WIFEXITED(status.fStatus) && WEXITSTATUS(status.fStatus) == i);
+        ReadOutput(fds[i][0], output, sizeof(output));
+        snprintf(expected, sizeof(expected), "%d\n", i);
+        CHECK(strcmp(output, expected) == 0);
+        close(fds[i][0]);
+        free(scripts[i].fPath);
+    }
+    CHECK(TestSeconds() - start < kScripts * 0.5);
+    
+    // Only scripts of the server can be waited for.
+    CHECK(ShellServerWait(&invocation, pids[0], &status) == -1 && errno == ECHILD);
+    
+    StopShellServer(&invocation);
+    FreeTestInvocation(&invocation);
+    RemoveTestDirectory(dir);
+}
+
+/// Stopping the server leaves nothing behind.
+static void TestStop(void)
+{
+    InvocationRecord invocation;
+    SpawnStatus status;
+    char *dir = CreateTestDirectory();
+    char server[MAXPATHLEN];
+    char output[64];
+    struct stat sb;
+    pid_t pid;
+    
+    CHECK(StartTestServer(&invocation));
+    strlcpy(server, invocation.fShellServer.fDirectory, sizeof(server));
+    pid = invocation.fShellServer.fPid;
+    CHECK(stat(server, &sb) == 0 && S_ISDIR(sb.st_mode));
+    CHECK(RunBatched(&invocation, dir, "#!/bin/sh\necho output\n", &status, output, sizeof(output)));
+    
+    StopShellServer(&invocation);
+    CHECK(invocation.fShellServer.fPid == -1);
+    CHECK(! invocation.fShellServer.fFailed);
+    CHECK(stat(server, &sb) == -1 && errno == ENOENT);
+    CHECK(kill(pid, 0) == -1 && errno == ESRCH);
+    FreeTestInvocation(&invocation);
+    RemoveTestDirectory(dir);
+}
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Main
+/////////////////////////////////////////////////////////////////////
+
+
+int main(void)
+{
+    // Fail rather than hang if a script is never reported.
+    alarm(60);
+    
+    InitTestPlugin(&gPlugin);
+    InitTestManifest(&gManifest, "fork");
+    gSettings = gManifest.fDefaults;
+    gSettings.fBatch = true;
+    
+    RUN_TEST(TestCanBatch);
+    RUN_TEST(TestExitAndOutput);
+    RUN_TEST(TestNoServerVariables);
+    RUN_TEST(TestSignals);
+    RUN_TEST(TestConcurrentScripts);
+    RUN_TEST(TestStop);
+    return TestResult();
+}
@@ -0,0 +1,162 @@
+//
+//  SpawnBenchmark.c
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+#include "TestPlugin.h"
+
+#include "Launcher.h"
+
+// Times starting a script with each spawn backend as the resident size of
+// the process starting it grows, the way a plugin host grows over a day
+// of logins. The memory is allocated in 1 MB blocks and written to, so
+// that both the resident size and the number of mappings grow. The
+// launcher is started before any of it, like at plugin creation.
+//
+// The scripts run in the root context, as posix_spawn falls back to fork
+// for user scripts where it can't drop privileges, such as on Linux.
+//
+// Usage: SpawnBenchmark [scripts]
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Runners
+/////////////////////////////////////////////////////////////////////
+
+
+enum {
+    kBlockSize = 1024 * 1024
+};
+
+static PluginRecord gPlugin;
+static ManifestRecord gManifest;
+static int gNullFd;
+
+/// Run the script at path count times with backend.
+///
+/// @return The milliseconds per script, or -1 if a script failed.
+static double RunSpawned(const SpawnBackend *backend, char *path, int count)
+{
+    InvocationRecord invocation;
+    SpawnStatus status;
+    double start, elapsed;
+    pid_t pid;
+    int i;
+    
+    InitTestInvocation(&invocation, &gPlugin, &gManifest, kRunAsRoot);
+    start = TestSeconds();
+    for (i = 0; i < count; i++) {
+        if ((pid = SpawnTestScript(&invocation, backend, path, gNullFd)) == -1
+            || backend->fWait(&gPlugin, pid, &status) != 0 || status.fStatus != 0) {
+            FreeTestInvocation(&invocation);
+            return -1;
+        }
+    }
+    elapsed = TestSeconds() - start;
+    FreeTestInvocation(&invocation);
+    return elapsed * 1e3 / count;
+}
+
+/// Allocate and write to blocks of kBlockSize until there are megabytes
+/// of them, adding to blocks.
+static void GrowResidentSize(char **blocks, size_t *count, size_t megabytes)
+{
+    while (*count < megabytes) {
+        if ((blocks[*count] = malloc(kBlockSize)) == NULL) {
+            perror("malloc");
+            exit(2);
+        }
+        memset(blocks[*count], (int)*count, kBlockSize);
+        (*count)++;
+    }
+}
+
+/// Return the resident size of the process in MB.
+static long ResidentMegabytes(void)
+{
+    struct rusage usage;
+    
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return usage.ru_maxrss / (1024 * 1024);
+#else
+    return usage.ru_maxrss / 1024;
+#endif
+}
+
+/// Print milliseconds as a cell of the results table.
+static void PrintResult(double milliseconds)
+{
+    if (milliseconds < 0) {
+        printf(" %12s", "failed");
+    } else {
+        printf(" %12.3f", milliseconds);
+    }
+}
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Main
+/////////////////////////////////////////////////////////////////////
+
+
+int main(int argc, char *argv[])
+{
+    static const char *backends[] = { "fork", "posix_spawn", "launcher" };
+    static const size_t sizes[] = { 0, 128, 512, 1024, 2048 };
+    int count = argc > 1 ? atoi(argv[1]) : 100;
+    char *dir = CreateTestDirectory();
+    char **blocks;
+    size_t blockCount = 0;
+    char *path;
+    size_t i, j;
+    
+    if (count <= 0) {
+        fprintf(stderr, "Usage: %s [scripts]\n", argv[0]);
+        return 2;
+    }
+    InitTestPlugin(&gPlugin);
+    InitTestManifest(&gManifest, "fork");
+    if (! StartLauncher(&gPlugin)) {
+        fprintf(stderr, "Launcher not started, its scripts will be forked\n");
+    }
+    if ((gNullFd = open("/dev/null", O_WRONLY | O_CLOEXEC)) == -1) {
+        perror("/dev/null");
+        return 2;
+    }
+    if ((blocks = calloc(sizes[sizeof(sizes) / sizeof(sizes[0]) - 1], sizeof(*blocks))) == NULL) {
+        perror("calloc");
+        return 2;
+    }
+    path = WriteTestFile(dir, "script", "#!/bin/sh\nexit 0\n", 0755);
+    
+    printf("%d scripts, one at a time, ms per script\n", count);
+    printf("%-20s", "resident MB");
+    for (j = 0; j < sizeof(backends) / sizeof(backends[0]); j++) {
+        printf(" %12s", backends[j]);
+    }
+    printf("\n");
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        GrowResidentSize(blocks, &blockCount, sizes[i]);
+        printf("%-20ld", ResidentMegabytes());
+        for (j = 0; j < sizeof(backends) / sizeof(backends[0]); j++) {
+            PrintResult(RunSpawned(SpawnBackendNamed(backends[j]), path, count));
+            fflush(stdout);
+        }
+        printf("\n");
+    }
+    
+    while (blockCount > 0) {
+        free(blocks[--blockCount]);
+    }
+    free(blocks);
+    free(path);
+    StopLauncher(&gPlugin);
+    close(gNullFd);
+    RemoveTestDirectory(dir);
+    return 0;
+}
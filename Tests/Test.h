@@ -0,0 +1,37 @@
+//
+//  Test.h
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+#ifndef __LoginScriptPlugin__Test__
+#define __LoginScriptPlugin__Test__
+
+#include <stdio.h>
+
+// A test program runs each of its tests with RUN_TEST(), and returns
+// TestResult() from main(). CHECK() logs a failed condition and carries
+// on with the rest of the test.
+
+static int gTestFailures = 0;
+
+#define CHECK(condition) do { \
+    if (! (condition)) { \
+        fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+        gTestFailures++; \
+    } \
+} while (0)
+
+#define RUN_TEST(test) do { \
+    int failures = gTestFailures; \
+    test(); \
+    fprintf(stderr, "%s %s\n", gTestFailures == failures ? "ok  " : "FAIL", #test); \
+} while (0)
+
+static int TestResult(void)
+{
+    return gTestFailures == 0 ? 0 : 1;
+}
+
+#endif /* defined(__LoginScriptPlugin__Test__) */
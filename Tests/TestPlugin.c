@@ -0,0 +1,271 @@
+//
+//  TestPlugin.c
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+#include <ftw.h>
+
+#include "TestPlugin.h"
+
+#include "BackgroundReaper.h"
+#include "DurationHistory.h"
+#include "EarlyLaunch.h"
+#include "Launcher.h"
+#include "LoginSessions.h"
+#include "Manifest.h"
+#include "PolicyService.h"
+#include "ResidentWorkers.h"
+#include "ScriptOutput.h"
+#include "ShellServer.h"
+#include "Spawn.h"
+#include "WorkerPool.h"
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Plugin
+/////////////////////////////////////////////////////////////////////
+
+
+/// Fill in plugin as AuthorizationPluginCreate() does, except that the
+/// launcher isn't started.
+void InitTestPlugin(PluginRecord *plugin)
+{
+    memset(plugin, 0, sizeof(*plugin));
+    plugin->fMagic = kPluginMagic;
+    plugin->fLogClient = asl_open("LoginScriptPluginTests", "se.gu.it.LoginScriptPlugin", 0);
+    InitWorkerPool(&plugin->fPool);
+    InitSessionTable(&plugin->fSessions);
+    InitBackgroundReaper(&plugin->fReaper);
+    InitResidentWorkers(&plugin->fResidents);
+    InitPolicyConnections(&plugin->fPolicy);
+    InitDurationHistory(&plugin->fHistory);
+    InitEarlyScriptTable(&plugin->fEarlyScripts);
+    pthread_mutex_init(&plugin->fLauncher.fLock, NULL);
+    pthread_cond_init(&plugin->fLauncher.fCondition, NULL);
+    plugin->fLauncher.fPid = -1;
+    plugin->fLauncher.fSocket = -1;
+}
+
+/// Fill in manifest with the defaults of an empty manifest file, using the
+/// spawn backend with the given name.
+void InitTestManifest(ManifestRecord *manifest, const char *backend)
+{
+    InitManifest(manifest);
+    manifest->fSpawnBackend = SpawnBackendNamed(backend);
+}
+
+/// Fill in manifest from the manifest file text.
+void ParseTestManifest(ManifestRecord *manifest, const char *text, aslclient logClient)
+{
+    FILE *file;
+    
+    InitManifest(manifest);
+    if ((file = fmemopen((void *)text, strlen(text), "r")) == NULL) {
+        perror("fmemopen");
+        exit(2);
+    }
+    ReadManifest(manifest, file, "manifest", logClient);
+    fclose(file);
+}
+
+/// Fill in invocation as MechanismInvoke() does, for the user running
+/// the tests and /tmp as the home directory.
+void InitTestInvocation(InvocationRecord *invocation, PluginRecord *plugin,
+                        const ManifestRecord *manifest, userContext context)
+{
+    memset(invocation, 0, sizeof(*invocation));
+    invocation->fPlugin = plugin;
+    invocation->fManifest = manifest;
+    invocation->fContext = context;
+    invocation->fPhase = kRunAfterHomedirMount;
+    invocation->fUid = getuid();
+    invocation->fGid = getgid();
+    invocation->fHome = "/tmp";
+    snprintf(invocation->fUidStr, sizeof(invocation->fUidStr), "%d", invocation->fUid);
+    snprintf(invocation->fGidStr, sizeof(invocation->fGidStr), "%d", invocation->fGid);
+    invocation->fEnvp = CreateEnvironment(invocation->fUid, invocation->fHome, context, plugin->fLogClient);
+    InitShellServer(&invocation->fShellServer);
+}
+
+/// Release what InitTestInvocation() allocated. The scripts belong to the
+/// caller.
+void FreeTestInvocation(InvocationRecord *invocation)
+{
+    FreeEnvironment(invocation->fEnvp);
+    invocation->fEnvp = NULL;
+}
+
+/// Fill in script as CreateScripts() does for a trusted script at path.
+void InitTestScript(ScriptRecord *script, char *path, const ScriptSettings *settings)
+{
+    memset(script, 0, sizeof(*script));
+    script->fPath = path;
+    script->fName = strrchr(path, '/') != NULL ? strrchr(path, '/') + 1 : path;
+    script->fSettings = settings;
+    script->fTrusted = true;
+    script->fState = kScriptPending;
+    script->fPid = -1;
+    script->fResult = kAuthorizationResultAllow;
+    InitOutputBuffer(&script->fOutput);
+    script->fNotifyFd = -1;
+    script->fMachineLocks.fLockFd = -1;
+}
+
+/// Start the script at path with backend, as StartScript() does for a
+/// script that isn't batched, with its output going to outputFd.
+///
+/// @return The pid of the script, or -1 with errno set.
+pid_t SpawnTestScript(InvocationRecord *invocation, const SpawnBackend *backend, char *path, int outputFd)
+{
+    SpawnRequest request;
+    char *argv[5];
+    
+    argv[0] = path;
+    argv[1] = invocation->fUidStr;
+    argv[2] = invocation->fGidStr;
+    argv[3] = (char *)invocation->fHome;
+    argv[4] = NULL;
+    
+    memset(&request, 0, sizeof(request));
+    request.fPath = path;
+    request.fArgv = argv;
+    request.fEnvp = invocation->fEnvp;
+    request.fUid = invocation->fUid;
+    request.fGid = invocation->fGid;
+    request.fContext = invocation->fContext;
+    request.fOutputFd = outputFd;
+    request.fNotifyFd = -1;
+    request.fPriority = kPriorityNormal;
+    return backend->fSpawn(invocation->fPlugin, &request);
+}
+
+
+
+/////////////////////////////////////////////////////////////////////
+#pragma mark ***** Files
+/////////////////////////////////////////////////////////////////////
+
+
+/// Create an empty directory for a test, readable by everyone.
+///
+/// @return Its path, to be removed with RemoveTestDirectory().
+char *CreateTestDirectory(void)
+{
+    char *dir;
+    
+    if ((dir = strdup("/tmp/LoginScriptPluginTests.XXXXXX")) == NULL || mkdtemp(dir) == NULL) {
+        perror("mkdtemp");
+        exit(2);
+    }
+    chmod(dir, 0755);
+    return dir;
+}
+
+/// Create an empty directory that the plugin trusts scripts in, owned by
+/// root and on the boot volume like kLoginScriptDir. Only root can.
+///
+/// @return Its path, to be removed with RemoveTestDirectory().
+char *CreateTrustedTestDirectory(void)
+{
+#ifdef __APPLE__
+    const char *pattern = "/Library/Application Support/LoginScriptPluginTests.XXXXXX";
+#else
+    const char *pattern = "/var/lib/LoginScriptPluginTests.XXXXXX";
+#endif
+    char *dir;
+    
+    if ((dir = strdup(pattern)) == NULL || mkdtemp(dir) == NULL) {
+        perror("mkdtemp");
+        exit(2);
+    }
+    chmod(dir, 0755);
+    return dir;
+}
+
+/// Write text to the file name in dir, with the given mode.
+///
+/// @return The path of the file, to be released with free().
+char *WriteTestFile(const char *dir, const char *name, const char *text, mode_t mode)
+{
+    char *path;
+    FILE *file;
+    
+    if (asprintf(&path, "%s/%s", dir, name) == -1 || (file = fopen(path, "w")) == NULL) {
+        perror(name);
+        exit(2);
+    }
+    fputs(text, file);
+    fclose(file);
+    chmod(path, mode);
+    return path;
+}
+
+/// Write a shell script to the file name in dir that runs body in dir, so
+/// that it can leave files there for the test to look at.
+///
+/// @return The path of the script, to be released with free().
+char *WriteTestScript(const char *dir, const char *name, const char *body)
+{
+    char *text;
+    char *path;
+    
+    if (asprintf(&text, "#!/bin/sh\ncd '%s' || exit 1\n%s\n", dir, body) == -1) {
+        perror(name);
+        exit(2);
+    }
+    path = WriteTestFile(dir, name, text, 0755);
+    free(text);
+    return path;
+}
+
+/// Read the file name in dir.
+///
+/// @return Its text, to be released with free(), or NULL if it can't be
+///         read.
+char *ReadTestFile(const char *dir, const char *name)
+{
+    char path[MAXPATHLEN];
+    char *text;
+    FILE *file;
+    long length;
+    
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    if ((file = fopen(path, "r")) == NULL) {
+        return NULL;
+    }
+    if (fseek(file, 0, SEEK_END) != 0 || (length = ftell(file)) < 0 || fseek(file, 0, SEEK_SET) != 0
+        || (text = malloc(length + 1)) == NULL) {
+        fclose(file);
+        return NULL;
+    }
+    text[fread(text, 1, length, file)] = '\0';
+    fclose(file);
+    return text;
+}
+
+static int RemoveTestFile(const char *path, const struct stat *sb, int type, struct FTW *ftw)
+{
+    (void)sb;
+    (void)type;
+    (void)ftw;
+    return remove(path);
+}
+
+/// Remove dir and everything in it, and release its path.
+void RemoveTestDirectory(char *dir)
+{
+    nftw(dir, RemoveTestFile, 16, FTW_DEPTH | FTW_PHYS);
+    free(dir);
+}
+
+/// Return the current time in seconds, for benchmarks.
+double TestSeconds(void)
+{
+    struct timeval now;
+    
+    gettimeofday(&now, NULL);
+    return now.tv_sec + now.tv_usec / 1e6;
+}
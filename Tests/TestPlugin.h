@@ -0,0 +1,35 @@
+//
+//  TestPlugin.h
+//  LoginScriptPlugin
+//
+//  Copyright (c) 2026 Göteborgs universitet. All rights reserved.
+//
+
+#ifndef __LoginScriptPlugin__TestPlugin__
+#define __LoginScriptPlugin__TestPlugin__
+
+#include "LoginScriptPlugin.h"
+#include "Manifest.h"
+#include "ScriptExecution.h"
+#include "Spawn.h"
+
+// Fixtures for the tests and benchmarks that drive the plugin's modules
+// directly, without an authorization engine.
+
+void InitTestPlugin(PluginRecord *plugin);
+void InitTestManifest(ManifestRecord *manifest, const char *backend);
+void ParseTestManifest(ManifestRecord *manifest, const char *text, aslclient logClient);
+void InitTestInvocation(InvocationRecord *invocation, PluginRecord *plugin,
+                        const ManifestRecord *manifest, userContext context);
+void FreeTestInvocation(InvocationRecord *invocation);
+void InitTestScript(ScriptRecord *script, char *path, const ScriptSettings *settings);
+pid_t SpawnTestScript(InvocationRecord *invocation, const SpawnBackend *backend, char *path, int outputFd);
+char *CreateTestDirectory(void);
+char *CreateTrustedTestDirectory(void);
+char *WriteTestFile(const char *dir, const char *name, const char *text, mode_t mode);
+char *WriteTestScript(const char *dir, const char *name, const char *body);
+char *ReadTestFile(const char *dir, const char *name);
+void RemoveTestDirectory(char *dir);
+double TestSeconds(void);
+
+#endif /* defined(__LoginScriptPlugin__TestPlugin__) */